@@ -0,0 +1,222 @@
+/*
+ * babeltrace-compress.c
+ *
+ * BabelTrace - Compress CTF Stream Files
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include <babeltrace/babeltrace.h>
+#include <babeltrace/context.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/compressed-stream.h>
+#include <babeltrace/ctf-ir/metadata.h>
+
+int babeltrace_debug, babeltrace_verbose;
+
+static char **s_inputnames;
+static int s_nr_inputs;
+static int s_help;
+
+/*
+ * Compress one stream file: the compressed stream is written to a
+ * hidden file of the trace directory, which the reader ignores, and
+ * then renamed over the stream file.
+ */
+static
+int compress_stream(struct ctf_trace *trace, struct ctf_file_stream *cfs)
+{
+	char tmpname[PATH_MAX];
+	struct stat st;
+	int in_fd, out_fd, ret;
+
+	in_fd = openat(trace->dirfd, cfs->parent.path, O_RDONLY);
+	if (in_fd < 0) {
+		perror("openat");
+		return -1;
+	}
+	ret = fstat(in_fd, &st);
+	if (ret) {
+		perror("fstat");
+		goto end_close_in;
+	}
+	ret = snprintf(tmpname, PATH_MAX, ".%s.tmp", cfs->parent.path);
+	if (ret < 0 || ret >= PATH_MAX) {
+		fprintf(stderr, "[error] Stream file name too long: %s\n",
+			cfs->parent.path);
+		ret = -1;
+		goto end_close_in;
+	}
+	out_fd = openat(trace->dirfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC,
+			st.st_mode & 0777);
+	if (out_fd < 0) {
+		perror("openat");
+		ret = -1;
+		goto end_close_in;
+	}
+	ret = ctf_cstream_compress(in_fd, st.st_size, cfs->pos.packet_index,
+			out_fd);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to compress stream file %s: %s\n",
+			cfs->parent.path, strerror(-ret));
+		goto end_unlink;
+	}
+	ret = fsync(out_fd);
+	if (ret) {
+		perror("fsync");
+		goto end_unlink;
+	}
+	ret = renameat(trace->dirfd, tmpname, trace->dirfd, cfs->parent.path);
+	if (ret) {
+		perror("renameat");
+		goto end_unlink;
+	}
+	goto end_close_out;
+
+end_unlink:
+	if (unlinkat(trace->dirfd, tmpname, 0))
+		perror("unlinkat");
+end_close_out:
+	if (close(out_fd))
+		perror("close");
+end_close_in:
+	if (close(in_fd))
+		perror("close");
+	return ret;
+}
+
+static
+int compress_trace(const char *path)
+{
+	struct bt_context *ctx;
+	struct ctf_trace *trace;
+	int i, j, ret;
+
+	ctx = bt_context_create();
+	if (!ctx)
+		return -1;
+	ret = bt_context_add_trace(ctx, path, "ctf", NULL, NULL, NULL);
+	if (ret < 0) {
+		fprintf(stderr, "[error] Unable to open trace %s\n", path);
+		goto end;
+	}
+	trace = container_of(g_ptr_array_index(ctx->tc->array, 0),
+			struct ctf_trace, parent);
+	ret = 0;
+	for (i = 0; i < trace->streams->len; i++) {
+		struct ctf_stream_declaration *stream_class;
+
+		stream_class = g_ptr_array_index(trace->streams, i);
+		if (!stream_class)
+			continue;
+		for (j = 0; j < stream_class->streams->len; j++) {
+			struct ctf_file_stream *cfs;
+
+			cfs = container_of(g_ptr_array_index(stream_class->streams, j),
+					struct ctf_file_stream, parent);
+			/* Skip empty and already compressed files. */
+			if (cfs->pos.cstream
+					|| !ctf_packet_index_len(cfs->pos.packet_index))
+				continue;
+			ret = compress_stream(trace, cfs);
+			if (ret)
+				goto end;
+		}
+	}
+end:
+	bt_context_put(ctx);
+	return ret;
+}
+
+static
+void usage(FILE *fp)
+{
+	fprintf(fp, "BabelTrace Stream Compressor %s\n", VERSION);
+	fprintf(fp, "\n");
+	fprintf(fp, "Compress the stream files of CTF traces in place.\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "usage : babeltrace-compress [OPTIONS] TRACE...\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "  TRACE                          Trace directory (holding a metadata file)\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "  -h                             Display this help\n");
+	fprintf(fp, "\n");
+}
+
+static
+int parse_args(int argc, char **argv)
+{
+	int i;
+
+	s_inputnames = calloc(argc, sizeof(*s_inputnames));
+	if (!s_inputnames)
+		return -ENOMEM;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-h")) {
+			s_help = 1;
+			return 0;
+		} else if (argv[i][0] == '-')
+			return -EINVAL;
+		else
+			s_inputnames[s_nr_inputs++] = argv[i];
+	}
+	if (!s_nr_inputs)
+		return -EINVAL;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i, ret;
+
+	ret = parse_args(argc, argv);
+	if (ret) {
+		fprintf(stderr, "Error: invalid argument.\n");
+		usage(stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	if (s_help) {
+		usage(stdout);
+		exit(EXIT_SUCCESS);
+	}
+
+	for (i = 0; i < s_nr_inputs; i++) {
+		ret = compress_trace(s_inputnames[i]);
+		if (ret)
+			exit(EXIT_FAILURE);
+	}
+	exit(EXIT_SUCCESS);
+}
@@ -24,8 +24,6 @@
  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
- *
- * Depends on glibc 2.10 for getline().
  */
 
 #define _GNU_SOURCE
@@ -44,7 +42,10 @@
 #include <inttypes.h>
 
 #include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/align.h>
 #include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/crc32c.h>
+#include <babeltrace/ctf/extent.h>
 #include <babeltrace/compat/uuid.h>
 #include <babeltrace/compat/utc.h>
 #include <babeltrace/endian.h>
@@ -54,6 +55,8 @@
 #define NSEC_PER_SEC 1000000000ULL
 #define USEC_PER_SEC 1000000UL
 
+#define INPUT_BLOCK_LEN		(1UL << 20)
+
 int babeltrace_debug, babeltrace_verbose;
 
 static char *s_outputname;
@@ -61,6 +64,16 @@ static int s_timestamp;
 static int s_help;
 static unsigned char s_uuid[BABELTRACE_UUID_LEN];
 
+static uint64_t s_packet_len;	/* Packet size, in bytes */
+
+/* The stream file is preallocated and mapped by extents. */
+static struct ctf_extent s_extent;
+
+/* Checksum of the current packet, and start of the data it covers */
+static uint32_t *s_checksum_loc;
+static char *s_data_start;
+static uint64_t s_data_offset;	/* Packet offset of s_data_start, in bits */
+
 /* Metadata format string */
 static const char metadata_fmt[] =
 "/* CTF 1.8 */\n"
@@ -83,6 +96,7 @@ static const char metadata_fmt[] =
 "	packet.context := struct {\n"
 "		uint64_t content_size;\n"
 "		uint64_t packet_size;\n"
+"		uint32_t checksum;\n"
 "	};\n"
 "%s"					/* Stream event header (opt.) */
 "};\n"
@@ -120,24 +134,12 @@ void print_metadata(FILE *fp)
 static
 void write_packet_header(struct ctf_stream_pos *pos, unsigned char *uuid)
 {
-	struct ctf_stream_pos dummy;
-
 	/* magic */
-	ctf_dummy_pos(pos, &dummy);
-	ctf_align_pos(&dummy, sizeof(uint32_t) * CHAR_BIT);
-	ctf_move_pos(&dummy, sizeof(uint32_t) * CHAR_BIT);
-	assert(!ctf_pos_packet(&dummy));
-
 	ctf_align_pos(pos, sizeof(uint32_t) * CHAR_BIT);
 	*(uint32_t *) ctf_get_pos_addr(pos) = 0xC1FC1FC1;
 	ctf_move_pos(pos, sizeof(uint32_t) * CHAR_BIT);
 
 	/* uuid */
-	ctf_dummy_pos(pos, &dummy);
-	ctf_align_pos(&dummy, sizeof(uint8_t) * CHAR_BIT);
-	ctf_move_pos(&dummy, 16 * CHAR_BIT);
-	assert(!ctf_pos_packet(&dummy));
-
 	ctf_align_pos(pos, sizeof(uint8_t) * CHAR_BIT);
 	memcpy(ctf_get_pos_addr(pos), uuid, BABELTRACE_UUID_LEN);
 	ctf_move_pos(pos, BABELTRACE_UUID_LEN * CHAR_BIT);
@@ -146,161 +148,300 @@ void write_packet_header(struct ctf_stream_pos *pos, unsigned char *uuid)
 static
 void write_packet_context(struct ctf_stream_pos *pos)
 {
-	struct ctf_stream_pos dummy;
-
 	/* content_size */
-	ctf_dummy_pos(pos, &dummy);
-	ctf_align_pos(&dummy, sizeof(uint64_t) * CHAR_BIT);
-	ctf_move_pos(&dummy, sizeof(uint64_t) * CHAR_BIT);
-	assert(!ctf_pos_packet(&dummy));
-
 	ctf_align_pos(pos, sizeof(uint64_t) * CHAR_BIT);
 	*(uint64_t *) ctf_get_pos_addr(pos) = ~0ULL;	/* Not known yet */
 	pos->content_size_loc = (uint64_t *) ctf_get_pos_addr(pos);
 	ctf_move_pos(pos, sizeof(uint64_t) * CHAR_BIT);
 
 	/* packet_size */
-	ctf_dummy_pos(pos, &dummy);
-	ctf_align_pos(&dummy, sizeof(uint64_t) * CHAR_BIT);
-	ctf_move_pos(&dummy, sizeof(uint64_t) * CHAR_BIT);
-	assert(!ctf_pos_packet(&dummy));
-
 	ctf_align_pos(pos, sizeof(uint64_t) * CHAR_BIT);
 	*(uint64_t *) ctf_get_pos_addr(pos) = pos->packet_size;
 	ctf_move_pos(pos, sizeof(uint64_t) * CHAR_BIT);
+
+	/* checksum */
+	ctf_align_pos(pos, sizeof(uint32_t) * CHAR_BIT);
+	s_checksum_loc = (uint32_t *) ctf_get_pos_addr(pos);
+	ctf_move_pos(pos, sizeof(uint32_t) * CHAR_BIT);
+	s_data_start = ctf_get_pos_addr(pos);
+	s_data_offset = pos->offset;
 }
 
+/*
+ * Preallocate and map the extent of the stream file starting at offset,
+ * replacing the current one.
+ */
+/*
+ * Packets are switched here rather than by ctf_move_pos(), which only
+ * does so for a stream position backed by a file descriptor: the
+ * position has none, and its base is the mapped extent.
+ */
 static
-void write_event_header(struct ctf_stream_pos *pos, char *line,
-			char **tline, size_t len, size_t *tlen,
-			uint64_t *ts)
+int open_packet(struct ctf_stream_pos *pos)
 {
-	if (!s_timestamp)
-		return;
-
-	/* Only need to be executed on first pass (dummy) */
-	if (pos->dummy)	{
-		int has_timestamp = 0;
-		unsigned long sec, usec, msec;
-		unsigned int year, mon, mday, hour, min;
-
-		/* Extract time from input line */
-		if (sscanf(line, "[%lu.%lu] ", &sec, &usec) == 2) {
-			*ts = (uint64_t) sec * USEC_PER_SEC + (uint64_t) usec;
-			/*
-			 * Default CTF clock has 1GHz frequency. Convert
-			 * from usec to nsec.
-			 */
-			*ts *= NSEC_PER_USEC;
-			has_timestamp = 1;
-		} else if (sscanf(line, "[%u-%u-%u %u:%u:%lu.%lu] ",
-				&year, &mon, &mday, &hour, &min,
-				&sec, &msec) == 7) {
-			time_t ep_sec;
-			struct tm ti;
-
-			memset(&ti, 0, sizeof(ti));
-			ti.tm_year = year - 1900;	/* from 1900 */
-			ti.tm_mon = mon - 1;		/* 0 to 11 */
-			ti.tm_mday = mday;
-			ti.tm_hour = hour;
-			ti.tm_min = min;
-			ti.tm_sec = sec;
-
-			ep_sec = babeltrace_timegm(&ti);
-			if (ep_sec != (time_t) -1) {
-				*ts = (uint64_t) ep_sec * NSEC_PER_SEC
-					+ (uint64_t) msec * NSEC_PER_MSEC;
-			}
-			has_timestamp = 1;
-		}
-		if (has_timestamp) {
-			*tline = strchr(line, ']');
-			assert(*tline);
-			(*tline)++;
-			if ((*tline)[0] == ' ') {
-				(*tline)++;
-			}
-			*tlen = len + line - *tline;
+	int ret;
+
+	ret = ctf_extent_next_packet(&s_extent, pos);
+	if (ret)
+		return ret;
+	pos->content_size = pos->packet_size;
+	write_packet_header(pos, s_uuid);
+	write_packet_context(pos);
+	return 0;
+}
+
+/*
+ * Set the content size and checksum of the current packet. The padding
+ * up to the packet size is left out of both.
+ */
+static
+void close_packet(struct ctf_stream_pos *pos)
+{
+	*pos->content_size_loc = pos->offset;
+	*s_checksum_loc = ctf_crc32c(0, s_data_start,
+			ctf_get_pos_addr(pos) - s_data_start);
+}
+
+static
+const char *parse_uint(const char *p, const char *end, uint64_t *v)
+{
+	const char *start = p;
+	uint64_t val = 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+		val = val * 10 + (*p++ - '0');
+	if (p == start)
+		return NULL;
+	*v = val;
+	return p;
+}
+
+/*
+ * Convert [YYYY-MM-DD HH:MM:SS.MS] to nanoseconds since the epoch. Log
+ * lines come in time order, so the conversion of the date and minute
+ * is kept for the next lines.
+ */
+static
+uint64_t date_to_ns(const uint64_t *v)
+{
+	static uint64_t last_date[5];
+	static time_t last_ep_min;
+	static int cached;
+
+	if (!cached || memcmp(last_date, v, sizeof(last_date))) {
+		struct tm ti;
+
+		memset(&ti, 0, sizeof(ti));
+		ti.tm_year = v[0] - 1900;	/* from 1900 */
+		ti.tm_mon = v[1] - 1;		/* 0 to 11 */
+		ti.tm_mday = v[2];
+		ti.tm_hour = v[3];
+		ti.tm_min = v[4];
+		last_ep_min = babeltrace_timegm(&ti);
+		memcpy(last_date, v, sizeof(last_date));
+		cached = 1;
+	}
+	if (last_ep_min == (time_t) -1)
+		return 0;
+	return (uint64_t) (last_ep_min + v[5]) * NSEC_PER_SEC
+		+ v[6] * NSEC_PER_MSEC;
+}
+
+/*
+ * Parse the timestamp at the start of line, which ends at end, in
+ * either format:
+ *
+ *   [sec.usec] string
+ *   [YYYY-MM-DD HH:MM:SS.MS] string
+ *
+ * Returns the start of the string, NULL if the line has no timestamp.
+ */
+static
+const char *parse_timestamp(const char *line, const char *end, uint64_t *ts)
+{
+	static const char date_sep[] = "-- ::.";
+	const char *p = line;
+	uint64_t v[7];
+	int i;
+
+	if (p == end || *p++ != '[')
+		return NULL;
+	p = parse_uint(p, end, &v[0]);
+	if (!p || p == end)
+		return NULL;
+	if (*p == '.') {
+		p = parse_uint(p + 1, end, &v[1]);
+		if (!p)
+			return NULL;
+		/*
+		 * Default CTF clock has 1GHz frequency. Convert
+		 * from usec to nsec.
+		 */
+		*ts = (v[0] * USEC_PER_SEC + v[1]) * NSEC_PER_USEC;
+	} else {
+		for (i = 0; i < 6; i++) {
+			if (p == end || *p != date_sep[i])
+				return NULL;
+			p = parse_uint(p + 1, end, &v[i + 1]);
+			if (!p)
+				return NULL;
 		}
+		*ts = date_to_ns(v);
 	}
-	/* timestamp */
-	ctf_align_pos(pos, sizeof(uint64_t) * CHAR_BIT);
-	if (!pos->dummy)
-		*(uint64_t *) ctf_get_pos_addr(pos) = *ts;
-	ctf_move_pos(pos, sizeof(uint64_t) * CHAR_BIT);
+	if (p == end || *p++ != ']')
+		return NULL;
+	if (p < end && *p == ' ')
+		p++;
+	return p;
+}
+
+/* Packet offset at the end of an event of tlen bytes written at offset */
+static
+uint64_t event_end(uint64_t offset, size_t tlen)
+{
+	if (s_timestamp)
+		offset = ALIGN(offset, sizeof(uint64_t) * CHAR_BIT)
+			+ sizeof(uint64_t) * CHAR_BIT;
+	return offset + tlen * CHAR_BIT;
 }
 
+/*
+ * Write the line, of len bytes including its terminating null byte, as
+ * an event.
+ */
 static
-void trace_string(char *line, struct ctf_stream_pos *pos, size_t len)
+int trace_string(struct ctf_stream_pos *pos, const char *line, size_t len)
 {
-	struct ctf_stream_pos dummy;
-	int attempt = 0;
-	char *tline = line;	/* tline is start of text, after timestamp */
+	const char *tline = line;	/* tline is start of text, after timestamp */
 	size_t tlen = len;
 	uint64_t ts = 0;
+	int ret;
 
 	printf_debug("read: %s\n", line);
 
-	for (;;) {
-		ctf_dummy_pos(pos, &dummy);
-		write_event_header(&dummy, line, &tline, len, &tlen, &ts);
-		ctf_align_pos(&dummy, sizeof(uint8_t) * CHAR_BIT);
-		ctf_move_pos(&dummy, tlen * CHAR_BIT);
-		if (ctf_pos_packet(&dummy)) {
-			ctf_pos_pad_packet(pos);
-			write_packet_header(pos, s_uuid);
-			write_packet_context(pos);
-			if (attempt++ == 1) {
-				fprintf(stderr, "[Error] Line too large for packet size (%" PRIu64 "kB) (discarded)\n",
-					pos->packet_size / CHAR_BIT / 1024);
-				return;
-			}
-			continue;
-		} else {
-			break;
+	if (s_timestamp) {
+		const char *p;
+
+		p = parse_timestamp(line, line + len - 1, &ts);
+		if (p) {
+			tline = p;
+			tlen = len - (p - line);
 		}
 	}
 
-	write_event_header(pos, line, &tline, len, &tlen, &ts);
-	ctf_align_pos(pos, sizeof(uint8_t) * CHAR_BIT);
+	if (event_end(pos->offset, tlen) > pos->packet_size) {
+		if (event_end(s_data_offset, tlen) > pos->packet_size) {
+			fprintf(stderr, "[Error] Line too large for packet size (%" PRIu64 "kB) (discarded)\n",
+				pos->packet_size / CHAR_BIT / 1024);
+			return 0;
+		}
+		close_packet(pos);
+		ret = open_packet(pos);
+		if (ret)
+			return ret;
+	}
+
+	if (s_timestamp) {
+		ctf_align_pos(pos, sizeof(uint64_t) * CHAR_BIT);
+		*(uint64_t *) ctf_get_pos_addr(pos) = ts;
+		ctf_move_pos(pos, sizeof(uint64_t) * CHAR_BIT);
+	}
 	memcpy(ctf_get_pos_addr(pos), tline, tlen);
 	ctf_move_pos(pos, tlen * CHAR_BIT);
+	return 0;
 }
 
+/*
+ * Read the input by large blocks, and write each line as an event as
+ * soon as its newline is found. The newline is replaced by the null
+ * byte terminating the event string. A partial line at the end of a
+ * block is moved to the start of the buffer, which grows if the line
+ * fills it.
+ */
 static
-void trace_text(FILE *input, int output)
+int trace_text(int input, int output)
 {
 	struct ctf_stream_pos pos;
-	ssize_t len;
-	char *line = NULL, *nl;
-	size_t linesize;
-	int ret;
-
+	size_t buf_len = INPUT_BLOCK_LEN, start = 0, end = 0;
+	char *buf, *nl;
+	int eof = 0, ret;
+
+	buf = malloc(buf_len);
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
 	memset(&pos, 0, sizeof(pos));
-	ret = ctf_init_pos(&pos, NULL, output, O_RDWR);
+	ret = ctf_init_pos(&pos, NULL, -1, O_RDWR);
 	if (ret) {
 		fprintf(stderr, "Error in ctf_init_pos\n");
-		return;
+		goto end_free;
 	}
-	write_packet_header(&pos, s_uuid);
-	write_packet_context(&pos);
+	ctf_extent_init(&s_extent, output, s_packet_len);
+	ret = open_packet(&pos);
+	if (ret)
+		goto end_fini;
+
 	for (;;) {
-		len = getline(&line, &linesize, input);
-		if (len < 0)
-			break;
-		nl = strrchr(line, '\n');
+		ssize_t len;
+
+		nl = memchr(buf + start, '\n', end - start);
 		if (nl) {
 			*nl = '\0';
-			trace_string(line, &pos, nl - line + 1);
-		} else {
-			trace_string(line, &pos, strlen(line) + 1);
+			ret = trace_string(&pos, buf + start, nl - (buf + start) + 1);
+			if (ret)
+				goto end_fini;
+			start = nl - buf + 1;
+			continue;
+		}
+		if (eof) {
+			if (start < end) {
+				buf[end] = '\0';	/* last line, without newline */
+				ret = trace_string(&pos, buf + start, end - start + 1);
+			}
+			break;
+		}
+		memmove(buf, buf + start, end - start);
+		end -= start;
+		start = 0;
+		/* Keep room for the null byte terminating the last line. */
+		if (end == buf_len - 1) {
+			char *new_buf;
+
+			new_buf = realloc(buf, buf_len * 2);
+			if (!new_buf) {
+				perror("realloc");
+				ret = -1;
+				goto end_fini;
+			}
+			buf = new_buf;
+			buf_len *= 2;
 		}
+		len = read(input, buf + end, buf_len - 1 - end);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			ret = -1;
+			goto end_fini;
+		}
+		if (!len)
+			eof = 1;
+		end += len;
 	}
-	ret = ctf_fini_pos(&pos);
-	if (ret) {
+	close_packet(&pos);
+
+end_fini:
+	if (ctf_fini_pos(&pos)) {
 		fprintf(stderr, "Error in ctf_fini_pos\n");
+		ret = -1;
 	}
+	/* Trim the preallocation past the last packet. */
+	if (!ret && ctf_extent_truncate(&s_extent, s_packet_len))
+		ret = -1;
+end_free:
+	free(buf);
+	return ret;
 }
 
 static
@@ -316,6 +457,8 @@ void usage(FILE *fp)
 	fprintf(fp, "\n");
 	fprintf(fp, "  -t                             With timestamps (format: [sec.usec] string\\n)\n");
 	fprintf(fp, "                                                 (format: [YYYY-MM-DD HH:MM:SS.MS] string\\n)\n");
+	fprintf(fp, "  -s SIZE                        Packet size in bytes, multiple of the page size\n");
+	fprintf(fp, "                                 (default: 8 pages)\n");
 	fprintf(fp, "\n");
 }
 
@@ -327,6 +470,20 @@ int parse_args(int argc, char **argv)
 	for (i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-t"))
 			s_timestamp = 1;
+		else if (!strcmp(argv[i], "-s")) {
+			char *endptr;
+
+			if (++i == argc)
+				return -EINVAL;
+			errno = 0;
+			s_packet_len = strtoull(argv[i], &endptr, 0);
+			if (errno || *endptr || !s_packet_len
+					|| s_packet_len % getpagesize()) {
+				fprintf(stderr, "[error] Packet size must be a multiple of the page size (%d bytes).\n",
+					getpagesize());
+				return -EINVAL;
+			}
+		}
 		else if (!strcmp(argv[i], "-h")) {
 			s_help = 1;
 			return 0;
@@ -337,6 +494,8 @@ int parse_args(int argc, char **argv)
 	}
 	if (!s_outputname)
 		return -EINVAL;
+	if (!s_packet_len)
+		s_packet_len = getpagesize() * 8;
 	return 0;
 }
 
@@ -397,11 +556,11 @@ int main(int argc, char **argv)
 
 	babeltrace_uuid_generate(s_uuid);
 	print_metadata(metadata_fp);
-	trace_text(stdin, fd);
-
-	ret = close(fd);
-	if (ret)
+	ret = trace_text(fileno(stdin), fd);
+	if (close(fd))
 		perror("close");
+	if (ret)
+		exit(EXIT_FAILURE);
 	exit(EXIT_SUCCESS);
 
 	/* error handling */
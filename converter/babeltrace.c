@@ -37,6 +37,8 @@
 /* TODO: fix object model for format-agnostic callbacks */
 #include <babeltrace/ctf/events-internal.h>
 #include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/histogram.h>
+#include <babeltrace/ctf/stream-cache.h>
 #include <babeltrace/ctf-text/types.h>
 #include <babeltrace/iterator.h>
 #include <popt.h>
@@ -48,12 +50,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <stdint.h>
 #include <ftw.h>
 #include <string.h>
 
 #include <babeltrace/ctf-ir/metadata.h>	/* for clocks */
 
 #define PARTIAL_ERROR_SLEEP	3	/* 3 seconds */
+#define FOLLOW_POLL_INTERVAL	100000	/* 100 ms, in microseconds */
+#define NSEC_PER_SEC		1000000000ULL
 
 #define DEFAULT_FILE_ARRAY_SIZE	1
 
@@ -68,6 +73,14 @@ static char *opt_input_format, *opt_output_format;
  */
 static GPtrArray *opt_input_paths;
 static char *opt_output_path;
+static char *opt_events;
+
+struct where_filter {
+	char *name;
+	int64_t min, max;
+};
+
+static GArray *opt_where;	/* struct where_filter */
 
 static struct bt_format *fmt_read;
 
@@ -99,6 +112,19 @@ enum {
 	OPT_CLOCK_DATE,
 	OPT_CLOCK_GMT,
 	OPT_CLOCK_FORCE_CORRELATE,
+	OPT_FOLLOW,
+	OPT_MAX_OPEN_FILES,
+	OPT_MAX_MAPPINGS,
+	OPT_IO_URING,
+	OPT_STREAMING,
+	OPT_LAZY_INDEX,
+	OPT_BEGIN,
+	OPT_END,
+	OPT_VERIFY,
+	OPT_BUCKET,
+	OPT_SAMPLE,
+	OPT_EVENTS,
+	OPT_WHERE,
 };
 
 /*
@@ -128,6 +154,19 @@ static struct poptOption long_options[] = {
 	{ "clock-date", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_DATE, NULL, NULL },
 	{ "clock-gmt", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_GMT, NULL, NULL },
 	{ "clock-force-correlate", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_FORCE_CORRELATE, NULL, NULL },
+	{ "follow", 0, POPT_ARG_NONE, NULL, OPT_FOLLOW, NULL, NULL },
+	{ "max-open-files", 0, POPT_ARG_STRING, NULL, OPT_MAX_OPEN_FILES, NULL, NULL },
+	{ "max-mappings", 0, POPT_ARG_STRING, NULL, OPT_MAX_MAPPINGS, NULL, NULL },
+	{ "io-uring", 0, POPT_ARG_STRING, NULL, OPT_IO_URING, NULL, NULL },
+	{ "streaming", 0, POPT_ARG_NONE, NULL, OPT_STREAMING, NULL, NULL },
+	{ "lazy-index", 0, POPT_ARG_NONE, NULL, OPT_LAZY_INDEX, NULL, NULL },
+	{ "begin", 0, POPT_ARG_STRING, NULL, OPT_BEGIN, NULL, NULL },
+	{ "end", 0, POPT_ARG_STRING, NULL, OPT_END, NULL, NULL },
+	{ "verify", 0, POPT_ARG_NONE, NULL, OPT_VERIFY, NULL, NULL },
+	{ "bucket", 0, POPT_ARG_STRING, NULL, OPT_BUCKET, NULL, NULL },
+	{ "sample", 0, POPT_ARG_STRING, NULL, OPT_SAMPLE, NULL, NULL },
+	{ "events", 'e', POPT_ARG_STRING, NULL, OPT_EVENTS, NULL, NULL },
+	{ "where", 0, POPT_ARG_STRING, NULL, OPT_WHERE, NULL, NULL },
 	{ NULL, 0, 0, NULL, 0, NULL, NULL },
 };
 
@@ -148,6 +187,7 @@ static void usage(FILE *fp)
 	fprintf(fp, "\n");
 	fprintf(fp, "  -i, --input-format FORMAT      Input trace format (default: ctf)\n");
 	fprintf(fp, "  -o, --output-format FORMAT     Output trace format (default: text)\n");
+	fprintf(fp, "                                 (ctf writes the traces to the OUTPUT directory)\n");
 	fprintf(fp, "\n");
 	fprintf(fp, "  -h, --help                     This help message\n");
 	fprintf(fp, "  -l, --list                     List available formats\n");
@@ -173,6 +213,33 @@ static void usage(FILE *fp)
 	fprintf(fp, "      --clock-gmt                Print clock in GMT time zone (default: local time zone)\n");
 	fprintf(fp, "      --clock-force-correlate    Assume that clocks are inherently correlated\n");
 	fprintf(fp, "                                 across traces.\n");
+	fprintf(fp, "      --follow                   Keep reading events appended to the traces\n");
+	fprintf(fp, "                                 until interrupted\n");
+	fprintf(fp, "      --max-open-files N         Maximum number of stream files kept open\n");
+	fprintf(fp, "                                 (default: derived from the open files limit)\n");
+	fprintf(fp, "      --max-mappings N           Maximum number of stream packets kept mapped\n");
+	fprintf(fp, "                                 (default: %d)\n", DEFAULT_MAX_MAPPINGS);
+	fprintf(fp, "      --io-uring N               Read packets through io_uring, with up to\n");
+	fprintf(fp, "                                 N reads at once (default: mmap)\n");
+	fprintf(fp, "      --streaming                Drop packets from the page cache once read\n");
+	fprintf(fp, "                                 (single pass over cold traces)\n");
+	fprintf(fp, "      --lazy-index               Index stream packets after the first one\n");
+	fprintf(fp, "                                 in the background\n");
+	fprintf(fp, "      --begin TIME               Skip events before TIME (seconds since the\n");
+	fprintf(fp, "                                 epoch, as printed by --clock-seconds)\n");
+	fprintf(fp, "      --end TIME                 Skip events after TIME. With -o ctf, packets\n");
+	fprintf(fp, "                                 within --begin/--end are copied undecoded\n");
+	fprintf(fp, "      --verify                   Verify the CRC32C of data packets having a\n");
+	fprintf(fp, "                                 checksum field in their packet context\n");
+	fprintf(fp, "      --bucket TIME              Histogram bucket length, in seconds\n");
+	fprintf(fp, "                                 (default: trace time span / %d)\n",
+		BT_CTF_HISTOGRAM_DEFAULT_BUCKETS);
+	fprintf(fp, "      --sample FRACTION          Fraction of the packets decoded by -o histogram\n");
+	fprintf(fp, "                                 for the event class breakdown (default: 0)\n");
+	fprintf(fp, "  -e, --events name1<,name2,...> Only read the events with these names\n");
+	fprintf(fp, "      --where FIELD=MIN[..MAX]   Only read the events whose packet or stream\n");
+	fprintf(fp, "                                 event context integer FIELD is in the range\n");
+	fprintf(fp, "                                 (can be repeated)\n");
 	list_formats(fp);
 	fprintf(fp, "\n");
 }
@@ -258,6 +325,67 @@ end:
 	return ret;
 }
 
+/*
+ * Parse a time given as seconds, with an optional fractional part, into
+ * nanoseconds.
+ */
+static int parse_time(const char *str, uint64_t *ns)
+{
+	unsigned long long sec;
+	uint64_t frac = 0;
+	const char *p;
+	char *endptr;
+	int digits = 0;
+
+	errno = 0;
+	sec = strtoull(str, &endptr, 10);
+	if (str == endptr || errno != 0 || sec > UINT64_MAX / NSEC_PER_SEC)
+		return -EINVAL;
+	p = endptr;
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++) {
+			if (digits++ < 9)
+				frac = frac * 10 + (*p - '0');
+		}
+		if (!digits)
+			return -EINVAL;
+		for (; digits < 9; digits++)
+			frac *= 10;
+	}
+	if (*p != '\0')
+		return -EINVAL;
+	*ns = sec * NSEC_PER_SEC + frac;
+	return 0;
+}
+
+/*
+ * Parse FIELD=MIN[..MAX] into filter. str is modified.
+ */
+static int parse_where(char *str, struct where_filter *filter)
+{
+	char *value, *endptr;
+
+	value = strchr(str, '=');
+	if (!value || value == str)
+		return -EINVAL;
+	*value++ = '\0';
+	errno = 0;
+	filter->min = strtoll(value, &endptr, 0);
+	if (endptr == value || errno != 0)
+		return -EINVAL;
+	filter->max = filter->min;
+	if (!strncmp(endptr, "..", 2)) {
+		value = endptr + 2;
+		filter->max = strtoll(value, &endptr, 0);
+		if (endptr == value || errno != 0)
+			return -EINVAL;
+	}
+	if (*endptr != '\0' || filter->min > filter->max)
+		return -EINVAL;
+	filter->name = str;
+	return 0;
+}
+
 /*
  * Return 0 if caller should continue, < 0 if caller should return
  * error, > 0 if caller should exit without reporting error.
@@ -392,6 +520,181 @@ static int parse_options(int argc, char **argv)
 		case OPT_CLOCK_FORCE_CORRELATE:
 			opt_clock_force_correlate = 1;
 			break;
+		case OPT_FOLLOW:
+			opt_follow = 1;
+			break;
+		case OPT_MAX_OPEN_FILES:
+		case OPT_MAX_MAPPINGS:
+		{
+			const char *name = (opt == OPT_MAX_OPEN_FILES) ?
+				"--max-open-files" : "--max-mappings";
+			unsigned long value;
+			char *str;
+			char *endptr;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing %s argument\n", name);
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			value = strtoul(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0 || !value) {
+				fprintf(stderr, "[error] Incorrect %s argument: %s\n", name, str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			free(str);
+			if (opt == OPT_MAX_OPEN_FILES)
+				opt_max_open_files = value;
+			else
+				opt_max_mappings = value;
+			break;
+		}
+		case OPT_IO_URING:
+		{
+			unsigned long value;
+			char *str;
+			char *endptr;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --io-uring argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			value = strtoul(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0) {
+				fprintf(stderr, "[error] Incorrect --io-uring argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			free(str);
+			opt_io_uring_depth = value;
+			break;
+		}
+		case OPT_STREAMING:
+			opt_streaming = 1;
+			break;
+		case OPT_LAZY_INDEX:
+			opt_lazy_index = 1;
+			break;
+		case OPT_BEGIN:
+		case OPT_END:
+		{
+			const char *name = (opt == OPT_BEGIN) ?
+				"--begin" : "--end";
+			uint64_t value;
+			char *str;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing %s argument\n", name);
+				ret = -EINVAL;
+				goto end;
+			}
+			if (parse_time(str, &value)) {
+				fprintf(stderr, "[error] Incorrect %s argument: %s\n", name, str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			free(str);
+			if (opt == OPT_BEGIN)
+				opt_begin_time = value;
+			else
+				opt_end_time = value;
+			break;
+		}
+		case OPT_VERIFY:
+			opt_verify = 1;
+			break;
+		case OPT_EVENTS:
+			opt_events = (char *) poptGetOptArg(pc);
+			if (!opt_events) {
+				ret = -EINVAL;
+				goto end;
+			}
+			break;
+		case OPT_WHERE:
+		{
+			struct where_filter filter;
+			GQuark name;
+			char *str;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --where argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			if (parse_where(str, &filter)) {
+				fprintf(stderr, "[error] Incorrect --where argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			if (!opt_where) {
+				opt_where = g_array_new(FALSE, TRUE,
+						sizeof(struct where_filter));
+				opt_index_fields = g_array_new(FALSE, TRUE,
+						sizeof(GQuark));
+			}
+			g_array_append_val(opt_where, filter);
+			/* Record the packet context values when indexing. */
+			name = g_quark_from_string(filter.name);
+			g_array_append_val(opt_index_fields, name);
+			break;
+		}
+		case OPT_BUCKET:
+		{
+			uint64_t value;
+			char *str;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --bucket argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			if (parse_time(str, &value) || !value) {
+				fprintf(stderr, "[error] Incorrect --bucket argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			free(str);
+			opt_bucket_len = value;
+			break;
+		}
+		case OPT_SAMPLE:
+		{
+			char *str, *endptr;
+			double value;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --sample argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			value = strtod(str, &endptr);
+			if (*endptr != '\0' || str == endptr || errno != 0
+					|| !(value >= 0.0 && value <= 1.0)) {
+				fprintf(stderr, "[error] Incorrect --sample argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			free(str);
+			opt_sample = value;
+			break;
+		}
 
 		default:
 			ret = -EINVAL;
@@ -408,6 +711,11 @@ static int parse_options(int argc, char **argv)
 		ret = -EINVAL;
 		goto end;
 	}
+	if (opt_begin_time > opt_end_time) {
+		fprintf(stderr, "[error] --begin is after --end\n");
+		ret = -EINVAL;
+		goto end;
+	}
 
 end:
 	if (pc) {
@@ -546,14 +854,11 @@ static
 int trace_pre_handler(struct bt_trace_descriptor *td_write,
 		  struct bt_context *ctx)
 {
-	struct ctf_text_stream_pos *sout;
+	struct bt_stream_pos *sout = td_write->output_pos;
 	struct trace_collection *tc;
 	int ret, i;
 
-	sout = container_of(td_write, struct ctf_text_stream_pos,
-			trace_descriptor);
-
-	if (!sout->parent.pre_trace_cb)
+	if (!sout->pre_trace_cb)
 		return 0;
 
 	tc = ctx->tc;
@@ -561,7 +866,7 @@ int trace_pre_handler(struct bt_trace_descriptor *td_write,
 		struct bt_trace_descriptor *td =
 			g_ptr_array_index(tc->array, i);
 
-		ret = sout->parent.pre_trace_cb(&sout->parent, td);
+		ret = sout->pre_trace_cb(sout, td);
 		if (ret) {
 			fprintf(stderr, "[error] Writing to trace pre handler failed.\n");
 			goto end;
@@ -576,14 +881,11 @@ static
 int trace_post_handler(struct bt_trace_descriptor *td_write,
 		  struct bt_context *ctx)
 {
-	struct ctf_text_stream_pos *sout;
+	struct bt_stream_pos *sout = td_write->output_pos;
 	struct trace_collection *tc;
 	int ret, i;
 
-	sout = container_of(td_write, struct ctf_text_stream_pos,
-			trace_descriptor);
-
-	if (!sout->parent.post_trace_cb)
+	if (!sout->post_trace_cb)
 		return 0;
 
 	tc = ctx->tc;
@@ -591,7 +893,7 @@ int trace_post_handler(struct bt_trace_descriptor *td_write,
 		struct bt_trace_descriptor *td =
 			g_ptr_array_index(tc->array, i);
 
-		ret = sout->parent.post_trace_cb(&sout->parent, td);
+		ret = sout->post_trace_cb(sout, td);
 		if (ret) {
 			fprintf(stderr, "[error] Writing to trace post handler failed.\n");
 			goto end;
@@ -607,33 +909,72 @@ int convert_trace(struct bt_trace_descriptor *td_write,
 		  struct bt_context *ctx)
 {
 	struct bt_ctf_iter *iter;
-	struct ctf_text_stream_pos *sout;
+	struct bt_stream_pos *sout = td_write->output_pos;
 	struct bt_iter_pos begin_pos;
 	struct bt_ctf_event *ctf_event;
-	int ret;
-
-	sout = container_of(td_write, struct ctf_text_stream_pos,
-			trace_descriptor);
+	int ret, i;
 
-	if (!sout->parent.event_cb)
+	if (!sout->event_cb)
 		return 0;
 
-	begin_pos.type = BT_SEEK_BEGIN;
+	if (opt_begin_time) {
+		begin_pos.type = BT_SEEK_TIME;
+		begin_pos.u.seek_time = opt_begin_time;
+	} else {
+		begin_pos.type = BT_SEEK_BEGIN;
+	}
 	iter = bt_ctf_iter_create(ctx, &begin_pos, NULL);
 	if (!iter) {
 		ret = -1;
 		goto error_iter;
 	}
-	while ((ctf_event = bt_ctf_iter_read_event(iter))) {
-		ret = sout->parent.event_cb(&sout->parent, ctf_event->parent->stream);
-		if (ret) {
-			fprintf(stderr, "[error] Writing event failed.\n");
+	for (i = 0; opt_where && i < opt_where->len; i++) {
+		struct where_filter *filter = &g_array_index(opt_where,
+				struct where_filter, i);
+
+		ret = bt_ctf_iter_add_field_filter(iter, filter->name,
+				filter->min, filter->max);
+		if (ret)
 			goto end;
+	}
+	if (opt_events) {
+		char *name, *strctx;
+
+		for (name = strtok_r(opt_events, ",", &strctx); name;
+				name = strtok_r(NULL, ",", &strctx)) {
+			ret = bt_ctf_iter_add_event_filter(iter, name);
+			if (ret)
+				goto end;
 		}
-		ret = bt_iter_next(bt_ctf_get_iter(iter));
-		if (ret < 0)
+	}
+	for (;;) {
+		while ((ctf_event = bt_ctf_iter_read_event(iter))) {
+			uint64_t timestamp = bt_ctf_get_timestamp(ctf_event);
+
+			if (timestamp != -1ULL && timestamp > opt_end_time)
+				goto done;
+			ret = sout->event_cb(sout, ctf_event->parent->stream);
+			if (ret) {
+				fprintf(stderr, "[error] Writing event failed.\n");
+				goto end;
+			}
+			ret = bt_iter_next(bt_ctf_get_iter(iter));
+			if (ret < 0)
+				goto end;
+		}
+		if (!opt_follow)
+			break;
+		/* Wait for complete packets to be appended to the traces. */
+		fflush(NULL);
+		ret = bt_context_update(ctx);
+		if (ret < 0) {
+			fprintf(stderr, "[error] Reading appended trace data failed.\n");
 			goto end;
+		}
+		if (!ret)
+			usleep(FOLLOW_POLL_INTERVAL);
 	}
+done:
 	ret = 0;
 
 end:
@@ -789,6 +1130,14 @@ end:
 	free(opt_input_format);
 	free(opt_output_format);
 	free(opt_output_path);
+	free(opt_events);
+	if (opt_where) {
+		for (i = 0; i < opt_where->len; i++)
+			free(g_array_index(opt_where, struct where_filter, i).name);
+		g_array_free(opt_where, TRUE);
+		g_array_free(opt_index_fields, TRUE);
+		opt_index_fields = NULL;
+	}
 	g_ptr_array_free(opt_input_paths, TRUE);
 	if (partial_error)
 		exit(EXIT_FAILURE);
@@ -55,6 +55,7 @@ struct bt_trace_descriptor *bt_dummy_open_trace(const char *path, int flags,
 	pos->parent.rw_table = NULL;
 	pos->parent.event_cb = bt_dummy_write_event;
 	pos->parent.trace = &pos->trace_descriptor;
+	pos->trace_descriptor.output_pos = &pos->parent;
 	return &pos->trace_descriptor;
 }
 
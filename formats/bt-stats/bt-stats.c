@@ -0,0 +1,383 @@
+/*
+ * BabelTrace - Statistics Output
+ *
+ * Event counts, timestamps, lost events and byte volume per event
+ * class, per stream and per CPU.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <errno.h>
+#include <glib.h>
+
+#define NSEC_PER_SEC	((uint64_t) 1000000000)
+
+struct stats_counts {
+	uint64_t events;
+	uint64_t bytes;			/* encoded size of the events */
+	uint64_t lost;			/* events discarded by the tracer */
+	uint64_t first, last;		/* timestamps, in ns */
+};
+
+struct stats_stream {
+	struct ctf_stream_definition *stream;
+	struct stats_counts counts;
+	int64_t cpu_id;			/* -1 if the packets have none */
+	int64_t cur_index;		/* packet cpu_id was read from */
+	GArray *events;			/* struct stats_counts, by event id */
+};
+
+/*
+ * Inherit from both struct bt_stream_pos and struct bt_trace_descriptor.
+ */
+struct stats_pos {
+	struct bt_stream_pos parent;
+	struct bt_trace_descriptor trace_descriptor;
+	FILE *fp;
+	GHashTable *streams_by_def;	/* stream -> struct stats_stream */
+	GPtrArray *streams;		/* struct stats_stream, in first event order */
+	struct stats_stream *last;	/* stream of the previous event */
+};
+
+/* Totals of an event class or a CPU, for the summary. */
+struct stats_entry {
+	const char *name;
+	int64_t cpu_id;
+	struct stats_counts counts;
+};
+
+static
+void counts_add(struct stats_counts *counts, uint64_t bytes,
+		struct ctf_stream_definition *stream)
+{
+	if (stream->has_timestamp) {
+		if (!counts->events || stream->real_timestamp < counts->first)
+			counts->first = stream->real_timestamp;
+		if (stream->real_timestamp > counts->last)
+			counts->last = stream->real_timestamp;
+	}
+	counts->events++;
+	counts->bytes += bytes;
+}
+
+static
+void counts_merge(struct stats_counts *dst, const struct stats_counts *src)
+{
+	if (!src->events) {
+		dst->lost += src->lost;
+		return;
+	}
+	if (!dst->events || src->first < dst->first)
+		dst->first = src->first;
+	if (src->last > dst->last)
+		dst->last = src->last;
+	dst->events += src->events;
+	dst->bytes += src->bytes;
+	dst->lost += src->lost;
+}
+
+static
+struct stats_stream *stats_get_stream(struct stats_pos *pos,
+		struct ctf_stream_definition *stream)
+{
+	struct stats_stream *ss;
+
+	if (likely(pos->last && pos->last->stream == stream))
+		return pos->last;
+	ss = g_hash_table_lookup(pos->streams_by_def, stream);
+	if (!ss) {
+		ss = g_new0(struct stats_stream, 1);
+		ss->stream = stream;
+		ss->cpu_id = -1;
+		ss->cur_index = -1;
+		ss->events = g_array_new(FALSE, TRUE,
+				sizeof(struct stats_counts));
+		g_hash_table_insert(pos->streams_by_def, stream, ss);
+		g_ptr_array_add(pos->streams, ss);
+	}
+	pos->last = ss;
+	return ss;
+}
+
+/*
+ * Only the event header and position of the stream are used: the
+ * event fields are decoded by the reader, but never formatted.
+ */
+static
+int stats_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct stats_pos *pos = container_of(ppos, struct stats_pos, parent);
+	struct ctf_stream_pos *in_pos =
+		&container_of(stream, struct ctf_file_stream, parent)->pos;
+	struct stats_stream *ss;
+	uint64_t bytes;
+
+	ss = stats_get_stream(pos, stream);
+	if (unlikely(in_pos->cur_index != ss->cur_index)) {
+		struct definition_integer *cpu_id = NULL;
+
+		ss->cur_index = in_pos->cur_index;
+		if (stream->stream_packet_context)
+			cpu_id = bt_lookup_integer(&stream->stream_packet_context->p,
+					"cpu_id", FALSE);
+		ss->cpu_id = cpu_id ? (int64_t) cpu_id->value._unsigned : -1;
+	}
+	if (stream->events_discarded) {
+		ss->counts.lost += stream->events_discarded;
+		stream->events_discarded = 0;
+	}
+	if (unlikely(stream->event_id >= ss->events->len))
+		g_array_set_size(ss->events, stream->event_id + 1);
+	bytes = (in_pos->offset - in_pos->last_offset) / CHAR_BIT;
+	counts_add(&ss->counts, bytes, stream);
+	counts_add(&g_array_index(ss->events, struct stats_counts,
+			stream->event_id), bytes, stream);
+	return 0;
+}
+
+static
+void print_timestamp(FILE *fp, uint64_t ts)
+{
+	fprintf(fp, " %10" PRIu64 ".%09" PRIu64,
+		ts / NSEC_PER_SEC, ts % NSEC_PER_SEC);
+}
+
+static
+void print_counts(FILE *fp, const struct stats_counts *counts)
+{
+	fprintf(fp, " %12" PRIu64 " %10" PRIu64 " %14" PRIu64,
+		counts->events, counts->lost, counts->bytes);
+	if (counts->events) {
+		print_timestamp(fp, counts->first);
+		print_timestamp(fp, counts->last);
+	}
+	fprintf(fp, "\n");
+}
+
+static
+void print_header(FILE *fp, const char *title, const char *key)
+{
+	fprintf(fp, "%s:\n%-40s %12s %10s %14s %20s %20s\n", title, key,
+		"events", "lost", "bytes", "first", "last");
+}
+
+static
+int compare_entries(const void *a, const void *b)
+{
+	const struct stats_entry *ea = a, *eb = b;
+
+	if (ea->counts.events != eb->counts.events)
+		return ea->counts.events < eb->counts.events ? 1 : -1;
+	return ea->cpu_id < eb->cpu_id ? -1 : ea->cpu_id > eb->cpu_id;
+}
+
+/*
+ * Add counts to the entry for name or cpu_id, appending it to entries
+ * if missing.
+ */
+static
+void entries_add(GArray *entries, const char *name, int64_t cpu_id,
+		const struct stats_counts *counts)
+{
+	struct stats_entry entry;
+	unsigned int i;
+
+	for (i = 0; i < entries->len; i++) {
+		struct stats_entry *e = &g_array_index(entries,
+				struct stats_entry, i);
+
+		if (e->name == name && e->cpu_id == cpu_id) {
+			counts_merge(&e->counts, counts);
+			return;
+		}
+	}
+	memset(&entry, 0, sizeof(entry));
+	entry.name = name;
+	entry.cpu_id = cpu_id;
+	counts_merge(&entry.counts, counts);
+	g_array_append_val(entries, entry);
+}
+
+static
+void print_summary(struct stats_pos *pos)
+{
+	FILE *fp = pos->fp;
+	GArray *classes, *cpus;
+	struct stats_counts total;
+	unsigned int i, j;
+
+	classes = g_array_new(FALSE, TRUE, sizeof(struct stats_entry));
+	cpus = g_array_new(FALSE, TRUE, sizeof(struct stats_entry));
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < pos->streams->len; i++) {
+		struct stats_stream *ss = g_ptr_array_index(pos->streams, i);
+		GPtrArray *events_by_id = ss->stream->stream_class->events_by_id;
+
+		for (j = 0; j < ss->events->len; j++) {
+			struct stats_counts *counts = &g_array_index(ss->events,
+					struct stats_counts, j);
+			struct ctf_event_declaration *event_class;
+
+			if (!counts->events)
+				continue;
+			event_class = g_ptr_array_index(events_by_id, j);
+			/* Names are quarks: equal names share a string. */
+			entries_add(classes, g_quark_to_string(event_class->name),
+				-1, counts);
+		}
+		if (ss->cpu_id >= 0)
+			entries_add(cpus, NULL, ss->cpu_id, &ss->counts);
+		counts_merge(&total, &ss->counts);
+	}
+	qsort(classes->data, classes->len, sizeof(struct stats_entry),
+		compare_entries);
+	qsort(cpus->data, cpus->len, sizeof(struct stats_entry),
+		compare_entries);
+
+	print_header(fp, "Event classes", "name");
+	for (i = 0; i < classes->len; i++) {
+		struct stats_entry *e = &g_array_index(classes,
+				struct stats_entry, i);
+
+		fprintf(fp, "%-40s", e->name);
+		print_counts(fp, &e->counts);
+	}
+	fprintf(fp, "\n");
+	print_header(fp, "Streams", "path (stream id)");
+	for (i = 0; i < pos->streams->len; i++) {
+		struct stats_stream *ss = g_ptr_array_index(pos->streams, i);
+		char name[PATH_MAX];
+
+		snprintf(name, sizeof(name), "%s (%" PRIu64 ")",
+			ss->stream->path[0] ? ss->stream->path : "<mmap>",
+			ss->stream->stream_id);
+		fprintf(fp, "%-40s", name);
+		print_counts(fp, &ss->counts);
+	}
+	if (cpus->len) {
+		fprintf(fp, "\n");
+		print_header(fp, "CPUs", "cpu_id");
+		for (i = 0; i < cpus->len; i++) {
+			struct stats_entry *e = &g_array_index(cpus,
+					struct stats_entry, i);
+
+			fprintf(fp, "%-40" PRId64, e->cpu_id);
+			print_counts(fp, &e->counts);
+		}
+	}
+	fprintf(fp, "\n");
+	fprintf(fp, "%-40s", "Total");
+	print_counts(fp, &total);
+	g_array_free(classes, TRUE);
+	g_array_free(cpus, TRUE);
+}
+
+static
+struct bt_trace_descriptor *stats_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	struct stats_pos *pos;
+	FILE *fp;
+
+	if (path) {
+		fp = fopen(path, "w");
+		if (!fp) {
+			fprintf(stderr, "[error] Unable to open %s: %s.\n",
+				path, strerror(errno));
+			return NULL;
+		}
+	} else {
+		fp = stdout;
+	}
+	pos = g_new0(struct stats_pos, 1);
+	pos->fp = fp;
+	pos->streams_by_def = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pos->streams = g_ptr_array_new();
+	pos->parent.rw_table = NULL;
+	pos->parent.event_cb = stats_write_event;
+	pos->parent.trace = &pos->trace_descriptor;
+	pos->trace_descriptor.output_pos = &pos->parent;
+	return &pos->trace_descriptor;
+}
+
+/*
+ * The summary is printed when the trace is closed, after the streams
+ * were read. Reading errors still leave the statistics of the events
+ * read so far.
+ */
+static
+int stats_close_trace(struct bt_trace_descriptor *td)
+{
+	struct stats_pos *pos =
+		container_of(td, struct stats_pos, trace_descriptor);
+	unsigned int i;
+	int ret = 0;
+
+	print_summary(pos);
+	for (i = 0; i < pos->streams->len; i++) {
+		struct stats_stream *ss = g_ptr_array_index(pos->streams, i);
+
+		g_array_free(ss->events, TRUE);
+		g_free(ss);
+	}
+	g_ptr_array_free(pos->streams, TRUE);
+	g_hash_table_destroy(pos->streams_by_def);
+	if (pos->fp != stdout && fclose(pos->fp)) {
+		perror("Error on fclose");
+		ret = -1;
+	}
+	g_free(pos);
+	return ret;
+}
+
+static
+struct bt_format stats_format = {
+	.open_trace = stats_open_trace,
+	.close_trace = stats_close_trace,
+};
+
+static
+void __attribute__((constructor)) stats_init(void)
+{
+	int ret;
+
+	stats_format.name = g_quark_from_static_string("stats");
+	ret = bt_register_format(&stats_format);
+	assert(!ret);
+}
+
+static
+void __attribute__((destructor)) stats_exit(void)
+{
+	bt_unregister_format(&stats_format);
+}
@@ -35,7 +35,9 @@
 #include <babeltrace/ctf/events.h>
 #include <babeltrace/ctf/events-internal.h>
 #include <babeltrace/ctf/callbacks-internal.h>
+#include <babeltrace/ctf/metadata.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 static
 struct bt_dependencies *_bt_dependencies_create(const char *first,
@@ -69,6 +71,9 @@ struct bt_dependencies *bt_dependencies_create(const char *first, ...)
 
 /*
  * bt_ctf_iter_add_callback: Add a callback to CTF iterator.
+ *
+ * A callback targeting an event is rejected if no stream class of the
+ * trace collection declares that event.
  */
 int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 		bt_intern_str event, void *private_data, int flags,
@@ -78,14 +83,34 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 		struct bt_dependencies *weak_depends,
 		struct bt_dependencies *provides)
 {
-	int i, stream_id;
+	int i, stream_id, found = 0;
 	gpointer *event_id_ptr;
 	unsigned long event_id;
 	struct trace_collection *tc;
+	struct bt_callback new_callback;
 
 	if (!iter || !callback)
 		return -EINVAL;
 
+	new_callback.prio = 0;
+	new_callback.seq = iter->nr_callbacks;
+	new_callback.private_data = private_data;
+	new_callback.flags = flags;
+	new_callback.callback = callback;
+	new_callback.depends = depends;
+	new_callback.weak_depends = weak_depends;
+	new_callback.provides = provides;
+
+	if (!event) {
+		/* callback for all events */
+		if (!iter->main_callbacks.callback) {
+			iter->main_callbacks.callback = g_array_new(FALSE, TRUE,
+					sizeof(struct bt_callback));
+		}
+		g_array_append_val(iter->main_callbacks.callback, new_callback);
+		goto end;
+	}
+
 	tc = iter->parent.ctx->tc;
 	for (i = 0; i < tc->array->len; i++) {
 		struct ctf_trace *tin;
@@ -98,11 +123,22 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 			struct ctf_stream_declaration *stream;
 			struct bt_stream_callbacks *bt_stream_cb = NULL;
 			struct bt_callback_chain *bt_chain = NULL;
-			struct bt_callback new_callback;
+			GArray *chain;
 
 			stream = g_ptr_array_index(tin->streams, stream_id);
+			if (!stream)
+				continue;
+
+			/* find the event id */
+			event_id_ptr = g_hash_table_lookup(stream->event_quark_to_id,
+					(gconstpointer) (unsigned long) event);
+			/* event not found in this stream class */
+			if (!event_id_ptr)
+				continue;
+			event_id = (uint64_t)(unsigned long) *event_id_ptr;
+			found = 1;
 
-			if (stream_id >= iter->callbacks->len) {
+			if (stream->stream_id >= iter->callbacks->len) {
 				g_array_set_size(iter->callbacks, stream->stream_id + 1);
 			}
 			bt_stream_cb = &g_array_index(iter->callbacks,
@@ -112,49 +148,388 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 						sizeof(struct bt_callback_chain));
 			}
 
-			if (event) {
-				/* find the event id */
-				event_id_ptr = g_hash_table_lookup(stream->event_quark_to_id,
-						(gconstpointer) (unsigned long) event);
-				/* event not found in this stream class */
-				if (!event_id_ptr) {
-					fprintf(stderr, "[error] Event ID not found in stream class\n");
+			/* find or create the bt_callback_chain for this event */
+			if (event_id >= bt_stream_cb->per_id_callbacks->len) {
+				g_array_set_size(bt_stream_cb->per_id_callbacks, event_id + 1);
+			}
+			bt_chain = &g_array_index(bt_stream_cb->per_id_callbacks,
+					struct bt_callback_chain, event_id);
+			if (!bt_chain->callback) {
+				bt_chain->callback = g_array_new(FALSE, TRUE,
+					sizeof(struct bt_callback));
+			}
+			chain = bt_chain->callback;
+
+			/*
+			 * Stream classes of several traces can share the
+			 * same stream and event ids: register only once.
+			 */
+			if (chain->len && g_array_index(chain, struct bt_callback,
+					chain->len - 1).seq == new_callback.seq)
+				continue;
+			g_array_append_val(chain, new_callback);
+		}
+	}
+
+	if (!found) {
+		fprintf(stderr, "[error] Event \"%s\" not found in trace collection.\n",
+			g_quark_to_string(event));
+		return -ENOENT;
+	}
+end:
+	iter->nr_callbacks++;
+	iter->recalculate_dep_graph = 1;
+	return 0;
+}
+
+static
+int deps_intersect(struct bt_dependencies *a, struct bt_dependencies *b)
+{
+	int i, j;
+
+	if (!a || !b)
+		return 0;
+	for (i = 0; i < a->deps->len; i++) {
+		GQuark q = g_array_index(a->deps, GQuark, i);
+
+		for (j = 0; j < b->deps->len; j++) {
+			if (g_array_index(b->deps, GQuark, j) == q)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Return whether callback "from" provides a result consumed, strongly
+ * or weakly, by callback "to".
+ */
+static
+int callback_feeds(struct bt_callback *from, struct bt_callback *to)
+{
+	if (from == to)
+		return 0;
+	return deps_intersect(from->provides, to->depends)
+		|| deps_intersect(from->provides, to->weak_depends);
+}
+
+static
+int callback_is_terminal(struct bt_callback *cb)
+{
+	return !cb->provides || !cb->provides->deps->len;
+}
+
+/* Append the callbacks of chain not yet in nodes, by registration order. */
+static
+void add_chain_nodes(GArray *nodes, char *added,
+		struct bt_callback_chain *bt_chain)
+{
+	int i;
+
+	if (!bt_chain->callback)
+		return;
+	for (i = 0; i < bt_chain->callback->len; i++) {
+		struct bt_callback *cb = &g_array_index(bt_chain->callback,
+				struct bt_callback, i);
+
+		if (added[cb->seq])
+			continue;
+		added[cb->seq] = 1;
+		g_array_append_val(nodes, *cb);
+	}
+}
+
+/*
+ * Return the callbacks to call, indexed by registration order, over the
+ * callbacks of all events: terminal callbacks (providing nothing), and
+ * the callbacks providing a result consumed by one of them, directly or
+ * not. Liveness does not depend on the event: a provider is kept for
+ * all its events as soon as a kept callback of any event consumes it.
+ */
+static
+char *compute_live(struct bt_ctf_iter *iter)
+{
+	GArray *nodes;
+	char *live, *added;
+	int i, j, changed;
+
+	live = g_new0(char, iter->nr_callbacks);
+	added = g_new0(char, iter->nr_callbacks);
+	nodes = g_array_new(FALSE, TRUE, sizeof(struct bt_callback));
+	add_chain_nodes(nodes, added, &iter->main_callbacks);
+	for (i = 0; i < iter->callbacks->len; i++) {
+		struct bt_stream_callbacks *bt_stream_cb;
+
+		bt_stream_cb = &g_array_index(iter->callbacks,
+				struct bt_stream_callbacks, i);
+		if (!bt_stream_cb->per_id_callbacks)
+			continue;
+		for (j = 0; j < bt_stream_cb->per_id_callbacks->len; j++)
+			add_chain_nodes(nodes, added,
+				&g_array_index(bt_stream_cb->per_id_callbacks,
+					struct bt_callback_chain, j));
+	}
+
+	for (i = 0; i < nodes->len; i++) {
+		struct bt_callback *cb = &g_array_index(nodes,
+				struct bt_callback, i);
+
+		live[cb->seq] = callback_is_terminal(cb);
+	}
+	do {
+		changed = 0;
+		for (i = 0; i < nodes->len; i++) {
+			struct bt_callback *consumer = &g_array_index(nodes,
+					struct bt_callback, i);
+
+			if (!live[consumer->seq])
+				continue;
+			for (j = 0; j < nodes->len; j++) {
+				struct bt_callback *provider = &g_array_index(nodes,
+						struct bt_callback, j);
+
+				if (live[provider->seq])
 					continue;
+				if (callback_feeds(provider, consumer)) {
+					live[provider->seq] = 1;
+					changed = 1;
 				}
-				event_id = (uint64_t)(unsigned long) *event_id_ptr;
+			}
+		}
+	} while (changed);
 
-				/* find or create the bt_callback_chain for this event */
-				if (event_id >= bt_stream_cb->per_id_callbacks->len) {
-					g_array_set_size(bt_stream_cb->per_id_callbacks, event_id + 1);
-				}
-				bt_chain = &g_array_index(bt_stream_cb->per_id_callbacks,
-						struct bt_callback_chain, event_id);
-				if (!bt_chain->callback) {
-					bt_chain->callback = g_array_new(FALSE, TRUE,
-						sizeof(struct bt_callback));
-				}
-			} else {
-				/* callback for all events */
-				if (!iter->main_callbacks.callback) {
-					iter->main_callbacks.callback = g_array_new(FALSE, TRUE,
-							sizeof(struct bt_callback));
-				}
-				bt_chain = &iter->main_callbacks;
+	g_array_free(nodes, TRUE);
+	g_free(added);
+	return live;
+}
+
+/*
+ * Return whether node start of nodes is on a dependency cycle of the
+ * live callbacks not yet placed.
+ */
+static
+int on_cycle(GArray *nodes, const char *live, const char *placed, int start)
+{
+	char *seen;
+	int *queue;
+	int head = 0, tail = 0, found = 0, i;
+
+	seen = g_new0(char, nodes->len);
+	queue = g_new(int, nodes->len);
+	queue[tail++] = start;
+	while (head < tail && !found) {
+		struct bt_callback *from = &g_array_index(nodes,
+				struct bt_callback, queue[head++]);
+
+		for (i = 0; i < nodes->len; i++) {
+			if (!live[i] || placed[i] || seen[i]
+					|| !callback_feeds(from,
+						&g_array_index(nodes, struct bt_callback, i)))
+				continue;
+			if (i == start) {
+				found = 1;
+				break;
 			}
+			seen[i] = 1;
+			queue[tail++] = i;
+		}
+	}
+	g_free(queue);
+	g_free(seen);
+	return found;
+}
 
-			new_callback.private_data = private_data;
-			new_callback.flags = flags;
-			new_callback.callback = callback;
-			new_callback.depends = depends;
-			new_callback.weak_depends = weak_depends;
-			new_callback.provides = provides;
+/*
+ * Flatten the callbacks for all events and the callbacks of one event
+ * into a dispatch array ordered by the dependency graph, keeping the
+ * live callbacks only (see compute_live()).
+ *
+ * Among callbacks whose dependencies are met, the earliest registered
+ * runs first, so independent callbacks keep their FIFO order. Cycles
+ * are reported and broken at their earliest registered callback.
+ */
+static
+GArray *build_dispatch(struct bt_callback_chain *main_chain,
+		struct bt_callback_chain *bt_chain, const char *live_seq)
+{
+	GArray *nodes, *dispatch;
+	char *live, *placed;
+	int *indeg;
+	int i, j, nr_live = 0;
+
+	nodes = g_array_new(FALSE, TRUE, sizeof(struct bt_callback));
+	if (main_chain->callback)
+		g_array_append_vals(nodes, main_chain->callback->data,
+				    main_chain->callback->len);
+	if (bt_chain && bt_chain->callback)
+		g_array_append_vals(nodes, bt_chain->callback->data,
+				    bt_chain->callback->len);
+	dispatch = g_array_sized_new(FALSE, TRUE, sizeof(struct bt_callback),
+				     nodes->len);
+	live = g_new0(char, nodes->len);
+	placed = g_new0(char, nodes->len);
+	indeg = g_new0(int, nodes->len);
 
-			/* TODO : take care of priority, for now just FIFO */
-			g_array_append_val(bt_chain->callback, new_callback);
+	for (i = 0; i < nodes->len; i++)
+		live[i] = live_seq[g_array_index(nodes,
+					struct bt_callback, i).seq];
+	for (i = 0; i < nodes->len; i++) {
+		if (!live[i])
+			continue;
+		nr_live++;
+		for (j = 0; j < nodes->len; j++) {
+			if (live[j] && callback_feeds(&g_array_index(nodes, struct bt_callback, j),
+					&g_array_index(nodes, struct bt_callback, i)))
+				indeg[i]++;
 		}
 	}
 
-	return 0;
+	while (dispatch->len < nr_live) {
+		struct bt_callback *cb;
+		int sel = -1, cycle = 0;
+
+		for (i = 0; i < nodes->len; i++) {
+			if (!live[i] || placed[i] || indeg[i])
+				continue;
+			if (sel < 0 || g_array_index(nodes, struct bt_callback, i).seq
+					< g_array_index(nodes, struct bt_callback, sel).seq)
+				sel = i;
+		}
+		if (sel < 0) {
+			cycle = 1;
+			for (i = 0; i < nodes->len; i++) {
+				if (!live[i] || placed[i]
+						|| !on_cycle(nodes, live, placed, i))
+					continue;
+				if (sel < 0 || g_array_index(nodes, struct bt_callback, i).seq
+						< g_array_index(nodes, struct bt_callback, sel).seq)
+					sel = i;
+			}
+		}
+		cb = &g_array_index(nodes, struct bt_callback, sel);
+		if (cycle)
+			fprintf(stderr, "[error] Callback dependency cycle, breaking it at callback %u.\n",
+				cb->seq);
+		placed[sel] = 1;
+		cb->prio = dispatch->len;
+		g_array_append_val(dispatch, *cb);
+		for (i = 0; i < nodes->len; i++) {
+			if (live[i] && !placed[i]
+					&& callback_feeds(cb, &g_array_index(nodes, struct bt_callback, i)))
+				indeg[i]--;
+		}
+	}
+
+	g_free(indeg);
+	g_free(placed);
+	g_free(live);
+	g_array_free(nodes, TRUE);
+	return dispatch;
+}
+
+/*
+ * Split the dispatch array into chains of callbacks linked by their
+ * dependencies, and link the callbacks of each chain in dispatch order.
+ * Return the number of chains.
+ */
+static
+int assign_groups(GArray *dispatch)
+{
+	int *parent;
+	int i, j, nr_groups = 0;
+
+	parent = g_new(int, dispatch->len);
+	for (i = 0; i < dispatch->len; i++)
+		parent[i] = i;
+	for (i = 0; i < dispatch->len; i++) {
+		struct bt_callback *a = &g_array_index(dispatch, struct bt_callback, i);
+
+		for (j = i + 1; j < dispatch->len; j++) {
+			struct bt_callback *b = &g_array_index(dispatch, struct bt_callback, j);
+			int ri = i, rj = j;
+
+			if (!callback_feeds(a, b) && !callback_feeds(b, a))
+				continue;
+			while (parent[ri] != ri)
+				ri = parent[ri];
+			while (parent[rj] != rj)
+				rj = parent[rj];
+			/* Keep the earliest callback as root. */
+			if (ri < rj)
+				parent[rj] = ri;
+			else
+				parent[ri] = rj;
+		}
+	}
+	for (i = 0; i < dispatch->len; i++) {
+		struct bt_callback *cb = &g_array_index(dispatch, struct bt_callback, i);
+		int root = i;
+
+		while (parent[root] != root)
+			root = parent[root];
+		if (root == i)
+			cb->group = nr_groups++;
+		else
+			cb->group = g_array_index(dispatch, struct bt_callback, root).group;
+		cb->next = -1;
+		for (j = i - 1; j >= 0; j--) {
+			struct bt_callback *prev = &g_array_index(dispatch,
+					struct bt_callback, j);
+
+			if (prev->group == cb->group) {
+				prev->next = i;
+				break;
+			}
+		}
+	}
+	g_free(parent);
+	return nr_groups;
+}
+
+static
+void chain_set_dispatch(struct bt_callback_chain *bt_chain, GArray *dispatch)
+{
+	if (bt_chain->dispatch)
+		g_array_free(bt_chain->dispatch, TRUE);
+	bt_chain->dispatch = dispatch;
+	bt_chain->nr_groups = assign_groups(dispatch);
+}
+
+/*
+ * Compute the per event id dispatch arrays. Called once after each
+ * change to the set of registered callbacks.
+ */
+static
+void calculate_dep_graph(struct bt_ctf_iter *iter)
+{
+	char *live;
+	int i, j;
+
+	live = compute_live(iter);
+	chain_set_dispatch(&iter->main_callbacks,
+		build_dispatch(&iter->main_callbacks, NULL, live));
+
+	for (i = 0; i < iter->callbacks->len; i++) {
+		struct bt_stream_callbacks *bt_stream_cb;
+
+		bt_stream_cb = &g_array_index(iter->callbacks,
+				struct bt_stream_callbacks, i);
+		if (!bt_stream_cb->per_id_callbacks)
+			continue;
+		for (j = 0; j < bt_stream_cb->per_id_callbacks->len; j++) {
+			struct bt_callback_chain *bt_chain;
+
+			bt_chain = &g_array_index(bt_stream_cb->per_id_callbacks,
+					struct bt_callback_chain, j);
+			if (!bt_chain->callback)
+				continue;
+			chain_set_dispatch(bt_chain,
+				build_dispatch(&iter->main_callbacks, bt_chain,
+					live));
+		}
+	}
+	g_free(live);
+	iter->recalculate_dep_graph = 0;
 }
 
 static
@@ -183,54 +558,256 @@ int extract_ctf_stream_event(struct ctf_stream_definition *stream,
 	return 0;
 }
 
+/*
+ * Run the chains of the event belonging to share index out of
+ * nr_shares. Chains are numbered in order of their first callback. A
+ * callback returning a stop value ends the callbacks of the event not
+ * started yet, on all shares.
+ */
+static
+void run_chains(struct bt_callback_event *ev, int index, int nr_shares)
+{
+	GArray *dispatch = ev->dispatch;
+	struct bt_ctf_event ctf_data;
+	int i, j, heads = 0;
+
+	ctf_data.parent = ev->event;
+	for (i = 0; i < dispatch->len; i++) {
+		struct bt_callback *cb = &g_array_index(dispatch, struct bt_callback, i);
+
+		if (cb->group != heads)
+			continue;
+		heads++;
+		if (cb->group % nr_shares != index)
+			continue;
+		for (j = i; j >= 0; j = cb->next) {
+			enum bt_cb_ret ret;
+
+			if (g_atomic_int_get(&ev->stop))
+				return;
+			cb = &g_array_index(dispatch, struct bt_callback, j);
+			ret = cb->callback(&ctf_data, cb->private_data);
+			if (ret == BT_CB_OK_STOP || ret == BT_CB_ERROR_STOP) {
+				g_atomic_int_set(&ev->stop, 1);
+				return;
+			}
+		}
+	}
+}
+
+static
+void *callback_worker_thread(void *arg)
+{
+	struct bt_callback_worker *worker = arg;
+	struct bt_callback_workers *w = worker->workers;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		struct bt_callback_event *ev;
+
+		while (!w->quit && w->head == seen)
+			pthread_cond_wait(&w->work_cond, &w->lock);
+		/* Quit once the posted events ran. */
+		if (w->head == seen)
+			break;
+		ev = &w->ring[seen++ % BT_CALLBACK_RING_SIZE];
+		pthread_mutex_unlock(&w->lock);
+		if (worker->index < ev->nr_groups)
+			run_chains(ev, worker->index, w->nr_threads);
+		pthread_mutex_lock(&w->lock);
+		if (!--ev->pending)
+			pthread_cond_broadcast(&w->done_cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+/*
+ * Move the tail past the completed events. Workers run the events in
+ * order, so an event completes after all events posted before it.
+ * Called with the lock held.
+ */
+static
+void retire_events(struct bt_callback_workers *w)
+{
+	while (w->tail != w->head
+			&& !w->ring[w->tail % BT_CALLBACK_RING_SIZE].pending)
+		w->tail++;
+}
+
+/*
+ * Wait for the posted events of stream, or for all posted events if
+ * stream is NULL. Called with the lock held.
+ */
+static
+void wait_events(struct bt_callback_workers *w,
+		struct ctf_stream_definition *stream)
+{
+	unsigned long i, end = w->tail;
+
+	for (i = w->tail; i != w->head; i++) {
+		if (!stream || w->ring[i % BT_CALLBACK_RING_SIZE].stream == stream)
+			end = i + 1;
+	}
+	for (;;) {
+		retire_events(w);
+		if ((long) (end - w->tail) <= 0)
+			break;
+		pthread_cond_wait(&w->done_cond, &w->lock);
+	}
+}
+
+void wait_callback_workers(struct bt_iter *iter,
+		struct ctf_file_stream *file_stream)
+{
+	struct bt_callback_workers *w;
+
+	w = container_of(iter, struct bt_ctf_iter, parent)->workers;
+	if (!w)
+		return;
+	pthread_mutex_lock(&w->lock);
+	wait_events(w, file_stream ? &file_stream->parent : NULL);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/*
+ * Hand the chains of an event off to the workers, and return to
+ * decoding. The event definitions stay valid until its stream is read
+ * again, which waits for the event through wait_callback_workers(), so
+ * the workers run a batch of events, one per stream at most, while the
+ * iterator decodes the next ones. The ring bounds the events in flight.
+ */
+static
+void run_parallel(struct bt_callback_workers *w, struct bt_callback_chain *bt_chain,
+		struct bt_ctf_event *ctf_data, struct ctf_stream_definition *stream)
+{
+	struct bt_callback_event *ev;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		retire_events(w);
+		if (w->head - w->tail < BT_CALLBACK_RING_SIZE)
+			break;
+		pthread_cond_wait(&w->done_cond, &w->lock);
+	}
+	ev = &w->ring[w->head % BT_CALLBACK_RING_SIZE];
+	ev->dispatch = bt_chain->dispatch;
+	ev->nr_groups = bt_chain->nr_groups;
+	ev->event = ctf_data->parent;
+	ev->stream = stream;
+	ev->pending = w->nr_threads;
+	ev->stop = 0;
+	w->head++;
+	pthread_cond_broadcast(&w->work_cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+void stop_callback_workers(struct bt_ctf_iter *iter)
+{
+	struct bt_callback_workers *w = iter->workers;
+	int i;
+
+	if (!w)
+		return;
+	iter->parent.wait_stream = NULL;
+	pthread_mutex_lock(&w->lock);
+	w->quit = 1;
+	pthread_cond_broadcast(&w->work_cond);
+	pthread_mutex_unlock(&w->lock);
+	for (i = 0; i < w->nr_threads; i++)
+		pthread_join(w->threads[i].thread, NULL);
+	pthread_cond_destroy(&w->done_cond);
+	pthread_cond_destroy(&w->work_cond);
+	pthread_mutex_destroy(&w->lock);
+	g_free(w->threads);
+	g_free(w);
+	iter->workers = NULL;
+}
+
+int bt_ctf_iter_set_callback_threads(struct bt_ctf_iter *iter,
+		int nr_threads)
+{
+	struct bt_callback_workers *w;
+	int i, ret;
+
+	if (!iter || nr_threads < 0)
+		return -EINVAL;
+	stop_callback_workers(iter);
+	if (!nr_threads)
+		return 0;
+
+	w = g_new0(struct bt_callback_workers, 1);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->work_cond, NULL);
+	pthread_cond_init(&w->done_cond, NULL);
+	w->threads = g_new0(struct bt_callback_worker, nr_threads);
+	iter->workers = w;
+	for (i = 0; i < nr_threads; i++) {
+		w->threads[i].workers = w;
+		w->threads[i].index = i;
+		ret = pthread_create(&w->threads[i].thread, NULL,
+				callback_worker_thread, &w->threads[i]);
+		if (ret) {
+			fprintf(stderr, "[error] Unable to create callback thread: %s.\n",
+				strerror(ret));
+			stop_callback_workers(iter);
+			return -ret;
+		}
+		w->nr_threads++;
+	}
+	iter->parent.wait_stream = wait_callback_workers;
+	return 0;
+}
+
 void process_callbacks(struct bt_ctf_iter *iter,
 		       struct ctf_stream_definition *stream)
 {
 	struct bt_stream_callbacks *bt_stream_cb;
-	struct bt_callback_chain *bt_chain;
+	struct bt_callback_chain *bt_chain = NULL;
 	struct bt_callback *cb;
+	GArray *dispatch;
 	int i;
 	enum bt_cb_ret ret;
 	struct bt_ctf_event ctf_data;
 
 	assert(iter && stream);
 
+	if (iter->recalculate_dep_graph) {
+		/* Posted events use the current dispatch arrays. */
+		wait_callback_workers(&iter->parent, NULL);
+		calculate_dep_graph(iter);
+	}
+
 	ret = extract_ctf_stream_event(stream, &ctf_data);
 	if (ret)
 		goto end;
 
-	/* process all events callback first */
-	if (iter->main_callbacks.callback) {
-		for (i = 0; i < iter->main_callbacks.callback->len; i++) {
-			cb = &g_array_index(iter->main_callbacks.callback, struct bt_callback, i);
-			if (!cb)
-				goto end;
-			ret = cb->callback(&ctf_data, cb->private_data);
-			switch (ret) {
-			case BT_CB_OK_STOP:
-			case BT_CB_ERROR_STOP:
-				goto end;
-			default:
-				break;
-			}
-		}
+	/*
+	 * Events with callbacks of their own have a dispatch array
+	 * including the callbacks for all events.
+	 */
+	if (stream->stream_id < iter->callbacks->len) {
+		bt_stream_cb = &g_array_index(iter->callbacks,
+				struct bt_stream_callbacks, stream->stream_id);
+		if (bt_stream_cb->per_id_callbacks
+				&& stream->event_id < bt_stream_cb->per_id_callbacks->len)
+			bt_chain = &g_array_index(bt_stream_cb->per_id_callbacks,
+					struct bt_callback_chain, stream->event_id);
 	}
-
-	/* process per event callbacks */
-	bt_stream_cb = &g_array_index(iter->callbacks,
-			struct bt_stream_callbacks, stream->stream_id);
-	if (!bt_stream_cb || !bt_stream_cb->per_id_callbacks)
+	if (!bt_chain || !bt_chain->dispatch)
+		bt_chain = &iter->main_callbacks;
+	dispatch = bt_chain->dispatch;
+	if (!dispatch)
 		goto end;
 
-	if (stream->event_id >= bt_stream_cb->per_id_callbacks->len)
-		goto end;
-	bt_chain = &g_array_index(bt_stream_cb->per_id_callbacks,
-			struct bt_callback_chain, stream->event_id);
-	if (!bt_chain || !bt_chain->callback)
+	if (iter->workers) {
+		run_parallel(iter->workers, bt_chain, &ctf_data, stream);
 		goto end;
+	}
 
-	for (i = 0; i < bt_chain->callback->len; i++) {
-		cb = &g_array_index(bt_chain->callback, struct bt_callback, i);
+	for (i = 0; i < dispatch->len; i++) {
+		cb = &g_array_index(dispatch, struct bt_callback, i);
 		ret = cb->callback(&ctf_data, cb->private_data);
 		switch (ret) {
 		case BT_CB_OK_STOP:
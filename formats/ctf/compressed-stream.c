@@ -0,0 +1,669 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Stream files compressed in packet-aligned frames.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/compressed-stream.h>
+#include <babeltrace/list.h>
+#include <babeltrace/endian.h>
+#include <pthread.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#ifndef min
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+/* Read-ahead state of the ahead buffer, protected by helper_lock. */
+enum ahead_state {
+	AHEAD_IDLE,		/* holds a decompressed frame, or none */
+	AHEAD_QUEUED,		/* compressed frame waiting for the helper */
+	AHEAD_RUNNING,		/* being decompressed by the helper */
+};
+
+struct frame_buf {
+	int64_t frame;		/* frame held, -1 if none */
+	char *data;		/* decompressed frame */
+	size_t data_alloc;
+	char *comp;		/* compressed frame */
+	size_t comp_alloc;
+};
+
+struct ctf_cstream {
+	uint32_t codec;
+	uint64_t raw_size;
+	uint64_t nr_frames;
+	struct ctf_cstream_frame *frames;	/* host byte order */
+
+	struct frame_buf bufs[2];
+	struct frame_buf *cur;		/* frame being read */
+	struct frame_buf *ahead;	/* next frame, decompressed ahead */
+	enum ahead_state ahead_state;
+	int ahead_ret;			/* helper decompression result */
+	struct bt_list_head job_node;	/* node in the helper queue */
+
+	char *scratch;			/* for ranges spanning frames */
+	size_t scratch_alloc;
+};
+
+/*
+ * A single helper thread serves the read-ahead requests of all streams,
+ * which only need one frame ahead each. Compressed data is read by the
+ * requesting thread, so the helper never touches stream fds, which the
+ * stream cache may close at any time. The helper is started by the
+ * first read-ahead and joined when the last stream is closed.
+ */
+static pthread_mutex_t helper_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t helper_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static BT_LIST_HEAD(helper_queue);
+static int helper_stop;		/* protected by helper_lock */
+
+/* Helper lifetime, protected by start_lock, taken before helper_lock. */
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static int helper_state;	/* 0: not started, 1: running, -1: failed */
+static pthread_t helper;
+static unsigned long nr_cstreams;	/* open compressed streams */
+
+static
+int pread_full(int fd, void *buf, size_t len, off_t offset)
+{
+	while (len) {
+		ssize_t ret;
+
+		ret = pread(fd, buf, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret ? -errno : -EIO;
+		buf = (char *) buf + ret;
+		offset += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static
+int pwrite_full(int fd, const void *buf, size_t len, off_t offset)
+{
+	while (len) {
+		ssize_t ret;
+
+		ret = pwrite(fd, buf, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -errno;
+		buf = (const char *) buf + ret;
+		offset += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static
+int reserve(char **buf, size_t *alloc, size_t len)
+{
+	char *newbuf;
+
+	if (*alloc >= len)
+		return 0;
+	newbuf = realloc(*buf, len);
+	if (!newbuf)
+		return -ENOMEM;
+	*buf = newbuf;
+	*alloc = len;
+	return 0;
+}
+
+/* Index of the frame holding raw offset. */
+static
+uint64_t find_frame(struct ctf_cstream *cs, uint64_t offset)
+{
+	uint64_t low = 0, high = cs->nr_frames - 1;
+
+	while (low < high) {
+		uint64_t mid = low + (high - low + 1) / 2;
+
+		if (cs->frames[mid].raw_offset <= offset)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
+}
+
+/* Read the compressed data of frame k into buf. */
+static
+int read_frame(struct ctf_cstream *cs, int fd, struct frame_buf *buf,
+		uint64_t k)
+{
+	struct ctf_cstream_frame *frame = &cs->frames[k];
+	int ret;
+
+	buf->frame = -1;
+	ret = reserve(&buf->comp, &buf->comp_alloc, frame->comp_len);
+	if (ret)
+		return ret;
+	ret = pread_full(fd, buf->comp, frame->comp_len, frame->comp_offset);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to read compressed stream frame: %s.\n",
+			strerror(-ret));
+		return ret;
+	}
+	buf->frame = k;
+	return 0;
+}
+
+/* Decompress the frame read into buf. Called by the helper thread. */
+static
+int inflate_frame(struct ctf_cstream *cs, struct frame_buf *buf)
+{
+	struct ctf_cstream_frame *frame = &cs->frames[buf->frame];
+	int ret;
+
+	ret = reserve(&buf->data, &buf->data_alloc, frame->raw_len);
+	if (ret)
+		return ret;
+#ifdef HAVE_LIBZ
+	{
+		uLongf len = frame->raw_len;
+
+		ret = uncompress((Bytef *) buf->data, &len,
+				(const Bytef *) buf->comp, frame->comp_len);
+		if (ret == Z_OK && len == frame->raw_len)
+			return 0;
+	}
+#endif
+	fprintf(stderr, "[error] Corrupted compressed stream frame at offset %" PRIu64 ".\n",
+		frame->comp_offset);
+	return -EIO;
+}
+
+static
+void *helper_thread(void *arg)
+{
+	struct ctf_cstream *cs;
+	int ret;
+
+	pthread_mutex_lock(&helper_lock);
+	for (;;) {
+		while (bt_list_empty(&helper_queue) && !helper_stop)
+			pthread_cond_wait(&helper_cond, &helper_lock);
+		if (helper_stop)
+			break;
+		cs = bt_list_entry(helper_queue.next, struct ctf_cstream,
+				job_node);
+		bt_list_del(&cs->job_node);
+		cs->ahead_state = AHEAD_RUNNING;
+		pthread_mutex_unlock(&helper_lock);
+		ret = inflate_frame(cs, cs->ahead);
+		pthread_mutex_lock(&helper_lock);
+		cs->ahead_ret = ret;
+		cs->ahead_state = AHEAD_IDLE;
+		pthread_cond_broadcast(&done_cond);
+	}
+	pthread_mutex_unlock(&helper_lock);
+	return NULL;
+}
+
+static
+int start_helper(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&start_lock);
+	if (!helper_state) {
+		helper_stop = 0;
+		helper_state = pthread_create(&helper, NULL, helper_thread,
+				NULL) ? -1 : 1;
+	}
+	ret = helper_state < 0;
+	pthread_mutex_unlock(&start_lock);
+	return ret;
+}
+
+/*
+ * Join the helper. Called with start_lock held once no stream is left,
+ * so that no read-ahead is queued or running.
+ */
+static
+void stop_helper(void)
+{
+	if (helper_state <= 0) {
+		helper_state = 0;
+		return;
+	}
+	pthread_mutex_lock(&helper_lock);
+	helper_stop = 1;
+	pthread_cond_signal(&helper_cond);
+	pthread_mutex_unlock(&helper_lock);
+	pthread_join(helper, NULL);
+	helper_state = 0;
+}
+
+/*
+ * Wait for the read-ahead of the stream to complete. A queued request
+ * is decompressed by the caller, or dropped if cancel is set. The
+ * ahead buffer holds no frame if decompression failed.
+ */
+static
+void ahead_wait(struct ctf_cstream *cs, int cancel)
+{
+	int queued = 0;
+
+	pthread_mutex_lock(&helper_lock);
+	if (cs->ahead_state == AHEAD_QUEUED) {
+		bt_list_del(&cs->job_node);
+		cs->ahead_state = AHEAD_IDLE;
+		queued = 1;
+	}
+	while (cs->ahead_state == AHEAD_RUNNING)
+		pthread_cond_wait(&done_cond, &helper_lock);
+	pthread_mutex_unlock(&helper_lock);
+	if (queued)
+		cs->ahead_ret = cancel ? -ECANCELED : inflate_frame(cs, cs->ahead);
+	if (cs->ahead_ret)
+		cs->ahead->frame = -1;
+	cs->ahead_ret = 0;
+}
+
+/* Queue frame k for decompression ahead of its use. */
+static
+void prefetch(struct ctf_cstream *cs, int fd, uint64_t k)
+{
+	if (k >= cs->nr_frames || cs->cur->frame == k
+			|| cs->ahead->frame == k)
+		return;
+	if (start_helper())
+		return;
+	ahead_wait(cs, 1);
+	if (read_frame(cs, fd, cs->ahead, k))
+		return;
+	pthread_mutex_lock(&helper_lock);
+	cs->ahead_state = AHEAD_QUEUED;
+	bt_list_add_tail(&cs->job_node, &helper_queue);
+	pthread_cond_signal(&helper_cond);
+	pthread_mutex_unlock(&helper_lock);
+}
+
+/* Make frame k the current frame. */
+static
+int get_frame(struct ctf_cstream *cs, int fd, uint64_t k)
+{
+	int ret;
+
+	if (cs->cur->frame == k)
+		return 0;
+	if (cs->ahead->frame == k) {
+		ahead_wait(cs, 0);
+		if (cs->ahead->frame == k) {
+			struct frame_buf *tmp = cs->cur;
+
+			cs->cur = cs->ahead;
+			cs->ahead = tmp;
+			return 0;
+		}
+	}
+	ret = read_frame(cs, fd, cs->cur, k);
+	if (ret)
+		return ret;
+	ret = inflate_frame(cs, cs->cur);
+	if (ret)
+		cs->cur->frame = -1;
+	return ret;
+}
+
+/*
+ * Copy a raw range into buf, frame by frame. Returns the index of the
+ * last frame copied, or a negative error value.
+ */
+static
+int64_t copy_raw(struct ctf_cstream *cs, int fd, char *buf,
+		uint64_t offset, size_t len)
+{
+	uint64_t k = find_frame(cs, offset);
+
+	for (;;) {
+		struct ctf_cstream_frame *frame = &cs->frames[k];
+		size_t frame_pos = offset - frame->raw_offset, copy_len;
+		int ret;
+
+		ret = get_frame(cs, fd, k);
+		if (ret)
+			return ret;
+		copy_len = min(len, frame->raw_len - frame_pos);
+		memcpy(buf, cs->cur->data + frame_pos, copy_len);
+		buf += copy_len;
+		offset += copy_len;
+		len -= copy_len;
+		if (!len)
+			return k;
+		k++;
+	}
+}
+
+int ctf_cstream_open(int fd, struct ctf_cstream **csp)
+{
+	struct ctf_cstream_header header;
+	struct ctf_cstream *cs;
+	uint64_t i, raw_offset = 0;
+	ssize_t len;
+	int ret;
+
+	*csp = NULL;
+	len = pread(fd, &header, sizeof(header), 0);
+	if (len < 0)
+		return -errno;
+	if (len < sizeof(header)
+			|| memcmp(header.magic, CTF_CSTREAM_MAGIC, CTF_CSTREAM_MAGIC_LEN))
+		return 0;
+	if (le32toh(header.version) != CTF_CSTREAM_VERSION) {
+		fprintf(stderr, "[error] Unsupported compressed stream version %u.\n",
+			le32toh(header.version));
+		return -EINVAL;
+	}
+#ifndef HAVE_LIBZ
+	fprintf(stderr, "[error] Babeltrace was built without zlib support, unable to read compressed streams.\n");
+	return -ENOTSUP;
+#endif
+	if (le32toh(header.codec) != CTF_CSTREAM_CODEC_ZLIB) {
+		fprintf(stderr, "[error] Unsupported compressed stream codec %u.\n",
+			le32toh(header.codec));
+		return -EINVAL;
+	}
+
+	cs = calloc(1, sizeof(*cs));
+	if (!cs)
+		return -ENOMEM;
+	cs->codec = le32toh(header.codec);
+	cs->raw_size = le64toh(header.raw_size);
+	cs->nr_frames = le64toh(header.nr_frames);
+	cs->cur = &cs->bufs[0];
+	cs->ahead = &cs->bufs[1];
+	cs->cur->frame = cs->ahead->frame = -1;
+	BT_INIT_LIST_HEAD(&cs->job_node);
+	ret = -EINVAL;
+	if (!cs->nr_frames || cs->nr_frames > SIZE_MAX / sizeof(*cs->frames))
+		goto error;
+	cs->frames = malloc(cs->nr_frames * sizeof(*cs->frames));
+	if (!cs->frames) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	ret = pread_full(fd, cs->frames, cs->nr_frames * sizeof(*cs->frames),
+			le64toh(header.table_offset));
+	if (ret)
+		goto error;
+	for (i = 0; i < cs->nr_frames; i++) {
+		struct ctf_cstream_frame *frame = &cs->frames[i];
+
+		frame->raw_offset = le64toh(frame->raw_offset);
+		frame->comp_offset = le64toh(frame->comp_offset);
+		frame->raw_len = le32toh(frame->raw_len);
+		frame->comp_len = le32toh(frame->comp_len);
+		if (frame->raw_offset != raw_offset || !frame->raw_len) {
+			ret = -EINVAL;
+			goto error;
+		}
+		raw_offset += frame->raw_len;
+	}
+	if (raw_offset != cs->raw_size) {
+		ret = -EINVAL;
+		goto error;
+	}
+	pthread_mutex_lock(&start_lock);
+	nr_cstreams++;
+	pthread_mutex_unlock(&start_lock);
+	*csp = cs;
+	return 0;
+
+error:
+	fprintf(stderr, "[error] Invalid compressed stream frame table: %s.\n",
+		strerror(-ret));
+	free(cs->frames);
+	free(cs);
+	return ret;
+}
+
+void ctf_cstream_release(struct ctf_cstream *cs)
+{
+	int i;
+
+	ahead_wait(cs, 1);
+	for (i = 0; i < 2; i++) {
+		struct frame_buf *buf = &cs->bufs[i];
+
+		free(buf->data);
+		free(buf->comp);
+		memset(buf, 0, sizeof(*buf));
+		buf->frame = -1;
+	}
+	free(cs->scratch);
+	cs->scratch = NULL;
+	cs->scratch_alloc = 0;
+}
+
+void ctf_cstream_close(struct ctf_cstream *cs)
+{
+	ctf_cstream_release(cs);
+	free(cs->frames);
+	free(cs);
+	pthread_mutex_lock(&start_lock);
+	if (!--nr_cstreams)
+		stop_helper();
+	pthread_mutex_unlock(&start_lock);
+}
+
+uint64_t ctf_cstream_raw_size(struct ctf_cstream *cs)
+{
+	return cs->raw_size;
+}
+
+struct mmap_align *ctf_cstream_map(struct ctf_cstream *cs, int fd,
+		off_t offset, size_t len)
+{
+	struct ctf_cstream_frame *frame;
+	struct mmap_align *mma;
+	int64_t k;
+	char *addr;
+	int ret;
+
+	if (offset < 0 || offset >= cs->raw_size) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+	len = min(len, cs->raw_size - offset);
+	mma = malloc(sizeof(*mma));
+	if (!mma) {
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+	k = find_frame(cs, offset);
+	frame = &cs->frames[k];
+	if (offset + len <= frame->raw_offset + frame->raw_len) {
+		/* Packets never span frames: point into the frame. */
+		ret = get_frame(cs, fd, k);
+		addr = cs->cur->data + (offset - frame->raw_offset);
+	} else {
+		/* Only packet index windows may span frames: copy. */
+		ret = reserve(&cs->scratch, &cs->scratch_alloc, len);
+		if (!ret) {
+			k = copy_raw(cs, fd, cs->scratch, offset, len);
+			ret = k < 0 ? k : 0;
+		}
+		addr = cs->scratch;
+	}
+	if (ret) {
+		free(mma);
+		errno = -ret;
+		return MAP_FAILED;
+	}
+	prefetch(cs, fd, k + 1);
+	mma->page_aligned_addr = NULL;
+	mma->page_aligned_length = 0;
+	mma->length = len;
+	mmap_align_set_addr(mma, addr);
+	return mma;
+}
+
+void ctf_cstream_unmap(struct ctf_cstream *cs, struct mmap_align *mma)
+{
+	free(mma);
+}
+
+int ctf_cstream_pread(struct ctf_cstream *cs, int fd, void *buf,
+		size_t len, off_t offset)
+{
+	int64_t ret;
+
+	if (!len)
+		return 0;
+	if (offset < 0 || offset + len > cs->raw_size)
+		return -EINVAL;
+	ret = copy_raw(cs, fd, buf, offset, len);
+	return ret < 0 ? ret : 0;
+}
+
+#ifdef HAVE_LIBZ
+/* Compress raw range [raw_offset, raw_offset + raw_len) as one frame. */
+static
+int compress_frame(int in_fd, int out_fd, struct ctf_cstream_frame *frame,
+		uint64_t raw_offset, uint64_t raw_len, off_t *out_offset,
+		char **raw, size_t *raw_alloc, char **comp, size_t *comp_alloc)
+{
+	uLongf comp_len;
+	int ret;
+
+	if (raw_len > UINT32_MAX)
+		return -EFBIG;
+	comp_len = compressBound(raw_len);
+	ret = reserve(raw, raw_alloc, raw_len);
+	if (!ret)
+		ret = reserve(comp, comp_alloc, comp_len);
+	if (ret)
+		return ret;
+	ret = pread_full(in_fd, *raw, raw_len, raw_offset);
+	if (ret)
+		return ret;
+	if (compress2((Bytef *) *comp, &comp_len, (const Bytef *) *raw,
+			raw_len, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return -EIO;
+	if (comp_len > UINT32_MAX)
+		return -EFBIG;
+	ret = pwrite_full(out_fd, *comp, comp_len, *out_offset);
+	if (ret)
+		return ret;
+	frame->raw_offset = htole64(raw_offset);
+	frame->comp_offset = htole64(*out_offset);
+	frame->raw_len = htole32(raw_len);
+	frame->comp_len = htole32(comp_len);
+	*out_offset += comp_len;
+	return 0;
+}
+
+int ctf_cstream_compress(int in_fd, uint64_t raw_size,
+		struct ctf_packet_index *index, int out_fd)
+{
+	struct ctf_cstream_header header;
+	struct ctf_cstream_frame *frames = NULL, *newframes;
+	size_t nr_frames = 0, frames_alloc = 0, i, len;
+	char *raw = NULL, *comp = NULL;
+	size_t raw_alloc = 0, comp_alloc = 0;
+	uint64_t frame_start = 0;
+	off_t out_offset = sizeof(header);
+	int ret = 0;
+
+	ctf_packet_index_complete(index);
+	len = ctf_packet_index_len(index);
+	/* Cut a frame before each packet once it holds enough data. */
+	for (i = 0; i <= len; i++) {
+		uint64_t frame_end;
+
+		if (i < len) {
+			struct packet_index packet;
+
+			ctf_packet_index_get(index, i, &packet);
+			frame_end = packet.offset;
+			if (frame_end - frame_start < CTF_CSTREAM_FRAME_LEN)
+				continue;
+		} else {
+			frame_end = raw_size;
+		}
+		if (frame_end <= frame_start)
+			continue;
+		if (nr_frames == frames_alloc) {
+			frames_alloc = frames_alloc ? 2 * frames_alloc : 64;
+			newframes = realloc(frames, frames_alloc * sizeof(*frames));
+			if (!newframes) {
+				ret = -ENOMEM;
+				goto end;
+			}
+			frames = newframes;
+		}
+		ret = compress_frame(in_fd, out_fd, &frames[nr_frames],
+				frame_start, frame_end - frame_start,
+				&out_offset, &raw, &raw_alloc, &comp, &comp_alloc);
+		if (ret)
+			goto end;
+		nr_frames++;
+		frame_start = frame_end;
+	}
+	if (!nr_frames) {
+		ret = -EINVAL;
+		goto end;
+	}
+	ret = pwrite_full(out_fd, frames, nr_frames * sizeof(*frames),
+			out_offset);
+	if (ret)
+		goto end;
+	memcpy(header.magic, CTF_CSTREAM_MAGIC, CTF_CSTREAM_MAGIC_LEN);
+	header.version = htole32(CTF_CSTREAM_VERSION);
+	header.codec = htole32(CTF_CSTREAM_CODEC_ZLIB);
+	header.raw_size = htole64(raw_size);
+	header.nr_frames = htole64(nr_frames);
+	header.table_offset = htole64(out_offset);
+	ret = pwrite_full(out_fd, &header, sizeof(header), 0);
+end:
+	free(frames);
+	free(raw);
+	free(comp);
+	return ret;
+}
+#else /* HAVE_LIBZ */
+int ctf_cstream_compress(int in_fd, uint64_t raw_size,
+		struct ctf_packet_index *index, int out_fd)
+{
+	fprintf(stderr, "[error] Babeltrace was built without zlib support.\n");
+	return -ENOSYS;
+}
+#endif /* HAVE_LIBZ */
@@ -0,0 +1,169 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CRC32C (Castagnoli) checksums.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/crc32c.h>
+#include <babeltrace/endian.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__GNUC__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HAVE_CRC32C_ARMV8
+#endif
+
+#define CRC32C_POLY	0x82F63B78	/* reflected */
+
+/* Slicing-by-8 tables, built at load time. */
+static uint32_t crc32c_table[8][256];
+
+static
+uint32_t (*crc32c_impl)(uint32_t crc, const unsigned char *p, size_t len);
+
+static
+uint32_t crc32c_table_update(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len && ((uintptr_t) p & 7)) {
+		crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t v;
+
+		memcpy(&v, p, sizeof(v));
+#if (BYTE_ORDER == BIG_ENDIAN)
+		v = __builtin_bswap64(v);
+#endif
+		v ^= crc;
+		crc = crc32c_table[7][v & 0xFF]
+			^ crc32c_table[6][(v >> 8) & 0xFF]
+			^ crc32c_table[5][(v >> 16) & 0xFF]
+			^ crc32c_table[4][(v >> 24) & 0xFF]
+			^ crc32c_table[3][(v >> 32) & 0xFF]
+			^ crc32c_table[2][(v >> 40) & 0xFF]
+			^ crc32c_table[1][(v >> 48) & 0xFF]
+			^ crc32c_table[0][v >> 56];
+		p += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+static __attribute__((target("sse4.2")))
+uint32_t crc32c_hw_update(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t crc64;
+
+	while (len && ((uintptr_t) p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	crc64 = crc;
+	while (len >= 8) {
+		crc64 = _mm_crc32_u64(crc64, *(const uint64_t *) p);
+		p += 8;
+		len -= 8;
+	}
+	crc = crc64;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+static
+int crc32c_hw_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+#endif /* HAVE_CRC32C_SSE42 */
+
+#ifdef HAVE_CRC32C_ARMV8
+static __attribute__((target("+crc")))
+uint32_t crc32c_hw_update(uint32_t crc, const unsigned char *p, size_t len)
+{
+	while (len && ((uintptr_t) p & 7)) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		crc = __crc32cd(crc, *(const uint64_t *) p);
+		p += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+
+static
+int crc32c_hw_supported(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+}
+#endif /* HAVE_CRC32C_ARMV8 */
+
+static
+void __attribute__((constructor)) crc32c_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+		crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+			crc32c_table[j][i] = crc;
+		}
+	}
+	crc32c_impl = crc32c_table_update;
+#if defined(HAVE_CRC32C_SSE42) || defined(HAVE_CRC32C_ARMV8)
+	if (crc32c_hw_supported())
+		crc32c_impl = crc32c_hw_update;
+#endif
+}
+
+uint32_t ctf_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	return ~crc32c_impl(~crc, buf, len);
+}
+
+uint32_t ctf_crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	return ~crc32c_table_update(~crc, buf, len);
+}
@@ -31,6 +31,12 @@
 #include <babeltrace/ctf/metadata.h>
 #include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/ctf/stream-cache.h>
+#include <babeltrace/ctf/compressed-stream.h>
+#include <babeltrace/ctf/io-uring.h>
+#include <babeltrace/ctf/lazy-index.h>
+#include <babeltrace/ctf/crc32c.h>
+#include <babeltrace/ctf/writer-internal.h>
 #include <babeltrace/trace-handle-internal.h>
 #include <babeltrace/context-internal.h>
 #include <babeltrace/compat/uuid.h>
@@ -46,12 +52,12 @@
 #include <glib.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "metadata/ctf-scanner.h"
 #include "metadata/ctf-parser.h"
 #include "metadata/ctf-ast.h"
 #include "events-private.h"
-#include <babeltrace/compat/memstream.h>
 
 #define LOG2_CHAR_BIT	3
 
@@ -69,6 +75,10 @@
 #define min(a, b)	(((a) < (b)) ? (a) : (b))
 #endif
 
+#ifndef max
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#endif
+
 #define NSEC_PER_SEC 1000000000ULL
 
 int opt_clock_cycles,
@@ -79,8 +89,17 @@ int opt_clock_cycles,
 uint64_t opt_clock_offset;
 uint64_t opt_clock_offset_ns;
 
+int opt_verify;
+int opt_follow;
+GArray *opt_index_fields;
+
 extern int yydebug;
 
+void bt_ctf_set_follow(int enable)
+{
+	opt_follow = enable;
+}
+
 static
 struct bt_trace_descriptor *ctf_open_trace(const char *path, int flags,
 		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
@@ -109,6 +128,11 @@ uint64_t ctf_timestamp_end(struct bt_trace_descriptor *descriptor,
 		struct bt_trace_handle *handle, enum bt_clock_type type);
 static
 int ctf_convert_index_timestamp(struct bt_trace_descriptor *tdp);
+static
+int ctf_update_trace(struct bt_trace_descriptor *tdp);
+static
+int create_trace_definitions(struct ctf_trace *td,
+		struct ctf_stream_definition *stream);
 
 static
 rw_dispatch read_dispatch_table[] = {
@@ -144,6 +168,7 @@ struct bt_format ctf_format = {
 	.timestamp_begin = ctf_timestamp_begin,
 	.timestamp_end = ctf_timestamp_end,
 	.convert_index_timestamp = ctf_convert_index_timestamp,
+	.update_trace = ctf_update_trace,
 };
 
 static
@@ -171,33 +196,29 @@ uint64_t ctf_timestamp_begin(struct bt_trace_descriptor *descriptor,
 			struct ctf_stream_definition *stream;
 			struct ctf_file_stream *cfs;
 			struct ctf_stream_pos *stream_pos;
-			struct packet_index *index;
+			uint64_t timestamp;
 
 			stream = g_ptr_array_index(stream_class->streams, j);
 			cfs = container_of(stream, struct ctf_file_stream,
 					parent);
 			stream_pos = &cfs->pos;
 
-			if (!stream_pos->packet_real_index)
+			if (!stream_pos->packet_index)
 				goto error;
 
-			if (stream_pos->packet_real_index->len <= 0)
+			if (ctf_packet_index_len(stream_pos->packet_index) <= 0)
 				continue;
 
+			timestamp = ctf_packet_index_timestamp_begin(
+					stream_pos->packet_index, 0);
 			if (type == BT_CLOCK_REAL) {
-				index = &g_array_index(stream_pos->packet_real_index,
-						struct packet_index,
-						stream_pos->packet_real_index->len - 1);
-			} else if (type == BT_CLOCK_CYCLES) {
-				index = &g_array_index(stream_pos->packet_cycles_index,
-						struct packet_index,
-						stream_pos->packet_real_index->len - 1);
-
-			} else {
+				timestamp = ctf_get_real_timestamp(stream,
+						timestamp);
+			} else if (type != BT_CLOCK_CYCLES) {
 				goto error;
 			}
-			if (index->timestamp_begin < begin)
-				begin = index->timestamp_begin;
+			if (timestamp < begin)
+				begin = timestamp;
 		}
 	}
 
@@ -232,33 +253,32 @@ uint64_t ctf_timestamp_end(struct bt_trace_descriptor *descriptor,
 			struct ctf_stream_definition *stream;
 			struct ctf_file_stream *cfs;
 			struct ctf_stream_pos *stream_pos;
-			struct packet_index *index;
+			uint64_t timestamp;
+			size_t len;
 
 			stream = g_ptr_array_index(stream_class->streams, j);
 			cfs = container_of(stream, struct ctf_file_stream,
 					parent);
 			stream_pos = &cfs->pos;
 
-			if (!stream_pos->packet_real_index)
+			if (!stream_pos->packet_index)
 				goto error;
 
-			if (stream_pos->packet_real_index->len <= 0)
+			ctf_packet_index_complete(stream_pos->packet_index);
+			len = ctf_packet_index_len(stream_pos->packet_index);
+			if (len <= 0)
 				continue;
 
+			timestamp = ctf_packet_index_timestamp_end(
+					stream_pos->packet_index, len - 1);
 			if (type == BT_CLOCK_REAL) {
-				index = &g_array_index(stream_pos->packet_real_index,
-						struct packet_index,
-						stream_pos->packet_real_index->len - 1);
-			} else if (type == BT_CLOCK_CYCLES) {
-				index = &g_array_index(stream_pos->packet_cycles_index,
-						struct packet_index,
-						stream_pos->packet_real_index->len - 1);
-
-			} else {
+				timestamp = ctf_get_real_timestamp(stream,
+						timestamp);
+			} else if (type != BT_CLOCK_CYCLES) {
 				goto error;
 			}
-			if (index->timestamp_end > end)
-				end = index->timestamp_end;
+			if (timestamp > end)
+				end = timestamp;
 		}
 	}
 
@@ -443,6 +463,165 @@ void ctf_print_discarded(FILE *fp, struct ctf_stream_definition *stream,
 	fflush(fp);
 }
 
+struct definition_integer *ctf_stream_lookup_integer(struct ctf_stream_definition *stream,
+		GQuark name, int *scope)
+{
+	struct definition_struct *scopes[] = {
+		stream->stream_packet_context,
+		stream->stream_event_context,
+	};
+	const int scope_ids[] = {
+		BT_STREAM_PACKET_CONTEXT,
+		BT_STREAM_EVENT_CONTEXT,
+	};
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct bt_definition *field;
+		int index;
+
+		if (!scopes[i])
+			continue;
+		index = bt_struct_declaration_lookup_field_index(scopes[i]->declaration,
+				name);
+		if (index < 0)
+			continue;
+		field = bt_struct_definition_get_field_from_index(scopes[i], index);
+		if (field->declaration->id != CTF_TYPE_INTEGER)
+			return NULL;
+		*scope = scope_ids[i];
+		return container_of(field, struct definition_integer, p);
+	}
+	return NULL;
+}
+
+static
+int stream_add_field_column(struct ctf_file_stream *file_stream, GQuark name)
+{
+	struct ctf_packet_index *index = file_stream->pos.packet_index;
+	int scope = -1, column;
+
+	ctf_stream_lookup_integer(&file_stream->parent, name, &scope);
+	column = ctf_packet_index_add_field(index, name, scope);
+	if (scope < 0) {
+		struct packet_field_range empty = PACKET_FIELD_RANGE_EMPTY;
+		size_t i;
+
+		/* No event of the stream has this field. */
+		for (i = 0; i < ctf_packet_index_len(index); i++)
+			*ctf_packet_index_field_range(index, column, i) = empty;
+	}
+	return column;
+}
+
+int ctf_stream_index_field(struct ctf_file_stream *file_stream, GQuark name)
+{
+	int i;
+
+	if (!file_stream->pos.packet_index)
+		return -1;
+	for (i = 0; opt_index_fields && i < opt_index_fields->len; i++)
+		stream_add_field_column(file_stream,
+			g_array_index(opt_index_fields, GQuark, i));
+	if (!name)
+		return -1;
+	return stream_add_field_column(file_stream, name);
+}
+
+/*
+ * Set the packet context field ranges of packet i from the packet
+ * context just read.
+ */
+static
+void stream_set_packet_fields(struct ctf_file_stream *file_stream, size_t i)
+{
+	struct ctf_packet_index *index = file_stream->pos.packet_index;
+	int column;
+
+	for (column = 0; column < index->fields->len; column++) {
+		struct packet_field_range range = PACKET_FIELD_RANGE_EMPTY;
+		struct definition_integer *integer;
+		int scope;
+
+		if (ctf_packet_index_field(index, column)->scope
+				!= BT_STREAM_PACKET_CONTEXT)
+			continue;
+		integer = ctf_stream_lookup_integer(&file_stream->parent,
+				ctf_packet_index_field(index, column)->name, &scope);
+		if (integer)
+			packet_field_range_add(&range, ctf_integer_value(integer));
+		*ctf_packet_index_field_range(index, column, i) = range;
+	}
+}
+
+/*
+ * Start collecting the stream event context field ranges of a packet.
+ */
+static
+void stream_reset_field_acc(struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_pos *pos = &file_stream->pos;
+	struct ctf_packet_index *index = pos->packet_index;
+	struct packet_field_range empty = PACKET_FIELD_RANGE_EMPTY;
+	unsigned int i, nr = 0;
+
+	for (i = 0; i < index->fields->len; i++) {
+		if (ctf_packet_index_field(index, i)->scope
+				== BT_STREAM_EVENT_CONTEXT)
+			nr++;
+	}
+	if (!pos->field_acc)
+		pos->field_acc = g_array_new(FALSE, TRUE,
+				sizeof(struct ctf_field_acc));
+	if (pos->field_acc->len != nr) {
+		g_array_set_size(pos->field_acc, 0);
+		for (i = 0; i < index->fields->len; i++) {
+			struct packet_field_column *column;
+			struct ctf_field_acc acc;
+			int scope;
+
+			column = ctf_packet_index_field(index, i);
+			if (column->scope != BT_STREAM_EVENT_CONTEXT)
+				continue;
+			acc.column = i;
+			acc.def = ctf_stream_lookup_integer(&file_stream->parent,
+					column->name, &scope);
+			g_array_append_val(pos->field_acc, acc);
+		}
+	}
+	for (i = 0; i < pos->field_acc->len; i++)
+		g_array_index(pos->field_acc, struct ctf_field_acc, i).range = empty;
+}
+
+/*
+ * Return 0 if the index tells the current packet holds no event the
+ * iterator reads. Filters not set for the current metadata match any
+ * packet, until the iterator updates them.
+ */
+static
+int packet_may_match(struct ctf_stream_pos *pos)
+{
+	unsigned int i;
+
+	if (!pos->filters_set)
+		return 1;
+	if (pos->filter_events
+			&& !(ctf_packet_index_event_ids(pos->packet_index,
+					pos->cur_index) & pos->event_filter))
+		return 0;
+	for (i = 0; pos->field_filters && i < pos->field_filters->len; i++) {
+		struct ctf_field_filter *filter = &g_array_index(pos->field_filters,
+				struct ctf_field_filter, i);
+
+		if (!packet_field_range_may_match(
+				ctf_packet_index_field_range(pos->packet_index,
+					filter->column, pos->cur_index),
+				filter->min, filter->max))
+			return 0;
+	}
+	return 1;
+}
+
 static
 int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *stream)
 {
@@ -468,6 +647,11 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 	 */
 	if (unlikely(pos->offset == EOF))
 		return EOF;
+
+	/* The stream cache may have unmapped the packet since last read. */
+	ret = ctf_stream_cache_ensure_mapped(pos);
+	if (ret)
+		return ret;
 	assert(pos->offset < pos->content_size);
 
 	/* Read event header */
@@ -523,6 +707,18 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 		if (ret)
 			goto error;
 	}
+	if (pos->field_acc) {
+		unsigned int i;
+
+		for (i = 0; i < pos->field_acc->len; i++) {
+			struct ctf_field_acc *acc = &g_array_index(pos->field_acc,
+					struct ctf_field_acc, i);
+
+			if (acc->def)
+				packet_field_range_add(&acc->range,
+					ctf_integer_value(acc->def));
+		}
+	}
 
 	if (unlikely(id >= stream_class->events_by_id->len)) {
 		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
@@ -533,6 +729,10 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
 		return -EINVAL;
 	}
+	/* Events read out of order leave the packet event ids unknown. */
+	if (unlikely(pos->last_offset != pos->event_ids_next))
+		pos->event_ids_valid = 0;
+	pos->event_ids |= ctf_packet_event_id_bit(id);
 
 	/* Read event-declared event context */
 	if (event->event_context) {
@@ -547,6 +747,29 @@ int ctf_read_event(struct bt_stream_pos *ppos, struct ctf_stream_definition *str
 		if (ret)
 			goto error;
 	}
+	pos->event_ids_next = pos->offset;
+
+	/*
+	 * Count the events read in order from the packet start. The
+	 * packet start needs no checkpoint.
+	 */
+	if (likely(pos->checkpoint_next == pos->last_offset)) {
+		if (unlikely(pos->packet_events
+				&& !(pos->packet_events % PACKET_CHECKPOINT_INTERVAL))) {
+			struct packet_checkpoint checkpoint;
+
+			checkpoint.offset = pos->last_offset;
+			checkpoint.cycles_timestamp = stream->cycles_timestamp;
+			ctf_packet_index_add_checkpoint(pos->packet_index,
+				pos->cur_index,
+				pos->packet_events / PACKET_CHECKPOINT_INTERVAL,
+				&checkpoint);
+		}
+		pos->packet_events++;
+		pos->checkpoint_next = pos->offset;
+	} else {
+		pos->checkpoint_next = -1;
+	}
 
 	return 0;
 
@@ -615,14 +838,12 @@ int ctf_init_pos(struct ctf_stream_pos *pos, struct bt_trace_descriptor *trace,
 {
 	pos->fd = fd;
 	if (fd >= 0) {
-		pos->packet_cycles_index = g_array_new(FALSE, TRUE,
-						sizeof(struct packet_index));
-		pos->packet_real_index = g_array_new(FALSE, TRUE,
-				sizeof(struct packet_index));
+		pos->packet_index = ctf_packet_index_create();
 	} else {
-		pos->packet_cycles_index = NULL;
-		pos->packet_real_index = NULL;
+		pos->packet_index = NULL;
 	}
+	/* Checkpoints are only counted from the start of indexed packets. */
+	pos->checkpoint_next = -1;
 	switch (open_flags & O_ACCMODE) {
 	case O_RDONLY:
 		pos->prot = PROT_READ;
@@ -650,6 +871,10 @@ int ctf_fini_pos(struct ctf_stream_pos *pos)
 {
 	if (pos->prot == PROT_WRITE && pos->content_size_loc)
 		*pos->content_size_loc = pos->offset;
+	ctf_uring_drop(pos);
+	ctf_lazy_index_stop(pos->packet_index);
+	if (ctf_stream_cache_remove(pos))
+		return -1;
 	if (pos->base_mma) {
 		int ret;
 
@@ -661,10 +886,13 @@ int ctf_fini_pos(struct ctf_stream_pos *pos)
 			return -1;
 		}
 	}
-	if (pos->packet_cycles_index)
-		(void) g_array_free(pos->packet_cycles_index, TRUE);
-	if (pos->packet_real_index)
-		(void) g_array_free(pos->packet_real_index, TRUE);
+	if (pos->cstream)
+		ctf_cstream_close(pos->cstream);
+	ctf_packet_index_destroy(pos->packet_index);
+	if (pos->field_acc)
+		g_array_free(pos->field_acc, TRUE);
+	if (pos->field_filters)
+		g_array_free(pos->field_filters, TRUE);
 	return 0;
 }
 
@@ -678,9 +906,12 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 		container_of(stream_pos, struct ctf_stream_pos, parent);
 	struct ctf_file_stream *file_stream =
 		container_of(pos, struct ctf_file_stream, pos);
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	/* Events discarded over the packets skipped by this seek */
+	uint64_t events_discarded = 0;
 	int ret;
 	off_t off;
-	struct packet_index *packet_index;
+	struct packet_index packet_index;
 
 	switch (whence) {
 	case SEEK_CUR:
@@ -693,16 +924,10 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 	if (pos->prot == PROT_WRITE && pos->content_size_loc)
 		*pos->content_size_loc = pos->offset;
 
-	if (pos->base_mma) {
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-				strerror(errno));
-			assert(0);
-		}
-		pos->base_mma = NULL;
-	}
+	/* unmap old base */
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		assert(0);
 
 	/*
 	 * The caller should never ask for ctf_move_pos across packets,
@@ -737,70 +962,95 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 			if (pos->offset == EOF) {
 				return;
 			}
-			assert(pos->cur_index < pos->packet_cycles_index->len);
-			assert(pos->cur_index < pos->packet_real_index->len);
+			assert(pos->cur_index < ctf_packet_index_len(pos->packet_index));
 
-			/* For printing discarded event count */
-			packet_index = &g_array_index(pos->packet_cycles_index,
-					struct packet_index, pos->cur_index);
-			file_stream->parent.prev_cycles_timestamp_end =
-				packet_index->timestamp_end;
-			file_stream->parent.prev_cycles_timestamp =
-				packet_index->timestamp_begin;
-
-			packet_index = &g_array_index(pos->packet_real_index,
-					struct packet_index, pos->cur_index);
-			file_stream->parent.prev_real_timestamp_end =
-						packet_index->timestamp_end;
-			file_stream->parent.prev_real_timestamp =
-				packet_index->timestamp_begin;
-
-			events_discarded_diff = packet_index->events_discarded;
-			if (pos->cur_index > 0) {
-				packet_index = &g_array_index(pos->packet_real_index,
-						struct packet_index,
-						pos->cur_index - 1);
-				events_discarded_diff -= packet_index->events_discarded;
-				/*
-				 * Deal with 32-bit wrap-around if the
-				 * tracer provided a 32-bit field.
-				 */
-				if (packet_index->events_discarded_len == 32) {
-					events_discarded_diff = (uint32_t) events_discarded_diff;
+			/* Record the event ids of a packet read entirely. */
+			if (pos->event_ids_valid
+					&& pos->event_ids_next == pos->content_size) {
+				unsigned int i;
+
+				ctf_packet_index_set_event_ids(pos->packet_index,
+					pos->cur_index, pos->event_ids);
+				for (i = 0; pos->field_acc && i < pos->field_acc->len; i++) {
+					struct ctf_field_acc *acc = &g_array_index(pos->field_acc,
+							struct ctf_field_acc, i);
+
+					*ctf_packet_index_field_range(pos->packet_index,
+						acc->column, pos->cur_index) = acc->range;
 				}
 			}
-			file_stream->parent.events_discarded = events_discarded_diff;
-			file_stream->parent.prev_real_timestamp = file_stream->parent.real_timestamp;
-			file_stream->parent.prev_cycles_timestamp = file_stream->parent.cycles_timestamp;
+			pos->event_ids_valid = 0;
+
+			events_discarded_diff = 0;
+			if (pos->cur_index > 0) {
+				ctf_packet_index_get(pos->packet_index,
+						pos->cur_index - 1, &packet_index);
+				events_discarded_diff -= packet_index.events_discarded;
+			}
+			ctf_packet_index_get(pos->packet_index, pos->cur_index,
+					&packet_index);
+			events_discarded_diff += packet_index.events_discarded;
+			/*
+			 * Deal with 32-bit wrap-around if the tracer provided
+			 * a 32-bit field.
+			 */
+			if (pos->cur_index > 0
+					&& packet_index.events_discarded_len == 32) {
+				events_discarded_diff = (uint32_t) events_discarded_diff;
+			}
+
+			/* For printing discarded event count */
+			stream->prev_cycles_timestamp_end =
+				packet_index.timestamp_end;
+			stream->prev_cycles_timestamp =
+				packet_index.timestamp_begin;
+			stream->prev_real_timestamp_end =
+				ctf_get_real_timestamp(stream,
+					packet_index.timestamp_end);
+			stream->prev_real_timestamp =
+				ctf_get_real_timestamp(stream,
+					packet_index.timestamp_begin);
+
+			events_discarded += events_discarded_diff;
+			stream->events_discarded = events_discarded;
+			stream->prev_real_timestamp = stream->real_timestamp;
+			stream->prev_cycles_timestamp = stream->cycles_timestamp;
 			/* The reader will expect us to skip padding */
 			++pos->cur_index;
 			break;
 		}
 		case SEEK_SET:
-			if (index >= pos->packet_cycles_index->len) {
+			ctf_packet_index_extend(pos->packet_index, index + 1);
+			if (index >= ctf_packet_index_len(pos->packet_index)) {
+				/* Resume after the last packet if the index grows */
+				pos->cur_index = ctf_packet_index_len(pos->packet_index);
 				pos->offset = EOF;
 				return;
 			}
-			packet_index = &g_array_index(pos->packet_cycles_index,
-					struct packet_index, index);
-			pos->last_events_discarded = packet_index->events_discarded;
+			/* Reads queued ahead are for the packets after the old one. */
+			if (index != pos->cur_index + 1)
+				ctf_uring_drop(pos);
+			ctf_packet_index_get(pos->packet_index, index,
+					&packet_index);
+			pos->last_events_discarded = packet_index.events_discarded;
 			pos->cur_index = index;
-			file_stream->parent.prev_real_timestamp = 0;
-			file_stream->parent.prev_real_timestamp_end = 0;
-			file_stream->parent.prev_cycles_timestamp = 0;
-			file_stream->parent.prev_cycles_timestamp_end = 0;
+			stream->prev_real_timestamp = 0;
+			stream->prev_real_timestamp_end = 0;
+			stream->prev_cycles_timestamp = 0;
+			stream->prev_cycles_timestamp_end = 0;
 			break;
 		default:
 			assert(0);
 		}
-		if (pos->cur_index >= pos->packet_real_index->len) {
+		ctf_packet_index_extend(pos->packet_index, pos->cur_index + 1);
+		if (pos->cur_index >= ctf_packet_index_len(pos->packet_index)) {
 			/*
 			 * We need to check if we are in trace read or
 			 * called from packet indexing.  In this last
 			 * case, the collection is not there, so we
 			 * cannot print the timestamps.
 			 */
-			if ((&file_stream->parent)->stream_class->trace->parent.collection) {
+			if (stream->stream_class->trace->parent.collection) {
 				/*
 				 * When a stream reaches the end of the
 				 * file, we need to show the number of
@@ -808,36 +1058,44 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 				 * there is no next event scheduled to
 				 * be printed in the output.
 				 */
-				if (file_stream->parent.events_discarded) {
+				if (stream->events_discarded) {
 					fflush(stdout);
-					ctf_print_discarded(stderr,
-						&file_stream->parent,
-						1);
-					file_stream->parent.events_discarded = 0;
+					ctf_print_discarded(stderr, stream, 1);
+					stream->events_discarded = 0;
 				}
 			}
 			pos->offset = EOF;
 			return;
 		}
-		packet_index = &g_array_index(pos->packet_cycles_index,
-				struct packet_index,
-				pos->cur_index);
-		file_stream->parent.cycles_timestamp = packet_index->timestamp_begin;
-
-		packet_index = &g_array_index(pos->packet_real_index,
-				struct packet_index,
-				pos->cur_index);
-		file_stream->parent.real_timestamp = packet_index->timestamp_begin;
-		pos->mmap_offset = packet_index->offset;
+		/*
+		 * When the iterator reads only some events, skip the
+		 * packets the index knows not to hold any of them,
+		 * without mapping them.
+		 */
+		if (whence == SEEK_CUR && !packet_may_match(pos))
+			goto read_next_packet;
+		ctf_packet_index_get(pos->packet_index, pos->cur_index,
+				&packet_index);
+		stream->cycles_timestamp = packet_index.timestamp_begin;
+		stream->real_timestamp = ctf_get_real_timestamp(stream,
+				packet_index.timestamp_begin);
+		pos->mmap_offset = packet_index.offset;
 
 		/* Lookup context/packet size in index */
-		pos->content_size = packet_index->content_size;
-		pos->packet_size = packet_index->packet_size;
-		if (packet_index->data_offset < packet_index->content_size) {
+		pos->content_size = packet_index.content_size;
+		pos->packet_size = packet_index.packet_size;
+		if (packet_index.data_offset < packet_index.content_size) {
 			pos->offset = 0;	/* will read headers */
-		} else if (packet_index->data_offset == packet_index->content_size) {
+		} else if (packet_index.data_offset == packet_index.content_size) {
 			/* empty packet */
-			pos->offset = packet_index->data_offset;
+			pos->offset = packet_index.data_offset;
+			pos->event_ids = 0;
+			pos->event_ids_next = pos->offset;
+			pos->event_ids_valid = 1;
+			pos->packet_events = 0;
+			pos->checkpoint_next = pos->offset;
+			if (pos->packet_index->fields->len)
+				stream_reset_field_acc(file_stream);
 			whence = SEEK_CUR;
 			goto read_next_packet;
 		} else {
@@ -846,13 +1104,9 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 		}
 	}
 	/* map new base. Need mapping length from header. */
-	pos->base_mma = mmap_align(pos->packet_size / CHAR_BIT, pos->prot,
-			pos->flags, pos->fd, pos->mmap_offset);
-	if (pos->base_mma == MAP_FAILED) {
-		fprintf(stderr, "[error] mmap error %s.\n",
-			strerror(errno));
+	ret = ctf_stream_cache_map(pos, pos->packet_size / CHAR_BIT);
+	if (ret)
 		assert(0);
-	}
 
 	/* update trace_packet_header and stream_packet_context */
 	if (pos->prot != PROT_WRITE && file_stream->parent.trace_packet_header) {
@@ -865,6 +1119,38 @@ void ctf_packet_seek(struct bt_stream_pos *stream_pos, size_t index, int whence)
 		ret = generic_rw(&pos->parent, &file_stream->parent.stream_packet_context->p);
 		assert(!ret);
 	}
+	if (pos->prot != PROT_WRITE) {
+		pos->event_ids = 0;
+		pos->event_ids_next = pos->offset;
+		pos->event_ids_valid = 1;
+		pos->packet_events = 0;
+		pos->checkpoint_next = pos->offset;
+		if (pos->packet_index->fields->len) {
+			stream_set_packet_fields(file_stream, pos->cur_index);
+			stream_reset_field_acc(file_stream);
+		}
+		/* Read the next packet ahead while this one is decoded. */
+		if (opt_streaming && pos->cur_index + 1
+				< ctf_packet_index_len(pos->packet_index)) {
+			ctf_packet_index_get(pos->packet_index,
+					pos->cur_index + 1, &packet_index);
+			ctf_stream_cache_will_need(pos, packet_index.offset,
+					packet_index.packet_size / CHAR_BIT);
+		}
+		/* Keep the next packets read in flight. */
+		if (ctf_uring_active()) {
+			size_t i;
+
+			for (i = pos->cur_index + 1; i <= pos->cur_index + URING_PACKETS_AHEAD
+					&& i < ctf_packet_index_len(pos->packet_index); i++) {
+				ctf_packet_index_get(pos->packet_index, i,
+						&packet_index);
+				ctf_uring_queue(pos, packet_index.offset,
+						packet_index.packet_size / CHAR_BIT);
+			}
+			ctf_uring_submit();
+		}
+	}
 }
 
 static
@@ -920,153 +1206,279 @@ warning:
 }
 
 static
-int ctf_open_trace_metadata_packet_read(struct ctf_trace *td, FILE *in,
-					FILE *out)
+int ctf_metadata_packet_header_check(struct ctf_trace *td,
+		struct metadata_packet_header *header)
 {
-	struct metadata_packet_header header;
-	size_t readlen, writelen, toread;
-	char buf[4096 + 1];	/* + 1 for debug-mode \0 */
-	int ret = 0;
-
-	readlen = fread(&header, header_sizeof(header), 1, in);
-	if (readlen < 1)
-		return -EINVAL;
-
 	if (td->byte_order != BYTE_ORDER) {
-		header.magic = GUINT32_SWAP_LE_BE(header.magic);
-		header.checksum = GUINT32_SWAP_LE_BE(header.checksum);
-		header.content_size = GUINT32_SWAP_LE_BE(header.content_size);
-		header.packet_size = GUINT32_SWAP_LE_BE(header.packet_size);
-	}
-	if (header.checksum)
-		fprintf(stderr, "[warning] checksum verification not supported yet.\n");
-	if (header.compression_scheme) {
+		header->magic = GUINT32_SWAP_LE_BE(header->magic);
+		header->checksum = GUINT32_SWAP_LE_BE(header->checksum);
+		header->content_size = GUINT32_SWAP_LE_BE(header->content_size);
+		header->packet_size = GUINT32_SWAP_LE_BE(header->packet_size);
+	}
+	if (header->checksum && !header->checksum_scheme)
+		fprintf(stderr, "[warning] checksum without checksum scheme, not verified.\n");
+	if (header->compression_scheme) {
 		fprintf(stderr, "[error] compression (%u) not supported yet.\n",
-			header.compression_scheme);
+			header->compression_scheme);
 		return -EINVAL;
 	}
-	if (header.encryption_scheme) {
+	if (header->encryption_scheme) {
 		fprintf(stderr, "[error] encryption (%u) not supported yet.\n",
-			header.encryption_scheme);
+			header->encryption_scheme);
 		return -EINVAL;
 	}
-	if (header.checksum_scheme) {
+	if (header->checksum_scheme != CTF_CHECKSUM_SCHEME_NONE
+			&& header->checksum_scheme != CTF_CHECKSUM_SCHEME_CRC32C) {
 		fprintf(stderr, "[error] checksum (%u) not supported yet.\n",
-			header.checksum_scheme);
+			header->checksum_scheme);
 		return -EINVAL;
 	}
-	if (check_version(header.major, header.minor) < 0)
+	if (check_version(header->major, header->minor) < 0)
 		return -EINVAL;
 	if (!CTF_TRACE_FIELD_IS_SET(td, uuid)) {
-		memcpy(td->uuid, header.uuid, sizeof(header.uuid));
+		memcpy(td->uuid, header->uuid, sizeof(header->uuid));
 		CTF_TRACE_SET_FIELD(td, uuid);
 	} else {
-		if (babeltrace_uuid_compare(header.uuid, td->uuid))
+		if (babeltrace_uuid_compare(header->uuid, td->uuid))
 			return -EINVAL;
 	}
-
-	if ((header.content_size / CHAR_BIT) < header_sizeof(header))
+	if ((header->content_size / CHAR_BIT) < header_sizeof(*header))
 		return -EINVAL;
+	return 0;
+}
 
-	toread = (header.content_size / CHAR_BIT) - header_sizeof(header);
+/*
+ * Strip the packet headers and padding of packetized metadata in place,
+ * leaving only the concatenated TSDL text in buf. Reading stops at the
+ * first invalid packet, or at the first packet not entirely in buf, so
+ * that the next read starts on a packet header. When the metadata is
+ * complete (final), the padding of the last packet may be missing.
+ * Returns the number of input bytes consumed, or -EINVAL if a packet
+ * does not match its checksum.
+ */
+static
+ssize_t ctf_metadata_packets_strip(struct ctf_trace *td, char *buf, size_t *len,
+		int final)
+{
+	struct metadata_packet_header header;
+	size_t in = 0, out = 0, content_len, packet_len;
+	uint32_t crc;
 
-	for (;;) {
-		readlen = fread(buf, sizeof(char), min(sizeof(buf) - 1, toread), in);
-		if (ferror(in)) {
-			ret = -EINVAL;
+	while (*len - in >= header_sizeof(header)) {
+		memcpy(&header, buf + in, header_sizeof(header));
+		if (ctf_metadata_packet_header_check(td, &header))
 			break;
+		content_len = header.content_size / CHAR_BIT;
+		packet_len = max((size_t) header.packet_size / CHAR_BIT,
+				content_len);
+		if (content_len > *len - in)
+			break;
+		if (packet_len > *len - in) {
+			if (!final)
+				break;
+			fprintf(stderr, "[warning] Missing padding at end of file\n");
+			packet_len = *len - in;
+		}
+		content_len -= header_sizeof(header);
+		if (header.checksum_scheme == CTF_CHECKSUM_SCHEME_CRC32C) {
+			crc = ctf_crc32c(0, buf + in + header_sizeof(header),
+					content_len);
+			if (crc != header.checksum) {
+				fprintf(stderr, "[error] Metadata packet at offset %zu: checksum 0x%08" PRIX32 " does not match content (0x%08" PRIX32 ").\n",
+					in, header.checksum, crc);
+				return -EINVAL;
+			}
 		}
 		if (babeltrace_debug) {
-			buf[readlen] = '\0';
-			fprintf(stderr, "[debug] metadata packet read: %s\n",
-				buf);
+			fprintf(stderr, "[debug] metadata packet read: %.*s\n",
+				(int) content_len, buf + in + header_sizeof(header));
 		}
+		memmove(buf + out, buf + in + header_sizeof(header),
+			content_len);
+		out += content_len;
+		in += packet_len;
+	}
+	buf[out] = buf[out + 1] = '\0';
+	*len = out;
+	return in;
+}
 
-		writelen = fwrite(buf, sizeof(char), readlen, out);
-		if (writelen < readlen) {
-			ret = -EIO;
-			break;
-		}
-		if (ferror(out)) {
-			ret = -EINVAL;
+/*
+ * Read the whole metadata stream into a single buffer and close fp.
+ * The buffer is terminated by two \0, as required to scan it in place.
+ */
+static
+int ctf_metadata_read_all(FILE *fp, char **buf, size_t *len)
+{
+	struct stat st;
+	char *text, *newtext;
+	size_t text_len = 0, alloc_len = getpagesize();
+	int ret = 0, closeret;
+
+	if (!fstat(fileno(fp), &st) && S_ISREG(st.st_mode))
+		alloc_len = max(alloc_len, (size_t) st.st_size + 2);
+	text = malloc(alloc_len);
+	if (!text) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	for (;;) {
+		text_len += fread(text + text_len, 1,
+				alloc_len - text_len - 2, fp);
+		if (text_len < alloc_len - 2)
 			break;
+		alloc_len *= 2;
+		newtext = realloc(text, alloc_len);
+		if (!newtext) {
+			ret = -ENOMEM;
+			goto end;
 		}
-		toread -= readlen;
-		if (!toread) {
-			ret = 0;	/* continue reading next packet */
-			goto read_padding;
-		}
+		text = newtext;
 	}
-	return ret;
+	if (ferror(fp)) {
+		perror("Metadata read");
+		ret = -EIO;
+		goto end;
+	}
+	text[text_len] = text[text_len + 1] = '\0';
+end:
+	closeret = fclose(fp);
+	if (closeret) {
+		perror("Error in fclose");
+	}
+	if (ret) {
+		free(text);
+		return ret;
+	}
+	*buf = text;
+	*len = text_len;
+	return 0;
+}
 
-read_padding:
-	toread = (header.packet_size - header.content_size) / CHAR_BIT;
-	ret = fseek(in, toread, SEEK_CUR);
-	if (ret < 0) {
-		fprintf(stderr, "[warning] Missing padding at end of file\n");
-		ret = 0;
+/*
+ * Traces are opened before they are added to a context, so the cache is
+ * shared by all the contexts of the process. It is protected by
+ * metadata_ast_lock, since traces may be opened and closed from several
+ * threads.
+ */
+static GHashTable *metadata_ast_cache;	/* struct ctf_metadata_ast set */
+static pthread_mutex_t metadata_ast_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static
+guint metadata_ast_hash(gconstpointer key)
+{
+	const struct ctf_metadata_ast *ast = key;
+	guint hash = 5381;
+	size_t i;
+
+	for (i = 0; i < ast->len; i++)
+		hash = (hash << 5) + hash + (unsigned char) ast->text[i];
+	if (ast->has_uuid) {
+		for (i = 0; i < BABELTRACE_UUID_LEN; i++)
+			hash = (hash << 5) + hash + ast->uuid[i];
 	}
-	return ret;
+	return hash;
 }
 
 static
-int ctf_open_trace_metadata_stream_read(struct ctf_trace *td, FILE **fp,
-					char **buf)
+gboolean metadata_ast_equal(gconstpointer a, gconstpointer b)
 {
-	FILE *in, *out;
-	size_t size, buflen;
-	int ret;
+	const struct ctf_metadata_ast *ast_a = a, *ast_b = b;
+
+	if (ast_a->len != ast_b->len || ast_a->has_uuid != ast_b->has_uuid)
+		return FALSE;
+	if (ast_a->has_uuid
+			&& babeltrace_uuid_compare(ast_a->uuid, ast_b->uuid))
+		return FALSE;
+	return !memcmp(ast_a->text, ast_b->text, ast_a->len);
+}
 
-	in = *fp;
-	/*
-	 * Using strlen on *buf instead of size of open_memstream
-	 * because its size includes garbage at the end (after final
-	 * \0). This is the allocated size, not the actual string size.
-	 */
-	out = babeltrace_open_memstream(buf, &size);
-	if (out == NULL) {
-		perror("Metadata open_memstream");
-		return -errno;
+static
+void metadata_ast_key_init(struct ctf_metadata_ast *key, struct ctf_trace *td)
+{
+	memset(key, 0, sizeof(*key));
+	key->text = td->metadata_string;
+	key->len = strlen(td->metadata_string);
+	if (CTF_TRACE_FIELD_IS_SET(td, uuid)) {
+		memcpy(key->uuid, td->uuid, BABELTRACE_UUID_LEN);
+		key->has_uuid = 1;
 	}
-	for (;;) {
-		ret = ctf_open_trace_metadata_packet_read(td, in, out);
-		if (ret) {
-			break;
-		}
-		if (feof(in)) {
-			ret = 0;
-			break;
-		}
+}
+
+/*
+ * Returns a new reference to the cached AST matching the metadata of
+ * td, or NULL if it has not been parsed yet.
+ */
+static
+struct ctf_metadata_ast *metadata_ast_get(struct ctf_trace *td)
+{
+	struct ctf_metadata_ast key, *ast = NULL;
+
+	pthread_mutex_lock(&metadata_ast_lock);
+	if (metadata_ast_cache) {
+		metadata_ast_key_init(&key, td);
+		ast = g_hash_table_lookup(metadata_ast_cache, &key);
+		if (ast)
+			ast->refcount++;
 	}
-	/* close to flush the buffer */
-	ret = babeltrace_close_memstream(buf, &size, out);
-	if (ret < 0) {
-		int closeret;
+	pthread_mutex_unlock(&metadata_ast_lock);
+	return ast;
+}
 
-		perror("babeltrace_flush_memstream");
-		ret = -errno;
-		closeret = fclose(in);
-		if (closeret) {
-			perror("Error in fclose");
+/*
+ * Add a parsed and validated AST to the cache. The cache takes
+ * ownership of the scanner. If another thread added the same metadata
+ * meanwhile, a reference to its AST is returned instead.
+ */
+static
+struct ctf_metadata_ast *metadata_ast_add(struct ctf_trace *td,
+		struct ctf_scanner *scanner)
+{
+	struct ctf_metadata_ast key, *ast;
+
+	pthread_mutex_lock(&metadata_ast_lock);
+	if (metadata_ast_cache) {
+		metadata_ast_key_init(&key, td);
+		ast = g_hash_table_lookup(metadata_ast_cache, &key);
+		if (ast) {
+			ast->refcount++;
+			pthread_mutex_unlock(&metadata_ast_lock);
+			ctf_scanner_free(scanner);
+			return ast;
 		}
-		return ret;
 	}
-	ret = fclose(in);
-	if (ret) {
-		perror("Error in fclose");
-	}
-	/* open for reading */
-	buflen = strlen(*buf);
-	if (!buflen) {
-		*fp = NULL;
-		return -ENOENT;
+	ast = g_new0(struct ctf_metadata_ast, 1);
+	metadata_ast_key_init(ast, td);
+	ast->text = g_strdup(td->metadata_string);
+	ast->scanner = scanner;
+	ast->refcount = 1;
+	if (!metadata_ast_cache)
+		metadata_ast_cache = g_hash_table_new(metadata_ast_hash,
+				metadata_ast_equal);
+	g_hash_table_insert(metadata_ast_cache, ast, ast);
+	pthread_mutex_unlock(&metadata_ast_lock);
+	return ast;
+}
+
+static
+void metadata_ast_put(struct ctf_metadata_ast *ast)
+{
+	if (!ast)
+		return;
+	pthread_mutex_lock(&metadata_ast_lock);
+	if (--ast->refcount) {
+		pthread_mutex_unlock(&metadata_ast_lock);
+		return;
 	}
-	*fp = babeltrace_fmemopen(*buf, buflen, "rb");
-	if (!*fp) {
-		perror("Metadata fmemopen");
-		return -errno;
+	g_hash_table_remove(metadata_ast_cache, ast);
+	if (!g_hash_table_size(metadata_ast_cache)) {
+		g_hash_table_destroy(metadata_ast_cache);
+		metadata_ast_cache = NULL;
 	}
-	return 0;
+	pthread_mutex_unlock(&metadata_ast_lock);
+	ctf_scanner_free(ast->scanner);
+	g_free(ast->text);
+	g_free(ast);
 }
 
 static
@@ -1074,11 +1486,13 @@ int ctf_open_trace_metadata_read(struct ctf_trace *td,
 		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
 			int whence), FILE *metadata_fp)
 {
-	struct ctf_scanner *scanner;
+	struct ctf_scanner *scanner = NULL;
+	struct ctf_metadata_ast *ast;
 	struct ctf_file_stream *metadata_stream;
 	FILE *fp;
 	char *buf = NULL;
-	int ret = 0, closeret;
+	size_t len;
+	int packetized, ret = 0, closeret;
 
 	metadata_stream = g_new0(struct ctf_file_stream, 1);
 	metadata_stream->pos.last_offset = LAST_OFFSET_POISON;
@@ -1116,33 +1530,52 @@ int ctf_open_trace_metadata_read(struct ctf_trace *td,
 	if (babeltrace_debug)
 		yydebug = 1;
 
-	if (packet_metadata(td, fp)) {
-		ret = ctf_open_trace_metadata_stream_read(td, &fp, &buf);
-		if (ret) {
-			/* Warn about empty metadata */
-			fprintf(stderr, "[warning] Empty metadata.\n");
+	packetized = packet_metadata(td, fp);
+	ret = ctf_metadata_read_all(fp, &buf, &len);
+	if (ret)
+		goto end_packet_read;
+	td->metadata_string = buf;
+	if (packetized) {
+		ssize_t consumed;
+
+		consumed = ctf_metadata_packets_strip(td, buf, &len,
+				!opt_follow);
+		if (consumed < 0) {
+			ret = consumed;
 			goto end_packet_read;
 		}
-		td->metadata_string = buf;
+		td->metadata_offset = consumed;
 		td->metadata_packetized = 1;
-	} else {
+	}
+	if (!len) {
+		/* Warn about empty metadata */
+		fprintf(stderr, "[warning] Empty metadata.\n");
+		ret = -ENOENT;
+		goto end_packet_read;
+	}
+	if (!packetized) {
 		unsigned int major, minor;
 		ssize_t nr_items;
 
 		td->byte_order = BYTE_ORDER;
 
 		/* Check text-only metadata header and version */
-		nr_items = fscanf(fp, "/* CTF %u.%u", &major, &minor);
+		nr_items = sscanf(buf, "/* CTF %u.%u", &major, &minor);
 		if (nr_items < 2)
 			fprintf(stderr, "[warning] Ill-shapen or missing \"/* CTF x.y\" header for text-only metadata.\n");
 		if (check_version(major, minor) < 0) {
 			ret = -EINVAL;
 			goto end_packet_read;
 		}
-		rewind(fp);
 	}
 
-	scanner = ctf_scanner_alloc(fp);
+	ast = metadata_ast_get(td);
+	if (ast) {
+		printf_verbose("Reusing metadata AST parsed for another trace.\n");
+		goto construct;
+	}
+
+	scanner = ctf_scanner_alloc_buffer(buf, len);
 	if (!scanner) {
 		fprintf(stderr, "[error] Error allocating scanner\n");
 		ret = -ENOMEM;
@@ -1167,22 +1600,22 @@ int ctf_open_trace_metadata_read(struct ctf_trace *td,
 		fprintf(stderr, "[error] Error in CTF semantic validation %d\n", ret);
 		goto end;
 	}
-	ret = ctf_visitor_construct_metadata(stderr, 0, &scanner->ast->root,
-			td, td->byte_order);
+	ast = metadata_ast_add(td, scanner);
+	scanner = NULL;		/* now owned by the cache */
+construct:
+	ret = ctf_visitor_construct_metadata(stderr, 0,
+			&ast->scanner->ast->root, td, td->byte_order);
 	if (ret) {
 		fprintf(stderr, "[error] Error in CTF metadata constructor %d\n", ret);
+		metadata_ast_put(ast);
 		goto end;
 	}
+	td->metadata_ast = ast;
 end:
-	ctf_scanner_free(scanner);
+	if (scanner)
+		ctf_scanner_free(scanner);
 end_scanner_alloc:
 end_packet_read:
-	if (fp) {
-		closeret = fclose(fp);
-		if (closeret) {
-			perror("Error on fclose");
-		}
-	}
 end_stream:
 	if (metadata_stream->pos.fd >= 0) {
 		closeret = close(metadata_stream->pos.fd);
@@ -1196,42 +1629,196 @@ end_free:
 	return ret;
 }
 
+/*
+ * Get the scanner parsing the metadata appended to the trace, chained
+ * to the scanner of the initial metadata. After a parse error, the
+ * scanner is created again, and the metadata successfully appended so
+ * far is parsed again for the type names it declares: its declarations
+ * are already constructed.
+ */
 static
-struct ctf_event_definition *create_event_definitions(struct ctf_trace *td,
-						  struct ctf_stream_definition *stream,
-						  struct ctf_event_declaration *event)
+struct ctf_scanner *metadata_update_scanner_get(struct ctf_trace *td)
 {
-	struct ctf_event_definition *stream_event = g_new0(struct ctf_event_definition, 1);
+	struct ctf_scanner *scanner;
+	char *appended;
+	size_t len;
+	int ret;
 
-	if (event->context_decl) {
-		struct bt_definition *definition =
-			event->context_decl->p.definition_new(&event->context_decl->p,
-				stream->parent_def_scope, 0, 0, "event.context");
-		if (!definition) {
+	if (td->metadata_update_scanner)
+		return td->metadata_update_scanner;
+	scanner = ctf_scanner_alloc_chained(td->metadata_ast->scanner);
+	if (!scanner)
+		return NULL;
+	len = strlen(td->metadata_string) - td->metadata_ast->len;
+	if (len) {
+		appended = malloc(len + 2);
+		if (!appended)
 			goto error;
-		}
-		stream_event->event_context = container_of(definition,
-					struct definition_struct, p);
-		stream->parent_def_scope = stream_event->event_context->p.scope;
-	}
-	if (event->fields_decl) {
-		struct bt_definition *definition =
-			event->fields_decl->p.definition_new(&event->fields_decl->p,
-				stream->parent_def_scope, 0, 0, "event.fields");
-		if (!definition) {
+		memcpy(appended, td->metadata_string + td->metadata_ast->len,
+			len);
+		appended[len] = appended[len + 1] = '\0';
+		ret = ctf_scanner_append_buffer(scanner, appended, len);
+		if (!ret)
+			ret = ctf_scanner_append_ast(scanner);
+		free(appended);
+		if (ret)
 			goto error;
-		}
-		stream_event->event_fields = container_of(definition,
-					struct definition_struct, p);
-		stream->parent_def_scope = stream_event->event_fields->p.scope;
 	}
-	stream_event->stream = stream;
-	return stream_event;
+	td->metadata_update_scanner = scanner;
+	return scanner;
 
 error:
-	if (stream_event->event_fields)
-		bt_definition_unref(&stream_event->event_fields->p);
-	if (stream_event->event_context)
+	ctf_scanner_free(scanner);
+	return NULL;
+}
+
+/*
+ * Parse the metadata packets appended since the metadata was last read,
+ * and construct their declarations in the existing trace scopes. The
+ * appended text is parsed by a scanner chained to the one of the
+ * initial metadata, so it can refer to the types declared there.
+ * Returns 1 if new declarations were added, 0 if there were none, or a
+ * negative error value.
+ */
+static
+int ctf_update_trace_metadata(struct ctf_trace *td)
+{
+	struct ctf_scanner *scanner;
+	struct ctf_ast_mark mark;
+	struct stat st;
+	char *buf = NULL, *text;
+	size_t len, text_len;
+	ssize_t consumed, nr;
+	int fd, ret = 0, closeret;
+
+	/* Text-only metadata has no boundaries to resume parsing at. */
+	if (!td->metadata_packetized || !td->metadata_ast)
+		return 0;
+	fd = openat(td->dirfd, "metadata", O_RDONLY);
+	if (fd < 0) {
+		perror("Metadata open");
+		return -errno;
+	}
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		goto end;
+	}
+	if (st.st_size <= td->metadata_offset)
+		goto end;
+	len = st.st_size - td->metadata_offset;
+	buf = malloc(len + 2);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	nr = pread(fd, buf, len, td->metadata_offset);
+	if (nr < 0) {
+		perror("Metadata read");
+		ret = -errno;
+		goto end;
+	}
+	len = nr;
+	consumed = ctf_metadata_packets_strip(td, buf, &len, 0);
+	if (consumed < 0) {
+		ret = consumed;
+		goto end;
+	}
+	if (!len) {
+		td->metadata_offset += consumed;
+		goto end;
+	}
+
+	scanner = metadata_update_scanner_get(td);
+	if (!scanner) {
+		fprintf(stderr, "[error] Error allocating scanner\n");
+		ret = -ENOMEM;
+		goto end;
+	}
+	ctf_ast_get_mark(&scanner->ast->root, &mark);
+	ret = ctf_scanner_append_buffer(scanner, buf, len);
+	if (ret)
+		goto end;
+	ret = ctf_scanner_append_ast(scanner);
+	if (ret) {
+		/*
+		 * The tracer may still be writing a declaration split
+		 * across metadata packets. The scanner may hold part of
+		 * it: start over from the text appended so far, and parse
+		 * the new text again at the next update.
+		 */
+		printf_verbose("Unable to parse appended metadata, retrying at next update.\n");
+		ctf_scanner_free(scanner);
+		td->metadata_update_scanner = NULL;
+		ret = 0;
+		goto end;
+	}
+	ret = ctf_visitor_semantic_check_append(stderr, 0,
+			&scanner->ast->root, &mark);
+	if (ret) {
+		fprintf(stderr, "[error] Error in CTF semantic validation %d\n", ret);
+		goto end;
+	}
+	ret = ctf_visitor_construct_metadata_append(stderr, 0,
+			&scanner->ast->root, &mark, td);
+	if (ret) {
+		fprintf(stderr, "[error] Error in CTF metadata constructor %d\n", ret);
+		goto end;
+	}
+
+	text_len = strlen(td->metadata_string);
+	text = realloc(td->metadata_string, text_len + len + 1);
+	if (!text) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	memcpy(text + text_len, buf, len + 1);
+	td->metadata_string = text;
+	td->metadata_offset += consumed;
+	ret = 1;
+end:
+	free(buf);
+	closeret = close(fd);
+	if (closeret)
+		perror("Error on metadata fd close");
+	return ret;
+}
+
+static
+struct ctf_event_definition *create_event_definitions(struct ctf_trace *td,
+						  struct ctf_stream_definition *stream,
+						  struct ctf_event_declaration *event)
+{
+	struct ctf_event_definition *stream_event = g_new0(struct ctf_event_definition, 1);
+
+	if (event->context_decl) {
+		struct bt_definition *definition =
+			event->context_decl->p.definition_new(&event->context_decl->p,
+				stream->parent_def_scope, 0, 0, "event.context");
+		if (!definition) {
+			goto error;
+		}
+		stream_event->event_context = container_of(definition,
+					struct definition_struct, p);
+		stream->parent_def_scope = stream_event->event_context->p.scope;
+	}
+	if (event->fields_decl) {
+		struct bt_definition *definition =
+			event->fields_decl->p.definition_new(&event->fields_decl->p,
+				stream->parent_def_scope, 0, 0, "event.fields");
+		if (!definition) {
+			goto error;
+		}
+		stream_event->event_fields = container_of(definition,
+					struct definition_struct, p);
+		stream->parent_def_scope = stream_event->event_fields->p.scope;
+	}
+	stream_event->stream = stream;
+	return stream_event;
+
+error:
+	if (stream_event->event_fields)
+		bt_definition_unref(&stream_event->event_fields->p);
+	if (stream_event->event_context)
 		bt_definition_unref(&stream_event->event_context->p);
 	fprintf(stderr, "[error] Unable to create event definition for event \"%s\".\n",
 		g_quark_to_string(event->name));
@@ -1322,6 +1909,34 @@ error:
 	return ret;
 }
 
+/*
+ * Create the definitions of event classes declared after the stream was
+ * opened.
+ */
+static
+int create_stream_new_event_definitions(struct ctf_trace *td,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	int i;
+
+	if (stream->events_by_id->len < stream_class->events_by_id->len)
+		g_ptr_array_set_size(stream->events_by_id,
+			stream_class->events_by_id->len);
+	for (i = 0; i < stream->events_by_id->len; i++) {
+		struct ctf_event_declaration *event = g_ptr_array_index(stream_class->events_by_id, i);
+		struct ctf_event_definition *stream_event;
+
+		if (!event || g_ptr_array_index(stream->events_by_id, i))
+			continue;
+		stream_event = create_event_definitions(td, stream, event);
+		if (!stream_event)
+			return -EINVAL;
+		g_ptr_array_index(stream->events_by_id, i) = stream_event;
+	}
+	return 0;
+}
+
 static
 int stream_assign_class(struct ctf_trace *td,
 		struct ctf_file_stream *file_stream,
@@ -1347,16 +1962,53 @@ int stream_assign_class(struct ctf_trace *td,
 	return 0;
 }
 
+/*
+ * Check the packet data, from the end of the packet context up to
+ * content_size, against the checksum field of the packet context.
+ */
+static
+int verify_packet_checksum(struct ctf_stream_pos *pos,
+		struct packet_index *packet_index, uint64_t checksum)
+{
+	size_t begin, end;
+	uint32_t crc;
+	int ret;
+
+	begin = (packet_index->data_offset + CHAR_BIT - 1) / CHAR_BIT;
+	end = (packet_index->content_size + CHAR_BIT - 1) / CHAR_BIT;
+	if (begin > end)
+		begin = end;
+	if (end > pos->packet_size / CHAR_BIT) {
+		/* Only the packet header and context are mapped. */
+		ret = ctf_stream_cache_unmap(pos);
+		if (ret)
+			return ret;
+		ret = ctf_stream_cache_map(pos,
+				packet_index->packet_size / CHAR_BIT);
+		if (ret)
+			return ret;
+	}
+	crc = ctf_crc32c(0, mmap_align_addr(pos->base_mma)
+			+ pos->mmap_base_offset + begin, end - begin);
+	if (crc != checksum) {
+		fprintf(stderr, "[error] Packet at file offset %zd: checksum 0x%08" PRIX64 " does not match content (0x%08" PRIX32 ").\n",
+			(ssize_t) packet_index->offset, checksum, crc);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static
 int create_stream_one_packet_index(struct ctf_stream_pos *pos,
 			struct ctf_trace *td,
 			struct ctf_file_stream *file_stream,
-			size_t filesize)
+			size_t filesize, int incremental)
 {
 	struct packet_index packet_index;
 	uint64_t stream_id = 0;
 	uint64_t packet_map_len = DEFAULT_HEADER_LEN, tmp_map_len;
-	int first_packet = 0;
+	uint64_t checksum = 0;
+	int first_packet = 0, has_checksum = 0;
 	int len_index;
 	int ret;
 
@@ -1369,20 +2021,14 @@ begin:
 		packet_map_len = (filesize - pos->mmap_offset) << LOG2_CHAR_BIT;
 	}
 
-	if (pos->base_mma) {
-		/* unmap old base */
-		ret = munmap_align(pos->base_mma);
-		if (ret) {
-			fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
-				strerror(errno));
-			return ret;
-		}
-		pos->base_mma = NULL;
-	}
+	/* unmap old base */
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
 	/* map new base. Need mapping length from header. */
-	pos->base_mma = mmap_align(packet_map_len >> LOG2_CHAR_BIT, PROT_READ,
-			 MAP_PRIVATE, pos->fd, pos->mmap_offset);
-	assert(pos->base_mma != MAP_FAILED);
+	ret = ctf_stream_cache_map(pos, packet_map_len >> LOG2_CHAR_BIT);
+	if (ret)
+		return ret;
 	/*
 	 * Use current mapping size as temporary content and packet
 	 * size.
@@ -1417,9 +2063,9 @@ begin:
 			field = bt_struct_definition_get_field_from_index(file_stream->parent.trace_packet_header, len_index);
 			magic = bt_get_unsigned_int(field);
 			if (magic != CTF_MAGIC) {
-				fprintf(stderr, "[error] Invalid magic number 0x%" PRIX64 " at packet %u (file offset %zd).\n",
+				fprintf(stderr, "[error] Invalid magic number 0x%" PRIX64 " at packet %zu (file offset %zd).\n",
 						magic,
-						file_stream->pos.packet_cycles_index->len,
+						ctf_packet_index_len(file_stream->pos.packet_index),
 						(ssize_t) pos->mmap_offset);
 				return -EINVAL;
 			}
@@ -1466,10 +2112,13 @@ begin:
 			file_stream->parent.stream_id);
 		return -EINVAL;
 	}
-	if (first_packet) {
+	/* A first packet still being written may be indexed again. */
+	if (first_packet && !file_stream->parent.stream_class) {
 		ret = stream_assign_class(td, file_stream, stream_id);
 		if (ret)
 			return ret;
+		if (opt_index_fields)
+			ctf_stream_index_field(file_stream, 0);
 	}
 
 	if (file_stream->parent.stream_packet_context) {
@@ -1512,12 +2161,6 @@ begin:
 
 			field = bt_struct_definition_get_field_from_index(file_stream->parent.stream_packet_context, len_index);
 			packet_index.timestamp_begin = bt_get_unsigned_int(field);
-			if (file_stream->parent.stream_class->trace->parent.collection) {
-				packet_index.timestamp_begin =
-					ctf_get_real_timestamp(
-						&file_stream->parent,
-						packet_index.timestamp_begin);
-			}
 		}
 
 		/* read timestamp end from header */
@@ -1527,12 +2170,6 @@ begin:
 
 			field = bt_struct_definition_get_field_from_index(file_stream->parent.stream_packet_context, len_index);
 			packet_index.timestamp_end = bt_get_unsigned_int(field);
-			if (file_stream->parent.stream_class->trace->parent.collection) {
-				packet_index.timestamp_end =
-					ctf_get_real_timestamp(
-						&file_stream->parent,
-						packet_index.timestamp_end);
-			}
 		}
 
 		/* read events discarded from header */
@@ -1544,6 +2181,18 @@ begin:
 			packet_index.events_discarded = bt_get_unsigned_int(field);
 			packet_index.events_discarded_len = bt_get_int_len(field);
 		}
+
+		/* read checksum from header */
+		len_index = bt_struct_declaration_lookup_field_index(file_stream->parent.stream_packet_context->declaration, g_quark_from_static_string("checksum"));
+		if (len_index >= 0) {
+			struct bt_definition *field;
+
+			field = bt_struct_definition_get_field_from_index(file_stream->parent.stream_packet_context, len_index);
+			if (field->declaration->id == CTF_TYPE_INTEGER) {
+				checksum = bt_get_unsigned_int(field);
+				has_checksum = 1;
+			}
+		}
 	} else {
 		/* Use file size for packet size */
 		packet_index.content_size = filesize * CHAR_BIT;
@@ -1559,6 +2208,8 @@ begin:
 	}
 
 	if (packet_index.packet_size > ((uint64_t) filesize - packet_index.offset) * CHAR_BIT) {
+		if (incremental)
+			return -EAGAIN;	/* packet still being written */
 		fprintf(stderr, "[error] Packet size (%" PRIu64 " bits) is larger than remaining file size (%" PRIu64 " bits).\n",
 			packet_index.packet_size, ((uint64_t) filesize - packet_index.offset) * CHAR_BIT);
 		return -EINVAL;
@@ -1567,8 +2218,17 @@ begin:
 	/* Save position after header and context */
 	packet_index.data_offset = pos->offset;
 
-	/* add index to packet array */
-	g_array_append_val(file_stream->pos.packet_cycles_index, packet_index);
+	if (opt_verify && has_checksum) {
+		ret = verify_packet_checksum(pos, &packet_index, checksum);
+		if (ret)
+			return ret;
+	}
+
+	/* add entry to packet index */
+	ctf_packet_index_append(file_stream->pos.packet_index, &packet_index);
+	if (file_stream->pos.packet_index->fields->len)
+		stream_set_packet_fields(file_stream,
+			ctf_packet_index_len(file_stream->pos.packet_index) - 1);
 
 	pos->mmap_offset += packet_index.packet_size >> LOG2_CHAR_BIT;
 
@@ -1580,6 +2240,8 @@ retry:
 		/*
 		 * Reached EOF, but still expecting header/context data.
 		 */
+		if (incremental)
+			return -EAGAIN;	/* packet still being written */
 		fprintf(stderr, "[error] Reached end of file, but still expecting header or context fields.\n");
 		return -EFAULT;
 	}
@@ -1594,29 +2256,158 @@ retry:
 	goto begin;
 }
 
+/*
+ * Read the headers of the next packets of a stream in one batch,
+ * guessing they have the size of the last packet indexed.
+ */
+static
+void uring_queue_headers(struct ctf_stream_pos *pos, off_t filesize)
+{
+	struct packet_index last;
+	off_t offset = pos->mmap_offset;
+	int i;
+
+	ctf_packet_index_get(pos->packet_index,
+		ctf_packet_index_len(pos->packet_index) - 1, &last);
+	if (!last.packet_size)
+		return;
+	for (i = 0; i < URING_HEADERS_AHEAD && offset < filesize; i++) {
+		ctf_uring_queue(pos, offset,
+			MIN(DEFAULT_HEADER_LEN >> LOG2_CHAR_BIT, filesize - offset));
+		offset += last.packet_size >> LOG2_CHAR_BIT;
+	}
+	ctf_uring_submit();
+}
+
+/*
+ * Create a second instance of a stream, with its own packet header
+ * and context definitions, to index its packets from the current
+ * indexing position on another thread. The stream file is opened by
+ * that thread for each batch of packets.
+ */
+static
+struct ctf_file_stream *open_index_stream(struct ctf_trace *td,
+		struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_declaration *stream_class;
+	struct ctf_file_stream *shadow;
+
+	stream_class = file_stream->parent.stream_class;
+	shadow = g_new0(struct ctf_file_stream, 1);
+	shadow->pos.last_offset = LAST_OFFSET_POISON;
+	strcpy(shadow->parent.path, file_stream->parent.path);
+	if (ctf_init_pos(&shadow->pos, &td->parent, -1, O_RDONLY))
+		goto error;
+	shadow->pos.packet_index = ctf_packet_index_create();
+	if (create_trace_definitions(td, &shadow->parent))
+		goto error_pos;
+	shadow->parent.stream_id = file_stream->parent.stream_id;
+	shadow->parent.stream_class = stream_class;
+	shadow->parent.current_clock = file_stream->parent.current_clock;
+	if (stream_class->packet_context_decl) {
+		struct bt_definition *definition =
+			stream_class->packet_context_decl->p.definition_new(&stream_class->packet_context_decl->p,
+				shadow->parent.parent_def_scope, 0, 0, "stream.packet.context");
+		if (!definition)
+			goto error_def;
+		shadow->parent.stream_packet_context = container_of(definition,
+						struct definition_struct, p);
+	}
+	shadow->pos.mmap_offset = file_stream->pos.mmap_offset;
+	return shadow;
+
+error_def:
+	if (shadow->parent.trace_packet_header)
+		bt_definition_unref(&shadow->parent.trace_packet_header->p);
+error_pos:
+	ctf_fini_pos(&shadow->pos);
+error:
+	g_free(shadow);
+	return NULL;
+}
+
+int ctf_index_next_packet(struct ctf_file_stream *shadow, off_t filesize)
+{
+	struct ctf_trace *td = container_of(shadow->pos.parent.trace,
+			struct ctf_trace, parent);
+
+	return create_stream_one_packet_index(&shadow->pos, td, shadow,
+			filesize, 0);
+}
+
+void ctf_close_index_stream(struct ctf_file_stream *shadow)
+{
+	if (shadow->parent.stream_packet_context)
+		bt_definition_unref(&shadow->parent.stream_packet_context->p);
+	if (shadow->parent.trace_packet_header)
+		bt_definition_unref(&shadow->parent.trace_packet_header->p);
+	if (ctf_fini_pos(&shadow->pos))
+		fprintf(stderr, "Error on ctf_fini_pos\n");
+	if (shadow->pos.fd >= 0 && close(shadow->pos.fd))
+		perror("Error closing indexing stream fd");
+	g_free(shadow);
+}
+
+/*
+ * Index the packets of a stream after the first one in the background.
+ * Returns 0 if started.
+ */
+static
+int start_lazy_index(struct ctf_trace *td, struct ctf_file_stream *file_stream,
+		off_t filesize)
+{
+	struct ctf_file_stream *shadow;
+	int ret;
+
+	if (file_stream->pos.cstream || !file_stream->parent.stream_packet_context
+			|| opt_index_fields)
+		return -EINVAL;
+	shadow = open_index_stream(td, file_stream);
+	if (!shadow)
+		return -ENOMEM;
+	ret = ctf_lazy_index_start(file_stream, shadow, filesize);
+	if (ret)
+		ctf_close_index_stream(shadow);
+	return ret;
+}
+
 static
 int create_stream_packet_index(struct ctf_trace *td,
 			struct ctf_file_stream *file_stream)
 {
 	struct ctf_stream_pos *pos;
 	struct stat filestats;
-	int ret;
+	off_t filesize;
+	unsigned long nr_packets = 0;
+	int ret = 0;
 
 	pos = &file_stream->pos;
 
-	ret = fstat(pos->fd, &filestats);
-	if (ret < 0)
-		return ret;
+	if (pos->cstream) {
+		/* Packets are indexed at their raw stream offsets. */
+		filesize = ctf_cstream_raw_size(pos->cstream);
+	} else {
+		ret = fstat(pos->fd, &filestats);
+		if (ret < 0)
+			return ret;
+		filesize = filestats.st_size;
+	}
 
 	/* Deal with empty files */
-	if (!filestats.st_size) {
+	if (!filesize) {
 		if (file_stream->parent.trace_packet_header
 				|| file_stream->parent.stream_packet_context) {
 			/*
 			 * We expect a trace packet header and/or stream packet
-			 * context. Since a trace needs to have at least one
-			 * packet, empty files are therefore not accepted.
+			 * context, so the stream class is only known from the
+			 * first packet. Tracers create stream files before
+			 * flushing their first packet: in follow mode, keep
+			 * the stream aside until it gets one. Otherwise, since
+			 * a trace needs to have at least one packet, empty
+			 * files are not accepted.
 			 */
+			if (opt_follow)
+				return -ENODATA;
 			fprintf(stderr, "[error] Encountered an empty file, but expecting a trace packet header.\n");
 			return -EINVAL;
 		} else {
@@ -1632,13 +2423,151 @@ int create_stream_packet_index(struct ctf_trace *td,
 		}
 	}
 
-	for (pos->mmap_offset = 0; pos->mmap_offset < filestats.st_size; ) {
+	for (pos->mmap_offset = 0; pos->mmap_offset < filesize; ) {
+		ret = create_stream_one_packet_index(pos, td, file_stream,
+			filesize, 0);
+		if (ret)
+			break;
+		/* Leave the other packets to the indexing thread. */
+		if (!nr_packets++ && opt_lazy_index
+				&& pos->mmap_offset < filesize
+				&& !start_lazy_index(td, file_stream, filesize))
+			break;
+		if (!pos->cstream && ctf_uring_active()
+				&& nr_packets % URING_HEADERS_AHEAD == 1)
+			uring_queue_headers(pos, filesize);
+	}
+	ctf_uring_drop(pos);
+	if (ret)
+		return ret;
+	/* Release the indexing mapping until the stream is read. */
+	return ctf_stream_cache_unmap(pos);
+}
+
+/*
+ * Index the complete packets appended to a stream file since it was
+ * last indexed. A packet still being written is left for the next
+ * update. The reader position is preserved. Returns the number of new
+ * packets, or a negative error value.
+ */
+static
+int update_stream_packet_index(struct ctf_trace *td,
+			struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_pos *pos = &file_stream->pos;
+	struct packet_index last;
+	struct stat filestats;
+	off_t mmap_offset, next_offset;
+	int64_t offset;
+	uint64_t packet_size, content_size;
+	size_t len;
+	int ret = 0, fd, mapped, nr_packets = 0;
+
+	/*
+	 * Packet boundaries are only known from the packet context.
+	 * Compressed stream files do not grow. Streams still indexed in
+	 * the background are updated once done.
+	 */
+	if (!file_stream->parent.stream_packet_context || pos->cstream
+			|| pos->packet_index->extend)
+		return 0;
+	len = ctf_packet_index_len(pos->packet_index);
+	if (!len)
+		return 0;
+	fd = ctf_stream_cache_get_fd(pos);
+	if (fd < 0)
+		return fd;
+	if (fstat(fd, &filestats) < 0)
+		return -errno;
+	ctf_packet_index_get(pos->packet_index, len - 1, &last);
+	next_offset = last.offset + (last.packet_size >> LOG2_CHAR_BIT);
+	if (next_offset >= filestats.st_size)
+		return 0;
+
+	/* Save the reader position, and release its packet mapping. */
+	mapped = pos->base_mma || pos->mma_evicted;
+	mmap_offset = pos->mmap_offset;
+	offset = pos->offset;
+	packet_size = pos->packet_size;
+	content_size = pos->content_size;
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
+
+	pos->mmap_offset = next_offset;
+	while (pos->mmap_offset < filestats.st_size) {
 		ret = create_stream_one_packet_index(pos, td, file_stream,
-			filestats.st_size);
+			filestats.st_size, 1);
+		if (ret)
+			break;
+		nr_packets++;
+	}
+	if (ret && ret != -EAGAIN)
+		return ret;
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
+
+	pos->mmap_offset = mmap_offset;
+	pos->packet_size = packet_size;
+	pos->content_size = content_size;
+	if (mapped) {
+		/*
+		 * Indexing overwrote the packet header and context
+		 * definitions: read them again for the packet being read.
+		 */
+		ret = ctf_stream_cache_map(pos, packet_size / CHAR_BIT);
 		if (ret)
 			return ret;
+		pos->offset = 0;
+		if (file_stream->parent.trace_packet_header)
+			generic_rw(&pos->parent, &file_stream->parent.trace_packet_header->p);
+		if (file_stream->parent.stream_packet_context)
+			generic_rw(&pos->parent, &file_stream->parent.stream_packet_context->p);
 	}
-	return 0;
+	pos->offset = offset;
+	return nr_packets;
+}
+
+/*
+ * Index the first complete packets of a stream file that was empty
+ * when the trace was opened, and add the stream to its stream class.
+ * The stream is left at EOF before its first packet, so the iterator
+ * picks it up like the other streams that got new packets. Returns the
+ * number of new packets, or a negative error value.
+ */
+static
+int update_empty_stream(struct ctf_trace *td,
+			struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_pos *pos = &file_stream->pos;
+	struct stat filestats;
+	int ret = 0, fd, nr_packets = 0;
+
+	fd = ctf_stream_cache_get_fd(pos);
+	if (fd < 0)
+		return fd;
+	if (fstat(fd, &filestats) < 0)
+		return -errno;
+	for (pos->mmap_offset = 0; pos->mmap_offset < filestats.st_size; ) {
+		ret = create_stream_one_packet_index(pos, td, file_stream,
+			filestats.st_size, 1);
+		if (ret)
+			break;
+		nr_packets++;
+	}
+	if (ret && ret != -EAGAIN)
+		return ret;
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
+	if (!nr_packets)
+		return 0;
+	g_ptr_array_add(file_stream->parent.stream_class->streams,
+			&file_stream->parent);
+	pos->cur_index = 0;
+	pos->offset = EOF;
+	return nr_packets;
 }
 
 static
@@ -1699,6 +2628,7 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	}
 
 	file_stream = g_new0(struct ctf_file_stream, 1);
+	file_stream->pos.fd = fd;
 	file_stream->pos.last_offset = LAST_OFFSET_POISON;
 
 	strncpy(file_stream->parent.path, path, PATH_MAX);
@@ -1715,6 +2645,10 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	ret = ctf_init_pos(&file_stream->pos, &td->parent, fd, flags);
 	if (ret)
 		goto error_def;
+	ret = ctf_cstream_open(fd, &file_stream->pos.cstream);
+	if (ret)
+		goto error_def;
+	ctf_stream_cache_add(&file_stream->pos);
 	ret = create_trace_definitions(td, &file_stream->parent);
 	if (ret)
 		goto error_def;
@@ -1723,6 +2657,12 @@ int ctf_open_file_stream_read(struct ctf_trace *td, const char *path, int flags,
 	 */
 	file_stream->parent.current_clock = td->parent.single_clock;
 	ret = create_stream_packet_index(td, file_stream);
+	if (ret == -ENODATA) {
+		printf_verbose("Stream file %s is empty, waiting for its first packet.\n",
+			path);
+		g_ptr_array_add(td->empty_streams, file_stream);
+		return 0;
+	}
 	if (ret) {
 		fprintf(stderr, "[error] Stream index creation error.\n");
 		goto error_index;
@@ -1740,7 +2680,11 @@ error_def:
 	if (closeret) {
 		fprintf(stderr, "Error on ctf_fini_pos\n");
 	}
+	/* The stream cache may have closed or reopened the file. */
+	fd = file_stream->pos.fd;
 	g_free(file_stream);
+	if (fd < 0)
+		goto error;
 fd_is_dir_ok:
 fstat_error:
 	closeret = close(fd);
@@ -1781,6 +2725,7 @@ int ctf_open_trace_read(struct ctf_trace *td,
 	}
 	strncpy(td->parent.path, path, sizeof(td->parent.path));
 	td->parent.path[sizeof(td->parent.path) - 1] = '\0';
+	td->empty_streams = g_ptr_array_new();
 
 	/*
 	 * Keep the metadata file separate.
@@ -1862,6 +2807,9 @@ struct bt_trace_descriptor *ctf_open_trace(const char *path, int flags,
 	if (!packet_seek)
 		packet_seek = ctf_packet_seek;
 
+	if ((flags & O_ACCMODE) == O_RDWR)
+		return ctf_writer_open_trace(path);
+
 	td = g_new0(struct ctf_trace, 1);
 
 	switch (flags & O_ACCMODE) {
@@ -1874,9 +2822,6 @@ struct bt_trace_descriptor *ctf_open_trace(const char *path, int flags,
 		if (ret)
 			goto error;
 		break;
-	case O_RDWR:
-		fprintf(stderr, "[error] Opening CTF traces for output is not supported yet.\n");
-		goto error;
 	default:
 		fprintf(stderr, "[error] Incorrect open flags.\n");
 		goto error;
@@ -1901,8 +2846,7 @@ void ctf_init_mmap_pos(struct ctf_stream_pos *pos,
 	pos->offset = 0;
 	pos->dummy = false;
 	pos->cur_index = 0;
-	pos->packet_cycles_index = NULL;
-	pos->packet_real_index = NULL;
+	pos->packet_index = NULL;
 	pos->prot = PROT_READ;
 	pos->flags = MAP_PRIVATE;
 	pos->parent.rw_table = read_dispatch_table;
@@ -2044,54 +2988,73 @@ error:
 	return NULL;
 }
 
+/*
+ * The packet index keeps timestamps in cycles only: conversion to ns is
+ * done on demand, once the trace collection clock offsets are known.
+ */
 static
 int ctf_convert_index_timestamp(struct bt_trace_descriptor *tdp)
 {
-	int i, j, k;
+	return 0;
+}
+
+/*
+ * Follow mode: pick up the metadata and complete packets appended to
+ * the trace files since they were last read. Returns the number of new
+ * packets, or a negative error value.
+ */
+static
+int ctf_update_trace(struct bt_trace_descriptor *tdp)
+{
 	struct ctf_trace *td = container_of(tdp, struct ctf_trace, parent);
+	int ret, new_metadata, nr_packets = 0, i, j;
 
-	/* for each stream_class */
-	for (i = 0; i < td->streams->len; i++) {
-		struct ctf_stream_declaration *stream_class;
+	/* Memory-mapped traces are not backed by files. */
+	if (!td->dir)
+		return 0;
 
-		stream_class = g_ptr_array_index(td->streams, i);
-		if (!stream_class)
+	new_metadata = ctf_update_trace_metadata(td);
+	if (new_metadata < 0)
+		return new_metadata;
+	for (i = 0; i < td->empty_streams->len; ) {
+		ret = update_empty_stream(td,
+				g_ptr_array_index(td->empty_streams, i));
+		if (ret < 0)
+			return ret;
+		if (!ret) {
+			i++;
 			continue;
-		/* for each file_stream */
-		for (j = 0; j < stream_class->streams->len; j++) {
-			struct ctf_stream_definition *stream;
-			struct ctf_stream_pos *stream_pos;
-			struct ctf_file_stream *cfs;
-
-			stream = g_ptr_array_index(stream_class->streams, j);
-			if (!stream)
-				continue;
-			cfs = container_of(stream, struct ctf_file_stream,
-					parent);
-			stream_pos = &cfs->pos;
-			if (!stream_pos->packet_cycles_index)
-				continue;
+		}
+		/* Now indexed with the other streams of its class. */
+		g_ptr_array_remove_index(td->empty_streams, i);
+		nr_packets += ret;
+	}
+	for (i = 0; i < td->streams->len; i++) {
+		struct ctf_stream_declaration *stream;
 
-			for (k = 0; k < stream_pos->packet_cycles_index->len; k++) {
-				struct packet_index *index;
-				struct packet_index new_index;
-
-				index = &g_array_index(stream_pos->packet_cycles_index,
-						struct packet_index, k);
-				memcpy(&new_index, index,
-						sizeof(struct packet_index));
-				new_index.timestamp_begin =
-					ctf_get_real_timestamp(stream,
-							index->timestamp_begin);
-				new_index.timestamp_end =
-					ctf_get_real_timestamp(stream,
-							index->timestamp_end);
-				g_array_append_val(stream_pos->packet_real_index,
-						new_index);
+		stream = g_ptr_array_index(td->streams, i);
+		if (!stream)
+			continue;
+		for (j = 0; j < stream->streams->len; j++) {
+			struct ctf_file_stream *file_stream;
+
+			file_stream = container_of(g_ptr_array_index(stream->streams, j),
+					struct ctf_file_stream, parent);
+			if (new_metadata) {
+				ret = create_stream_new_event_definitions(td,
+						&file_stream->parent);
+				if (ret)
+					return ret;
+				/* New event classes have no filter bit yet. */
+				file_stream->pos.filters_set = 0;
 			}
+			ret = update_stream_packet_index(td, file_stream);
+			if (ret < 0)
+				return ret;
+			nr_packets += ret;
 		}
 	}
-	return 0;
+	return nr_packets;
 }
 
 static
@@ -2104,6 +3067,9 @@ int ctf_close_file_stream(struct ctf_file_stream *file_stream)
 		fprintf(stderr, "Error on ctf_fini_pos\n");
 		return -1;
 	}
+	/* The stream cache may have closed the file. */
+	if (file_stream->pos.fd < 0)
+		return 0;
 	ret = close(file_stream->pos.fd);
 	if (ret) {
 		perror("Error closing file fd");
@@ -2118,6 +3084,8 @@ int ctf_close_trace(struct bt_trace_descriptor *tdp)
 	struct ctf_trace *td = container_of(tdp, struct ctf_trace, parent);
 	int ret;
 
+	if (tdp->output_pos)
+		return ctf_writer_close_trace(tdp);
 	if (td->streams) {
 		int i;
 
@@ -2138,6 +3106,22 @@ int ctf_close_trace(struct bt_trace_descriptor *tdp)
 			}
 		}
 	}
+	if (td->empty_streams) {
+		int i;
+
+		for (i = 0; i < td->empty_streams->len; i++) {
+			struct ctf_file_stream *file_stream;
+
+			file_stream = g_ptr_array_index(td->empty_streams, i);
+			ret = ctf_close_file_stream(file_stream);
+			if (ret)
+				return ret;
+			if (file_stream->parent.trace_packet_header)
+				bt_definition_unref(&file_stream->parent.trace_packet_header->p);
+			g_free(file_stream);
+		}
+		g_ptr_array_free(td->empty_streams, TRUE);
+	}
 	ctf_destroy_metadata(td);
 	ret = close(td->dirfd);
 	if (ret) {
@@ -2149,6 +3133,9 @@ int ctf_close_trace(struct bt_trace_descriptor *tdp)
 		perror("Error closedir");
 		return ret;
 	}
+	if (td->metadata_update_scanner)
+		ctf_scanner_free(td->metadata_update_scanner);
+	metadata_ast_put(td->metadata_ast);
 	free(td->metadata_string);
 	g_free(td);
 	return 0;
@@ -0,0 +1,795 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF writer API: produce a trace from events appended by the
+ * application.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+#include <babeltrace/ctf/writer.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/crc32c.h>
+#include <babeltrace/ctf/extent.h>
+#include <babeltrace/compat/uuid.h>
+#include <babeltrace/align.h>
+#include <babeltrace/endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#define DEFAULT_PACKET_LEN	(256 * 1024)	/* bytes */
+
+#define CTF_MAGIC		0xC1FC1FC1
+
+#define OUTPUT_DIR_MODE		(S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+#define OUTPUT_FILE_MODE	(S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+struct bt_ctf_writer {
+	int dirfd;
+	unsigned char uuid[BABELTRACE_UUID_LEN];
+	size_t packet_len;		/* bytes */
+	GPtrArray *stream_classes;
+	/* Unsigned and signed integers of 8, 16, 32 and 64 bits */
+	struct declaration_integer *uint_decl[4], *int_decl[4];
+	struct declaration_string *string_decl;
+};
+
+struct bt_ctf_writer_stream_class {
+	struct bt_ctf_writer *writer;
+	unsigned int id;
+	GPtrArray *event_classes;
+	GPtrArray *streams;
+};
+
+struct writer_field {
+	char *name;
+	enum bt_ctf_writer_field_type type;
+	/* Definition written for each event, the value set beforehand */
+	union {
+		struct definition_integer integer;
+		struct definition_string string;
+	} def;
+};
+
+struct bt_ctf_writer_event_class {
+	struct bt_ctf_writer_stream_class *stream_class;
+	unsigned int id;
+	char *name;
+	GArray *fields;			/* struct writer_field */
+	int frozen;			/* events appended, no more fields */
+};
+
+/*
+ * Packet context fields written again when a packet is closed, at
+ * their offset in the packet, in bits.
+ */
+struct packet_fields {
+	uint64_t timestamp_begin, timestamp_end;
+	uint64_t content_size, packet_size;
+	uint64_t checksum;
+};
+
+struct bt_ctf_writer_stream {
+	struct bt_ctf_writer_stream_class *stream_class;
+	unsigned int id;		/* in the stream class */
+	int fd;
+	struct ctf_extent extent;
+	struct ctf_stream_pos pos;	/* based on the mapped extent */
+	struct packet_fields fields;
+	uint64_t data_offset;		/* end of the packet context, in bits */
+	uint64_t packet_events;		/* events in the current packet */
+	uint64_t first_timestamp;	/* of the current packet */
+	uint64_t last_timestamp;	/* of the stream */
+	struct definition_integer id_def, timestamp_def;
+};
+
+static const char *tsdl_keywords[] = {
+	"align", "callsite", "char", "clock", "const", "double", "enum",
+	"env", "event", "floating_point", "float", "integer", "int", "long",
+	"short", "signed", "stream", "string", "struct", "trace",
+	"typealias", "typedef", "unsigned", "variant", "void", "_Bool",
+	"_Complex", "_Imaginary",
+};
+
+static const char *field_type_names[] = {
+	[ BT_CTF_WRITER_UINT8 ] = "uint8_t",
+	[ BT_CTF_WRITER_UINT16 ] = "uint16_t",
+	[ BT_CTF_WRITER_UINT32 ] = "uint32_t",
+	[ BT_CTF_WRITER_UINT64 ] = "uint64_t",
+	[ BT_CTF_WRITER_INT8 ] = "int8_t",
+	[ BT_CTF_WRITER_INT16 ] = "int16_t",
+	[ BT_CTF_WRITER_INT32 ] = "int32_t",
+	[ BT_CTF_WRITER_INT64 ] = "int64_t",
+	[ BT_CTF_WRITER_FLOAT ] = "floating_point { exp_dig = 8; mant_dig = 24; align = 32; }",
+	[ BT_CTF_WRITER_DOUBLE ] = "floating_point { exp_dig = 11; mant_dig = 53; align = 64; }",
+	[ BT_CTF_WRITER_STRING ] = "string",
+};
+
+/* Index of the 8, 16, 32 and 64-bit integer declarations */
+static
+int int_decl_index(size_t len)
+{
+	switch (len) {
+	case 8:		return 0;
+	case 16:	return 1;
+	case 32:	return 2;
+	default:	return 3;
+	}
+}
+
+static
+struct declaration_integer *uint_decl(struct bt_ctf_writer *writer,
+		size_t len)
+{
+	return writer->uint_decl[int_decl_index(len)];
+}
+
+static
+void init_integer_def(struct definition_integer *def,
+		struct declaration_integer *decl)
+{
+	memset(def, 0, sizeof(*def));
+	def->p.declaration = &decl->p;
+	def->declaration = decl;
+}
+
+static
+int write_uint(struct ctf_stream_pos *pos, struct declaration_integer *decl,
+		uint64_t value)
+{
+	struct definition_integer def;
+
+	init_integer_def(&def, decl);
+	def.value._unsigned = value;
+	return ctf_integer_write(&pos->parent, &def.p);
+}
+
+/* Write an unsigned integer at offset, in bits, of the current packet. */
+static
+int rewrite_uint(struct ctf_stream_pos *pos, struct declaration_integer *decl,
+		uint64_t offset, uint64_t value)
+{
+	int64_t end = pos->offset;
+	int ret;
+
+	pos->offset = offset;
+	ret = write_uint(pos, decl, value);
+	pos->offset = end;
+	return ret;
+}
+
+static
+int open_packet(struct bt_ctf_writer_stream *stream)
+{
+	struct bt_ctf_writer *writer = stream->stream_class->writer;
+	struct ctf_stream_pos *pos = &stream->pos;
+	struct declaration_integer *u8 = uint_decl(writer, 8),
+		*u32 = uint_decl(writer, 32), *u64 = uint_decl(writer, 64);
+	int i, ret;
+
+	ret = ctf_extent_next_packet(&stream->extent, pos);
+	if (ret)
+		return ret;
+	pos->content_size = -1ULL;	/* Unknown at this point */
+
+	/* Packet header */
+	ret = write_uint(pos, u32, CTF_MAGIC);
+	for (i = 0; !ret && i < BABELTRACE_UUID_LEN; i++)
+		ret = write_uint(pos, u8, writer->uuid[i]);
+	if (!ret)
+		ret = write_uint(pos, u32, stream->stream_class->id);
+
+	/* Packet context, completed on close */
+	ctf_align_pos(pos, u64->p.alignment);
+	stream->fields.timestamp_begin = pos->offset;
+	if (!ret)
+		ret = write_uint(pos, u64, 0);
+	stream->fields.timestamp_end = pos->offset;
+	if (!ret)
+		ret = write_uint(pos, u64, 0);
+	stream->fields.content_size = pos->offset;
+	if (!ret)
+		ret = write_uint(pos, u64, -1ULL);
+	stream->fields.packet_size = pos->offset;
+	if (!ret)
+		ret = write_uint(pos, u64, pos->packet_size);
+	stream->fields.checksum = pos->offset;
+	if (!ret)
+		ret = write_uint(pos, u32, 0);
+	if (ret) {
+		fprintf(stderr, "[error] Packet size too small for the packet header and context.\n");
+		return ret;
+	}
+	stream->data_offset = pos->offset;
+	stream->packet_events = 0;
+	return 0;
+}
+
+/*
+ * Set the packet context fields known once the packet is full, and the
+ * packet checksum (see babeltrace/ctf/crc32c.h). The last packet of a
+ * stream is shrunk to its content.
+ */
+static
+int close_packet(struct bt_ctf_writer_stream *stream, int shrink)
+{
+	struct bt_ctf_writer *writer = stream->stream_class->writer;
+	struct ctf_stream_pos *pos = &stream->pos;
+	struct declaration_integer *u32 = uint_decl(writer, 32),
+		*u64 = uint_decl(writer, 64);
+	char *data = mmap_align_addr(pos->base_mma) + pos->mmap_base_offset
+		+ stream->data_offset / CHAR_BIT;
+	uint64_t content_size = pos->offset;
+	int ret;
+
+	if (!pos->base_mma)
+		return -EIO;	/* the packet could not be opened */
+	if (shrink)
+		pos->packet_size = ALIGN(content_size, CHAR_BIT);
+	ret = rewrite_uint(pos, u64, stream->fields.content_size, content_size);
+	if (!ret)
+		ret = rewrite_uint(pos, u64, stream->fields.packet_size,
+				pos->packet_size);
+	if (!ret && stream->packet_events) {
+		ret = rewrite_uint(pos, u64, stream->fields.timestamp_begin,
+				stream->first_timestamp);
+		if (!ret)
+			ret = rewrite_uint(pos, u64, stream->fields.timestamp_end,
+					stream->last_timestamp);
+	}
+	if (!ret)
+		ret = rewrite_uint(pos, u32, stream->fields.checksum,
+			ctf_crc32c(0, data, (ALIGN(content_size, CHAR_BIT)
+				- stream->data_offset) / CHAR_BIT));
+	return ret;
+}
+
+static
+int close_stream(struct bt_ctf_writer_stream *stream)
+{
+	int ret;
+
+	ret = close_packet(stream, 1);
+	if (ctf_fini_pos(&stream->pos))
+		ret = -1;
+	if (!ret)
+		ret = ctf_extent_truncate(&stream->extent,
+				stream->pos.packet_size / CHAR_BIT);
+	if (close(stream->fd)) {
+		perror("Error closing stream file");
+		ret = -errno;
+	}
+	g_free(stream);
+	return ret;
+}
+
+/*
+ * Write one event at the current position. Returns -EFAULT if the
+ * event does not fit in the current packet.
+ */
+static
+int write_event(struct bt_ctf_writer_stream *stream,
+		struct bt_ctf_writer_event_class *event_class,
+		uint64_t timestamp, const union bt_ctf_writer_value *values)
+{
+	struct bt_stream_pos *ppos = &stream->pos.parent;
+	unsigned int i;
+	int ret;
+
+	stream->id_def.value._unsigned = event_class->id;
+	ret = ctf_integer_write(ppos, &stream->id_def.p);
+	if (ret)
+		return ret;
+	stream->timestamp_def.value._unsigned = timestamp;
+	ret = ctf_integer_write(ppos, &stream->timestamp_def.p);
+	if (ret)
+		return ret;
+	for (i = 0; i < event_class->fields->len; i++) {
+		struct writer_field *field = &g_array_index(event_class->fields,
+				struct writer_field, i);
+		const union bt_ctf_writer_value *value = &values[i];
+		union {
+			float f;
+			uint32_t u;
+		} f32;
+		union {
+			double d;
+			uint64_t u;
+		} f64;
+
+		/* Floats are written as integers holding their bits. */
+		switch (field->type) {
+		case BT_CTF_WRITER_UINT8:
+		case BT_CTF_WRITER_UINT16:
+		case BT_CTF_WRITER_UINT32:
+		case BT_CTF_WRITER_UINT64:
+			field->def.integer.value._unsigned = value->u;
+			ret = ctf_integer_write(ppos, &field->def.integer.p);
+			break;
+		case BT_CTF_WRITER_INT8:
+		case BT_CTF_WRITER_INT16:
+		case BT_CTF_WRITER_INT32:
+		case BT_CTF_WRITER_INT64:
+			field->def.integer.value._signed = value->s;
+			ret = ctf_integer_write(ppos, &field->def.integer.p);
+			break;
+		case BT_CTF_WRITER_FLOAT:
+			f32.f = value->d;
+			field->def.integer.value._unsigned = f32.u;
+			ret = ctf_integer_write(ppos, &field->def.integer.p);
+			break;
+		case BT_CTF_WRITER_DOUBLE:
+			f64.d = value->d;
+			field->def.integer.value._unsigned = f64.u;
+			ret = ctf_integer_write(ppos, &field->def.integer.p);
+			break;
+		case BT_CTF_WRITER_STRING:
+			field->def.string.value = (char *) value->str;
+			field->def.string.len = strlen(value->str) + 1;
+			ret = ctf_string_write(ppos, &field->def.string.p);
+			break;
+		default:
+			assert(0);
+		}
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Clear what was written of an event which did not fit in the packet,
+ * and move back to its start.
+ */
+static
+void discard_event(struct bt_ctf_writer_stream *stream, int64_t event_offset)
+{
+	struct ctf_stream_pos *pos = &stream->pos;
+
+	memset(mmap_align_addr(pos->base_mma) + pos->mmap_base_offset
+			+ event_offset / CHAR_BIT,
+		0, (pos->offset - event_offset) / CHAR_BIT);
+	pos->offset = event_offset;
+}
+
+size_t bt_ctf_writer_append_events(struct bt_ctf_writer_stream *stream,
+		struct bt_ctf_writer_event_class *event_class,
+		const uint64_t *timestamps,
+		const union bt_ctf_writer_value *values,
+		size_t nr_events)
+{
+	struct ctf_stream_pos *pos = &stream->pos;
+	size_t i;
+	int ret;
+
+	if (event_class->stream_class != stream->stream_class) {
+		fprintf(stderr, "[error] Event class %s does not belong to the stream class.\n",
+			event_class->name);
+		return 0;
+	}
+	if (!pos->base_mma)
+		return 0;
+	event_class->frozen = 1;
+	for (i = 0; i < nr_events; i++, values += event_class->fields->len) {
+		int64_t event_offset = pos->offset;
+
+		if (timestamps[i] < stream->last_timestamp) {
+			fprintf(stderr, "[error] Event timestamps decrease within a stream.\n");
+			break;
+		}
+		ret = write_event(stream, event_class, timestamps[i], values);
+		if (ret == -EFAULT && stream->packet_events) {
+			/* Retry in a new packet. */
+			discard_event(stream, event_offset);
+			ret = close_packet(stream, 0);
+			if (!ret)
+				ret = open_packet(stream);
+			if (!ret) {
+				event_offset = pos->offset;
+				ret = write_event(stream, event_class,
+						timestamps[i], values);
+			}
+		}
+		if (ret == -EFAULT) {
+			discard_event(stream, event_offset);
+			fprintf(stderr, "[error] Event larger than the packet size (%zu bytes).\n",
+				stream->extent.packet_len);
+		}
+		if (ret)
+			break;
+		if (!stream->packet_events++)
+			stream->first_timestamp = timestamps[i];
+		stream->last_timestamp = timestamps[i];
+	}
+	return i;
+}
+
+struct bt_ctf_writer_stream *
+	bt_ctf_writer_create_stream(struct bt_ctf_writer_stream_class *stream_class)
+{
+	struct bt_ctf_writer *writer = stream_class->writer;
+	struct bt_ctf_writer_stream *stream;
+	char name[PATH_MAX];
+
+	stream = g_new0(struct bt_ctf_writer_stream, 1);
+	stream->stream_class = stream_class;
+	stream->id = stream_class->streams->len;
+	init_integer_def(&stream->id_def, uint_decl(writer, 32));
+	init_integer_def(&stream->timestamp_def, uint_decl(writer, 64));
+	snprintf(name, PATH_MAX, "stream_%u_%u", stream_class->id, stream->id);
+	stream->fd = openat(writer->dirfd, name, O_RDWR | O_CREAT | O_EXCL,
+			OUTPUT_FILE_MODE);
+	if (stream->fd < 0) {
+		perror("Error creating stream file");
+		goto error;
+	}
+	ctf_extent_init(&stream->extent, stream->fd, writer->packet_len);
+	ctf_init_pos(&stream->pos, NULL, -1, O_RDWR);
+	if (open_packet(stream)) {
+		ctf_fini_pos(&stream->pos);
+		close(stream->fd);
+		goto error;
+	}
+	g_ptr_array_add(stream_class->streams, stream);
+	return stream;
+
+error:
+	g_free(stream);
+	return NULL;
+}
+
+static
+int is_identifier(const char *name)
+{
+	unsigned int i;
+
+	if (!g_ascii_isalpha(name[0]) && name[0] != '_')
+		return 0;
+	for (i = 1; name[i]; i++) {
+		if (!g_ascii_isalnum(name[i]) && name[i] != '_')
+			return 0;
+	}
+	for (i = 0; i < sizeof(tsdl_keywords) / sizeof(tsdl_keywords[0]); i++) {
+		if (!strcmp(name, tsdl_keywords[i]))
+			return 0;
+	}
+	return 1;
+}
+
+int bt_ctf_writer_event_class_add_field(struct bt_ctf_writer_event_class *event_class,
+		const char *name, enum bt_ctf_writer_field_type type)
+{
+	struct bt_ctf_writer *writer = event_class->stream_class->writer;
+	struct writer_field field;
+	unsigned int i;
+
+	if (event_class->frozen) {
+		fprintf(stderr, "[error] Fields must be added to event class %s before its first event.\n",
+			event_class->name);
+		return -EBUSY;
+	}
+	if (!is_identifier(name) || type > BT_CTF_WRITER_STRING) {
+		fprintf(stderr, "[error] Invalid field %s.\n", name);
+		return -EINVAL;
+	}
+	for (i = 0; i < event_class->fields->len; i++) {
+		if (!strcmp(g_array_index(event_class->fields,
+				struct writer_field, i).name, name)) {
+			fprintf(stderr, "[error] Duplicate field %s in event class %s.\n",
+				name, event_class->name);
+			return -EEXIST;
+		}
+	}
+	memset(&field, 0, sizeof(field));
+	field.type = type;
+	switch (type) {
+	case BT_CTF_WRITER_UINT8:
+	case BT_CTF_WRITER_UINT16:
+	case BT_CTF_WRITER_UINT32:
+	case BT_CTF_WRITER_UINT64:
+		init_integer_def(&field.def.integer,
+			writer->uint_decl[type - BT_CTF_WRITER_UINT8]);
+		break;
+	case BT_CTF_WRITER_INT8:
+	case BT_CTF_WRITER_INT16:
+	case BT_CTF_WRITER_INT32:
+	case BT_CTF_WRITER_INT64:
+		init_integer_def(&field.def.integer,
+			writer->int_decl[type - BT_CTF_WRITER_INT8]);
+		break;
+	case BT_CTF_WRITER_FLOAT:
+		init_integer_def(&field.def.integer, uint_decl(writer, 32));
+		break;
+	case BT_CTF_WRITER_DOUBLE:
+		init_integer_def(&field.def.integer, uint_decl(writer, 64));
+		break;
+	case BT_CTF_WRITER_STRING:
+		field.def.string.p.declaration = &writer->string_decl->p;
+		field.def.string.declaration = writer->string_decl;
+		break;
+	}
+	field.name = g_strdup(name);
+	g_array_append_val(event_class->fields, field);
+	return 0;
+}
+
+struct bt_ctf_writer_event_class *
+	bt_ctf_writer_add_event_class(struct bt_ctf_writer_stream_class *stream_class,
+		const char *name)
+{
+	struct bt_ctf_writer_event_class *event_class;
+
+	if (!name[0] || strpbrk(name, "\"\\\n")) {
+		fprintf(stderr, "[error] Invalid event class name %s.\n", name);
+		return NULL;
+	}
+	event_class = g_new0(struct bt_ctf_writer_event_class, 1);
+	event_class->stream_class = stream_class;
+	event_class->id = stream_class->event_classes->len;
+	event_class->name = g_strdup(name);
+	event_class->fields = g_array_new(FALSE, TRUE,
+			sizeof(struct writer_field));
+	g_ptr_array_add(stream_class->event_classes, event_class);
+	return event_class;
+}
+
+static
+void event_class_free(struct bt_ctf_writer_event_class *event_class)
+{
+	unsigned int i;
+
+	for (i = 0; i < event_class->fields->len; i++)
+		g_free(g_array_index(event_class->fields,
+				struct writer_field, i).name);
+	g_array_free(event_class->fields, TRUE);
+	g_free(event_class->name);
+	g_free(event_class);
+}
+
+struct bt_ctf_writer_stream_class *
+	bt_ctf_writer_add_stream_class(struct bt_ctf_writer *writer)
+{
+	struct bt_ctf_writer_stream_class *stream_class;
+
+	stream_class = g_new0(struct bt_ctf_writer_stream_class, 1);
+	stream_class->writer = writer;
+	stream_class->id = writer->stream_classes->len;
+	stream_class->event_classes = g_ptr_array_new();
+	stream_class->streams = g_ptr_array_new();
+	g_ptr_array_add(writer->stream_classes, stream_class);
+	return stream_class;
+}
+
+int bt_ctf_writer_set_packet_size(struct bt_ctf_writer *writer,
+		size_t packet_size)
+{
+	if (!packet_size || packet_size % getpagesize()) {
+		fprintf(stderr, "[error] Packet size must be a multiple of the page size (%d bytes).\n",
+			getpagesize());
+		return -EINVAL;
+	}
+	writer->packet_len = packet_size;
+	return 0;
+}
+
+static
+void print_event_class(FILE *fp, struct bt_ctf_writer_event_class *event_class)
+{
+	unsigned int i;
+
+	fprintf(fp, "event {\n"
+		"	name = \"%s\";\n"
+		"	id = %u;\n"
+		"	stream_id = %u;\n",
+		event_class->name, event_class->id,
+		event_class->stream_class->id);
+	if (event_class->fields->len) {
+		fprintf(fp, "	fields := struct {\n");
+		for (i = 0; i < event_class->fields->len; i++) {
+			struct writer_field *field =
+				&g_array_index(event_class->fields,
+					struct writer_field, i);
+
+			fprintf(fp, "		%s %s;\n",
+				field_type_names[field->type], field->name);
+		}
+		fprintf(fp, "	};\n");
+	}
+	fprintf(fp, "};\n\n");
+}
+
+static
+void print_metadata(FILE *fp, struct bt_ctf_writer *writer)
+{
+	char uuid_str[BABELTRACE_UUID_STR_LEN];
+	unsigned int i, j;
+
+	babeltrace_uuid_unparse(writer->uuid, uuid_str);
+	fprintf(fp, "/* CTF 1.8 */\n"
+		"typealias integer { size = 8; align = 8; signed = false; } := uint8_t;\n"
+		"typealias integer { size = 16; align = 16; signed = false; } := uint16_t;\n"
+		"typealias integer { size = 32; align = 32; signed = false; } := uint32_t;\n"
+		"typealias integer { size = 64; align = 64; signed = false; } := uint64_t;\n"
+		"typealias integer { size = 8; align = 8; signed = true; } := int8_t;\n"
+		"typealias integer { size = 16; align = 16; signed = true; } := int16_t;\n"
+		"typealias integer { size = 32; align = 32; signed = true; } := int32_t;\n"
+		"typealias integer { size = 64; align = 64; signed = true; } := int64_t;\n"
+		"\n"
+		"trace {\n"
+		"	major = 1;\n"
+		"	minor = 8;\n"
+		"	uuid = \"%s\";\n"
+		"	byte_order = %s;\n"
+		"	packet.header := struct {\n"
+		"		uint32_t magic;\n"
+		"		uint8_t  uuid[16];\n"
+		"		uint32_t stream_id;\n"
+		"	};\n"
+		"};\n\n",
+		uuid_str, BYTE_ORDER == LITTLE_ENDIAN ? "le" : "be");
+	for (i = 0; i < writer->stream_classes->len; i++) {
+		struct bt_ctf_writer_stream_class *stream_class =
+			g_ptr_array_index(writer->stream_classes, i);
+
+		fprintf(fp, "stream {\n"
+			"	id = %u;\n"
+			"	packet.context := struct {\n"
+			"		uint64_t timestamp_begin;\n"
+			"		uint64_t timestamp_end;\n"
+			"		uint64_t content_size;\n"
+			"		uint64_t packet_size;\n"
+			"		uint32_t checksum;\n"
+			"	};\n"
+			"	event.header := struct {\n"
+			"		uint32_t id;\n"
+			"		uint64_t timestamp;\n"
+			"	};\n"
+			"};\n\n", stream_class->id);
+		for (j = 0; j < stream_class->event_classes->len; j++)
+			print_event_class(fp,
+				g_ptr_array_index(stream_class->event_classes, j));
+	}
+}
+
+static
+int write_metadata(struct bt_ctf_writer *writer)
+{
+	FILE *fp;
+	int fd;
+
+	fd = openat(writer->dirfd, "metadata", O_WRONLY | O_CREAT | O_EXCL,
+			OUTPUT_FILE_MODE);
+	if (fd < 0) {
+		perror("Error creating metadata file");
+		return -errno;
+	}
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		perror("fdopen");
+		close(fd);
+		return -errno;
+	}
+	print_metadata(fp, writer);
+	if (fclose(fp)) {
+		perror("Error writing metadata file");
+		return -errno;
+	}
+	return 0;
+}
+
+static
+void writer_free(struct bt_ctf_writer *writer)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		if (writer->uint_decl[i])
+			bt_declaration_unref(&writer->uint_decl[i]->p);
+		if (writer->int_decl[i])
+			bt_declaration_unref(&writer->int_decl[i]->p);
+	}
+	if (writer->string_decl)
+		bt_declaration_unref(&writer->string_decl->p);
+	for (i = 0; i < writer->stream_classes->len; i++) {
+		struct bt_ctf_writer_stream_class *stream_class =
+			g_ptr_array_index(writer->stream_classes, i);
+		unsigned int j;
+
+		for (j = 0; j < stream_class->event_classes->len; j++)
+			event_class_free(g_ptr_array_index(stream_class->event_classes, j));
+		g_ptr_array_free(stream_class->event_classes, TRUE);
+		g_ptr_array_free(stream_class->streams, TRUE);
+		g_free(stream_class);
+	}
+	g_ptr_array_free(writer->stream_classes, TRUE);
+	if (writer->dirfd >= 0 && close(writer->dirfd))
+		perror("Error closing trace directory");
+	g_free(writer);
+}
+
+int bt_ctf_writer_close(struct bt_ctf_writer *writer)
+{
+	unsigned int i, j;
+	int ret = 0;
+
+	for (i = 0; i < writer->stream_classes->len; i++) {
+		struct bt_ctf_writer_stream_class *stream_class =
+			g_ptr_array_index(writer->stream_classes, i);
+
+		for (j = 0; j < stream_class->streams->len; j++) {
+			if (close_stream(g_ptr_array_index(stream_class->streams, j)))
+				ret = -1;
+		}
+	}
+	if (!ret)
+		ret = write_metadata(writer);
+	writer_free(writer);
+	return ret;
+}
+
+struct bt_ctf_writer *bt_ctf_writer_create(const char *path)
+{
+	struct bt_ctf_writer *writer;
+	int i;
+
+	writer = g_new0(struct bt_ctf_writer, 1);
+	writer->stream_classes = g_ptr_array_new();
+	writer->packet_len = DEFAULT_PACKET_LEN;
+	writer->dirfd = -1;
+	if (mkdir(path, OUTPUT_DIR_MODE)) {
+		perror("Error creating trace directory");
+		goto error;
+	}
+	writer->dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	if (writer->dirfd < 0) {
+		perror("Error opening trace directory");
+		goto error;
+	}
+	if (babeltrace_uuid_generate(writer->uuid)) {
+		fprintf(stderr, "[error] Unable to generate trace UUID.\n");
+		goto error;
+	}
+	for (i = 0; i < 4; i++) {
+		size_t len = 8 << i;
+
+		writer->uint_decl[i] = bt_integer_declaration_new(len,
+				BYTE_ORDER, 0, len, 10, CTF_STRING_NONE, NULL);
+		writer->int_decl[i] = bt_integer_declaration_new(len,
+				BYTE_ORDER, 1, len, 10, CTF_STRING_NONE, NULL);
+	}
+	writer->string_decl = bt_string_declaration_new(CTF_STRING_UTF8);
+	return writer;
+
+error:
+	writer_free(writer);
+	return NULL;
+}
@@ -0,0 +1,107 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Stream files written through mapped extents.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#define _GNU_SOURCE
+#include <config.h>
+#include <babeltrace/ctf/extent.h>
+#include <babeltrace/ctf/types.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void ctf_extent_init(struct ctf_extent *extent, int fd, size_t packet_len)
+{
+	memset(extent, 0, sizeof(*extent));
+	extent->fd = fd;
+	extent->packet_len = packet_len;
+	extent->extent_len = CTF_EXTENT_LEN - CTF_EXTENT_LEN % packet_len;
+	if (!extent->extent_len)
+		extent->extent_len = packet_len;
+}
+
+static
+int map_extent(struct ctf_extent *extent, struct ctf_stream_pos *pos,
+		off_t offset)
+{
+	int ret;
+
+	if (pos->base_mma) {
+		ret = munmap_align(pos->base_mma);
+		pos->base_mma = NULL;
+		pos->content_size_loc = NULL;
+		if (ret) {
+			perror("Error unmapping stream file extent");
+			return -errno;
+		}
+	}
+	ret = posix_fallocate(extent->fd, offset, extent->extent_len);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to allocate stream file extent: %s.\n",
+			strerror(ret));
+		return -ret;
+	}
+	pos->base_mma = mmap_align(extent->extent_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED, extent->fd, offset);
+	if (pos->base_mma == MAP_FAILED) {
+		pos->base_mma = NULL;
+		perror("Error mapping stream file extent");
+		return -errno;
+	}
+	extent->extent_offset = offset;
+	return 0;
+}
+
+int ctf_extent_next_packet(struct ctf_extent *extent,
+		struct ctf_stream_pos *pos)
+{
+	int ret;
+
+	if (pos->base_mma)
+		extent->packet_offset += extent->packet_len;
+	if (!pos->base_mma || extent->packet_offset + extent->packet_len
+			> extent->extent_offset + extent->extent_len) {
+		ret = map_extent(extent, pos, extent->packet_offset);
+		if (ret)
+			return ret;
+	}
+	pos->mmap_base_offset = extent->packet_offset - extent->extent_offset;
+	pos->packet_size = extent->packet_len * CHAR_BIT;
+	pos->offset = 0;
+	return 0;
+}
+
+int ctf_extent_truncate(struct ctf_extent *extent, size_t packet_size)
+{
+	if (ftruncate(extent->fd, extent->packet_offset + packet_size)) {
+		perror("Error truncating stream file");
+		return -errno;
+	}
+	return 0;
+}
@@ -0,0 +1,706 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Event rate histograms computed from the packet index.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/histogram.h>
+#include <babeltrace/format.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <errno.h>
+#include <glib.h>
+
+#define NSEC_PER_SEC	((uint64_t) 1000000000)
+
+/* Width of the histogram bars printed by the histogram format. */
+#define BAR_WIDTH	40
+
+uint64_t opt_bucket_len;
+double opt_sample;
+
+/* A decoded packet and its exact number of events. */
+struct histogram_sample {
+	size_t index;
+	uint64_t events;
+};
+
+struct histogram_stream {
+	struct ctf_file_stream *cfs;
+	uint64_t sampled_bytes;		/* event data of the decoded packets */
+	uint64_t sampled_events;
+	GArray *samples;		/* struct histogram_sample, by packet */
+	GArray *class_events;		/* uint64_t, decoded events by event id */
+	GArray *events;			/* double, by bucket */
+	GArray *lost;			/* uint64_t, by bucket */
+};
+
+struct histogram_class {
+	GQuark name;
+	double events;
+};
+
+struct bt_ctf_histogram {
+	uint64_t bucket_len;		/* ns */
+	double sample;
+	uint64_t begin, end;		/* ns */
+	size_t nr_buckets;
+	uint64_t nr_packets, nr_sampled;
+	GPtrArray *streams;		/* struct histogram_stream */
+	GArray *events;			/* double, totals by bucket */
+	GArray *lost;			/* uint64_t, totals by bucket */
+	GArray *classes;		/* struct histogram_class */
+};
+
+/*
+ * Inherit from both struct bt_stream_pos and struct bt_trace_descriptor.
+ */
+struct histogram_pos {
+	struct bt_stream_pos parent;
+	struct bt_trace_descriptor trace_descriptor;
+	FILE *fp;
+	struct bt_ctf_histogram *histogram;
+};
+
+static
+struct bt_ctf_histogram *histogram_alloc(uint64_t bucket_len, double sample)
+{
+	struct bt_ctf_histogram *h;
+
+	if (!(sample >= 0.0 && sample <= 1.0))
+		return NULL;
+	h = g_new0(struct bt_ctf_histogram, 1);
+	h->bucket_len = bucket_len;
+	h->sample = sample;
+	h->begin = -1ULL;
+	h->streams = g_ptr_array_new();
+	h->events = g_array_new(FALSE, TRUE, sizeof(double));
+	h->lost = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	h->classes = g_array_new(FALSE, TRUE, sizeof(struct histogram_class));
+	return h;
+}
+
+void bt_ctf_histogram_destroy(struct bt_ctf_histogram *h)
+{
+	unsigned int i;
+
+	if (!h)
+		return;
+	for (i = 0; i < h->streams->len; i++) {
+		struct histogram_stream *hs = g_ptr_array_index(h->streams, i);
+
+		g_array_free(hs->samples, TRUE);
+		g_array_free(hs->class_events, TRUE);
+		g_array_free(hs->events, TRUE);
+		g_array_free(hs->lost, TRUE);
+		g_free(hs);
+	}
+	g_ptr_array_free(h->streams, TRUE);
+	g_array_free(h->events, TRUE);
+	g_array_free(h->lost, TRUE);
+	g_array_free(h->classes, TRUE);
+	g_free(h);
+}
+
+/* Size of the events of a packet, in bytes. */
+static
+uint64_t packet_event_bytes(const struct packet_index *packet)
+{
+	if (packet->content_size <= packet->data_offset)
+		return 0;
+	return (packet->content_size - packet->data_offset) / CHAR_BIT;
+}
+
+/*
+ * Decode the events of packet i, counting them by event class.
+ */
+static
+int histogram_sample_packet(struct bt_ctf_histogram *h,
+		struct histogram_stream *hs, const struct packet_index *packet,
+		size_t i)
+{
+	struct ctf_stream_pos *pos = &hs->cfs->pos;
+	struct ctf_stream_definition *stream = &hs->cfs->parent;
+	struct histogram_sample sample;
+	int ret = 0;
+
+	sample.index = i;
+	sample.events = 0;
+	pos->packet_seek(&pos->parent, i, SEEK_SET);
+	while (pos->offset != EOF && pos->cur_index == i
+			&& pos->offset < pos->content_size) {
+		ret = pos->parent.event_cb(&pos->parent, stream);
+		if (ret)
+			break;
+		if (unlikely(stream->event_id >= hs->class_events->len))
+			g_array_set_size(hs->class_events, stream->event_id + 1);
+		g_array_index(hs->class_events, uint64_t, stream->event_id)++;
+		sample.events++;
+	}
+	/* Lost events are taken from the index. */
+	stream->events_discarded = 0;
+	if (ret && ret != EOF) {
+		fprintf(stderr, "[error] Unable to decode packet %zu of stream %s.\n",
+			i, stream->path);
+		return ret;
+	}
+	g_array_append_val(hs->samples, sample);
+	hs->sampled_events += sample.events;
+	hs->sampled_bytes += packet_event_bytes(packet);
+	h->nr_sampled++;
+	return 0;
+}
+
+/*
+ * Find the time span of the stream and decode its sample packets: the
+ * first packet holding events, then one packet every 1 / h->sample.
+ */
+static
+int histogram_add_stream(struct bt_ctf_histogram *h,
+		struct ctf_file_stream *cfs)
+{
+	struct ctf_packet_index *index = cfs->pos.packet_index;
+	struct histogram_stream *hs;
+	double credit = 0.0;
+	size_t i, len;
+	int ret;
+
+	hs = g_new0(struct histogram_stream, 1);
+	hs->cfs = cfs;
+	hs->samples = g_array_new(FALSE, TRUE, sizeof(struct histogram_sample));
+	hs->class_events = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	hs->events = g_array_new(FALSE, TRUE, sizeof(double));
+	hs->lost = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	g_ptr_array_add(h->streams, hs);
+
+	ctf_packet_index_complete(index);
+	len = ctf_packet_index_len(index);
+	if (!len)
+		return 0;
+	h->begin = MIN(h->begin, ctf_get_real_timestamp(&cfs->parent,
+			ctf_packet_index_timestamp_begin(index, 0)));
+	h->end = MAX(h->end, ctf_get_real_timestamp(&cfs->parent,
+			ctf_packet_index_timestamp_end(index, len - 1)));
+	h->nr_packets += len;
+	for (i = 0; i < len; i++) {
+		struct packet_index packet;
+		int sample = 0;
+
+		credit += h->sample;
+		if (credit >= 1.0) {
+			credit -= 1.0;
+			sample = 1;
+		}
+		if (!hs->sampled_events)
+			sample = 1;
+		if (!sample)
+			continue;
+		ctf_packet_index_get(index, i, &packet);
+		if (!packet_event_bytes(&packet))
+			continue;
+		ret = histogram_sample_packet(h, hs, &packet, i);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int histogram_add_trace(struct bt_ctf_histogram *h, struct ctf_trace *trace)
+{
+	int i, j, ret;
+
+	for (i = 0; i < trace->streams->len; i++) {
+		struct ctf_stream_declaration *stream_class;
+
+		stream_class = g_ptr_array_index(trace->streams, i);
+		if (!stream_class)
+			continue;
+		for (j = 0; j < stream_class->streams->len; j++) {
+			struct ctf_stream_definition *stream;
+
+			stream = g_ptr_array_index(stream_class->streams, j);
+			if (!stream)
+				continue;
+			ret = histogram_add_stream(h,
+				container_of(stream, struct ctf_file_stream,
+					parent));
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Spread the events of a packet over the buckets it overlaps, in
+ * proportion to the overlap.
+ */
+static
+void histogram_spread(struct bt_ctf_histogram *h, GArray *events,
+		double nr_events, uint64_t begin, uint64_t end)
+{
+	size_t first, last, k;
+
+	begin = CLAMP(begin, h->begin, h->end);
+	end = CLAMP(end, begin, h->end);
+	first = (begin - h->begin) / h->bucket_len;
+	last = (end - h->begin) / h->bucket_len;
+	if (first == last) {
+		g_array_index(events, double, first) += nr_events;
+		return;
+	}
+	for (k = first; k <= last; k++) {
+		uint64_t b = h->begin + k * h->bucket_len;
+		uint64_t e = b + h->bucket_len;
+
+		b = MAX(b, begin);
+		e = MIN(e, end);
+		g_array_index(events, double, k) +=
+			nr_events * (double) (e - b) / (double) (end - begin);
+	}
+}
+
+static
+void histogram_add_class(struct bt_ctf_histogram *h, GQuark name,
+		double events)
+{
+	struct histogram_class class;
+	unsigned int i;
+
+	for (i = 0; i < h->classes->len; i++) {
+		struct histogram_class *c = &g_array_index(h->classes,
+				struct histogram_class, i);
+
+		if (c->name == name) {
+			c->events += events;
+			return;
+		}
+	}
+	class.name = name;
+	class.events = events;
+	g_array_append_val(h->classes, class);
+}
+
+/*
+ * Estimate the events of each packet of the stream and spread them
+ * over the buckets. Decoded packets count exactly.
+ */
+static
+void histogram_compute_stream(struct bt_ctf_histogram *h,
+		struct histogram_stream *hs)
+{
+	struct ctf_packet_index *index = hs->cfs->pos.packet_index;
+	struct ctf_stream_definition *stream = &hs->cfs->parent;
+	double mean_bytes = 0.0, total = 0.0;
+	uint64_t prev_discarded = 0;
+	size_t i, s = 0, len;
+
+	g_array_set_size(hs->events, h->nr_buckets);
+	g_array_set_size(hs->lost, h->nr_buckets);
+	if (hs->sampled_events)
+		mean_bytes = (double) hs->sampled_bytes / hs->sampled_events;
+	len = ctf_packet_index_len(index);
+	for (i = 0; i < len; i++) {
+		struct packet_index packet;
+		uint64_t begin, end, lost;
+		double nr_events = 0.0;
+
+		ctf_packet_index_get(index, i, &packet);
+		begin = ctf_get_real_timestamp(stream, packet.timestamp_begin);
+		end = ctf_get_real_timestamp(stream, packet.timestamp_end);
+		if (s < hs->samples->len && g_array_index(hs->samples,
+				struct histogram_sample, s).index == i) {
+			nr_events = g_array_index(hs->samples,
+				struct histogram_sample, s++).events;
+		} else if (mean_bytes > 0.0) {
+			nr_events = packet_event_bytes(&packet) / mean_bytes;
+		}
+		histogram_spread(h, hs->events, nr_events, begin, end);
+		total += nr_events;
+
+		/* Same wrap-around handling as ctf_packet_seek(). */
+		lost = packet.events_discarded - prev_discarded;
+		if (i > 0 && packet.events_discarded_len == 32)
+			lost = (uint32_t) lost;
+		prev_discarded = packet.events_discarded;
+		g_array_index(hs->lost, uint64_t,
+			(CLAMP(begin, h->begin, h->end) - h->begin)
+				/ h->bucket_len) += lost;
+	}
+	for (i = 0; i < h->nr_buckets; i++) {
+		g_array_index(h->events, double, i) +=
+			g_array_index(hs->events, double, i);
+		g_array_index(h->lost, uint64_t, i) +=
+			g_array_index(hs->lost, uint64_t, i);
+	}
+	if (!hs->sampled_events)
+		return;
+	for (i = 0; i < hs->class_events->len; i++) {
+		uint64_t count = g_array_index(hs->class_events, uint64_t, i);
+		struct ctf_event_declaration *event_class;
+
+		if (!count)
+			continue;
+		event_class = g_ptr_array_index(stream->stream_class->events_by_id, i);
+		histogram_add_class(h, event_class->name,
+			total * count / hs->sampled_events);
+	}
+}
+
+static
+int compare_classes(const void *a, const void *b)
+{
+	const struct histogram_class *ca = a, *cb = b;
+
+	if (ca->events != cb->events)
+		return ca->events < cb->events ? 1 : -1;
+	return 0;
+}
+
+static
+void histogram_compute(struct bt_ctf_histogram *h)
+{
+	unsigned int i;
+
+	if (!h->nr_packets) {
+		h->begin = h->end = 0;
+		if (!h->bucket_len)
+			h->bucket_len = 1;
+		return;
+	}
+	if (h->end < h->begin)
+		h->end = h->begin;
+	if (!h->bucket_len) {
+		h->bucket_len = (h->end - h->begin)
+			/ BT_CTF_HISTOGRAM_DEFAULT_BUCKETS + 1;
+	}
+	h->nr_buckets = (h->end - h->begin) / h->bucket_len + 1;
+	g_array_set_size(h->events, h->nr_buckets);
+	g_array_set_size(h->lost, h->nr_buckets);
+	for (i = 0; i < h->streams->len; i++)
+		histogram_compute_stream(h, g_ptr_array_index(h->streams, i));
+	qsort(h->classes->data, h->classes->len,
+		sizeof(struct histogram_class), compare_classes);
+}
+
+struct bt_ctf_histogram *bt_ctf_histogram_create(struct bt_context *ctx,
+		uint64_t bucket_len, double sample)
+{
+	struct bt_ctf_histogram *h;
+	int i;
+
+	if (!ctx || !ctx->tc)
+		return NULL;
+	h = histogram_alloc(bucket_len, sample);
+	if (!h)
+		return NULL;
+	for (i = 0; i < ctx->tc->array->len; i++) {
+		struct bt_trace_descriptor *td =
+			g_ptr_array_index(ctx->tc->array, i);
+
+		if (histogram_add_trace(h,
+				container_of(td, struct ctf_trace, parent))) {
+			bt_ctf_histogram_destroy(h);
+			return NULL;
+		}
+	}
+	histogram_compute(h);
+	return h;
+}
+
+uint64_t bt_ctf_histogram_get_begin(struct bt_ctf_histogram *h)
+{
+	return h->begin;
+}
+
+uint64_t bt_ctf_histogram_get_bucket_len(struct bt_ctf_histogram *h)
+{
+	return h->bucket_len;
+}
+
+size_t bt_ctf_histogram_get_nr_buckets(struct bt_ctf_histogram *h)
+{
+	return h->nr_buckets;
+}
+
+int bt_ctf_histogram_get_nr_streams(struct bt_ctf_histogram *h)
+{
+	return h->streams->len;
+}
+
+const char *bt_ctf_histogram_get_stream_path(struct bt_ctf_histogram *h,
+		int stream)
+{
+	struct histogram_stream *hs;
+
+	if (stream < 0 || stream >= h->streams->len)
+		return NULL;
+	hs = g_ptr_array_index(h->streams, stream);
+	return hs->cfs->parent.path[0] ? hs->cfs->parent.path : NULL;
+}
+
+uint64_t bt_ctf_histogram_get_stream_id(struct bt_ctf_histogram *h,
+		int stream)
+{
+	struct histogram_stream *hs;
+
+	if (stream < 0 || stream >= h->streams->len)
+		return -1ULL;
+	hs = g_ptr_array_index(h->streams, stream);
+	return hs->cfs->parent.stream_id;
+}
+
+double bt_ctf_histogram_get_events(struct bt_ctf_histogram *h,
+		int stream, size_t bucket)
+{
+	GArray *events;
+
+	if (bucket >= h->nr_buckets || stream >= (int) h->streams->len)
+		return 0.0;
+	if (stream == BT_CTF_HISTOGRAM_ALL_STREAMS)
+		events = h->events;
+	else if (stream >= 0)
+		events = ((struct histogram_stream *)
+			g_ptr_array_index(h->streams, stream))->events;
+	else
+		return 0.0;
+	return g_array_index(events, double, bucket);
+}
+
+uint64_t bt_ctf_histogram_get_lost(struct bt_ctf_histogram *h,
+		int stream, size_t bucket)
+{
+	GArray *lost;
+
+	if (bucket >= h->nr_buckets || stream >= (int) h->streams->len)
+		return 0;
+	if (stream == BT_CTF_HISTOGRAM_ALL_STREAMS)
+		lost = h->lost;
+	else if (stream >= 0)
+		lost = ((struct histogram_stream *)
+			g_ptr_array_index(h->streams, stream))->lost;
+	else
+		return 0;
+	return g_array_index(lost, uint64_t, bucket);
+}
+
+uint64_t bt_ctf_histogram_get_nr_packets(struct bt_ctf_histogram *h)
+{
+	return h->nr_packets;
+}
+
+uint64_t bt_ctf_histogram_get_nr_sampled(struct bt_ctf_histogram *h)
+{
+	return h->nr_sampled;
+}
+
+int bt_ctf_histogram_get_nr_event_classes(struct bt_ctf_histogram *h)
+{
+	return h->classes->len;
+}
+
+const char *bt_ctf_histogram_get_event_class_name(struct bt_ctf_histogram *h,
+		int event_class)
+{
+	if (event_class < 0 || event_class >= h->classes->len)
+		return NULL;
+	return g_quark_to_string(g_array_index(h->classes,
+			struct histogram_class, event_class).name);
+}
+
+double bt_ctf_histogram_get_event_class_events(struct bt_ctf_histogram *h,
+		int event_class)
+{
+	if (event_class < 0 || event_class >= h->classes->len)
+		return 0.0;
+	return g_array_index(h->classes, struct histogram_class,
+			event_class).events;
+}
+
+static
+void print_time(FILE *fp, uint64_t ns)
+{
+	fprintf(fp, "%10" PRIu64 ".%09" PRIu64, ns / NSEC_PER_SEC,
+		ns % NSEC_PER_SEC);
+}
+
+/*
+ * Print the rates of a stream, or of all streams, one bucket per line,
+ * with a bar scaled to the highest rate.
+ */
+static
+void print_rates(FILE *fp, struct bt_ctf_histogram *h, int stream)
+{
+	double seconds = (double) h->bucket_len / NSEC_PER_SEC, max = 0.0;
+	size_t i;
+
+	for (i = 0; i < h->nr_buckets; i++)
+		max = MAX(max, bt_ctf_histogram_get_events(h, stream, i));
+	fprintf(fp, "  %-20s %14s %10s\n", "begin", "events/s", "lost");
+	for (i = 0; i < h->nr_buckets; i++) {
+		double events = bt_ctf_histogram_get_events(h, stream, i);
+		int bar = max > 0.0 ? (int) (events * BAR_WIDTH / max + 0.5) : 0;
+
+		fprintf(fp, "  ");
+		print_time(fp, h->begin + i * h->bucket_len);
+		fprintf(fp, " %14.1f %10" PRIu64 " %.*s\n", events / seconds,
+			bt_ctf_histogram_get_lost(h, stream, i), bar,
+			"########################################");
+	}
+}
+
+static
+void print_histogram(FILE *fp, struct bt_ctf_histogram *h)
+{
+	double total = 0.0;
+	size_t i;
+	int s;
+
+	fprintf(fp, "Event rates from the packet index (%" PRIu64 " of %"
+		PRIu64 " packets decoded), buckets of ",
+		h->nr_sampled, h->nr_packets);
+	print_time(fp, h->bucket_len);
+	fprintf(fp, " s\n\nAll streams:\n");
+	print_rates(fp, h, BT_CTF_HISTOGRAM_ALL_STREAMS);
+	for (s = 0; s < bt_ctf_histogram_get_nr_streams(h); s++) {
+		const char *path = bt_ctf_histogram_get_stream_path(h, s);
+
+		fprintf(fp, "\nStream %s (%" PRIu64 "):\n", path ? : "<mmap>",
+			bt_ctf_histogram_get_stream_id(h, s));
+		print_rates(fp, h, s);
+	}
+	if (!h->classes->len)
+		return;
+	for (i = 0; i < h->classes->len; i++)
+		total += bt_ctf_histogram_get_event_class_events(h, i);
+	fprintf(fp, "\nEvent classes (from the decoded packets):\n");
+	fprintf(fp, "  %-40s %16s %7s\n", "name", "events", "share");
+	for (i = 0; i < h->classes->len; i++) {
+		double events = bt_ctf_histogram_get_event_class_events(h, i);
+
+		fprintf(fp, "  %-40s %16.0f %6.2f%%\n",
+			bt_ctf_histogram_get_event_class_name(h, i), events,
+			total > 0.0 ? events * 100.0 / total : 0.0);
+	}
+}
+
+static
+int histogram_pre_trace(struct bt_stream_pos *ppos,
+		struct bt_trace_descriptor *td)
+{
+	struct histogram_pos *pos =
+		container_of(ppos, struct histogram_pos, parent);
+
+	return histogram_add_trace(pos->histogram,
+		container_of(td, struct ctf_trace, parent));
+}
+
+/*
+ * There is no event callback: the packets sampled are decoded by the
+ * pre-trace callback, and the histogram printed when the output trace
+ * is closed.
+ */
+static
+struct bt_trace_descriptor *histogram_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	struct histogram_pos *pos;
+	struct bt_ctf_histogram *h;
+	FILE *fp;
+
+	h = histogram_alloc(opt_bucket_len, opt_sample);
+	if (!h) {
+		fprintf(stderr, "[error] Incorrect histogram sample fraction.\n");
+		return NULL;
+	}
+	if (path) {
+		fp = fopen(path, "w");
+		if (!fp) {
+			fprintf(stderr, "[error] Unable to open %s: %s.\n",
+				path, strerror(errno));
+			bt_ctf_histogram_destroy(h);
+			return NULL;
+		}
+	} else {
+		fp = stdout;
+	}
+	pos = g_new0(struct histogram_pos, 1);
+	pos->fp = fp;
+	pos->histogram = h;
+	pos->parent.rw_table = NULL;
+	pos->parent.pre_trace_cb = histogram_pre_trace;
+	pos->parent.trace = &pos->trace_descriptor;
+	pos->trace_descriptor.output_pos = &pos->parent;
+	return &pos->trace_descriptor;
+}
+
+static
+int histogram_close_trace(struct bt_trace_descriptor *td)
+{
+	struct histogram_pos *pos =
+		container_of(td, struct histogram_pos, trace_descriptor);
+	int ret = 0;
+
+	histogram_compute(pos->histogram);
+	print_histogram(pos->fp, pos->histogram);
+	bt_ctf_histogram_destroy(pos->histogram);
+	if (pos->fp != stdout && fclose(pos->fp)) {
+		perror("Error on fclose");
+		ret = -1;
+	}
+	g_free(pos);
+	return ret;
+}
+
+static
+struct bt_format histogram_format = {
+	.open_trace = histogram_open_trace,
+	.close_trace = histogram_close_trace,
+};
+
+static
+void __attribute__((constructor)) histogram_init(void)
+{
+	int ret;
+
+	histogram_format.name = g_quark_from_static_string("histogram");
+	ret = bt_register_format(&histogram_format);
+	assert(!ret);
+}
+
+static
+void __attribute__((destructor)) histogram_exit(void)
+{
+	bt_unregister_format(&histogram_format);
+}
@@ -0,0 +1,306 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Batched packet reads with io_uring.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/io-uring.h>
+#include <babeltrace/ctf/stream-cache.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/list.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+struct ctf_uring_read {
+	struct mmap_align *mma;		/* buffer read into */
+	off_t offset;
+	size_t len;
+	int done;			/* completed, res is set */
+	int res;
+	int lost;			/* completion not waited for */
+	struct bt_list_head node;	/* in the stream reads, by offset */
+};
+
+struct ctf_uring_stream {
+	struct bt_list_head reads;
+};
+
+unsigned long opt_io_uring_depth;
+
+void bt_ctf_set_io_uring_depth(unsigned long depth)
+{
+	opt_io_uring_depth = depth;
+}
+
+#ifdef HAVE_LIBURING
+
+static struct io_uring ring;
+static int ring_state;		/* 0: not set up, 1: active, -1: unavailable */
+/* Reads held, and of these, queued but not submitted yet. */
+static unsigned long nr_reads, nr_queued;
+
+int ctf_uring_active(void)
+{
+	int ret;
+
+	if (!opt_io_uring_depth)
+		return 0;
+	if (likely(ring_state))
+		return ring_state > 0;
+	ret = io_uring_queue_init(opt_io_uring_depth, &ring, 0);
+	if (ret) {
+		printf_verbose("io_uring unavailable (%s), mapping packets "
+			"from the files.\n", strerror(-ret));
+		ring_state = -1;
+		return 0;
+	}
+	printf_verbose("io_uring: up to %lu packet reads.\n",
+		opt_io_uring_depth);
+	ring_state = 1;
+	return 1;
+}
+
+/* Reap one completion, waiting for it if wait is set. */
+static
+int reap_read(int wait)
+{
+	struct io_uring_cqe *cqe;
+	struct ctf_uring_read *read;
+	int ret;
+
+	if (wait)
+		ret = io_uring_wait_cqe(&ring, &cqe);
+	else
+		ret = io_uring_peek_cqe(&ring, &cqe);
+	if (ret)
+		return ret;
+	read = io_uring_cqe_get_data(cqe);
+	read->res = cqe->res;
+	read->done = 1;
+	io_uring_cqe_seen(&ring, cqe);
+	return 0;
+}
+
+void ctf_uring_submit(void)
+{
+	int ret;
+
+	if (!nr_queued)
+		return;
+	ret = io_uring_submit(&ring);
+	if (ret > 0)
+		nr_queued -= ret;
+	while (!reap_read(0))
+		;
+}
+
+/*
+ * Wait for a read to complete. If its completion cannot be waited for,
+ * the read is marked lost and failed, and io_uring is not used for new
+ * reads: the kernel may still write to the buffer and complete the
+ * read, so neither is ever freed.
+ */
+static
+void wait_read(struct ctf_uring_read *read)
+{
+	int ret;
+
+	if (!read->done)
+		ctf_uring_submit();
+	while (!read->done) {
+		ret = reap_read(1);
+		if (!ret || ret == -EINTR || ret == -EAGAIN)
+			continue;
+		fprintf(stderr, "[error] Waiting for io_uring read: %s.\n",
+			strerror(-ret));
+		read->lost = 1;
+		read->res = ret;
+		read->done = 1;
+		ring_state = -1;
+	}
+}
+
+static
+void free_read(struct ctf_uring_read *read)
+{
+	wait_read(read);
+	bt_list_del(&read->node);
+	nr_reads--;
+	if (read->lost)
+		return;
+	munmap_align(read->mma);
+	g_free(read);
+}
+
+static
+struct mmap_align *alloc_buffer(size_t len)
+{
+	struct mmap_align *mma;
+
+	mma = malloc(sizeof(*mma));
+	if (!mma)
+		return NULL;
+	mma->length = len;
+	mma->page_aligned_length = ALIGN(len, PAGE_SIZE);
+	mma->page_aligned_addr = mmap(NULL, mma->page_aligned_length,
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mma->page_aligned_addr == MAP_FAILED) {
+		free(mma);
+		return NULL;
+	}
+	mma->addr = mma->page_aligned_addr;
+	return mma;
+}
+
+void ctf_uring_queue(struct ctf_stream_pos *pos, off_t offset, size_t len)
+{
+	struct ctf_uring_stream *stream;
+	struct ctf_uring_read *read, *tmp;
+	struct io_uring_sqe *sqe;
+	struct mmap_align *mma;
+	int fd;
+
+	if (!ctf_uring_active() || pos->cstream || !len)
+		return;
+	if (!pos->uring) {
+		pos->uring = g_new0(struct ctf_uring_stream, 1);
+		BT_INIT_LIST_HEAD(&pos->uring->reads);
+	}
+	stream = pos->uring;
+	bt_list_for_each_entry_safe(read, tmp, &stream->reads, node) {
+		if (read->offset == offset && read->len >= len)
+			return;
+		/* The stream moved past it. */
+		if (read->offset < pos->mmap_offset)
+			free_read(read);
+	}
+	if (nr_reads >= opt_io_uring_depth)
+		return;
+	fd = ctf_stream_cache_get_fd(pos);
+	if (fd < 0)
+		return;
+	mma = alloc_buffer(len);
+	if (!mma)
+		return;
+	sqe = io_uring_get_sqe(&ring);
+	if (!sqe) {
+		ctf_uring_submit();
+		sqe = io_uring_get_sqe(&ring);
+		if (!sqe) {
+			munmap_align(mma);
+			return;
+		}
+	}
+	read = g_new0(struct ctf_uring_read, 1);
+	read->mma = mma;
+	read->offset = offset;
+	read->len = len;
+	io_uring_prep_read(sqe, fd, mma->addr, len, offset);
+	io_uring_sqe_set_data(sqe, read);
+	bt_list_add_tail(&read->node, &stream->reads);
+	nr_reads++;
+	nr_queued++;
+}
+
+struct mmap_align *ctf_uring_take(struct ctf_stream_pos *pos, off_t offset,
+		size_t len)
+{
+	struct ctf_uring_read *read;
+	struct mmap_align *mma;
+
+	if (!pos->uring)
+		return NULL;
+	bt_list_for_each_entry(read, &pos->uring->reads, node) {
+		if (read->offset != offset || read->len < len)
+			continue;
+		wait_read(read);
+		bt_list_del(&read->node);
+		nr_reads--;
+		/* Map the file instead. */
+		if (read->lost)
+			return NULL;
+		mma = read->mma;
+		if (read->res < 0 || (size_t) read->res < len) {
+			/* Short read or error: map the file instead. */
+			munmap_align(mma);
+			mma = NULL;
+		} else {
+			mma->length = len;
+		}
+		g_free(read);
+		return mma;
+	}
+	return NULL;
+}
+
+void ctf_uring_drop(struct ctf_stream_pos *pos)
+{
+	struct ctf_uring_read *read, *tmp;
+
+	if (!pos->uring)
+		return;
+	bt_list_for_each_entry_safe(read, tmp, &pos->uring->reads, node)
+		free_read(read);
+	g_free(pos->uring);
+	pos->uring = NULL;
+}
+
+#else /* HAVE_LIBURING */
+
+int ctf_uring_active(void)
+{
+	static int warned;
+
+	if (opt_io_uring_depth && !warned) {
+		printf_verbose("Built without io_uring support, mapping "
+			"packets from the files.\n");
+		warned = 1;
+	}
+	return 0;
+}
+
+void ctf_uring_queue(struct ctf_stream_pos *pos, off_t offset, size_t len)
+{
+}
+
+void ctf_uring_submit(void)
+{
+}
+
+struct mmap_align *ctf_uring_take(struct ctf_stream_pos *pos, off_t offset,
+		size_t len)
+{
+	return NULL;
+}
+
+void ctf_uring_drop(struct ctf_stream_pos *pos)
+{
+}
+
+#endif /* HAVE_LIBURING */
@@ -35,6 +35,7 @@
 #include <babeltrace/iterator-internal.h>
 #include <babeltrace/ctf/events-internal.h>
 #include <babeltrace/ctf/metadata.h>
+#include <babeltrace/context-internal.h>
 #include <glib.h>
 
 #include "events-private.h"
@@ -59,10 +60,199 @@ struct bt_ctf_iter *bt_ctf_iter_create(struct bt_context *ctx,
 			sizeof(struct bt_stream_callbacks));
 	iter->recalculate_dep_graph = 0;
 	iter->main_callbacks.callback = NULL;
+	iter->main_callbacks.dispatch = NULL;
 	iter->dep_gc = g_ptr_array_new();
 	return iter;
 }
 
+/* A filter on the value of a packet or stream event context field. */
+struct field_filter {
+	GQuark name;
+	int64_t min, max;
+};
+
+/*
+ * Call fn on each file stream of the iterator context.
+ */
+static
+void foreach_file_stream(struct bt_ctf_iter *iter,
+		void (*fn)(struct ctf_file_stream *cfs, const void *data),
+		const void *data)
+{
+	struct trace_collection *tc = iter->parent.ctx->tc;
+	int i, j, k;
+
+	for (i = 0; i < tc->array->len; i++) {
+		struct ctf_trace *trace;
+
+		trace = container_of(g_ptr_array_index(tc->array, i),
+				struct ctf_trace, parent);
+		for (j = 0; j < trace->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(trace->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				fn(container_of(stream, struct ctf_file_stream,
+						parent), data);
+			}
+		}
+	}
+}
+
+/*
+ * Add the ids of the events named name to the event filter of a
+ * stream.
+ */
+static
+void add_stream_event_filter(struct ctf_file_stream *cfs, GQuark name)
+{
+	GPtrArray *events_by_id = cfs->parent.stream_class->events_by_id;
+	int i;
+
+	for (i = 0; i < events_by_id->len; i++) {
+		struct ctf_event_declaration *event_class;
+
+		event_class = g_ptr_array_index(events_by_id, i);
+		if (event_class && event_class->name == name)
+			cfs->pos.event_filter |= ctf_packet_event_id_bit(i);
+	}
+	cfs->pos.filter_events = 1;
+}
+
+static
+void add_stream_field_filter(struct ctf_file_stream *cfs,
+		const struct field_filter *filter)
+{
+	struct ctf_field_filter stream_filter;
+
+	stream_filter.column = ctf_stream_index_field(cfs, filter->name);
+	if (stream_filter.column < 0)
+		return;
+	stream_filter.min = filter->min;
+	stream_filter.max = filter->max;
+	if (!cfs->pos.field_filters)
+		cfs->pos.field_filters = g_array_new(FALSE, TRUE,
+				sizeof(struct ctf_field_filter));
+	g_array_append_val(cfs->pos.field_filters, stream_filter);
+}
+
+static
+void clear_stream_filters(struct ctf_file_stream *cfs, const void *data)
+{
+	cfs->pos.filters_set = 0;
+	cfs->pos.filter_events = 0;
+	cfs->pos.event_filter = 0;
+	if (cfs->pos.field_filters)
+		g_array_set_size(cfs->pos.field_filters, 0);
+}
+
+/*
+ * Set the packet filters of a stream from the filters of the iterator
+ * *data. Also called on the streams whose filters were never set or
+ * went stale, which follow mode leaves for streams and event classes
+ * added by bt_context_update().
+ */
+static
+void set_stream_filters(struct ctf_file_stream *cfs, const void *data)
+{
+	const struct bt_ctf_iter *iter = data;
+	int i;
+
+	clear_stream_filters(cfs, NULL);
+	for (i = 0; iter->event_filter && i < iter->event_filter->len; i++)
+		add_stream_event_filter(cfs,
+			g_array_index(iter->event_filter, GQuark, i));
+	for (i = 0; iter->field_filters && i < iter->field_filters->len; i++)
+		add_stream_field_filter(cfs, &g_array_index(iter->field_filters,
+				struct field_filter, i));
+	cfs->pos.filters_set = 1;
+}
+
+int bt_ctf_iter_add_event_filter(struct bt_ctf_iter *iter, const char *name)
+{
+	GQuark quark;
+
+	if (!iter || !name)
+		return -1;
+	if (!iter->event_filter)
+		iter->event_filter = g_array_new(FALSE, TRUE, sizeof(GQuark));
+	quark = g_quark_from_string(name);
+	g_array_append_val(iter->event_filter, quark);
+	foreach_file_stream(iter, set_stream_filters, iter);
+	return 0;
+}
+
+int bt_ctf_iter_add_field_filter(struct bt_ctf_iter *iter, const char *name,
+		int64_t min, int64_t max)
+{
+	struct field_filter filter;
+
+	if (!iter || !name || min > max)
+		return -1;
+	if (!iter->field_filters)
+		iter->field_filters = g_array_new(FALSE, TRUE,
+				sizeof(struct field_filter));
+	filter.name = g_quark_from_string(name);
+	filter.min = min;
+	filter.max = max;
+	g_array_append_val(iter->field_filters, filter);
+	foreach_file_stream(iter, set_stream_filters, iter);
+	return 0;
+}
+
+/*
+ * Return 1 if the current event of the stream passes the event and
+ * field filters of the iterator.
+ */
+static
+int iter_filter_match(struct bt_ctf_iter *iter,
+		struct ctf_file_stream *file_stream)
+{
+	struct ctf_stream_definition *stream = &file_stream->parent;
+	int i;
+
+	if (!file_stream->pos.filters_set)
+		set_stream_filters(file_stream, iter);
+	if (iter->event_filter) {
+		struct ctf_event_declaration *event_class;
+
+		if (!(file_stream->pos.event_filter
+				& ctf_packet_event_id_bit(stream->event_id)))
+			return 0;
+		event_class = g_ptr_array_index(stream->stream_class->events_by_id,
+				stream->event_id);
+		for (i = 0; i < iter->event_filter->len; i++) {
+			if (g_array_index(iter->event_filter, GQuark, i)
+					== event_class->name)
+				break;
+		}
+		if (i == iter->event_filter->len)
+			return 0;
+	}
+	for (i = 0; iter->field_filters && i < iter->field_filters->len; i++) {
+		struct field_filter *filter = &g_array_index(iter->field_filters,
+				struct field_filter, i);
+		struct definition_integer *integer;
+		int64_t value;
+		int scope;
+
+		integer = ctf_stream_lookup_integer(stream, filter->name, &scope);
+		if (!integer)
+			return 0;
+		value = ctf_integer_value(integer);
+		if (value < filter->min || value > filter->max)
+			return 0;
+	}
+	return 1;
+}
+
 void bt_ctf_iter_destroy(struct bt_ctf_iter *iter)
 {
 	struct bt_stream_callbacks *bt_stream_cb;
@@ -71,9 +261,13 @@ void bt_ctf_iter_destroy(struct bt_ctf_iter *iter)
 
 	assert(iter);
 
+	stop_callback_workers(iter);
+
 	/* free all events callbacks */
 	if (iter->main_callbacks.callback)
 		g_array_free(iter->main_callbacks.callback, TRUE);
+	if (iter->main_callbacks.dispatch)
+		g_array_free(iter->main_callbacks.dispatch, TRUE);
 
 	/* free per-event callbacks */
 	for (i = 0; i < iter->callbacks->len; i++) {
@@ -87,11 +281,20 @@ void bt_ctf_iter_destroy(struct bt_ctf_iter *iter)
 			if (bt_chain->callback) {
 				g_array_free(bt_chain->callback, TRUE);
 			}
+			if (bt_chain->dispatch) {
+				g_array_free(bt_chain->dispatch, TRUE);
+			}
 		}
 		g_array_free(bt_stream_cb->per_id_callbacks, TRUE);
 	}
 	g_array_free(iter->callbacks, TRUE);
 	g_ptr_array_free(iter->dep_gc, TRUE);
+	if (iter->event_filter || iter->field_filters)
+		foreach_file_stream(iter, clear_stream_filters, NULL);
+	if (iter->event_filter)
+		g_array_free(iter->event_filter, TRUE);
+	if (iter->field_filters)
+		g_array_free(iter->field_filters, TRUE);
 
 	bt_iter_fini(&iter->parent);
 	g_free(iter);
@@ -111,7 +314,7 @@ struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 	struct ctf_file_stream *file_stream;
 	struct bt_ctf_event *ret;
 	struct ctf_stream_definition *stream;
-	struct packet_index *packet_index;
+	struct packet_index packet_index;
 
 	/*
 	 * We do not want to fail for any other reason than end of
@@ -121,6 +324,12 @@ struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 
 	ret = &iter->current_ctf_event;
 	file_stream = bt_heap_maximum(iter->parent.stream_heap);
+	while ((iter->event_filter || iter->field_filters) && file_stream
+			&& !iter_filter_match(iter, file_stream)) {
+		if (bt_iter_next(&iter->parent) < 0)
+			goto stop;
+		file_stream = bt_heap_maximum(iter->parent.stream_heap);
+	}
 	if (!file_stream) {
 		/* end of file for all streams */
 		goto stop;
@@ -131,28 +340,23 @@ struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 
 	if (flags)
 		*flags = 0;
-	if (!file_stream->pos.packet_cycles_index)
-		packet_index = NULL;
-	else
-		packet_index = &g_array_index(file_stream->pos.packet_cycles_index,
-				struct packet_index, file_stream->pos.cur_index);
 	iter->events_lost = 0;
-	if (packet_index && packet_index->events_discarded >
-			file_stream->pos.last_events_discarded) {
-		if (flags)
-			*flags |= BT_ITER_FLAG_LOST_EVENTS;
-		iter->events_lost += packet_index->events_discarded -
-			file_stream->pos.last_events_discarded;
-		file_stream->pos.last_events_discarded =
-			packet_index->events_discarded;
+	if (file_stream->pos.packet_index) {
+		ctf_packet_index_get(file_stream->pos.packet_index,
+				file_stream->pos.cur_index, &packet_index);
+		if (packet_index.events_discarded >
+				file_stream->pos.last_events_discarded) {
+			if (flags)
+				*flags |= BT_ITER_FLAG_LOST_EVENTS;
+			iter->events_lost += packet_index.events_discarded -
+				file_stream->pos.last_events_discarded;
+			file_stream->pos.last_events_discarded =
+				packet_index.events_discarded;
+		}
 	}
 
-	if (ret->parent->stream->stream_id > iter->callbacks->len)
-		goto end;
-
 	process_callbacks(iter, ret->parent->stream);
 
-end:
 	return ret;
 stop:
 	return NULL;
@@ -0,0 +1,253 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Background packet indexing.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/lazy-index.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/stream-cache.h>
+#include <babeltrace/list.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+struct ctf_lazy_index {
+	struct ctf_file_stream *shadow;	/* indexing stream, index thread */
+	off_t filesize;
+	GArray *published;		/* struct packet_index, to append */
+	int queued;			/* in the indexing queue */
+	int running;			/* being indexed by the thread */
+	int cancel;			/* do not queue it again */
+	int done;			/* last packet indexed, or error */
+	int error;
+	struct bt_list_head node;	/* node in the indexing queue */
+};
+
+int opt_lazy_index;
+
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static BT_LIST_HEAD(index_queue);
+static int thread_started;
+
+void bt_ctf_set_lazy_index(int enable)
+{
+	opt_lazy_index = enable;
+}
+
+/*
+ * Publish the entries of the indexing stream index, then start it
+ * over so it only holds the current batch. Called with lazy_lock held.
+ */
+static
+void publish_batch(struct ctf_lazy_index *li)
+{
+	struct ctf_stream_pos *pos = &li->shadow->pos;
+	size_t i;
+
+	for (i = 0; i < ctf_packet_index_len(pos->packet_index); i++) {
+		struct packet_index entry;
+
+		ctf_packet_index_get(pos->packet_index, i, &entry);
+		g_array_append_val(li->published, entry);
+	}
+	ctf_packet_index_destroy(pos->packet_index);
+	pos->packet_index = ctf_packet_index_create();
+}
+
+/*
+ * Open the stream file of the indexing stream for a batch. Between
+ * batches, it holds neither fd nor mapping, so that the thread adds at
+ * most one of each to the stream cache budgets.
+ */
+static
+int batch_open(struct ctf_file_stream *shadow)
+{
+	struct ctf_trace *td = container_of(shadow->pos.parent.trace,
+			struct ctf_trace, parent);
+
+	shadow->pos.fd = openat(td->dirfd, shadow->parent.path, O_RDONLY);
+	if (shadow->pos.fd < 0)
+		return -errno;
+	return 0;
+}
+
+static
+void batch_close(struct ctf_file_stream *shadow)
+{
+	(void) ctf_stream_cache_unmap(&shadow->pos);
+	if (shadow->pos.fd >= 0 && close(shadow->pos.fd))
+		perror("Error closing indexing stream fd");
+	shadow->pos.fd = -1;
+}
+
+static
+void *index_thread(void *arg)
+{
+	struct ctf_lazy_index *li;
+
+	pthread_mutex_lock(&lazy_lock);
+	for (;;) {
+		int i, ret = 0;
+
+		while (bt_list_empty(&index_queue))
+			pthread_cond_wait(&work_cond, &lazy_lock);
+		li = bt_list_entry(index_queue.next, struct ctf_lazy_index,
+				node);
+		bt_list_del(&li->node);
+		li->queued = 0;
+		li->running = 1;
+		pthread_mutex_unlock(&lazy_lock);
+
+		ret = batch_open(li->shadow);
+		for (i = 0; !ret && i < LAZY_INDEX_BATCH
+				&& li->shadow->pos.mmap_offset < li->filesize; i++)
+			ret = ctf_index_next_packet(li->shadow, li->filesize);
+		batch_close(li->shadow);
+
+		pthread_mutex_lock(&lazy_lock);
+		publish_batch(li);
+		li->running = 0;
+		if (ret || li->shadow->pos.mmap_offset >= li->filesize) {
+			li->error = ret;
+			li->done = 1;
+		} else if (!li->cancel) {
+			bt_list_add_tail(&li->node, &index_queue);
+			li->queued = 1;
+		}
+		pthread_cond_broadcast(&done_cond);
+	}
+	return NULL;
+}
+
+/* Called by the reading thread once the thread is done with li. */
+static
+void lazy_index_free(struct ctf_lazy_index *li)
+{
+	ctf_close_index_stream(li->shadow);
+	g_array_free(li->published, TRUE);
+	g_free(li);
+}
+
+static
+void lazy_index_extend(struct ctf_packet_index *index, size_t len)
+{
+	struct ctf_lazy_index *li = index->extend_data;
+	size_t i;
+	int done;
+
+	pthread_mutex_lock(&lazy_lock);
+	for (;;) {
+		for (i = 0; i < li->published->len; i++)
+			ctf_packet_index_append(index, &g_array_index(
+				li->published, struct packet_index, i));
+		g_array_set_size(li->published, 0);
+		if (index->len >= len || li->done)
+			break;
+		/* Index this stream next. */
+		if (li->queued)
+			bt_list_move(&li->node, &index_queue);
+		pthread_cond_wait(&done_cond, &lazy_lock);
+	}
+	done = li->done;
+	pthread_mutex_unlock(&lazy_lock);
+	if (!done)
+		return;
+	if (li->error)
+		fprintf(stderr, "[error] Background indexing of stream %s "
+			"stopped after %zu packets: %s.\n",
+			li->shadow->parent.path, index->len,
+			strerror(-li->error));
+	index->extend = NULL;
+	index->extend_data = NULL;
+	lazy_index_free(li);
+}
+
+int ctf_lazy_index_start(struct ctf_file_stream *file_stream,
+		struct ctf_file_stream *shadow, off_t filesize)
+{
+	struct ctf_lazy_index *li;
+	int ret = 0;
+
+	li = g_new0(struct ctf_lazy_index, 1);
+	li->shadow = shadow;
+	li->filesize = filesize;
+	li->published = g_array_new(FALSE, FALSE, sizeof(struct packet_index));
+
+	pthread_mutex_lock(&lazy_lock);
+	if (!thread_started) {
+		pthread_attr_t attr;
+		pthread_t thread;
+
+		ret = pthread_attr_init(&attr);
+		if (!ret) {
+			pthread_attr_setdetachstate(&attr,
+					PTHREAD_CREATE_DETACHED);
+			ret = pthread_create(&thread, &attr, index_thread, NULL);
+			pthread_attr_destroy(&attr);
+		}
+		if (ret) {
+			fprintf(stderr, "[warning] Unable to create indexing "
+				"thread.\n");
+			pthread_mutex_unlock(&lazy_lock);
+			g_array_free(li->published, TRUE);
+			g_free(li);
+			return -ret;
+		}
+		thread_started = 1;
+	}
+	file_stream->pos.packet_index->extend = lazy_index_extend;
+	file_stream->pos.packet_index->extend_data = li;
+	bt_list_add_tail(&li->node, &index_queue);
+	li->queued = 1;
+	pthread_cond_signal(&work_cond);
+	pthread_mutex_unlock(&lazy_lock);
+	return 0;
+}
+
+void ctf_lazy_index_stop(struct ctf_packet_index *index)
+{
+	struct ctf_lazy_index *li;
+
+	if (!index || !index->extend)
+		return;
+	li = index->extend_data;
+	pthread_mutex_lock(&lazy_lock);
+	li->cancel = 1;
+	if (li->queued) {
+		bt_list_del(&li->node);
+		li->queued = 0;
+	}
+	while (li->running)
+		pthread_cond_wait(&done_cond, &lazy_lock);
+	pthread_mutex_unlock(&lazy_lock);
+	index->extend = NULL;
+	index->extend_data = NULL;
+	lazy_index_free(li);
+}
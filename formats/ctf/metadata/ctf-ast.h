@@ -295,6 +295,38 @@ struct ctf_ast {
 	struct ctf_node root;
 };
 
+/*
+ * Last node of each root list at the time the mark is taken. Used to
+ * visit only the declarations appended to the AST afterwards.
+ */
+struct ctf_ast_mark {
+	struct bt_list_head *declaration_list;
+	struct bt_list_head *trace;
+	struct bt_list_head *env;
+	struct bt_list_head *stream;
+	struct bt_list_head *event;
+	struct bt_list_head *clock;
+	struct bt_list_head *callsite;
+};
+
+static inline
+void ctf_ast_get_mark(struct ctf_node *root, struct ctf_ast_mark *mark)
+{
+	mark->declaration_list = root->u.root.declaration_list.prev;
+	mark->trace = root->u.root.trace.prev;
+	mark->env = root->u.root.env.prev;
+	mark->stream = root->u.root.stream.prev;
+	mark->event = root->u.root.event.prev;
+	mark->clock = root->u.root.clock.prev;
+	mark->callsite = root->u.root.callsite.prev;
+}
+
+/* Iterate on the nodes of list head following the marked node last. */
+#define ctf_ast_for_each_after_mark(pos, last, head)			\
+	for (pos = bt_list_entry((last)->next, struct ctf_node, siblings); \
+	     &pos->siblings != (head);					\
+	     pos = bt_list_entry(pos->siblings.next, struct ctf_node, siblings))
+
 const char *node_type(struct ctf_node *node);
 
 struct ctf_trace;
@@ -304,11 +336,16 @@ int ctf_visitor_print_xml(FILE *fd, int depth, struct ctf_node *node);
 BT_HIDDEN
 int ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node);
 BT_HIDDEN
-int ctf_visitor_parent_links(FILE *fd, int depth, struct ctf_node *node);
+int ctf_visitor_semantic_check_append(FILE *fd, int depth,
+		struct ctf_node *node, const struct ctf_ast_mark *mark);
 BT_HIDDEN
 int ctf_visitor_construct_metadata(FILE *fd, int depth, struct ctf_node *node,
 			struct ctf_trace *trace, int byte_order);
 BT_HIDDEN
+int ctf_visitor_construct_metadata_append(FILE *fd, int depth,
+		struct ctf_node *node, const struct ctf_ast_mark *mark,
+		struct ctf_trace *trace);
+BT_HIDDEN
 int ctf_destroy_metadata(struct ctf_trace *trace);
 
 #endif /* _CTF_AST_H */
@@ -68,6 +68,11 @@ int yylex_destroy(yyscan_t yyscanner);
 BT_HIDDEN
 void yyrestart(FILE * in_str, yyscan_t scanner);
 BT_HIDDEN
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size,
+		yyscan_t scanner);
+BT_HIDDEN
+void yy_delete_buffer(struct yy_buffer_state *b, yyscan_t scanner);
+BT_HIDDEN
 int yyget_lineno(yyscan_t yyscanner);
 BT_HIDDEN
 char *yyget_text(yyscan_t yyscanner);
@@ -977,7 +982,8 @@ int ctf_scanner_append_ast(struct ctf_scanner *scanner)
 	return yyparse(scanner);
 }
 
-struct ctf_scanner *ctf_scanner_alloc(FILE *input)
+static
+struct ctf_scanner *ctf_scanner_create(void)
 {
 	struct ctf_scanner *scanner;
 	int ret;
@@ -994,8 +1000,6 @@ struct ctf_scanner *ctf_scanner_alloc(FILE *input)
 		printf_fatal("yylex_init error");
 		goto cleanup_scanner;
 	}
-	/* Start processing new stream */
-	yyrestart(input, scanner->scanner);
 
 	scanner->objstack = objstack_create();
 	if (!scanner->objstack)
@@ -1006,11 +1010,6 @@ struct ctf_scanner *ctf_scanner_alloc(FILE *input)
 	init_scope(&scanner->root_scope, NULL);
 	scanner->cs = &scanner->root_scope;
 
-	if (yydebug)
-		fprintf(stdout, "Scanner input is a%s.\n",
-			isatty(fileno(input)) ? "n interactive tty" :
-						" noninteractive file");
-
 	return scanner;
 
 cleanup_objstack:
@@ -1024,6 +1023,72 @@ cleanup_scanner:
 	return NULL;
 }
 
+struct ctf_scanner *ctf_scanner_alloc(FILE *input)
+{
+	struct ctf_scanner *scanner;
+
+	scanner = ctf_scanner_create();
+	if (!scanner)
+		return NULL;
+	/* Start processing new stream */
+	yyrestart(input, scanner->scanner);
+
+	if (yydebug)
+		fprintf(stdout, "Scanner input is a%s.\n",
+			isatty(fileno(input)) ? "n interactive tty" :
+						" noninteractive file");
+
+	return scanner;
+}
+
+struct ctf_scanner *ctf_scanner_alloc_buffer(char *buf, size_t len)
+{
+	struct ctf_scanner *scanner;
+
+	scanner = ctf_scanner_create();
+	if (!scanner)
+		return NULL;
+	if (ctf_scanner_append_buffer(scanner, buf, len)) {
+		ctf_scanner_free(scanner);
+		return NULL;
+	}
+	return scanner;
+}
+
+struct ctf_scanner *ctf_scanner_alloc_chained(struct ctf_scanner *parent)
+{
+	struct ctf_scanner *scanner;
+
+	scanner = ctf_scanner_create();
+	if (!scanner)
+		return NULL;
+	scanner->root_scope.parent = &parent->root_scope;
+	return scanner;
+}
+
+int ctf_scanner_append_buffer(struct ctf_scanner *scanner, char *buf,
+		size_t len)
+{
+	/*
+	 * Scan the buffer in place rather than copying it into the
+	 * lexer buffer. The two trailing \0 are the flex end-of-buffer
+	 * markers.
+	 */
+	assert(buf[len] == '\0' && buf[len + 1] == '\0');
+	if (scanner->buffer)
+		yy_delete_buffer(scanner->buffer, scanner->scanner);
+	scanner->buffer = yy_scan_buffer(buf, len + 2, scanner->scanner);
+	if (!scanner->buffer) {
+		printf_fatal("yy_scan_buffer error");
+		return -ENOMEM;
+	}
+
+	if (yydebug)
+		fprintf(stdout, "Scanner input is a %zu bytes buffer.\n", len);
+
+	return 0;
+}
+
 void ctf_scanner_free(struct ctf_scanner *scanner)
 {
 	int ret;
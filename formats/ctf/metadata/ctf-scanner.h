@@ -25,6 +25,8 @@
 typedef void* yyscan_t;
 #endif
 
+struct yy_buffer_state;
+
 struct ctf_scanner_scope;
 struct ctf_scanner_scope {
 	struct ctf_scanner_scope *parent;
@@ -37,9 +39,30 @@ struct ctf_scanner {
 	struct ctf_scanner_scope root_scope;
 	struct ctf_scanner_scope *cs;
 	struct objstack *objstack;
+	struct yy_buffer_state *buffer;	/* in-place input buffer, if any */
 };
 
 struct ctf_scanner *ctf_scanner_alloc(FILE *input);
+/*
+ * Scan buf in place. buf[len] and buf[len + 1] must be \0. The buffer
+ * is temporarily modified while scanning, and restored once the whole
+ * input has been consumed.
+ */
+struct ctf_scanner *ctf_scanner_alloc_buffer(char *buf, size_t len);
+/*
+ * Allocate a scanner whose root scope is nested in the root scope of
+ * parent, so type names declared in the input of parent are known.
+ * parent must outlive the new scanner.
+ */
+struct ctf_scanner *ctf_scanner_alloc_chained(struct ctf_scanner *parent);
+/*
+ * Switch the scanner input to a new in-place buffer, with the same
+ * requirements as ctf_scanner_alloc_buffer(). Type names declared by
+ * the previous input stay visible, so the next ctf_scanner_append_ast()
+ * extends the existing AST.
+ */
+int ctf_scanner_append_buffer(struct ctf_scanner *scanner, char *buf,
+		size_t len);
 void ctf_scanner_free(struct ctf_scanner *scanner);
 int ctf_scanner_append_ast(struct ctf_scanner *scanner);
 
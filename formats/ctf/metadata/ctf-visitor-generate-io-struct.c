@@ -3023,6 +3023,67 @@ error:
 	return ret;
 }
 
+/*
+ * Construct the declarations appended to the AST after mark, in the
+ * scopes of an already constructed trace. Trace and clock blocks
+ * cannot be appended, since existing definitions depend on them.
+ */
+int ctf_visitor_construct_metadata_append(FILE *fd, int depth,
+		struct ctf_node *node, const struct ctf_ast_mark *mark,
+		struct ctf_trace *trace)
+{
+	int ret = 0;
+	struct ctf_node *iter;
+
+	printf_verbose("CTF visitor: appended metadata construction...\n");
+	if (mark->trace->next != &node->u.root.trace
+			|| mark->clock->next != &node->u.root.clock) {
+		fprintf(fd, "[error] %s: trace and clock declarations cannot be appended\n", __func__);
+		return -EINVAL;
+	}
+	ctf_ast_for_each_after_mark(iter, mark->declaration_list,
+			&node->u.root.declaration_list) {
+		ret = ctf_root_declaration_visit(fd, depth + 1, iter, trace);
+		if (ret) {
+			fprintf(fd, "[error] %s: root declaration error\n", __func__);
+			return ret;
+		}
+	}
+	ctf_ast_for_each_after_mark(iter, mark->callsite,
+			&node->u.root.callsite) {
+		ret = ctf_callsite_visit(fd, depth + 1, iter, trace);
+		if (ret) {
+			fprintf(fd, "[error] %s: callsite declaration error\n", __func__);
+			return ret;
+		}
+	}
+	ctf_ast_for_each_after_mark(iter, mark->env, &node->u.root.env) {
+		ret = ctf_env_visit(fd, depth + 1, iter, trace);
+		if (ret) {
+			fprintf(fd, "[error] %s: env declaration error\n", __func__);
+			return ret;
+		}
+	}
+	ctf_ast_for_each_after_mark(iter, mark->stream, &node->u.root.stream) {
+		ret = ctf_stream_visit(fd, depth + 1, iter,
+				trace->root_declaration_scope, trace);
+		if (ret) {
+			fprintf(fd, "[error] %s: stream declaration error\n", __func__);
+			return ret;
+		}
+	}
+	ctf_ast_for_each_after_mark(iter, mark->event, &node->u.root.event) {
+		ret = ctf_event_visit(fd, depth + 1, iter,
+				trace->root_declaration_scope, trace);
+		if (ret) {
+			fprintf(fd, "[error] %s: event declaration error\n", __func__);
+			return ret;
+		}
+	}
+	printf_verbose("done.\n");
+	return 0;
+}
+
 int ctf_destroy_metadata(struct ctf_trace *trace)
 {
 	int i;
@@ -46,6 +46,19 @@
 static
 int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node);
 
+/*
+ * Parent links are created as the validator walks down the tree,
+ * which saves a separate pass over the AST. Only the nodes reached by
+ * the validator rely on their parent link.
+ */
+static
+int ctf_visitor_check_child(FILE *fd, int depth, struct ctf_node *parent,
+		struct ctf_node *node)
+{
+	node->parent = parent;
+	return _ctf_visitor_semantic_check(fd, depth, node);
+}
+
 static
 int ctf_visitor_unary_expression(FILE *fd, int depth, struct ctf_node *node)
 {
@@ -367,7 +380,7 @@ int ctf_visitor_type_declarator(FILE *fd, int depth, struct ctf_node *node)
 
 	bt_list_for_each_entry(iter, &node->u.type_declarator.pointers,
 				siblings) {
-		ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+		ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 		if (ret)
 			return ret;
 	}
@@ -378,7 +391,7 @@ int ctf_visitor_type_declarator(FILE *fd, int depth, struct ctf_node *node)
 	case TYPEDEC_NESTED:
 	{
 		if (node->u.type_declarator.u.nested.type_declarator) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1,
+			ret = ctf_visitor_check_child(fd, depth + 1, node,
 				node->u.type_declarator.u.nested.type_declarator);
 			if (ret)
 				return ret;
@@ -390,7 +403,7 @@ int ctf_visitor_type_declarator(FILE *fd, int depth, struct ctf_node *node)
 					fprintf(fd, "[error] %s: expecting unary expression as length\n", __func__);
 					return -EINVAL;
 				}
-				ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+				ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 				if (ret)
 					return ret;
 			}
@@ -401,7 +414,7 @@ int ctf_visitor_type_declarator(FILE *fd, int depth, struct ctf_node *node)
 			}
 		}
 		if (node->u.type_declarator.bitfield_len) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1,
+			ret = ctf_visitor_check_child(fd, depth + 1, node,
 				node->u.type_declarator.bitfield_len);
 			if (ret)
 				return ret;
@@ -437,22 +450,22 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 	switch (node->type) {
 	case NODE_ROOT:
 		bt_list_for_each_entry(iter, &node->u.root.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
 		bt_list_for_each_entry(iter, &node->u.root.trace, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
 		bt_list_for_each_entry(iter, &node->u.root.stream, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
 		bt_list_for_each_entry(iter, &node->u.root.event, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -467,7 +480,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.event.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -481,7 +494,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.stream.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -495,7 +508,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.env.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -509,7 +522,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.trace.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -523,7 +536,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.clock.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -537,7 +550,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.callsite.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -578,12 +591,12 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 
 		depth++;
 		bt_list_for_each_entry(iter, &node->u.ctf_expression.left, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
 		bt_list_for_each_entry(iter, &node->u.ctf_expression.right, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -626,12 +639,12 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		depth++;
-		ret = _ctf_visitor_semantic_check(fd, depth + 1,
+		ret = ctf_visitor_check_child(fd, depth + 1, node,
 			node->u._typedef.type_specifier_list);
 		if (ret)
 			return ret;
 		bt_list_for_each_entry(iter, &node->u._typedef.type_declarators, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -649,13 +662,13 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		depth++;
-		ret = _ctf_visitor_semantic_check(fd, depth + 1,
+		ret = ctf_visitor_check_child(fd, depth + 1, node,
 			node->u.typealias_target.type_specifier_list);
 		if (ret)
 			return ret;
 		nr_declarators = 0;
 		bt_list_for_each_entry(iter, &node->u.typealias_target.type_declarators, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 			nr_declarators++;
@@ -680,13 +693,13 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		depth++;
-		ret = _ctf_visitor_semantic_check(fd, depth + 1,
+		ret = ctf_visitor_check_child(fd, depth + 1, node,
 			node->u.typealias_alias.type_specifier_list);
 		if (ret)
 			return ret;
 		nr_declarators = 0;
 		bt_list_for_each_entry(iter, &node->u.typealias_alias.type_declarators, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 			nr_declarators++;
@@ -732,10 +745,10 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 			goto errinval;
 		}
 
-		ret = _ctf_visitor_semantic_check(fd, depth + 1, node->u.typealias.target);
+		ret = ctf_visitor_check_child(fd, depth + 1, node, node->u.typealias.target);
 		if (ret)
 			return ret;
-		ret = _ctf_visitor_semantic_check(fd, depth + 1, node->u.typealias.alias);
+		ret = ctf_visitor_check_child(fd, depth + 1, node, node->u.typealias.alias);
 		if (ret)
 			return ret;
 		break;
@@ -775,7 +788,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 			goto errperm;
 		}
 		bt_list_for_each_entry(iter, &node->u.floating_point.expressions, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -790,7 +803,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.integer.expressions, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -807,7 +820,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.string.expressions, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -853,7 +866,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		bt_list_for_each_entry(iter, &node->u.enumerator.values, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -870,12 +883,12 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		}
 
 		depth++;
-		ret = _ctf_visitor_semantic_check(fd, depth + 1, node->u._enum.container_type);
+		ret = ctf_visitor_check_child(fd, depth + 1, node, node->u._enum.container_type);
 		if (ret)
 			return ret;
 
 		bt_list_for_each_entry(iter, &node->u._enum.enumerator_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -889,12 +902,12 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 		default:
 			goto errinval;
 		}
-		ret = _ctf_visitor_semantic_check(fd, depth + 1,
+		ret = ctf_visitor_check_child(fd, depth + 1, node,
 			node->u.struct_or_variant_declaration.type_specifier_list);
 		if (ret)
 			return ret;
 		bt_list_for_each_entry(iter, &node->u.struct_or_variant_declaration.type_declarators, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -910,7 +923,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 			goto errperm;
 		}
 		bt_list_for_each_entry(iter, &node->u.variant.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -927,7 +940,7 @@ int _ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 			goto errperm;
 		}
 		bt_list_for_each_entry(iter, &node->u._struct.declaration_list, siblings) {
-			ret = _ctf_visitor_semantic_check(fd, depth + 1, iter);
+			ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
 			if (ret)
 				return ret;
 		}
@@ -956,20 +969,43 @@ int ctf_visitor_semantic_check(FILE *fd, int depth, struct ctf_node *node)
 {
 	int ret = 0;
 
-	/*
-	 * First make sure we create the parent links for all children. Let's
-	 * take the safe route and recreate them at each validation, just in
-	 * case the structure has changed.
-	 */
-	printf_verbose("CTF visitor: parent links creation... ");
-	ret = ctf_visitor_parent_links(fd, depth, node);
-	if (ret)
-		return ret;
-	printf_verbose("done.\n");
-	printf_verbose("CTF visitor: semantic check... ");
+	printf_verbose("CTF visitor: parent links creation and semantic check... ");
 	ret = _ctf_visitor_semantic_check(fd, depth, node);
 	if (ret)
 		return ret;
 	printf_verbose("done.\n");
 	return ret;
 }
+
+/*
+ * Check only the top-level declarations appended after mark.
+ */
+int ctf_visitor_semantic_check_append(FILE *fd, int depth,
+		struct ctf_node *node, const struct ctf_ast_mark *mark)
+{
+	int ret;
+	struct ctf_node *iter;
+
+	ctf_ast_for_each_after_mark(iter, mark->declaration_list,
+			&node->u.root.declaration_list) {
+		ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
+		if (ret)
+			return ret;
+	}
+	ctf_ast_for_each_after_mark(iter, mark->trace, &node->u.root.trace) {
+		ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
+		if (ret)
+			return ret;
+	}
+	ctf_ast_for_each_after_mark(iter, mark->stream, &node->u.root.stream) {
+		ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
+		if (ret)
+			return ret;
+	}
+	ctf_ast_for_each_after_mark(iter, mark->event, &node->u.root.event) {
+		ret = ctf_visitor_check_child(fd, depth + 1, node, iter);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
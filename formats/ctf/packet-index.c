@@ -0,0 +1,314 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Compact packet index.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/packet-index.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <limits.h>
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Each record holds, in order:
+ * - zigzag(offset - (prev offset + prev packet size in bytes)),
+ * - zigzag(packet_size - prev packet_size),
+ * - packet_size - content_size,
+ * - zigzag(data_offset - prev data_offset),
+ * - zigzag(events_discarded - prev events_discarded),
+ * - events_discarded_len.
+ * In a well-formed stream most of those are 0 and take a single byte.
+ */
+
+static inline
+uint64_t zigzag_encode(int64_t v)
+{
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline
+int64_t zigzag_decode(uint64_t v)
+{
+	return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static
+void put_varint(GArray *data, uint64_t v)
+{
+	uint8_t byte;
+
+	while (v >= 0x80) {
+		byte = (uint8_t) (v | 0x80);
+		g_array_append_val(data, byte);
+		v >>= 7;
+	}
+	byte = (uint8_t) v;
+	g_array_append_val(data, byte);
+}
+
+static inline
+uint64_t get_varint(GArray *data, size_t *pos)
+{
+	const uint8_t *p = &g_array_index(data, uint8_t, *pos);
+	uint64_t v = 0;
+	unsigned int shift = 0;
+
+	for (;;) {
+		uint8_t byte = *p++;
+
+		v |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			break;
+		shift += 7;
+	}
+	*pos = p - &g_array_index(data, uint8_t, 0);
+	return v;
+}
+
+static
+void encode_record(GArray *data, const struct packet_index *prev,
+		const struct packet_index *entry)
+{
+	off_t expected_offset;
+
+	expected_offset = prev->offset + (prev->packet_size / CHAR_BIT);
+	put_varint(data, zigzag_encode(entry->offset - expected_offset));
+	put_varint(data, zigzag_encode(entry->packet_size - prev->packet_size));
+	assert(entry->content_size <= entry->packet_size);
+	put_varint(data, entry->packet_size - entry->content_size);
+	put_varint(data, zigzag_encode(entry->data_offset - prev->data_offset));
+	put_varint(data, zigzag_encode(entry->events_discarded
+				- prev->events_discarded));
+	put_varint(data, entry->events_discarded_len);
+}
+
+static
+void decode_record(GArray *data, size_t *pos,
+		const struct packet_index *prev, struct packet_index *entry)
+{
+	off_t expected_offset;
+
+	expected_offset = prev->offset + (prev->packet_size / CHAR_BIT);
+	entry->offset = expected_offset + zigzag_decode(get_varint(data, pos));
+	entry->packet_size = prev->packet_size
+		+ zigzag_decode(get_varint(data, pos));
+	entry->content_size = entry->packet_size - get_varint(data, pos);
+	entry->data_offset = prev->data_offset
+		+ zigzag_decode(get_varint(data, pos));
+	entry->events_discarded = prev->events_discarded
+		+ zigzag_decode(get_varint(data, pos));
+	entry->events_discarded_len = get_varint(data, pos);
+}
+
+struct ctf_packet_index *ctf_packet_index_create(void)
+{
+	struct ctf_packet_index *index;
+
+	index = g_new0(struct ctf_packet_index, 1);
+	index->timestamp_begin = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	index->timestamp_end = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	index->blocks = g_array_new(FALSE, TRUE,
+			sizeof(struct packet_index_block));
+	index->data = g_array_new(FALSE, TRUE, sizeof(uint8_t));
+	index->fields = g_array_new(FALSE, TRUE,
+			sizeof(struct packet_field_column));
+	index->cursor = -1UL;
+	return index;
+}
+
+void ctf_packet_index_destroy(struct ctf_packet_index *index)
+{
+	unsigned int i;
+
+	if (!index)
+		return;
+	g_array_free(index->timestamp_begin, TRUE);
+	g_array_free(index->timestamp_end, TRUE);
+	g_array_free(index->blocks, TRUE);
+	g_array_free(index->data, TRUE);
+	if (index->event_ids)
+		g_array_free(index->event_ids, TRUE);
+	for (i = 0; index->checkpoints && i < index->checkpoints->len; i++) {
+		GArray *checkpoints = g_ptr_array_index(index->checkpoints, i);
+
+		if (checkpoints)
+			g_array_free(checkpoints, TRUE);
+	}
+	if (index->checkpoints)
+		g_ptr_array_free(index->checkpoints, TRUE);
+	for (i = 0; i < index->fields->len; i++)
+		g_array_free(ctf_packet_index_field(index, i)->ranges, TRUE);
+	g_array_free(index->fields, TRUE);
+	g_free(index);
+}
+
+void ctf_packet_index_append(struct ctf_packet_index *index,
+		const struct packet_index *entry)
+{
+	unsigned int i;
+
+	if (!(index->len % PACKET_INDEX_BLOCK_LEN)) {
+		struct packet_index_block block;
+
+		block.data_pos = index->data->len;
+		block.prev = index->last;
+		g_array_append_val(index->blocks, block);
+	}
+	encode_record(index->data, &index->last, entry);
+	g_array_append_val(index->timestamp_begin, entry->timestamp_begin);
+	g_array_append_val(index->timestamp_end, entry->timestamp_end);
+	if (index->event_ids) {
+		uint64_t unknown = PACKET_EVENT_IDS_UNKNOWN;
+
+		g_array_append_val(index->event_ids, unknown);
+	}
+	for (i = 0; i < index->fields->len; i++) {
+		struct packet_field_range unknown = PACKET_FIELD_RANGE_UNKNOWN;
+
+		g_array_append_val(ctf_packet_index_field(index, i)->ranges,
+			unknown);
+	}
+	index->last = *entry;
+	index->len++;
+}
+
+void ctf_packet_index_get(struct ctf_packet_index *index, size_t i,
+		struct packet_index *entry)
+{
+	struct packet_index prev;
+	size_t pos, j;
+
+	assert(i < index->len);
+	if (i == index->cursor) {
+		*entry = index->cursor_entry;
+		return;
+	}
+	if (index->cursor != -1UL && i == index->cursor + 1) {
+		/* Sequential access: decode a single record. */
+		prev = index->cursor_entry;
+		pos = index->cursor_pos;
+		j = i;
+	} else {
+		struct packet_index_block *block;
+
+		block = &g_array_index(index->blocks,
+				struct packet_index_block,
+				i / PACKET_INDEX_BLOCK_LEN);
+		prev = block->prev;
+		pos = block->data_pos;
+		j = i - (i % PACKET_INDEX_BLOCK_LEN);
+	}
+	for (; j <= i; j++) {
+		decode_record(index->data, &pos, &prev, entry);
+		prev = *entry;
+	}
+	entry->timestamp_begin = ctf_packet_index_timestamp_begin(index, i);
+	entry->timestamp_end = ctf_packet_index_timestamp_end(index, i);
+
+	index->cursor = i;
+	index->cursor_pos = pos;
+	index->cursor_entry = *entry;
+}
+
+void ctf_packet_index_set_event_ids(struct ctf_packet_index *index, size_t i,
+		uint64_t event_ids)
+{
+	assert(i < index->len);
+	if (!index->event_ids) {
+		size_t j;
+
+		index->event_ids = g_array_sized_new(FALSE, FALSE,
+				sizeof(uint64_t), index->len);
+		g_array_set_size(index->event_ids, index->len);
+		for (j = 0; j < index->len; j++)
+			g_array_index(index->event_ids, uint64_t, j) =
+				PACKET_EVENT_IDS_UNKNOWN;
+	}
+	g_array_index(index->event_ids, uint64_t, i) = event_ids;
+}
+
+void ctf_packet_index_add_checkpoint(struct ctf_packet_index *index,
+		size_t i, size_t nr, const struct packet_checkpoint *checkpoint)
+{
+	GArray *checkpoints;
+
+	assert(i < index->len);
+	if (!index->checkpoints)
+		index->checkpoints = g_ptr_array_new();
+	if (i >= index->checkpoints->len)
+		g_ptr_array_set_size(index->checkpoints, i + 1);
+	checkpoints = g_ptr_array_index(index->checkpoints, i);
+	if (!checkpoints) {
+		checkpoints = g_array_new(FALSE, FALSE,
+				sizeof(struct packet_checkpoint));
+		g_ptr_array_index(index->checkpoints, i) = checkpoints;
+	}
+	if (nr != checkpoints->len + 1)
+		return;
+	g_array_append_val(checkpoints, *checkpoint);
+}
+
+int ctf_packet_index_add_field(struct ctf_packet_index *index, GQuark name,
+		int scope)
+{
+	struct packet_field_range unknown = PACKET_FIELD_RANGE_UNKNOWN;
+	struct packet_field_column column;
+	size_t j;
+	int i;
+
+	for (i = 0; i < index->fields->len; i++) {
+		if (ctf_packet_index_field(index, i)->name == name)
+			return i;
+	}
+	column.name = name;
+	column.scope = scope;
+	column.ranges = g_array_sized_new(FALSE, FALSE,
+			sizeof(struct packet_field_range), index->len);
+	for (j = 0; j < index->len; j++)
+		g_array_append_val(column.ranges, unknown);
+	g_array_append_val(index->fields, column);
+	return i;
+}
+
+size_t ctf_packet_index_mem_size(struct ctf_packet_index *index)
+{
+	size_t checkpoints = 0;
+	unsigned int i;
+
+	for (i = 0; index->checkpoints && i < index->checkpoints->len; i++) {
+		GArray *array = g_ptr_array_index(index->checkpoints, i);
+
+		checkpoints += sizeof(void *);
+		if (array)
+			checkpoints += array->len * sizeof(struct packet_checkpoint);
+	}
+	return sizeof(*index) + checkpoints
+		+ index->timestamp_begin->len * sizeof(uint64_t)
+		+ index->timestamp_end->len * sizeof(uint64_t)
+		+ index->blocks->len * sizeof(struct packet_index_block)
+		+ index->data->len
+		+ (index->event_ids ? index->len * sizeof(uint64_t) : 0)
+		+ index->fields->len * index->len
+			* sizeof(struct packet_field_range);
+}
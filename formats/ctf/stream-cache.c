@@ -0,0 +1,359 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Bounded cache of file stream descriptors and packet mappings.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/stream-cache.h>
+#include <babeltrace/ctf/compressed-stream.h>
+#include <babeltrace/ctf/io-uring.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIN_MAX_OPEN_FILES	16
+/*
+ * Descriptors left for metadata, directories, output files and the
+ * background indexing stream.
+ */
+#define RESERVED_OPEN_FILES	64
+
+unsigned long opt_max_open_files, opt_max_mappings;
+int opt_streaming;
+
+struct ctf_stream_cache_stats ctf_stream_cache_stats;
+
+static BT_LIST_HEAD(fd_lru);		/* most recently used first */
+BT_LIST_HEAD(ctf_stream_cache_mma_lru);	/* most recently used first */
+static unsigned long nr_streams, nr_fds, nr_mappings;
+static unsigned long max_fds, max_mappings;
+static unsigned char *mincore_vec;	/* page residency, for --verbose */
+static size_t mincore_vec_len;
+
+static
+void init_limits(void)
+{
+	struct rlimit rlim;
+
+	max_fds = opt_max_open_files;
+	if (!max_fds) {
+		if (!getrlimit(RLIMIT_NOFILE, &rlim)
+				&& rlim.rlim_cur != RLIM_INFINITY
+				&& rlim.rlim_cur > RESERVED_OPEN_FILES)
+			max_fds = rlim.rlim_cur - RESERVED_OPEN_FILES;
+		else
+			max_fds = 1024 - RESERVED_OPEN_FILES;
+	}
+	if (max_fds < MIN_MAX_OPEN_FILES)
+		max_fds = MIN_MAX_OPEN_FILES;
+	max_mappings = opt_max_mappings ? : DEFAULT_MAX_MAPPINGS;
+	printf_verbose("Stream cache: up to %lu open files, %lu mappings.\n",
+		max_fds, max_mappings);
+}
+
+static
+uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Bytes of a packet mapping resident in the page cache. */
+static
+uint64_t resident_bytes(struct mmap_align *mma)
+{
+	long page_size = sysconf(_SC_PAGE_SIZE);
+	size_t nr_pages, i;
+	uint64_t resident = 0;
+
+	nr_pages = (mma->page_aligned_length + page_size - 1) / page_size;
+	if (nr_pages > mincore_vec_len) {
+		mincore_vec = g_realloc(mincore_vec, nr_pages);
+		mincore_vec_len = nr_pages;
+	}
+	if (mincore(mma->page_aligned_addr, mma->page_aligned_length,
+			mincore_vec))
+		return 0;
+	for (i = 0; i < nr_pages; i++)
+		resident += mincore_vec[i] & 1;
+	return resident * page_size;
+}
+
+/*
+ * Bytes of the packet just dropped from the page cache which are still
+ * resident, seen through a fresh mapping: the kernel may keep pages
+ * that are dirty or mapped elsewhere.
+ */
+static
+uint64_t dropped_resident_bytes(struct ctf_stream_pos *pos, size_t len)
+{
+	struct mmap_align *mma;
+	uint64_t resident;
+
+	mma = mmap_align(len, pos->prot, pos->flags, pos->fd,
+			pos->mmap_offset);
+	if (mma == MAP_FAILED)
+		return 0;
+	resident = resident_bytes(mma);
+	if (munmap_align(mma))
+		fprintf(stderr, "[error] Unable to unmap packet: %s.\n",
+			strerror(errno));
+	return resident;
+}
+
+static
+void print_scan_stats(void)
+{
+	uint64_t elapsed_ns = get_time_ns() - ctf_stream_cache_stats.scan_start_ns;
+
+	printf_verbose("Stream scan: %" PRIu64 " MiB mapped in %" PRIu64 " ms "
+		"(%.1f MiB/s), %" PRIu64 " MiB resident at unmap, "
+		"%" PRIu64 " MiB left in page cache%s.\n",
+		ctf_stream_cache_stats.mapped_bytes >> 20,
+		elapsed_ns / 1000000,
+		elapsed_ns ? (double) ctf_stream_cache_stats.mapped_bytes
+			/ (1 << 20) * 1e9 / elapsed_ns : 0.0,
+		ctf_stream_cache_stats.cached_bytes >> 20,
+		ctf_stream_cache_stats.left_bytes >> 20,
+		opt_streaming ? " (streaming)" : "");
+}
+
+static
+void evict_fd(void)
+{
+	struct ctf_stream_pos *pos;
+
+	pos = bt_list_entry(fd_lru.prev, struct ctf_stream_pos, fd_node);
+	bt_list_del(&pos->fd_node);
+	if (close(pos->fd))
+		perror("Error closing evicted stream fd");
+	pos->fd = -1;
+	nr_fds--;
+}
+
+static
+void evict_mapping(void)
+{
+	struct ctf_stream_pos *pos;
+
+	pos = bt_list_entry(ctf_stream_cache_mma_lru.prev, struct ctf_stream_pos,
+			mma_node);
+	bt_list_del(&pos->mma_node);
+	if (pos->cstream) {
+		ctf_cstream_unmap(pos->cstream, pos->base_mma);
+		ctf_cstream_release(pos->cstream);
+	} else if (munmap_align(pos->base_mma)) {
+		fprintf(stderr, "[error] Unable to unmap evicted packet: %s.\n",
+			strerror(errno));
+	}
+	pos->base_mma = NULL;
+	pos->mma_evicted = 1;
+	nr_mappings--;
+}
+
+void ctf_stream_cache_add(struct ctf_stream_pos *pos)
+{
+	if (!nr_streams++)
+		init_limits();
+	pos->cached = 1;
+	pos->mma_evicted = 0;
+	if (opt_streaming)
+		(void) posix_fadvise(pos->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	BT_INIT_LIST_HEAD(&pos->mma_node);
+	bt_list_add(&pos->fd_node, &fd_lru);
+	if (++nr_fds > max_fds)
+		evict_fd();
+}
+
+int ctf_stream_cache_remove(struct ctf_stream_pos *pos)
+{
+	int ret;
+
+	if (!pos->cached)
+		return 0;
+	ret = ctf_stream_cache_unmap(pos);
+	if (pos->fd >= 0) {
+		bt_list_del(&pos->fd_node);
+		nr_fds--;
+	}
+	pos->cached = 0;
+	if (!--nr_streams && ctf_stream_cache_stats.fd_reopens
+			+ ctf_stream_cache_stats.mapping_remaps) {
+		printf_verbose("Stream cache: %" PRIu64 " fd hits, %" PRIu64 " reopens (%" PRIu64 " us), "
+			"%" PRIu64 " mapping hits, %" PRIu64 " remaps (%" PRIu64 " us).\n",
+			ctf_stream_cache_stats.fd_hits,
+			ctf_stream_cache_stats.fd_reopens,
+			ctf_stream_cache_stats.reopen_ns / 1000,
+			ctf_stream_cache_stats.mapping_hits,
+			ctf_stream_cache_stats.mapping_remaps,
+			ctf_stream_cache_stats.remap_ns / 1000);
+	}
+	if (!nr_streams && ctf_stream_cache_stats.mapped_bytes) {
+		print_scan_stats();
+		g_free(mincore_vec);
+		mincore_vec = NULL;
+		mincore_vec_len = 0;
+	}
+	return ret;
+}
+
+int ctf_stream_cache_get_fd(struct ctf_stream_pos *pos)
+{
+	struct ctf_file_stream *file_stream;
+	struct ctf_trace *td;
+	uint64_t start;
+	int fd;
+
+	if (!pos->cached)
+		return pos->fd;
+	if (pos->fd >= 0) {
+		ctf_stream_cache_stats.fd_hits++;
+		bt_list_move(&pos->fd_node, &fd_lru);
+		return pos->fd;
+	}
+	file_stream = container_of(pos, struct ctf_file_stream, pos);
+	td = container_of(pos->parent.trace, struct ctf_trace, parent);
+	start = get_time_ns();
+	fd = openat(td->dirfd, file_stream->parent.path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "[error] Unable to reopen stream file %s: %s.\n",
+			file_stream->parent.path, strerror(errno));
+		return -errno;
+	}
+	ctf_stream_cache_stats.reopen_ns += get_time_ns() - start;
+	ctf_stream_cache_stats.fd_reopens++;
+	if (opt_streaming)
+		(void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	pos->fd = fd;
+	bt_list_add(&pos->fd_node, &fd_lru);
+	if (++nr_fds > max_fds)
+		evict_fd();
+	return fd;
+}
+
+int ctf_stream_cache_map(struct ctf_stream_pos *pos, size_t len)
+{
+	uint64_t start = 0;
+	int fd, evicted = pos->mma_evicted;
+
+	fd = ctf_stream_cache_get_fd(pos);
+	if (fd < 0)
+		return fd;
+	if (evicted)
+		start = get_time_ns();
+	if (pos->cstream)
+		pos->base_mma = ctf_cstream_map(pos->cstream, fd,
+				pos->mmap_offset, len);
+	else {
+		pos->base_mma = ctf_uring_take(pos, pos->mmap_offset, len);
+		if (!pos->base_mma)
+			pos->base_mma = mmap_align(len, pos->prot, pos->flags,
+					fd, pos->mmap_offset);
+	}
+	if (pos->base_mma == MAP_FAILED) {
+		pos->base_mma = NULL;
+		fprintf(stderr, "[error] mmap error %s.\n", strerror(errno));
+		return -errno;
+	}
+	pos->mma_evicted = 0;
+	if (!pos->cached)
+		return 0;
+	if (evicted) {
+		ctf_stream_cache_stats.remap_ns += get_time_ns() - start;
+		ctf_stream_cache_stats.mapping_remaps++;
+	} else {
+		if (!ctf_stream_cache_stats.scan_start_ns)
+			ctf_stream_cache_stats.scan_start_ns = get_time_ns();
+		ctf_stream_cache_stats.mapped_bytes += len;
+	}
+	bt_list_add(&pos->mma_node, &ctf_stream_cache_mma_lru);
+	if (++nr_mappings > max_mappings)
+		evict_mapping();
+	return 0;
+}
+
+int ctf_stream_cache_unmap(struct ctf_stream_pos *pos)
+{
+	uint64_t resident = 0;
+	size_t len;
+	int ret;
+
+	pos->mma_evicted = 0;
+	if (!pos->base_mma)
+		return 0;
+	if (pos->cached) {
+		bt_list_del(&pos->mma_node);
+		nr_mappings--;
+	}
+	if (pos->cstream) {
+		ctf_cstream_unmap(pos->cstream, pos->base_mma);
+		pos->base_mma = NULL;
+		return 0;
+	}
+	if (pos->cached && babeltrace_verbose)
+		resident = resident_bytes(pos->base_mma);
+	len = pos->base_mma->length;
+	ret = munmap_align(pos->base_mma);
+	pos->base_mma = NULL;
+	if (ret) {
+		fprintf(stderr, "[error] Unable to unmap old base: %s.\n",
+			strerror(errno));
+		return -errno;
+	}
+	if (!pos->cached)
+		return 0;
+	ctf_stream_cache_stats.cached_bytes += resident;
+	/* The page cache may only be dropped once the packet is unmapped. */
+	if (!opt_streaming || pos->fd < 0) {
+		ctf_stream_cache_stats.left_bytes += resident;
+		return 0;
+	}
+	(void) posix_fadvise(pos->fd, pos->mmap_offset, len,
+			POSIX_FADV_DONTNEED);
+	if (babeltrace_verbose)
+		ctf_stream_cache_stats.left_bytes += dropped_resident_bytes(pos,
+				len);
+	return 0;
+}
+
+void ctf_stream_cache_will_need(struct ctf_stream_pos *pos, off_t offset,
+		size_t len)
+{
+	int fd;
+
+	if (!opt_streaming || pos->cstream)
+		return;
+	fd = ctf_stream_cache_get_fd(pos);
+	if (fd < 0)
+		return;
+	(void) posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+}
@@ -88,9 +88,11 @@ int ctf_array_write(struct bt_stream_pos *ppos, struct bt_definition *definition
 				if (!ctf_pos_access_ok(pos, array_declaration->len * CHAR_BIT))
 					return -EFAULT;
 
-				memcpy((char *) ctf_get_pos_addr(pos),
-					array_definition->string->str,
-					array_declaration->len);
+				if (!pos->dummy) {
+					memcpy((char *) ctf_get_pos_addr(pos),
+						array_definition->string->str,
+						array_declaration->len);
+				}
 				ctf_move_pos(pos, array_declaration->len * CHAR_BIT);
 				return 0;
 			}
@@ -87,8 +87,10 @@ int ctf_sequence_write(struct bt_stream_pos *ppos, struct bt_definition *definit
 				if (!ctf_pos_access_ok(pos, len * CHAR_BIT))
 					return -EFAULT;
 
-				memcpy((char *) ctf_get_pos_addr(pos),
-					sequence_definition->string->str, len);
+				if (!pos->dummy) {
+					memcpy((char *) ctf_get_pos_addr(pos),
+						sequence_definition->string->str, len);
+				}
 				ctf_move_pos(pos, len * CHAR_BIT);
 				return 0;
 			}
@@ -83,7 +83,7 @@ int ctf_string_write(struct bt_stream_pos *ppos,
 	assert(string_definition->value != NULL);
 	len = string_definition->len;
 
-	if (!ctf_pos_access_ok(pos, len))
+	if (!ctf_pos_access_ok(pos, len * CHAR_BIT))
 		return -EFAULT;
 
 	if (pos->dummy)
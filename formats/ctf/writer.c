@@ -0,0 +1,915 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF trace output.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/ctf/writer-internal.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/stream-cache.h>
+#include <babeltrace/ctf/compressed-stream.h>
+#include <babeltrace/ctf/crc32c.h>
+#include <babeltrace/align.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+/*
+ * Smallest output packet, in bits.
+ */
+#define MIN_PACKET_LEN	(getpagesize() * CHAR_BIT)
+
+/*
+ * Size of the buffer used to copy packets when the kernel cannot copy
+ * them between files.
+ */
+#define COPY_BUF_LEN	(1024 * 1024)
+
+#define OUTPUT_DIR_MODE		(S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+#define OUTPUT_FILE_MODE	(S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+#ifndef min
+#define min(a, b)	(((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#endif
+
+uint64_t opt_begin_time, opt_end_time = -1ULL;
+
+/*
+ * Inherit from both struct bt_stream_pos and struct bt_trace_descriptor.
+ */
+struct ctf_writer {
+	struct bt_stream_pos parent;
+	struct bt_trace_descriptor trace_descriptor;
+	int dirfd;		/* output directory */
+	int trim;		/* copy only the opt_begin_time/opt_end_time range */
+	GHashTable *traces;	/* input trace -> struct ctf_writer_trace */
+	GHashTable *streams;	/* input stream -> struct ctf_writer_stream */
+};
+
+struct ctf_writer_trace {
+	int dirfd;			/* output directory of the trace */
+	unsigned int nr_unnamed;	/* streams without a file name */
+};
+
+/*
+ * Packet context fields written again when a packet is closed.
+ */
+enum packet_field_id {
+	PACKET_FIELD_CONTENT_SIZE,
+	PACKET_FIELD_PACKET_SIZE,
+	PACKET_FIELD_TIMESTAMP_BEGIN,
+	PACKET_FIELD_TIMESTAMP_END,
+	PACKET_FIELD_CHECKSUM,
+	NR_PACKET_FIELDS,
+};
+
+static
+const char *packet_field_names[NR_PACKET_FIELDS] = {
+	[ PACKET_FIELD_CONTENT_SIZE ] = "content_size",
+	[ PACKET_FIELD_PACKET_SIZE ] = "packet_size",
+	[ PACKET_FIELD_TIMESTAMP_BEGIN ] = "timestamp_begin",
+	[ PACKET_FIELD_TIMESTAMP_END ] = "timestamp_end",
+	[ PACKET_FIELD_CHECKSUM ] = "checksum",
+};
+
+struct packet_field {
+	int64_t offset;		/* in the current packet, in bits. -1 if absent. */
+	struct definition_integer def;	/* copy used to write the field */
+};
+
+struct ctf_writer_stream {
+	struct ctf_stream_pos pos;
+	int packet_open;
+	uint64_t packet_events;		/* events in the current packet */
+	uint64_t in_index;		/* input packet being copied */
+	/*
+	 * Set when only part of the events of the input packet are
+	 * written. The packet timestamps are then narrowed to the events
+	 * written, so compact event header timestamps stay relative to
+	 * a timestamp_begin preceding them by less than one wrap.
+	 */
+	int packet_trimmed;
+	uint64_t first_timestamp;	/* in cycles */
+	uint64_t last_timestamp;	/* in cycles */
+	struct packet_field fields[NR_PACKET_FIELDS];
+	int64_t data_offset;		/* end of the packet context, in bits */
+};
+
+static
+int is_dir_end(char c)
+{
+	return c == '/' || c == '\0';
+}
+
+/*
+ * Path of an input trace relative to the deepest directory holding all
+ * the traces of its collection. Returns a newly allocated string, empty
+ * when the collection holds a single trace.
+ */
+static
+char *trace_relative_path(struct bt_trace_descriptor *td)
+{
+	char *path, *rel;
+	size_t len;
+	int i;
+
+	path = realpath(td->path, NULL);
+	if (!path)
+		path = strdup(td->path);
+	if (!path)
+		return NULL;
+	len = strlen(path);
+	for (i = 0; td->collection && i < td->collection->array->len; i++) {
+		struct bt_trace_descriptor *other =
+			g_ptr_array_index(td->collection->array, i);
+		char *other_path;
+		size_t j = 0;
+
+		other_path = realpath(other->path, NULL);
+		if (!other_path)
+			continue;
+		while (j < len && path[j] == other_path[j])
+			j++;
+		while (j > 0 && !(is_dir_end(path[j])
+				&& is_dir_end(other_path[j])))
+			j--;
+		len = j;
+		free(other_path);
+	}
+	for (rel = path + len; *rel == '/'; rel++)
+		;
+	rel = strdup(rel);
+	free(path);
+	return rel;
+}
+
+/*
+ * Create the directory relpath, and its parents, under dirfd.
+ */
+static
+int mkdirat_p(int dirfd, char *relpath)
+{
+	char *p;
+
+	for (p = relpath; ; p++) {
+		char c = *p;
+
+		if (c != '/' && c != '\0')
+			continue;
+		*p = '\0';
+		if (p != relpath && mkdirat(dirfd, relpath, OUTPUT_DIR_MODE)
+				&& errno != EEXIST) {
+			fprintf(stderr, "[error] Unable to create output directory %s: %s.\n",
+				relpath, strerror(errno));
+			*p = c;
+			return -errno;
+		}
+		*p = c;
+		if (c == '\0')
+			return 0;
+	}
+}
+
+static
+void ctf_writer_trace_free(gpointer data)
+{
+	struct ctf_writer_trace *wt = data;
+
+	if (close(wt->dirfd))
+		perror("Error on close");
+	g_free(wt);
+}
+
+static
+struct ctf_writer_trace *ctf_writer_get_trace(struct ctf_writer *writer,
+		struct bt_trace_descriptor *td)
+{
+	struct ctf_writer_trace *wt;
+	char *relpath;
+	int dirfd;
+
+	wt = g_hash_table_lookup(writer->traces, td);
+	if (wt)
+		return wt;
+	relpath = trace_relative_path(td);
+	if (!relpath)
+		return NULL;
+	if (mkdirat_p(writer->dirfd, relpath)) {
+		free(relpath);
+		return NULL;
+	}
+	dirfd = openat(writer->dirfd, relpath[0] ? relpath : ".",
+			O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0) {
+		fprintf(stderr, "[error] Unable to open output directory %s: %s.\n",
+			relpath, strerror(errno));
+		free(relpath);
+		return NULL;
+	}
+	free(relpath);
+	wt = g_new0(struct ctf_writer_trace, 1);
+	wt->dirfd = dirfd;
+	g_hash_table_insert(writer->traces, td, wt);
+	return wt;
+}
+
+static
+struct ctf_writer_stream *ctf_writer_get_stream(struct ctf_writer *writer,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_writer_stream *ws;
+	struct ctf_writer_trace *wt;
+	char *name;
+	int fd;
+
+	ws = g_hash_table_lookup(writer->streams, stream);
+	if (ws)
+		return ws;
+	wt = ctf_writer_get_trace(writer, &stream->stream_class->trace->parent);
+	if (!wt)
+		return NULL;
+	if (stream->path[0])
+		name = g_strdup(stream->path);
+	else
+		name = g_strdup_printf("stream_%u", wt->nr_unnamed++);
+	fd = openat(wt->dirfd, name, O_RDWR | O_CREAT | O_TRUNC,
+			OUTPUT_FILE_MODE);
+	if (fd < 0) {
+		fprintf(stderr, "[error] Unable to create output stream file %s: %s.\n",
+			name, strerror(errno));
+		g_free(name);
+		return NULL;
+	}
+	g_free(name);
+	ws = g_new0(struct ctf_writer_stream, 1);
+	ctf_init_pos(&ws->pos, &writer->trace_descriptor, fd, O_RDWR);
+	g_hash_table_insert(writer->streams, stream, ws);
+	return ws;
+}
+
+/*
+ * Write the stream packet context, recording where the fields updated
+ * on packet close are written.
+ */
+static
+int write_packet_context(struct ctf_writer_stream *ws,
+		struct definition_struct *context)
+{
+	struct ctf_stream_pos *pos = &ws->pos;
+	unsigned long i;
+	int ret, j;
+
+	for (j = 0; j < NR_PACKET_FIELDS; j++)
+		ws->fields[j].offset = -1;
+	if (!context)
+		goto missing;
+	ctf_align_pos(pos, context->p.declaration->alignment);
+	for (i = 0; i < context->fields->len; i++) {
+		struct bt_definition *field =
+			g_ptr_array_index(context->fields, i);
+
+		for (j = 0; j < NR_PACKET_FIELDS; j++) {
+			if (field->name != g_quark_from_static_string(packet_field_names[j]))
+				continue;
+			if (field->declaration->id != CTF_TYPE_INTEGER)
+				break;
+			ctf_align_pos(pos, field->declaration->alignment);
+			ws->fields[j].offset = pos->offset;
+			ws->fields[j].def = *container_of(field,
+					struct definition_integer, p);
+			break;
+		}
+		ret = generic_rw(&pos->parent, field);
+		if (ret)
+			return ret;
+	}
+	if (ws->fields[PACKET_FIELD_CONTENT_SIZE].offset < 0
+			|| ws->fields[PACKET_FIELD_PACKET_SIZE].offset < 0)
+		goto missing;
+	return 0;
+
+missing:
+	fprintf(stderr, "[error] Writing a CTF stream requires content_size and packet_size fields in its packet context.\n");
+	return -EINVAL;
+}
+
+static
+int ctf_writer_open_packet(struct ctf_writer_stream *ws,
+		struct ctf_stream_definition *stream, uint64_t packet_size)
+{
+	struct ctf_stream_pos *pos = &ws->pos;
+	int ret;
+
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
+	ret = posix_fallocate(pos->fd, pos->mmap_offset,
+			packet_size / CHAR_BIT);
+	if (ret) {
+		fprintf(stderr, "[error] Unable to allocate output packet: %s.\n",
+			strerror(ret));
+		return -ret;
+	}
+	pos->packet_size = packet_size;
+	pos->content_size = -1ULL;	/* Unknown at this point */
+	pos->offset = 0;
+	ret = ctf_stream_cache_map(pos, packet_size / CHAR_BIT);
+	if (ret)
+		return ret;
+	if (stream->trace_packet_header) {
+		ret = generic_rw(&pos->parent, &stream->trace_packet_header->p);
+		if (ret)
+			return ret;
+	}
+	ret = write_packet_context(ws, stream->stream_packet_context);
+	if (ret)
+		return ret;
+	ws->data_offset = pos->offset;
+	ws->packet_open = 1;
+	ws->packet_events = 0;
+	ws->packet_trimmed = 0;
+	return 0;
+}
+
+static
+int write_packet_field(struct ctf_writer_stream *ws, enum packet_field_id id,
+		uint64_t value)
+{
+	struct ctf_stream_pos *pos = &ws->pos;
+	struct packet_field *field = &ws->fields[id];
+	int64_t end = pos->offset;
+	int ret;
+
+	if (field->offset < 0)
+		return 0;
+	field->def.value._unsigned = value;
+	pos->offset = field->offset;
+	ret = generic_rw(&pos->parent, &field->def.p);
+	pos->offset = end;
+	return ret;
+}
+
+/*
+ * Set the final content and packet sizes of the current packet, and
+ * its checksum (see babeltrace/ctf/crc32c.h). The packet is shrunk to
+ * the events written, and the next packet starts right after it.
+ */
+static
+int ctf_writer_close_packet(struct ctf_writer_stream *ws)
+{
+	struct ctf_stream_pos *pos = &ws->pos;
+	uint64_t content_size, packet_size;
+	int ret;
+
+	if (!ws->packet_open)
+		return 0;
+	ws->packet_open = 0;
+	content_size = pos->offset;
+	packet_size = content_size + offset_align(content_size, CHAR_BIT);
+	ret = write_packet_field(ws, PACKET_FIELD_CONTENT_SIZE, content_size);
+	if (ret)
+		return ret;
+	ret = write_packet_field(ws, PACKET_FIELD_PACKET_SIZE, packet_size);
+	if (ret)
+		return ret;
+	if (ws->packet_trimmed && ws->packet_events) {
+		ret = write_packet_field(ws, PACKET_FIELD_TIMESTAMP_BEGIN,
+				ws->first_timestamp);
+		if (ret)
+			return ret;
+		ret = write_packet_field(ws, PACKET_FIELD_TIMESTAMP_END,
+				ws->last_timestamp);
+		if (ret)
+			return ret;
+	}
+	if (ws->fields[PACKET_FIELD_CHECKSUM].offset >= 0) {
+		char *base = mmap_align_addr(pos->base_mma) + pos->mmap_base_offset;
+		size_t begin = (ws->data_offset + CHAR_BIT - 1) / CHAR_BIT;
+
+		ret = write_packet_field(ws, PACKET_FIELD_CHECKSUM,
+				ctf_crc32c(0, base + begin,
+					packet_size / CHAR_BIT - begin));
+		if (ret)
+			return ret;
+	}
+	ret = ctf_stream_cache_unmap(pos);
+	if (ret)
+		return ret;
+	pos->mmap_offset += packet_size / CHAR_BIT;
+	return 0;
+}
+
+static
+int ctf_writer_close_stream(struct ctf_writer_stream *ws)
+{
+	int ret, close_ret;
+
+	ret = ctf_writer_close_packet(ws);
+	if (!ret && ftruncate(ws->pos.fd, ws->pos.mmap_offset)) {
+		perror("Error truncating output stream file");
+		ret = -errno;
+	}
+	if (ctf_fini_pos(&ws->pos))
+		ret = -1;
+	close_ret = close(ws->pos.fd);
+	if (close_ret) {
+		perror("Error on close");
+		ret = close_ret;
+	}
+	g_free(ws);
+	return ret;
+}
+
+static
+int ctf_writer_stream_write_event(struct ctf_writer_stream *ws,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_stream_pos *in_pos =
+		&container_of(stream, struct ctf_file_stream, parent)->pos;
+	struct ctf_stream_pos dummy;
+	uint64_t packet_size;
+	int ret;
+
+	if (ws->packet_open && ws->in_index != in_pos->cur_index) {
+		ret = ctf_writer_close_packet(ws);
+		if (ret)
+			return ret;
+	}
+	/*
+	 * A subset of the events of an input packet always fits in a
+	 * packet of the same size. Larger packets are only needed when
+	 * the input packet is filled up to its last bit.
+	 */
+	packet_size = max(in_pos->packet_size, MIN_PACKET_LEN);
+	for (;;) {
+		if (!ws->packet_open) {
+			ret = ctf_writer_open_packet(ws, stream, packet_size);
+			if (ret)
+				return ret;
+			ws->in_index = in_pos->cur_index;
+		}
+		/* Compute the event size on a dummy position first. */
+		ctf_dummy_pos(&ws->pos, &dummy);
+		dummy.packet_size = -1ULL;
+		ret = dummy.parent.event_cb(&dummy.parent, stream);
+		if (ret)
+			return ret;
+		/* Reaching the packet end would switch packets in ctf_move_pos. */
+		if (dummy.offset < ws->pos.packet_size)
+			break;
+		if (ws->packet_events) {
+			ret = ctf_writer_close_packet(ws);
+		} else {
+			/* Rewrite the empty packet with twice the room. */
+			ret = ctf_stream_cache_unmap(&ws->pos);
+			ws->packet_open = 0;
+			packet_size *= 2;
+		}
+		if (ret)
+			return ret;
+	}
+	ret = ws->pos.parent.event_cb(&ws->pos.parent, stream);
+	if (ret)
+		return ret;
+	if (!ws->packet_events++)
+		ws->first_timestamp = stream->cycles_timestamp;
+	ws->last_timestamp = stream->cycles_timestamp;
+	return 0;
+}
+
+static
+int ctf_writer_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_writer *writer = container_of(ppos, struct ctf_writer, parent);
+	struct ctf_writer_stream *ws;
+
+	ws = ctf_writer_get_stream(writer, stream);
+	if (!ws)
+		return -1;
+	return ctf_writer_stream_write_event(ws, stream);
+}
+
+/*
+ * Copy len bytes of in_fd at in_offset to out_fd at out_offset. The
+ * copy is done by the kernel when possible, which lets filesystems
+ * supporting it share the data extents instead of copying them.
+ */
+static
+int copy_file_data(int in_fd, off_t in_offset, int out_fd, off_t out_offset,
+		size_t len)
+{
+	char *buf;
+	int ret = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while (len) {
+		ssize_t copied;
+
+		copied = copy_file_range(in_fd, &in_offset, out_fd,
+				&out_offset, len, 0);
+		if (copied <= 0)
+			break;	/* Fall back on read/write */
+		len -= copied;
+	}
+	if (!len)
+		return 0;
+#endif
+	buf = malloc(COPY_BUF_LEN);
+	if (!buf)
+		return -ENOMEM;
+	while (len) {
+		ssize_t nr, nw, done;
+
+		nr = pread(in_fd, buf, min(len, COPY_BUF_LEN), in_offset);
+		if (nr <= 0) {
+			fprintf(stderr, "[error] Unable to read input trace data: %s.\n",
+				nr ? strerror(errno) : "unexpected end of file");
+			ret = nr ? -errno : -EIO;
+			goto end;
+		}
+		for (done = 0; done < nr; done += nw) {
+			nw = pwrite(out_fd, buf + done, nr - done,
+					out_offset + done);
+			if (nw < 0) {
+				fprintf(stderr, "[error] Unable to write output trace data: %s.\n",
+					strerror(errno));
+				ret = -errno;
+				goto end;
+			}
+		}
+		in_offset += nr;
+		out_offset += nr;
+		len -= nr;
+	}
+end:
+	free(buf);
+	return ret;
+}
+
+/*
+ * Copy raw data of a compressed input stream. Reuses the frame buffers
+ * of the stream, so its packet must not be mapped.
+ */
+static
+int copy_cstream_data(struct ctf_cstream *cs, int in_fd, off_t in_offset,
+		int out_fd, off_t out_offset, size_t len)
+{
+	char *buf;
+	int ret = 0;
+
+	buf = malloc(COPY_BUF_LEN);
+	if (!buf)
+		return -ENOMEM;
+	while (len) {
+		size_t nr = min(len, COPY_BUF_LEN);
+		ssize_t nw, done;
+
+		ret = ctf_cstream_pread(cs, in_fd, buf, nr, in_offset);
+		if (ret) {
+			fprintf(stderr, "[error] Unable to read input trace data: %s.\n",
+				strerror(-ret));
+			goto end;
+		}
+		for (done = 0; done < nr; done += nw) {
+			nw = pwrite(out_fd, buf + done, nr - done,
+					out_offset + done);
+			if (nw < 0) {
+				fprintf(stderr, "[error] Unable to write output trace data: %s.\n",
+					strerror(errno));
+				ret = -errno;
+				goto end;
+			}
+		}
+		in_offset += nr;
+		out_offset += nr;
+		len -= nr;
+	}
+end:
+	free(buf);
+	return ret;
+}
+
+/*
+ * Append an input packet to the output stream as is.
+ */
+static
+int ctf_writer_copy_packet(struct ctf_writer_stream *ws,
+		struct ctf_stream_pos *in_pos, struct packet_index *packet)
+{
+	int in_fd, ret;
+
+	ret = ctf_writer_close_packet(ws);
+	if (ret)
+		return ret;
+	ret = ctf_stream_cache_unmap(&ws->pos);
+	if (ret)
+		return ret;
+	if (in_pos->cstream) {
+		ret = ctf_stream_cache_unmap(in_pos);
+		if (ret)
+			return ret;
+	}
+	in_fd = ctf_stream_cache_get_fd(in_pos);
+	if (in_fd < 0)
+		return in_fd;
+	if (in_pos->cstream)
+		ret = copy_cstream_data(in_pos->cstream, in_fd, packet->offset,
+				ws->pos.fd, ws->pos.mmap_offset,
+				packet->packet_size / CHAR_BIT);
+	else
+		ret = copy_file_data(in_fd, packet->offset, ws->pos.fd,
+				ws->pos.mmap_offset, packet->packet_size / CHAR_BIT);
+	if (ret)
+		return ret;
+	ws->pos.mmap_offset += packet->packet_size / CHAR_BIT;
+	return 0;
+}
+
+/*
+ * Decode the events of input packet i and write those within the time
+ * range to the output stream.
+ */
+static
+int ctf_writer_trim_packet(struct ctf_writer_stream *ws,
+		struct ctf_file_stream *cfs, size_t i)
+{
+	struct ctf_stream_pos *in_pos = &cfs->pos;
+	struct ctf_stream_definition *stream = &cfs->parent;
+	int ret;
+
+	in_pos->packet_seek(&in_pos->parent, i, SEEK_SET);
+	while (in_pos->offset != EOF && in_pos->cur_index == i
+			&& in_pos->offset < in_pos->content_size) {
+		ret = in_pos->parent.event_cb(&in_pos->parent, stream);
+		if (ret == EOF)
+			break;
+		if (ret)
+			return ret;
+		if (stream->real_timestamp < opt_begin_time)
+			continue;
+		if (stream->real_timestamp > opt_end_time)
+			break;
+		ret = ctf_writer_stream_write_event(ws, stream);
+		if (ret)
+			return ret;
+		ws->packet_trimmed = 1;
+	}
+	return ctf_writer_close_packet(ws);
+}
+
+/*
+ * Write the packets of a stream overlapping the time range. Packets
+ * lying fully within the range are copied without being decoded; only
+ * the packets crossing a range boundary are decoded and re-encoded.
+ */
+static
+int ctf_writer_trim_stream(struct ctf_writer *writer,
+		struct ctf_file_stream *cfs)
+{
+	struct ctf_packet_index *index = cfs->pos.packet_index;
+	struct ctf_writer_stream *ws = NULL;
+	size_t low = 0, high, i;
+	int ret;
+
+	/* First packet ending at or after the range begin. */
+	ctf_packet_index_complete(index);
+	high = ctf_packet_index_len(index);
+	while (low < high) {
+		size_t mid = low + ((high - low) >> 1);
+
+		if (ctf_get_real_timestamp(&cfs->parent,
+				ctf_packet_index_timestamp_end(index, mid))
+				< opt_begin_time)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	for (i = low; i < ctf_packet_index_len(index); i++) {
+		uint64_t begin, end;
+
+		begin = ctf_get_real_timestamp(&cfs->parent,
+			ctf_packet_index_timestamp_begin(index, i));
+		end = ctf_get_real_timestamp(&cfs->parent,
+			ctf_packet_index_timestamp_end(index, i));
+		if (begin > opt_end_time)
+			break;
+		if (!ws) {
+			ws = ctf_writer_get_stream(writer, &cfs->parent);
+			if (!ws)
+				return -1;
+		}
+		if (begin >= opt_begin_time && end <= opt_end_time) {
+			struct packet_index packet;
+
+			ctf_packet_index_get(index, i, &packet);
+			ret = ctf_writer_copy_packet(ws, &cfs->pos, &packet);
+		} else {
+			ret = ctf_writer_trim_packet(ws, cfs, i);
+		}
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int ctf_writer_trim_trace(struct ctf_writer *writer, struct ctf_trace *trace)
+{
+	int i, j, ret;
+
+	for (i = 0; i < trace->streams->len; i++) {
+		struct ctf_stream_declaration *stream_class;
+
+		stream_class = g_ptr_array_index(trace->streams, i);
+		if (!stream_class)
+			continue;
+		for (j = 0; j < stream_class->streams->len; j++) {
+			struct ctf_stream_definition *stream;
+
+			stream = g_ptr_array_index(stream_class->streams, j);
+			if (!stream)
+				continue;
+			ret = ctf_writer_trim_stream(writer,
+				container_of(stream, struct ctf_file_stream,
+					parent));
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static
+int ctf_writer_pre_trace(struct bt_stream_pos *ppos,
+		struct bt_trace_descriptor *td)
+{
+	struct ctf_writer *writer = container_of(ppos, struct ctf_writer, parent);
+
+	if (!ctf_writer_get_trace(writer, td))
+		return -1;
+	if (writer->trim)
+		return ctf_writer_trim_trace(writer,
+			container_of(td, struct ctf_trace, parent));
+	return 0;
+}
+
+/*
+ * The metadata is written last, so it includes metadata appended to the
+ * input traces while they are followed. The metadata file is copied
+ * verbatim, unless the input trace has no backing directory.
+ */
+static
+int ctf_writer_post_trace(struct bt_stream_pos *ppos,
+		struct bt_trace_descriptor *td)
+{
+	struct ctf_writer *writer = container_of(ppos, struct ctf_writer, parent);
+	struct ctf_trace *trace = container_of(td, struct ctf_trace, parent);
+	struct ctf_writer_trace *wt;
+	FILE *fp;
+	int fd, ret = 0;
+
+	wt = ctf_writer_get_trace(writer, td);
+	if (!wt)
+		return -1;
+	fd = openat(wt->dirfd, "metadata", O_WRONLY | O_CREAT | O_TRUNC,
+			OUTPUT_FILE_MODE);
+	if (fd < 0) {
+		fprintf(stderr, "[error] Unable to create output metadata file: %s.\n",
+			strerror(errno));
+		return -errno;
+	}
+	if (trace->dir) {
+		struct stat st;
+		int in_fd;
+
+		in_fd = openat(trace->dirfd, "metadata", O_RDONLY);
+		if (in_fd < 0 || fstat(in_fd, &st)) {
+			fprintf(stderr, "[error] Unable to open input metadata file: %s.\n",
+				strerror(errno));
+			ret = -errno;
+		} else {
+			ret = copy_file_data(in_fd, 0, fd, 0, st.st_size);
+		}
+		if (in_fd >= 0 && close(in_fd))
+			perror("Error on close");
+		if (close(fd)) {
+			perror("Error on close");
+			ret = -1;
+		}
+		return ret;
+	}
+	if (!trace->metadata_string) {
+		close(fd);
+		return -EINVAL;
+	}
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		perror("Error on fdopen");
+		close(fd);
+		return -1;
+	}
+	if (trace->metadata_packetized) {
+		fprintf(fp, "/* CTF %u.%u */\n",
+			BT_CTF_MAJOR, BT_CTF_MINOR);
+	}
+	fprintf(fp, "%s", trace->metadata_string);
+	if (fclose(fp)) {
+		perror("Error on fclose");
+		ret = -1;
+	}
+	return ret;
+}
+
+struct bt_trace_descriptor *ctf_writer_open_trace(const char *path)
+{
+	struct ctf_writer *writer;
+
+	if (!path) {
+		fprintf(stderr, "[error] Path missing for output CTF trace.\n");
+		return NULL;
+	}
+	if (mkdir(path, OUTPUT_DIR_MODE) && errno != EEXIST) {
+		fprintf(stderr, "[error] Unable to create output directory %s: %s.\n",
+			path, strerror(errno));
+		return NULL;
+	}
+	writer = g_new0(struct ctf_writer, 1);
+	writer->dirfd = open(path, O_RDONLY | O_DIRECTORY);
+	if (writer->dirfd < 0) {
+		fprintf(stderr, "[error] Unable to open output directory %s: %s.\n",
+			path, strerror(errno));
+		g_free(writer);
+		return NULL;
+	}
+	strncpy(writer->trace_descriptor.path, path, PATH_MAX);
+	writer->trace_descriptor.path[PATH_MAX - 1] = '\0';
+	writer->traces = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, ctf_writer_trace_free);
+	writer->streams = g_hash_table_new(g_direct_hash, g_direct_equal);
+	writer->trim = opt_begin_time || opt_end_time != -1ULL;
+	/* When trimming, whole packets are written by pre_trace_cb. */
+	if (!writer->trim)
+		writer->parent.event_cb = ctf_writer_write_event;
+	writer->parent.pre_trace_cb = ctf_writer_pre_trace;
+	writer->parent.post_trace_cb = ctf_writer_post_trace;
+	writer->parent.trace = &writer->trace_descriptor;
+	writer->trace_descriptor.output_pos = &writer->parent;
+	return &writer->trace_descriptor;
+}
+
+int ctf_writer_close_trace(struct bt_trace_descriptor *td)
+{
+	struct ctf_writer *writer =
+		container_of(td, struct ctf_writer, trace_descriptor);
+	GHashTableIter iter;
+	gpointer key, value;
+	int ret = 0;
+
+	g_hash_table_iter_init(&iter, writer->streams);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (ctf_writer_close_stream(value))
+			ret = -1;
+	}
+	g_hash_table_destroy(writer->streams);
+	g_hash_table_destroy(writer->traces);
+	if (close(writer->dirfd)) {
+		perror("Error on close");
+		ret = -1;
+	}
+	g_free(writer);
+	return ret;
+}
@@ -221,5 +221,17 @@ extern int opt_all_field_names,
 
 extern uint64_t opt_clock_offset;
 extern uint64_t opt_clock_offset_ns;
+extern unsigned long opt_max_open_files;
+extern unsigned long opt_max_mappings;
+extern unsigned long opt_io_uring_depth;
+extern int opt_lazy_index;
+extern int opt_streaming;
+extern uint64_t opt_begin_time;
+extern uint64_t opt_end_time;
+extern int opt_verify;
+extern int opt_follow;
+extern uint64_t opt_bucket_len;
+extern double opt_sample;
+extern GArray *opt_index_fields;
 
 #endif
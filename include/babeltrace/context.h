@@ -95,6 +95,22 @@ int bt_context_add_trace(struct bt_context *ctx, const char *path,
  */
 int bt_context_remove_trace(struct bt_context *ctx, int trace_id);
 
+/*
+ * bt_context_update: Read data appended to the traces of the context
+ *
+ * Follow mode: index the complete packets appended to the trace stream
+ * files, and parse the metadata appended to them, since the traces
+ * were opened or last updated. Stream files that were empty are read
+ * from their first packet. Streams of the context iterator that
+ * reached their end are put back in iteration if new packets are
+ * available for them. Traces whose format does not support updates are
+ * left untouched.
+ *
+ * Return: the number of new packets (0 if none), or a negative value
+ * on error.
+ */
+int bt_context_update(struct bt_context *ctx);
+
 /*
  * bt_context_get and bt_context_put : increments and decrement the
  * refcount of the context
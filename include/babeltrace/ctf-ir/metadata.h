@@ -42,6 +42,25 @@ struct ctf_stream_declaration;
 struct ctf_event_declaration;
 struct ctf_clock;
 struct ctf_callsite;
+struct ctf_metadata_ast;
+struct ctf_scanner;
+
+/*
+ * Traces produced by the same tracer session (per-UID or per-PID
+ * buffers, rotated chunks) usually carry byte-identical metadata. The
+ * AST of such metadata is parsed and validated once, and shared
+ * read-only between all the open traces having the same metadata text
+ * and UUID. Declarations are still constructed for each trace, since
+ * they refer to the clocks and streams of their trace.
+ */
+struct ctf_metadata_ast {
+	char *text;
+	size_t len;
+	unsigned char uuid[BABELTRACE_UUID_LEN];
+	int has_uuid;
+	struct ctf_scanner *scanner;	/* owns the AST */
+	unsigned int refcount;		/* number of traces using it */
+};
 
 struct ctf_stream_definition {
 	struct ctf_stream_declaration *stream_class;
@@ -185,9 +204,13 @@ struct ctf_trace {
 	/* innermost definition scope. to be used as parent of stream. */
 	struct definition_scope *definition_scope;
 	GPtrArray *streams;			/* Array of struct ctf_stream_declaration pointers */
+	GPtrArray *empty_streams;		/* struct ctf_file_stream without packets yet */
 	struct ctf_stream_definition *metadata;
 	char *metadata_string;
 	int metadata_packetized;
+	size_t metadata_offset;		/* packetized metadata bytes consumed */
+	struct ctf_metadata_ast *metadata_ast;	/* shared parsed metadata */
+	struct ctf_scanner *metadata_update_scanner;	/* appended metadata */
 	GHashTable *callsites;
 	GPtrArray *event_declarations;		/* Array of all the struct bt_ctf_event_decl */
 
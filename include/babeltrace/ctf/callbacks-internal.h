@@ -30,10 +30,18 @@
  */
 
 #include <glib.h>
+#include <pthread.h>
 #include <babeltrace/ctf/events.h>
 
+struct ctf_file_stream;
+struct ctf_stream_definition;
+struct ctf_event_definition;
+
 struct bt_callback {
 	int prio;		/* Callback order priority. Lower first. Dynamically assigned from dependency graph. */
+	unsigned int seq;	/* Registration order, orders independent callbacks */
+	int group;		/* Chain of dependent callbacks, in dispatch */
+	int next;		/* Next callback of the chain in dispatch, -1 if last */
 	void *private_data;
 	int flags;
 	struct bt_dependencies *depends;
@@ -44,7 +52,14 @@ struct bt_callback {
 };
 
 struct bt_callback_chain {
-	GArray *callback;	/* Array of struct bt_callback, ordered by priority */
+	GArray *callback;	/* Array of struct bt_callback, in registration order */
+	/*
+	 * Array of struct bt_callback ordered by priority, including
+	 * the callbacks for all events. Computed from the dependency
+	 * graph. NULL until computed.
+	 */
+	GArray *dispatch;
+	int nr_groups;		/* Independent chains in dispatch */
 };
 
 /*
@@ -60,6 +75,52 @@ struct bt_dependencies {
 	int refcount;			/* free when decremented to 0 */
 };
 
+struct bt_callback_workers;
+
+/* A thread running its share of the independent chains of each event. */
+struct bt_callback_worker {
+	struct bt_callback_workers *workers;
+	int index;			/* Share index */
+	pthread_t thread;
+};
+
+/* Events handed to the workers and not completed yet, at most */
+#define BT_CALLBACK_RING_SIZE	64
+
+/* An event handed to the workers. */
+struct bt_callback_event {
+	GArray *dispatch;
+	int nr_groups;
+	struct ctf_event_definition *event;
+	struct ctf_stream_definition *stream;
+	int pending;			/* Workers still running the event */
+	int stop;			/* A callback returned a stop value */
+};
+
+/*
+ * Worker threads of an iterator. The iterator thread posts events to
+ * the ring and goes on decoding while the workers run their callbacks.
+ * Event definitions are reused by the next event of their stream, so
+ * the iterator waits for the posted events of a stream before reading
+ * it again, and for all posted events before seeking.
+ */
+struct bt_callback_workers {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* Event posted, or quit */
+	pthread_cond_t done_cond;	/* An event completed */
+	struct bt_callback_worker *threads;
+	int nr_threads;
+	int quit;
+	struct bt_callback_event ring[BT_CALLBACK_RING_SIZE];
+	unsigned long head;		/* Events posted */
+	unsigned long tail;		/* Events completed, in order */
+};
+
+BT_HIDDEN
+void stop_callback_workers(struct bt_ctf_iter *iter);
+BT_HIDDEN
+void wait_callback_workers(struct bt_iter *iter,
+		struct ctf_file_stream *file_stream);
 BT_HIDDEN
 void process_callbacks(struct bt_ctf_iter *iter, struct ctf_stream_definition *stream);
 
@@ -78,6 +78,13 @@ void bt_dependencies_destroy(struct bt_dependencies *dep);
  *            provided by this callback.
  *            Ends with 0. NULL is accepted as empty dependency.
  *
+ * Callbacks are called in an order satisfying their dependencies,
+ * otherwise in registration order. Callbacks providing results that no
+ * other callback consumes, for any event, are not called.
+ *
+ * Returns 0 on success, -EINVAL on invalid arguments, -ENOENT if
+ * @event is not declared by any stream class of the trace collection.
+ *
  * "depends", "weak_depends" and "provides" memory is handled by the
  * babeltrace library after this call succeeds or fails. These objects
  * can still be used by the caller until the babeltrace iterator is
@@ -102,6 +109,34 @@ int bt_ctf_iter_add_callback(struct bt_ctf_iter *iter,
 		struct bt_dependencies *weak_depends,
 		struct bt_dependencies *provides);
 
+/*
+ * bt_ctf_iter_set_callback_threads: Run independent callbacks in parallel.
+ *
+ * @iter: trace collection iterator (input)
+ * @nr_threads: number of worker threads, 0 to run callbacks serially
+ *              on the iterator thread (the default).
+ *
+ * Callbacks with no dependency between them, direct or indirect, form
+ * independent chains. With worker threads, the chains of each event
+ * are spread over the workers while the iterator thread goes on
+ * decoding the next events. Each chain still sees the events in order,
+ * and callbacks within a chain keep their dependency order.
+ * BT_CB_OK_STOP and BT_CB_ERROR_STOP end the callbacks of the event
+ * not started yet, in all chains; callbacks of other chains already
+ * running complete. Callbacks of different chains must not share
+ * unsynchronized state.
+ *
+ * Callbacks may still run after bt_ctf_iter_read_event() returns the
+ * event: the iterator only waits for them before reading the stream of
+ * the event again, seeking, updating the context or destroying the
+ * iterator. Up to 64 events are in flight.
+ *
+ * Returns 0 on success, a negative error value otherwise, in which case
+ * callbacks run serially.
+ */
+int bt_ctf_iter_set_callback_threads(struct bt_ctf_iter *iter,
+		int nr_threads);
+
 /*
  * For flags parameter above.
  */
@@ -0,0 +1,118 @@
+#ifndef _BABELTRACE_CTF_COMPRESSED_STREAM_H
+#define _BABELTRACE_CTF_COMPRESSED_STREAM_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Stream files compressed in packet-aligned frames.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/mmap-align.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+/*
+ * A compressed stream file holds the raw stream file cut into frames,
+ * each made of whole packets and compressed independently:
+ *
+ *   header | frame 0 | frame 1 | ... | frame table
+ *
+ * The frame table lists, for each frame, its offset and length in the
+ * raw stream and in the compressed file. All integers are little
+ * endian. Offsets handed to the reader (packet index, mmap_offset)
+ * stay raw stream offsets: mapping a packet decompresses the frame
+ * holding it into a buffer reused by the following packets of the same
+ * frame, while the next frame is decompressed ahead by a helper thread.
+ */
+#define CTF_CSTREAM_MAGIC	"CTFZSTRM"
+#define CTF_CSTREAM_MAGIC_LEN	8
+#define CTF_CSTREAM_VERSION	1
+
+#define CTF_CSTREAM_CODEC_ZLIB	1
+
+/* Frames are filled with packets up to this raw length. */
+#define CTF_CSTREAM_FRAME_LEN	(1UL << 20)
+
+struct ctf_cstream_header {
+	char magic[CTF_CSTREAM_MAGIC_LEN];
+	uint32_t version;
+	uint32_t codec;
+	uint64_t raw_size;	/* length of the raw stream, in bytes */
+	uint64_t nr_frames;
+	uint64_t table_offset;	/* frame table offset in the file */
+} __attribute__((packed));
+
+struct ctf_cstream_frame {
+	uint64_t raw_offset;	/* frame offset in the raw stream */
+	uint64_t comp_offset;	/* frame offset in the file */
+	uint32_t raw_len;
+	uint32_t comp_len;
+} __attribute__((packed));
+
+struct ctf_cstream;
+
+/*
+ * Probe the file open on fd. *csp is set to NULL if the file is not a
+ * compressed stream. Returns 0 on success, a negative error value
+ * otherwise.
+ */
+BT_HIDDEN
+int ctf_cstream_open(int fd, struct ctf_cstream **csp);
+BT_HIDDEN
+void ctf_cstream_close(struct ctf_cstream *cs);
+/* Length of the raw stream, in bytes. */
+BT_HIDDEN
+uint64_t ctf_cstream_raw_size(struct ctf_cstream *cs);
+/*
+ * Provide len bytes of the raw stream at offset, reading the file
+ * through fd. Behaves as mmap_align(): returns MAP_FAILED and sets
+ * errno on error. The data stays valid until ctf_cstream_unmap(), which
+ * must be called before the next ctf_cstream_map().
+ */
+BT_HIDDEN
+struct mmap_align *ctf_cstream_map(struct ctf_cstream *cs, int fd,
+		off_t offset, size_t len);
+BT_HIDDEN
+void ctf_cstream_unmap(struct ctf_cstream *cs, struct mmap_align *mma);
+/* Free the frame buffers, e.g. when the stream mapping is evicted. */
+BT_HIDDEN
+void ctf_cstream_release(struct ctf_cstream *cs);
+/*
+ * Copy len bytes of the raw stream at offset into buf. The frame
+ * buffers are reused, so no range may be mapped.
+ */
+BT_HIDDEN
+int ctf_cstream_pread(struct ctf_cstream *cs, int fd, void *buf,
+		size_t len, off_t offset);
+
+/*
+ * Write the raw stream file open on in_fd, of length raw_size, as a
+ * compressed stream to out_fd. Frames are cut at the packet offsets
+ * listed in index.
+ */
+int ctf_cstream_compress(int in_fd, uint64_t raw_size,
+		struct ctf_packet_index *index, int out_fd);
+
+#endif /* _BABELTRACE_CTF_COMPRESSED_STREAM_H */
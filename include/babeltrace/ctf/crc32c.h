@@ -0,0 +1,55 @@
+#ifndef _BABELTRACE_CTF_CRC32C_H
+#define _BABELTRACE_CTF_CRC32C_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CRC32C (Castagnoli) checksums.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Checksum schemes of metadata packet headers. The CRC32C of a metadata
+ * packet covers its metadata text, from the end of the packet header to
+ * content_size.
+ *
+ * Data packets are checksummed when their packet context has an
+ * unsigned integer field named "checksum": it holds the CRC32C of the
+ * bytes following the packet context, up to content_size rounded up to
+ * a byte.
+ */
+#define CTF_CHECKSUM_SCHEME_NONE	0
+#define CTF_CHECKSUM_SCHEME_CRC32C	1
+
+/*
+ * Return the CRC32C of len bytes at buf, continuing from crc, which is
+ * 0 for the first chunk. Uses the SSE4.2 or ARMv8 CRC32 instructions
+ * when the CPU has them, and a table-driven implementation otherwise.
+ */
+uint32_t ctf_crc32c(uint32_t crc, const void *buf, size_t len);
+/* Table-driven implementation, for testing. */
+uint32_t ctf_crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+#endif /* _BABELTRACE_CTF_CRC32C_H */
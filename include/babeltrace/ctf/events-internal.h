@@ -69,6 +69,8 @@ struct bt_ctf_iter {
 	 * graph calculation if it sees this flag set.
 	 */
 	int recalculate_dep_graph;
+	unsigned int nr_callbacks;	/* Registration counter */
+	struct bt_callback_workers *workers;	/* NULL if callbacks run serially */
 	/*
 	 * Array of pointers to struct bt_dependencies, for garbage
 	 * collection. We're not using a linked list here because each
@@ -77,6 +79,8 @@ struct bt_ctf_iter {
 	 */
 	GPtrArray *dep_gc;
 	uint64_t events_lost;
+	GArray *event_filter;		/* GQuark event names, NULL if none */
+	GArray *field_filters;		/* struct field_filter, NULL if none */
 };
 
 void ctf_print_discarded(FILE *fp, struct ctf_stream_definition *stream,
@@ -0,0 +1,67 @@
+#ifndef _BABELTRACE_CTF_EXTENT_H
+#define _BABELTRACE_CTF_EXTENT_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Stream files written through mapped extents.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <stddef.h>
+
+struct ctf_stream_pos;
+
+/* Stream files are preallocated and mapped by extents of this size. */
+#define CTF_EXTENT_LEN		(64UL << 20)
+
+/*
+ * Stream file written through a shared mapping of a preallocated
+ * extent holding a whole number of packets. The stream position has no
+ * file descriptor: its base is the mapped extent, and packets are
+ * switched by ctf_extent_next_packet() rather than by ctf_move_pos().
+ */
+struct ctf_extent {
+	int fd;
+	size_t packet_len;		/* bytes */
+	size_t extent_len;		/* bytes */
+	off_t extent_offset;		/* file offset of the mapped extent */
+	off_t packet_offset;		/* file offset of the current packet */
+};
+
+void ctf_extent_init(struct ctf_extent *extent, int fd, size_t packet_len);
+/*
+ * Move pos to the start of the next packet, or of the first one if
+ * nothing is mapped yet, mapping the following extent when the packet
+ * does not fit in the current one. Sets the packet size; the content
+ * size is left to the caller. Returns 0 or a negative errno.
+ */
+int ctf_extent_next_packet(struct ctf_extent *extent,
+		struct ctf_stream_pos *pos);
+/*
+ * Trim the preallocation past the current packet, of packet_size bytes.
+ * To be called once pos is finalized.
+ */
+int ctf_extent_truncate(struct ctf_extent *extent, size_t packet_size);
+
+#endif /* _BABELTRACE_CTF_EXTENT_H */
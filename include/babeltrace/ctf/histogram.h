@@ -0,0 +1,119 @@
+#ifndef _BABELTRACE_CTF_HISTOGRAM_H
+#define _BABELTRACE_CTF_HISTOGRAM_H
+
+/*
+ * BabelTrace
+ *
+ * CTF event rate histograms
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct bt_context;
+
+/*
+ * An event rate histogram counts the events of each stream of a
+ * context in time buckets, from the packet index alone: the events of
+ * a packet are spread evenly between its begin and end timestamps.
+ *
+ * The number of events of a packet is not part of its index. It is
+ * estimated from the packet content size and the mean event size of
+ * the stream, measured on decoded sample packets: the first non-empty
+ * packet of each stream, and a fraction of the others. Decoded packets
+ * count exactly, and give the event class breakdown. Lost events come
+ * from the events_discarded field of the packet contexts.
+ */
+struct bt_ctf_histogram;
+
+/* Stream index of the totals over all streams. */
+#define BT_CTF_HISTOGRAM_ALL_STREAMS	-1
+
+/* Number of buckets when no bucket length is given. */
+#define BT_CTF_HISTOGRAM_DEFAULT_BUCKETS	60
+
+/*
+ * bt_ctf_histogram_create: build the histogram of the traces of ctx.
+ *
+ * @bucket_len: bucket length, in ns. If 0, the trace time span is
+ *              divided in BT_CTF_HISTOGRAM_DEFAULT_BUCKETS buckets.
+ * @sample: fraction of the packets decoded, between 0 and 1.
+ *
+ * The streams of ctx are read to sample packets: create iterators
+ * afterwards. Returns NULL on error.
+ */
+struct bt_ctf_histogram *bt_ctf_histogram_create(struct bt_context *ctx,
+		uint64_t bucket_len, double sample);
+void bt_ctf_histogram_destroy(struct bt_ctf_histogram *histogram);
+
+/* Begin of the first bucket, in ns, and bucket length, in ns. */
+uint64_t bt_ctf_histogram_get_begin(struct bt_ctf_histogram *histogram);
+uint64_t bt_ctf_histogram_get_bucket_len(struct bt_ctf_histogram *histogram);
+size_t bt_ctf_histogram_get_nr_buckets(struct bt_ctf_histogram *histogram);
+
+/*
+ * Streams are numbered from 0. bt_ctf_histogram_get_stream_path returns
+ * the path of the stream file, or NULL for streams without a file.
+ */
+int bt_ctf_histogram_get_nr_streams(struct bt_ctf_histogram *histogram);
+const char *bt_ctf_histogram_get_stream_path(struct bt_ctf_histogram *histogram,
+		int stream);
+uint64_t bt_ctf_histogram_get_stream_id(struct bt_ctf_histogram *histogram,
+		int stream);
+
+/*
+ * Estimated number of events and number of lost events of a stream, or
+ * of all streams with BT_CTF_HISTOGRAM_ALL_STREAMS, in a bucket.
+ */
+double bt_ctf_histogram_get_events(struct bt_ctf_histogram *histogram,
+		int stream, size_t bucket);
+uint64_t bt_ctf_histogram_get_lost(struct bt_ctf_histogram *histogram,
+		int stream, size_t bucket);
+
+/*
+ * Number of packets of all streams, and number of packets decoded.
+ */
+uint64_t bt_ctf_histogram_get_nr_packets(struct bt_ctf_histogram *histogram);
+uint64_t bt_ctf_histogram_get_nr_sampled(struct bt_ctf_histogram *histogram);
+
+/*
+ * Event classes seen in the decoded packets, by decreasing estimated
+ * number of events over all streams. Classes of the same name are
+ * merged.
+ */
+int bt_ctf_histogram_get_nr_event_classes(struct bt_ctf_histogram *histogram);
+const char *bt_ctf_histogram_get_event_class_name(struct bt_ctf_histogram *histogram,
+		int event_class);
+double bt_ctf_histogram_get_event_class_events(struct bt_ctf_histogram *histogram,
+		int event_class);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BABELTRACE_CTF_HISTOGRAM_H */
@@ -0,0 +1,81 @@
+#ifndef _BABELTRACE_CTF_IO_URING_H
+#define _BABELTRACE_CTF_IO_URING_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Batched packet reads with io_uring.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/mmap-align.h>
+#include <babeltrace/ctf/types.h>
+#include <sys/types.h>
+
+/*
+ * With opt_io_uring_depth set, packets are read into anonymous
+ * mappings through a single io_uring shared by all streams, holding up
+ * to opt_io_uring_depth reads, in flight or completed:
+ *
+ * - when indexing, the headers of the next URING_HEADERS_AHEAD packets
+ *   of a stream are read in one batch, assuming they have the size of
+ *   the packet just indexed (the common case of fixed-size packets);
+ * - when reading, the next URING_PACKETS_AHEAD packets of a stream are
+ *   read while its current packet is decoded.
+ *
+ * A mapping is served from a completed read when one covers it, and
+ * mapped from the file otherwise, so reads issued on a wrong guess
+ * only cost their I/O. Reads of a stream before its current packet
+ * are released when it queues more, and all of them when it seeks to
+ * another packet or is closed. Reads are issued and reaped by the
+ * reading thread only. When babeltrace is built without liburing, or
+ * the kernel does not support io_uring, packets are mapped from the
+ * files. Compressed stream files are never read through io_uring.
+ */
+#define URING_HEADERS_AHEAD	16
+#define URING_PACKETS_AHEAD	4
+
+/* Return whether reads go through io_uring, setting it up if needed. */
+BT_HIDDEN
+int ctf_uring_active(void);
+/*
+ * Queue a read of len bytes of the stream file at offset, unless one
+ * is already queued there. ctf_uring_submit() submits the reads queued.
+ */
+BT_HIDDEN
+void ctf_uring_queue(struct ctf_stream_pos *pos, off_t offset, size_t len);
+BT_HIDDEN
+void ctf_uring_submit(void);
+/*
+ * Return the read covering len bytes at offset, waiting for its
+ * completion, or NULL. The mapping then belongs to the caller, and is
+ * released with munmap_align().
+ */
+BT_HIDDEN
+struct mmap_align *ctf_uring_take(struct ctf_stream_pos *pos, off_t offset,
+		size_t len);
+/* Wait for the reads of the stream and release them. */
+BT_HIDDEN
+void ctf_uring_drop(struct ctf_stream_pos *pos);
+
+#endif /* _BABELTRACE_CTF_IO_URING_H */
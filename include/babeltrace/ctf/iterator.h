@@ -94,6 +94,80 @@ struct bt_ctf_event *bt_ctf_iter_read_event(struct bt_ctf_iter *iter);
 struct bt_ctf_event *bt_ctf_iter_read_event_flags(struct bt_ctf_iter *iter,
 		int *flags);
 
+/*
+ * bt_ctf_set_io_uring_depth: Read packets through io_uring.
+ *
+ * @depth: number of packet reads held at once, 0 to map packets from
+ *         the stream files (the default).
+ *
+ * Packet headers are read in batches while indexing, and the next
+ * packets of each stream are read while its current packet is decoded.
+ * Falls back to mapping packets when babeltrace is built without
+ * liburing or the kernel lacks io_uring. Applies to the traces opened
+ * after the call.
+ */
+void bt_ctf_set_io_uring_depth(unsigned long depth);
+
+/*
+ * bt_ctf_set_lazy_index: Index stream packets in the background.
+ *
+ * @enable: non-zero to index only the first packet of each stream when
+ *          opening a trace, and the others on a background thread.
+ *
+ * Seeks and timestamp range queries wait for the packets they need.
+ * Applies to the traces opened after the call.
+ */
+void bt_ctf_set_lazy_index(int enable);
+
+/*
+ * bt_ctf_set_follow: Open traces for follow mode.
+ *
+ * @enable: non-zero to accept stream files without any packet yet,
+ *          which bt_context_update() reads from their first packet.
+ *
+ * Without it, an empty stream file is an error for stream classes with
+ * a packet header or context. Applies to the traces opened after the
+ * call.
+ */
+void bt_ctf_set_follow(int enable);
+
+/*
+ * bt_ctf_iter_add_event_filter: Read only the events named name.
+ *
+ * @iter: trace collection iterator (input). Should NOT be NULL.
+ * @name: event name (input).
+ *
+ * Once a filter is added, the iterator only returns the events whose
+ * name was given to one of the calls. Packets the packet index knows
+ * to hold none of these events are skipped without being mapped: the
+ * index learns the events of each packet decoded entirely, so this
+ * speeds up reading again parts of a trace. Callbacks are only called
+ * for the events read. Lost event counts still include all packets.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int bt_ctf_iter_add_event_filter(struct bt_ctf_iter *iter, const char *name);
+
+/*
+ * bt_ctf_iter_add_field_filter: Read only the events whose integer
+ * field name, from the stream packet context or the stream event
+ * context, is between min and max, inclusive.
+ *
+ * @iter: trace collection iterator (input). Should NOT be NULL.
+ * @name: field name (input).
+ * @min, @max: range of the field value (input).
+ *
+ * Filters added by several calls must all match. The packet index
+ * records the range of the field values of each packet, from the
+ * packet context when the packet is indexed or read, and from the
+ * event contexts when it is decoded entirely. Packets whose range
+ * cannot match are skipped without being mapped.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int bt_ctf_iter_add_field_filter(struct bt_ctf_iter *iter, const char *name,
+		int64_t min, int64_t max);
+
 /*
  * bt_ctf_get_lost_events_count: returns the number of events discarded
  * immediately prior to the last event read
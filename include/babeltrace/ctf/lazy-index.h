@@ -0,0 +1,75 @@
+#ifndef _BABELTRACE_CTF_LAZY_INDEX_H
+#define _BABELTRACE_CTF_LAZY_INDEX_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Background packet indexing.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/ctf/types.h>
+#include <sys/types.h>
+
+struct ctf_file_stream;
+
+/*
+ * With opt_lazy_index, opening a stream file only indexes its first
+ * packet. The other packets are indexed by a background thread, which
+ * decodes their headers and contexts through an indexing stream of its
+ * own: a separate fd, mapping and packet header/context definitions,
+ * outside of the stream cache. The thread takes streams in turn,
+ * indexing up to LAZY_INDEX_BATCH packets of each with the stream file
+ * opened for that batch only, so that it holds at most one fd and one
+ * mapping besides the stream cache budgets, and publishes the
+ * entries; the reading thread appends them to the stream packet index
+ * from ctf_packet_index_extend(), only waiting when it needs packets
+ * not indexed yet, in which case the stream is indexed next.
+ *
+ * An error found while indexing in the background ends the stream
+ * index at the last valid packet. Compressed stream files, streams
+ * without packet context and traces opened with index fields (--where)
+ * are indexed when opened.
+ */
+#define LAZY_INDEX_BATCH	64
+
+/*
+ * Index the packets of file_stream after its first one in the
+ * background, using the indexing stream shadow, positioned on the
+ * second packet. Returns 0 on success; the caller then no longer owns
+ * shadow.
+ */
+BT_HIDDEN
+int ctf_lazy_index_start(struct ctf_file_stream *file_stream,
+		struct ctf_file_stream *shadow, off_t filesize);
+/* Stop indexing a packet index in the background, if it is. */
+BT_HIDDEN
+void ctf_lazy_index_stop(struct ctf_packet_index *index);
+
+/* Provided by the CTF reader. */
+BT_HIDDEN
+int ctf_index_next_packet(struct ctf_file_stream *shadow, off_t filesize);
+BT_HIDDEN
+void ctf_close_index_stream(struct ctf_file_stream *shadow);
+
+#endif /* _BABELTRACE_CTF_LAZY_INDEX_H */
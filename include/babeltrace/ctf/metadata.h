@@ -33,6 +33,8 @@
 #include <babeltrace/ctf-ir/metadata.h>
 #include <babeltrace/trace-handle-internal.h>
 #include <babeltrace/context-internal.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/clock-internal.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <assert.h>
@@ -63,4 +65,52 @@ struct metadata_packet_header {
 	HEADER_END;
 };
 
+/*
+ * Look up the integer field name in the packet context, then in the
+ * stream event context of a stream, setting scope to the enum
+ * bt_ctf_scope of the field. Returns NULL if not found.
+ */
+BT_HIDDEN
+struct definition_integer *ctf_stream_lookup_integer(struct ctf_stream_definition *stream,
+		GQuark name, int *scope);
+
+static inline
+int64_t ctf_integer_value(const struct definition_integer *integer)
+{
+	if (integer->declaration->signedness)
+		return integer->value._signed;
+	return (int64_t) integer->value._unsigned;
+}
+
+/*
+ * Add the field columns of opt_index_fields to the packet index of a
+ * stream, or the column name if name is non-zero. Returns the column
+ * number of name.
+ */
+BT_HIDDEN
+int ctf_stream_index_field(struct ctf_file_stream *file_stream, GQuark name);
+
+/*
+ * Convert a stream timestamp in cycles to ns, applying the clock offset
+ * of the trace collection.
+ */
+static inline
+uint64_t ctf_get_real_timestamp(struct ctf_stream_definition *stream,
+			uint64_t timestamp)
+{
+	uint64_t ts_nsec;
+	struct ctf_trace *trace = stream->stream_class->trace;
+	struct trace_collection *tc = trace->parent.collection;
+	uint64_t tc_offset;
+
+	if (tc->clock_use_offset_avg)
+		tc_offset = tc->single_clock_offset_avg;
+	else
+		tc_offset = trace->parent.single_clock->offset;
+
+	ts_nsec = clock_cycles_to_ns(stream->current_clock, timestamp);
+	ts_nsec += tc_offset;	/* Add offset */
+	return ts_nsec;
+}
+
 #endif /* _BABELTRACE_CTF_METADATA_H */
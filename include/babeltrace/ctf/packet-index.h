@@ -0,0 +1,290 @@
+#ifndef _BABELTRACE_CTF_PACKET_INDEX_H
+#define _BABELTRACE_CTF_PACKET_INDEX_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Compact packet index.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <glib.h>
+
+/*
+ * Decoded view of one packet index entry. Timestamps are expressed in
+ * clock cycles; use ctf_get_real_timestamp() to convert them to ns.
+ */
+struct packet_index {
+	off_t offset;		/* offset of the packet in the file, in bytes */
+	int64_t data_offset;	/* offset of data within the packet, in bits */
+	uint64_t packet_size;	/* packet size, in bits */
+	uint64_t content_size;	/* content size, in bits */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t events_discarded_len;	/* length of the field, in bits */
+};
+
+/*
+ * Number of entries between two full checkpoints of the encoded
+ * columns. Random access decodes at most this many records.
+ */
+#define PACKET_INDEX_BLOCK_LEN	32
+
+/*
+ * Event ids present in a packet, as a bitmap of the ids modulo 64: a
+ * packet without any bit of a mask holds none of the events of the
+ * mask. Packets are marked unknown until they are decoded entirely.
+ */
+#define PACKET_EVENT_IDS_UNKNOWN	(~(uint64_t) 0)
+
+static inline
+uint64_t ctf_packet_event_id_bit(uint64_t id)
+{
+	return (uint64_t) 1 << (id & 63);
+}
+
+struct packet_index_block {
+	size_t data_pos;		/* position of first record in data */
+	struct packet_index prev;	/* entry preceding the block */
+};
+
+/*
+ * Range of the values of an integer field in a packet, with a 64-bit
+ * Bloom filter of the values, so packets which cannot hold events
+ * matching a predicate on the field are skipped. Values are compared
+ * as signed 64-bit integers. Packets are marked unknown, a range
+ * matching any value, until their values are known.
+ */
+struct packet_field_range {
+	int64_t min, max;
+	uint64_t bloom;
+};
+
+#define PACKET_FIELD_RANGE_UNKNOWN	{ INT64_MIN, INT64_MAX, ~(uint64_t) 0 }
+#define PACKET_FIELD_RANGE_EMPTY	{ INT64_MAX, INT64_MIN, 0 }
+
+/*
+ * Values of a packet context field are known when the packet is
+ * indexed or read. Values of a stream event context field are known
+ * once the packet is decoded entirely.
+ */
+struct packet_field_column {
+	GQuark name;
+	int scope;		/* enum bt_ctf_scope, -1 if not in the stream */
+	GArray *ranges;		/* struct packet_field_range, by packet */
+};
+
+static inline
+uint64_t packet_field_bloom_bits(int64_t value)
+{
+	uint64_t h = (uint64_t) value * 0x9E3779B97F4A7C15ULL;
+
+	return ((uint64_t) 1 << (h >> 58)) | ((uint64_t) 1 << ((h >> 52) & 63));
+}
+
+static inline
+void packet_field_range_add(struct packet_field_range *range, int64_t value)
+{
+	if (value < range->min)
+		range->min = value;
+	if (value > range->max)
+		range->max = value;
+	range->bloom |= packet_field_bloom_bits(value);
+}
+
+/*
+ * Return 0 if no value of the range is between min and max.
+ */
+static inline
+int packet_field_range_may_match(const struct packet_field_range *range,
+		int64_t min, int64_t max)
+{
+	if (range->max < min || range->min > max)
+		return 0;
+	if (min == max && (range->bloom & packet_field_bloom_bits(min))
+			!= packet_field_bloom_bits(min))
+		return 0;
+	return 1;
+}
+
+/* Events between two checkpoints of a packet. */
+#define PACKET_CHECKPOINT_INTERVAL	1024
+
+/*
+ * Restore point on an event within a packet: decoding can resume from
+ * the event offset once the stream clock is set to the event timestamp.
+ */
+struct packet_checkpoint {
+	int64_t offset;			/* event offset in the packet, in bits */
+	uint64_t cycles_timestamp;	/* event timestamp, in cycles */
+};
+
+/*
+ * The packet index is kept as a structure of arrays. Timestamps have
+ * their own uncompressed columns (in cycles) so binary searches only
+ * touch the timestamp_end column. Offsets, sizes and discarded event
+ * counts are stored as varint-encoded deltas against the previous
+ * entry, with a checkpoint every PACKET_INDEX_BLOCK_LEN entries.
+ *
+ * The event id bitmaps are an optional column, allocated when the
+ * first packet is decoded entirely: indexing only reads the packet
+ * headers and contexts, so it cannot fill it. Likewise, checkpoints
+ * every PACKET_CHECKPOINT_INTERVAL events are recorded for the packets
+ * decoded from their start, so time seeks within large packets decode
+ * at most that many events.
+ *
+ * Decoding keeps a cursor on the last entry read, so sequential access
+ * (the common packet_seek SEEK_CUR case) decodes a single record. The
+ * cursor makes ctf_packet_index_get() unsafe to call concurrently on
+ * the same index.
+ *
+ * An index still being built in the background (see
+ * babeltrace/ctf/lazy-index.h) only holds the packets indexed so far:
+ * code needing more packets calls ctf_packet_index_extend() first, or
+ * ctf_packet_index_complete() for all of them.
+ */
+struct ctf_packet_index {
+	size_t len;			/* number of entries */
+	GArray *timestamp_begin;	/* uint64_t, in cycles */
+	GArray *timestamp_end;		/* uint64_t, in cycles */
+	GArray *blocks;			/* struct packet_index_block */
+	GArray *data;			/* encoded records, uint8_t */
+	GArray *event_ids;		/* uint64_t, NULL until first set */
+	GPtrArray *checkpoints;		/* GArray of struct packet_checkpoint
+					   per packet, NULL until first set */
+	GArray *fields;			/* struct packet_field_column */
+	struct packet_index last;	/* last appended entry */
+
+	/* Indexes more packets, while the index is built in the background */
+	void (*extend)(struct ctf_packet_index *index, size_t len);
+	void *extend_data;
+
+	/* Decoding cursor */
+	size_t cursor;			/* entry held in cursor_entry */
+	size_t cursor_pos;		/* data position after that entry */
+	struct packet_index cursor_entry;
+};
+
+struct ctf_packet_index *ctf_packet_index_create(void);
+void ctf_packet_index_destroy(struct ctf_packet_index *index);
+void ctf_packet_index_append(struct ctf_packet_index *index,
+		const struct packet_index *entry);
+void ctf_packet_index_get(struct ctf_packet_index *index, size_t i,
+		struct packet_index *entry);
+void ctf_packet_index_set_event_ids(struct ctf_packet_index *index, size_t i,
+		uint64_t event_ids);
+/*
+ * Record checkpoint nr (from 1) of packet i, on event
+ * nr * PACKET_CHECKPOINT_INTERVAL of the packet. Checkpoints are added
+ * in order: nr is ignored unless it follows the last checkpoint of the
+ * packet.
+ */
+void ctf_packet_index_add_checkpoint(struct ctf_packet_index *index,
+		size_t i, size_t nr, const struct packet_checkpoint *checkpoint);
+/*
+ * Add a field column, or return the existing column of that name.
+ * Returns the column number.
+ */
+int ctf_packet_index_add_field(struct ctf_packet_index *index, GQuark name,
+		int scope);
+/*
+ * Approximate memory footprint of the index, in bytes.
+ */
+size_t ctf_packet_index_mem_size(struct ctf_packet_index *index);
+
+/*
+ * Make sure the index holds at least len entries, or all the packets
+ * of the stream if it has fewer.
+ */
+static inline
+void ctf_packet_index_extend(struct ctf_packet_index *index, size_t len)
+{
+	if (index->extend && index->len < len)
+		index->extend(index, len);
+}
+
+static inline
+void ctf_packet_index_complete(struct ctf_packet_index *index)
+{
+	ctf_packet_index_extend(index, SIZE_MAX);
+}
+
+static inline
+size_t ctf_packet_index_len(struct ctf_packet_index *index)
+{
+	return index->len;
+}
+
+static inline
+uint64_t ctf_packet_index_timestamp_begin(struct ctf_packet_index *index,
+		size_t i)
+{
+	return g_array_index(index->timestamp_begin, uint64_t, i);
+}
+
+static inline
+uint64_t ctf_packet_index_timestamp_end(struct ctf_packet_index *index,
+		size_t i)
+{
+	return g_array_index(index->timestamp_end, uint64_t, i);
+}
+
+static inline
+uint64_t ctf_packet_index_event_ids(struct ctf_packet_index *index, size_t i)
+{
+	if (!index->event_ids)
+		return PACKET_EVENT_IDS_UNKNOWN;
+	return g_array_index(index->event_ids, uint64_t, i);
+}
+
+/*
+ * Checkpoints of packet i, as an array of struct packet_checkpoint, or
+ * NULL if none. Element n is checkpoint n + 1.
+ */
+static inline
+GArray *ctf_packet_index_checkpoints(struct ctf_packet_index *index, size_t i)
+{
+	if (!index->checkpoints || i >= index->checkpoints->len)
+		return NULL;
+	return g_ptr_array_index(index->checkpoints, i);
+}
+
+static inline
+struct packet_field_column *ctf_packet_index_field(struct ctf_packet_index *index,
+		int column)
+{
+	return &g_array_index(index->fields, struct packet_field_column, column);
+}
+
+static inline
+struct packet_field_range *ctf_packet_index_field_range(struct ctf_packet_index *index,
+		int column, size_t i)
+{
+	return &g_array_index(ctf_packet_index_field(index, column)->ranges,
+			struct packet_field_range, i);
+}
+
+#endif /* _BABELTRACE_CTF_PACKET_INDEX_H */
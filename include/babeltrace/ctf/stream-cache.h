@@ -0,0 +1,133 @@
+#ifndef _BABELTRACE_CTF_STREAM_CACHE_H
+#define _BABELTRACE_CTF_STREAM_CACHE_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * Bounded cache of file stream descriptors and packet mappings.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/ctf/types.h>
+#include <stdint.h>
+
+/*
+ * Read-side file streams registered in the stream cache share a budget
+ * of open file descriptors and of live packet mappings, each managed as
+ * an LRU list. When a budget is exceeded, the least recently used
+ * stream gets its fd closed (it is reopened by path on next use) or
+ * its current packet unmapped (it is mapped again before its next event
+ * is read). Mapping eviction relies on decoded definitions never
+ * pointing into the packet mapping.
+ *
+ * Packets of compressed stream files (see
+ * babeltrace/ctf/compressed-stream.h) are "mapped" by decompressing
+ * their frame, and evicting such a mapping also frees the frame
+ * buffers.
+ *
+ * The limits are taken from opt_max_open_files and opt_max_mappings
+ * when the first stream is added. 0 selects a default derived from
+ * RLIMIT_NOFILE for fds, and DEFAULT_MAX_MAPPINGS for mappings.
+ *
+ * With opt_streaming, stream files are read for a single pass: they are
+ * advised for sequential access, the next packet of a stream is
+ * advised WILLNEED when the current one is mapped, and packets are
+ * dropped from the page cache (POSIX_FADV_DONTNEED) when unmapped, so
+ * the page cache held by a scan stays bounded by the live mappings.
+ * Evicted mappings are kept in the page cache, as they are mapped
+ * again. Compressed stream files are only advised sequential.
+ */
+#define DEFAULT_MAX_MAPPINGS	32768
+
+struct ctf_stream_cache_stats {
+	uint64_t fd_hits;	/* fd requests served by an open fd */
+	uint64_t fd_reopens;	/* files reopened after eviction */
+	uint64_t reopen_ns;	/* time spent reopening files */
+	uint64_t mapping_hits;	/* event reads with a live mapping */
+	uint64_t mapping_remaps;	/* packets mapped again after eviction */
+	uint64_t remap_ns;	/* time spent mapping packets again */
+	uint64_t scan_start_ns;	/* first packet mapped */
+	uint64_t mapped_bytes;	/* packet bytes mapped, without remaps */
+	uint64_t cached_bytes;	/* resident in the page cache at unmap */
+	uint64_t left_bytes;	/* still resident after unmap */
+};
+
+extern struct ctf_stream_cache_stats ctf_stream_cache_stats;
+/* Mapped packets of the registered streams, most recently used first. */
+extern struct bt_list_head ctf_stream_cache_mma_lru;
+
+/*
+ * Register a read-side file stream whose pos->fd is open. The file is
+ * reopened relative to the trace directory, using the stream path.
+ */
+BT_HIDDEN
+void ctf_stream_cache_add(struct ctf_stream_pos *pos);
+/*
+ * Unregister a stream and unmap its packet. The fd, if still open, is
+ * left to the caller.
+ */
+BT_HIDDEN
+int ctf_stream_cache_remove(struct ctf_stream_pos *pos);
+/*
+ * Return the fd of the stream, reopening the file if needed, or a
+ * negative error value.
+ */
+BT_HIDDEN
+int ctf_stream_cache_get_fd(struct ctf_stream_pos *pos);
+/*
+ * Map len bytes of the stream file at pos->mmap_offset into
+ * pos->base_mma. Streams not registered in the cache are mapped
+ * directly. Returns 0 on success, a negative error value otherwise.
+ */
+BT_HIDDEN
+int ctf_stream_cache_map(struct ctf_stream_pos *pos, size_t len);
+BT_HIDDEN
+int ctf_stream_cache_unmap(struct ctf_stream_pos *pos);
+/*
+ * With opt_streaming, ask the kernel to read len bytes of the stream
+ * file at offset ahead.
+ */
+BT_HIDDEN
+void ctf_stream_cache_will_need(struct ctf_stream_pos *pos, off_t offset,
+		size_t len);
+
+/*
+ * Map the current packet again if its mapping was evicted, or mark it
+ * as the most recently used one. Must be called before decoding from a
+ * registered stream.
+ */
+static inline
+int ctf_stream_cache_ensure_mapped(struct ctf_stream_pos *pos)
+{
+	if (likely(!pos->mma_evicted)) {
+		if (pos->cached && pos->base_mma) {
+			ctf_stream_cache_stats.mapping_hits++;
+			if (ctf_stream_cache_mma_lru.next != &pos->mma_node)
+				bt_list_move(&pos->mma_node,
+					&ctf_stream_cache_mma_lru);
+		}
+		return 0;
+	}
+	return ctf_stream_cache_map(pos, pos->packet_size / CHAR_BIT);
+}
+
+#endif /* _BABELTRACE_CTF_STREAM_CACHE_H */
@@ -39,20 +39,29 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <babeltrace/mmap-align.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <babeltrace/list.h>
 
 #define LAST_OFFSET_POISON	((int64_t) ~0ULL)
 
 struct bt_stream_callbacks;
+struct ctf_cstream;
+struct ctf_uring_stream;
 
-struct packet_index {
-	off_t offset;		/* offset of the packet in the file, in bytes */
-	int64_t data_offset;	/* offset of data within the packet, in bits */
-	uint64_t packet_size;	/* packet size, in bits */
-	uint64_t content_size;	/* content size, in bits */
-	uint64_t timestamp_begin;
-	uint64_t timestamp_end;
-	uint64_t events_discarded;
-	uint64_t events_discarded_len;	/* length of the field, in bits */
+/*
+ * Values of a stream event context field in the current packet, for a
+ * field column of the packet index.
+ */
+struct ctf_field_acc {
+	int column;			/* field column in the packet index */
+	struct definition_integer *def;	/* field, NULL if not an integer */
+	struct packet_field_range range;
+};
+
+/* Predicate on a field column, for packet skipping. */
+struct ctf_field_filter {
+	int column;
+	int64_t min, max;
 };
 
 /*
@@ -61,8 +70,7 @@ struct packet_index {
 struct ctf_stream_pos {
 	struct bt_stream_pos parent;
 	int fd;			/* backing file fd. -1 if unset. */
-	GArray *packet_cycles_index;	/* contains struct packet_index in cycles */
-	GArray *packet_real_index;	/* contains struct packet_index in ns */
+	struct ctf_packet_index *packet_index;	/* packet index, in cycles */
 	int prot;		/* mmap protection */
 	int flags;		/* mmap flags */
 
@@ -82,6 +90,29 @@ struct ctf_stream_pos {
 
 	int dummy;		/* dummy position, for length calculation */
 	struct bt_stream_callbacks *cb;	/* Callbacks registered for iterator. */
+
+	/* Stream cache (see babeltrace/ctf/stream-cache.h) */
+	int cached;		/* fd and mapping managed by the stream cache */
+	int mma_evicted;	/* current packet unmapped by the stream cache */
+	struct bt_list_head fd_node;	/* node in the open fd LRU list */
+	struct bt_list_head mma_node;	/* node in the mapping LRU list */
+
+	struct ctf_cstream *cstream;	/* compressed stream file, or NULL */
+	struct ctf_uring_stream *uring;	/* io_uring reads, or NULL */
+
+	/* Event ids of the current packet, for the packet index */
+	uint64_t event_ids;	/* bitmap of the ids read in this packet */
+	int64_t event_ids_next;	/* end of the last event counted, in bits */
+	int event_ids_valid;	/* all events read from the packet start */
+	int filters_set;	/* filters below up to date with the iterator */
+	int filter_events;	/* skip packets without event_filter ids */
+	uint64_t event_filter;	/* bitmap of the ids read by the iterator */
+	GArray *field_acc;	/* struct ctf_field_acc, NULL if none */
+	GArray *field_filters;	/* struct ctf_field_filter, NULL if none */
+
+	/* Checkpoints of the current packet, for the packet index */
+	uint64_t packet_events;	/* events counted from the packet start */
+	int64_t checkpoint_next;	/* end of the last event counted, in bits, -1 if lost */
 };
 
 static inline
@@ -184,6 +215,7 @@ void ctf_dummy_pos(struct ctf_stream_pos *pos, struct ctf_stream_pos *dummy)
 	memcpy(dummy, pos, sizeof(struct ctf_stream_pos));
 	dummy->dummy = 1;
 	dummy->fd = -1;
+	dummy->cached = 0;
 }
 
 /*
@@ -0,0 +1,54 @@
+#ifndef _BABELTRACE_CTF_WRITER_INTERNAL_H
+#define _BABELTRACE_CTF_WRITER_INTERNAL_H
+
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF trace output.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/format-internal.h>
+#include <babeltrace/babeltrace-internal.h>
+
+/*
+ * A CTF output trace is a directory receiving a copy of each input
+ * trace of the collection. Each input trace is written to the path it
+ * has relative to the directory holding all input traces, with its
+ * metadata and one stream file per input stream file. Events are
+ * re-encoded with the write dispatch table, and each input packet
+ * starts a new output packet with the same packet header and context,
+ * except for its content_size and packet_size, which describe the
+ * events actually written.
+ *
+ * When opt_begin_time or opt_end_time restrict the output to a time
+ * range, the writer has no event callback: input traces are trimmed
+ * from the packet index by the pre-trace callback instead. Packets
+ * lying entirely within the range are copied as is, and only the
+ * packets crossing a bound are decoded and re-encoded.
+ */
+BT_HIDDEN
+struct bt_trace_descriptor *ctf_writer_open_trace(const char *path);
+BT_HIDDEN
+int ctf_writer_close_trace(struct bt_trace_descriptor *descriptor);
+
+#endif /* _BABELTRACE_CTF_WRITER_INTERNAL_H */
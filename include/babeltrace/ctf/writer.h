@@ -0,0 +1,164 @@
+#ifndef _BABELTRACE_CTF_WRITER_H
+#define _BABELTRACE_CTF_WRITER_H
+
+/*
+ * BabelTrace
+ *
+ * CTF writer API
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A writer produces a CTF trace in a new directory. Stream classes and
+ * their event classes are declared first, then streams of those
+ * classes are created and events appended to them. Each stream is
+ * written to its own file, in packets of the writer packet size. The
+ * TSDL metadata describing the classes is written when the writer is
+ * closed.
+ *
+ * Event timestamps are in nanoseconds and must not decrease within a
+ * stream. A writer and its streams must not be used concurrently from
+ * several threads.
+ */
+struct bt_ctf_writer;
+struct bt_ctf_writer_stream_class;
+struct bt_ctf_writer_event_class;
+struct bt_ctf_writer_stream;
+
+/* Event field types. Integers and floats are in native byte order. */
+enum bt_ctf_writer_field_type {
+	BT_CTF_WRITER_UINT8,
+	BT_CTF_WRITER_UINT16,
+	BT_CTF_WRITER_UINT32,
+	BT_CTF_WRITER_UINT64,
+	BT_CTF_WRITER_INT8,
+	BT_CTF_WRITER_INT16,
+	BT_CTF_WRITER_INT32,
+	BT_CTF_WRITER_INT64,
+	BT_CTF_WRITER_FLOAT,
+	BT_CTF_WRITER_DOUBLE,
+	BT_CTF_WRITER_STRING,
+};
+
+/* Value of an event field, used according to the field type. */
+union bt_ctf_writer_value {
+	uint64_t u;		/* unsigned integers */
+	int64_t s;		/* signed integers */
+	double d;		/* floats and doubles */
+	const char *str;	/* strings */
+};
+
+/*
+ * bt_ctf_writer_create: create a trace in the directory path, which
+ * must not exist.
+ *
+ * Returns NULL on error.
+ */
+struct bt_ctf_writer *bt_ctf_writer_create(const char *path);
+
+/*
+ * bt_ctf_writer_close: close the streams of the writer, write the
+ * trace metadata and free the writer and its classes.
+ *
+ * Returns 0 on success, a negative value on error. The writer is freed
+ * in both cases.
+ */
+int bt_ctf_writer_close(struct bt_ctf_writer *writer);
+
+/*
+ * bt_ctf_writer_set_packet_size: set the size of the packets of the
+ * streams created afterwards, in bytes. It must be a multiple of the
+ * page size. An event must fit in a packet.
+ *
+ * Returns 0 on success, a negative value on error.
+ */
+int bt_ctf_writer_set_packet_size(struct bt_ctf_writer *writer,
+		size_t packet_size);
+
+/*
+ * bt_ctf_writer_add_stream_class: declare a stream class.
+ *
+ * Returns NULL on error.
+ */
+struct bt_ctf_writer_stream_class *
+	bt_ctf_writer_add_stream_class(struct bt_ctf_writer *writer);
+
+/*
+ * bt_ctf_writer_add_event_class: declare an event class named name in
+ * the stream class. Its fields are added with
+ * bt_ctf_writer_event_class_add_field(), before the first event of
+ * this class is appended.
+ *
+ * Returns NULL on error.
+ */
+struct bt_ctf_writer_event_class *
+	bt_ctf_writer_add_event_class(struct bt_ctf_writer_stream_class *stream_class,
+		const char *name);
+
+/*
+ * bt_ctf_writer_event_class_add_field: add a field named name, which
+ * must be a valid identifier, to the event class payload.
+ *
+ * Returns 0 on success, a negative value on error.
+ */
+int bt_ctf_writer_event_class_add_field(struct bt_ctf_writer_event_class *event_class,
+		const char *name, enum bt_ctf_writer_field_type type);
+
+/*
+ * bt_ctf_writer_create_stream: create a stream of the stream class.
+ *
+ * Returns NULL on error.
+ */
+struct bt_ctf_writer_stream *
+	bt_ctf_writer_create_stream(struct bt_ctf_writer_stream_class *stream_class);
+
+/*
+ * bt_ctf_writer_append_events: append nr_events events of class
+ * event_class to the stream.
+ *
+ * @timestamps: timestamp of each event, in nanoseconds
+ * @values: field values, one row of one value per field of the event
+ *          class for each event
+ *
+ * Events are written in the current packet of the stream, and a new
+ * packet is started when it is full. Returns the number of events
+ * appended, which is less than nr_events if an error occurred.
+ */
+size_t bt_ctf_writer_append_events(struct bt_ctf_writer_stream *stream,
+		struct bt_ctf_writer_event_class *event_class,
+		const uint64_t *timestamps,
+		const union bt_ctf_writer_value *values,
+		size_t nr_events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BABELTRACE_CTF_WRITER_H */
@@ -37,6 +37,8 @@
 extern "C" {
 #endif
 
+struct bt_stream_pos;
+
 /* Parent trace descriptor */
 struct bt_trace_descriptor {
 	char path[PATH_MAX];		/* trace path */
@@ -45,6 +47,7 @@ struct bt_trace_descriptor {
 	struct trace_collection *collection;	/* Container of this trace */
 	GHashTable *clocks;
 	struct ctf_clock *single_clock;		/* currently supports only one clock */
+	struct bt_stream_pos *output_pos;	/* output traces: position events are written to */
 };
 
 #ifdef __cplusplus
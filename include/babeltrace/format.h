@@ -77,6 +77,7 @@ struct bt_format {
 	uint64_t (*timestamp_end)(struct bt_trace_descriptor *descriptor,
 			struct bt_trace_handle *handle, enum bt_clock_type type);
 	int (*convert_index_timestamp)(struct bt_trace_descriptor *descriptor);
+	int (*update_trace)(struct bt_trace_descriptor *descriptor);
 };
 
 extern struct bt_format *bt_lookup_format(bt_intern_str qname);
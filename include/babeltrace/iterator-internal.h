@@ -29,6 +29,7 @@
  * SOFTWARE.
  */
 
+#include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/ctf/events.h>
 
 /*
@@ -39,6 +40,22 @@ struct bt_iter {
 	struct ptr_heap *stream_heap;
 	struct bt_context *ctx;
 	const struct bt_iter_pos *end_pos;
+	/*
+	 * Top of the heap when it was last rebalanced, and the smallest
+	 * timestamp of the other streams. Until the top stream reaches
+	 * it, the heap needs no rebalancing. NULL when the heap changed
+	 * otherwise.
+	 */
+	struct ctf_file_stream *bypass_stream;
+	uint64_t bypass_timestamp;
+	struct bt_packet_cache *packet_cache;	/* NULL if disabled */
+	/*
+	 * Called before a stream is read again, or with a NULL stream
+	 * before all streams are moved, while events handed to other
+	 * threads may still use the stream definitions. NULL if unused.
+	 */
+	void (*wait_stream)(struct bt_iter *iter,
+			struct ctf_file_stream *file_stream);
 };
 
 /*
@@ -68,4 +85,13 @@ int bt_iter_init(struct bt_iter *iter,
 		const struct bt_iter_pos *end_pos);
 void bt_iter_fini(struct bt_iter *iter);
 
+/*
+ * bt_iter_resume_streams - Put back in the iteration the streams which
+ * reached their end, but got new packets since (follow mode).
+ *
+ * Return 0 on success, an error value otherwise.
+ */
+BT_HIDDEN
+int bt_iter_resume_streams(struct bt_iter *iter);
+
 #endif /* _BABELTRACE_ITERATOR_INTERNAL_H */
@@ -104,6 +104,9 @@ void bt_iter_free_pos(struct bt_iter_pos *pos);
  *
  * On error, the stream_heap is reinitialized and returned empty.
  *
+ * With BT_SEEK_RESTORE, streams already positioned on their saved event
+ * are left as is, only the others are read again.
+ *
  * Return 0 for success.
  *
  * Return EOF if the position requested is after the last event of the
@@ -123,6 +126,44 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *pos);
 struct bt_iter_pos *bt_iter_create_time_pos(struct bt_iter *iter,
 		uint64_t timestamp);
 
+/*
+ * bt_iter_serialize_pos: encode a position into bytes.
+ *
+ * Positions saved with bt_iter_get_pos identify each stream by trace
+ * UUID, stream class id and stream file path (or file number for
+ * memory-mapped traces), along with the packet index, bit offset and
+ * timestamps of its current event, so they can be stored and restored
+ * by another process opening the same traces.
+ *
+ * Returns a buffer of *len bytes to be freed with free(), or NULL on
+ * error.
+ */
+void *bt_iter_serialize_pos(const struct bt_iter_pos *pos, size_t *len);
+
+/*
+ * bt_iter_deserialize_pos: decode a position encoded by
+ * bt_iter_serialize_pos.
+ *
+ * The streams of the position are looked up in the trace collection of
+ * iter. The returned position needs to be freed by bt_iter_free_pos.
+ * Returns NULL if the data is invalid or a stream is not found.
+ */
+struct bt_iter_pos *bt_iter_deserialize_pos(struct bt_iter *iter,
+		const void *data, size_t len);
+
+/*
+ * bt_iter_set_packet_cache_size: cache the events decoded by time seeks.
+ *
+ * BT_SEEK_TIME decodes the packet holding the requested timestamp from
+ * its start. With a packet cache, the offsets and timestamps of the
+ * events decoded are kept for the most recently visited packets, up to
+ * max_size bytes, so seeking again within them decodes only the target
+ * event. 0 disables the cache (the default).
+ *
+ * Return 0 for success, -EINVAL when called with invalid parameter.
+ */
+int bt_iter_set_packet_cache_size(struct bt_iter *iter, size_t max_size);
+
 #ifdef __cplusplus
 }
 #endif
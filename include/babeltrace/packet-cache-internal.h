@@ -0,0 +1,91 @@
+#ifndef _BABELTRACE_PACKET_CACHE_INTERNAL_H
+#define _BABELTRACE_PACKET_CACHE_INTERNAL_H
+
+/*
+ * BabelTrace
+ *
+ * Cache of the events decoded by time seeks, per packet.
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/list.h>
+#include <glib.h>
+#include <stdint.h>
+
+struct ctf_file_stream;
+
+/*
+ * Time seeks decode the events of a packet from its start up to the
+ * target timestamp. The offsets and timestamps of these events are
+ * recorded, so that seeking again within a recently visited part of a
+ * packet decodes only the target event, as BT_SEEK_RESTORE does, and
+ * seeking further resumes decoding from the last recorded event.
+ *
+ * Packets are kept in LRU order within a memory budget, per iterator.
+ */
+struct bt_packet_event {
+	int64_t offset;			/* event offset in the packet, in bits */
+	uint64_t cycles_timestamp;
+	uint64_t real_timestamp;
+};
+
+struct bt_packet_key {
+	struct ctf_file_stream *cfs;
+	uint64_t index;			/* packet index in the stream */
+};
+
+struct bt_packet_cache_entry {
+	struct bt_packet_key key;	/* hash table key */
+	GArray *events;			/* struct bt_packet_event, from the packet start */
+	int complete;			/* events holds all events of the packet */
+	struct bt_list_head node;	/* node in the LRU list */
+};
+
+struct bt_packet_cache {
+	GHashTable *entries;		/* struct bt_packet_cache_entry, by (cfs, index) */
+	struct bt_list_head lru;	/* most recently used first */
+	size_t size, max_size;		/* in bytes */
+};
+
+BT_HIDDEN
+struct bt_packet_cache *bt_packet_cache_create(size_t max_size);
+BT_HIDDEN
+void bt_packet_cache_destroy(struct bt_packet_cache *cache);
+/*
+ * Return the entry of a packet, creating it empty if needed, as most
+ * recently used.
+ */
+BT_HIDDEN
+struct bt_packet_cache_entry *bt_packet_cache_get(struct bt_packet_cache *cache,
+		struct ctf_file_stream *cfs, uint64_t index);
+/*
+ * Record the next event of a packet. Evicts other packets to stay
+ * within budget. Returns 0 on success, -ENOSPC if the event does not
+ * fit, in which case the events recorded stay a valid prefix.
+ */
+BT_HIDDEN
+int bt_packet_cache_append(struct bt_packet_cache *cache,
+		struct bt_packet_cache_entry *entry,
+		const struct bt_packet_event *event);
+
+#endif /* _BABELTRACE_PACKET_CACHE_INTERNAL_H */
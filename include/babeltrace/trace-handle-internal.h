@@ -50,6 +50,12 @@ struct bt_trace_handle {
 	uint64_t real_timestamp_end;
 	uint64_t cycles_timestamp_begin;
 	uint64_t cycles_timestamp_end;
+	/*
+	 * End timestamps computed. They are computed on first use, as
+	 * they need the whole packet index, which may still be built in
+	 * the background.
+	 */
+	int timestamp_end_valid;
 };
 
 /*
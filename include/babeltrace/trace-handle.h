@@ -63,7 +63,8 @@ uint64_t bt_trace_handle_get_timestamp_begin(struct bt_context *ctx,
 /*
  * bt_trace_handle_get_timestamp_end : returns the destruction timestamp
  * (in nanoseconds or cycles depending on type) of the buffers of a trace
- * or -1ULL on error.
+ * or -1ULL on error. The first call waits for the trace to be fully
+ * indexed when it is indexed in the background.
  */
 uint64_t bt_trace_handle_get_timestamp_end(struct bt_context *ctx,
 		int handle_id, enum bt_clock_type type);
@@ -30,6 +30,7 @@
 #include <babeltrace/babeltrace.h>
 #include <babeltrace/context.h>
 #include <babeltrace/context-internal.h>
+#include <babeltrace/iterator-internal.h>
 #include <babeltrace/trace-handle.h>
 #include <babeltrace/trace-handle-internal.h>
 #include <babeltrace/trace-collection.h>
@@ -138,9 +139,7 @@ int bt_context_add_trace(struct bt_context *ctx, const char *path,
 		goto error;
 
 	handle->real_timestamp_begin = fmt->timestamp_begin(td, handle, BT_CLOCK_REAL);
-	handle->real_timestamp_end = fmt->timestamp_end(td, handle, BT_CLOCK_REAL);
 	handle->cycles_timestamp_begin = fmt->timestamp_begin(td, handle, BT_CLOCK_CYCLES);
-	handle->cycles_timestamp_end = fmt->timestamp_end(td, handle, BT_CLOCK_CYCLES);
 
 	return handle->id;
 
@@ -180,6 +179,41 @@ int bt_context_remove_trace(struct bt_context *ctx, int handle_id)
 	return 0;
 }
 
+int bt_context_update(struct bt_context *ctx)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	int ret, nr_packets = 0;
+
+	if (!ctx)
+		return -EINVAL;
+
+	/* New metadata changes the event classes callbacks may look at. */
+	if (ctx->current_iterator && ctx->current_iterator->wait_stream)
+		ctx->current_iterator->wait_stream(ctx->current_iterator, NULL);
+	g_hash_table_iter_init(&iter, ctx->trace_handles);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct bt_trace_handle *handle = value;
+		struct bt_format *fmt = handle->format;
+
+		if (!fmt->update_trace)
+			continue;
+		ret = fmt->update_trace(handle->td);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			continue;
+		nr_packets += ret;
+		handle->timestamp_end_valid = 0;
+	}
+	if (nr_packets && ctx->current_iterator) {
+		ret = bt_iter_resume_streams(ctx->current_iterator);
+		if (ret)
+			return ret < 0 ? ret : -ret;
+	}
+	return nr_packets;
+}
+
 static
 void bt_context_destroy(struct bt_context *ctx)
 {
@@ -32,6 +32,7 @@
 #include <babeltrace/context-internal.h>
 #include <babeltrace/iterator-internal.h>
 #include <babeltrace/iterator.h>
+#include <babeltrace/packet-cache-internal.h>
 #include <babeltrace/prio_heap.h>
 #include <babeltrace/ctf/metadata.h>
 #include <babeltrace/ctf/events.h>
@@ -41,10 +42,31 @@ static int babeltrace_filestream_seek(struct ctf_file_stream *file_stream,
 		const struct bt_iter_pos *begin_pos,
 		unsigned long stream_id);
 
+/*
+ * Serialized position layout, all integers little-endian:
+ *
+ *   u32 magic, u32 version, u32 type
+ *   BT_SEEK_TIME:    u64 seek_time
+ *   BT_SEEK_RESTORE: u32 nr_streams, then for each stream:
+ *     u8 trace uuid[BABELTRACE_UUID_LEN], u64 stream class id,
+ *     u32 file number in stream class, u32 path length, path,
+ *     u64 packet index, s64 offset, u64 real timestamp,
+ *     u64 cycles timestamp
+ */
+#define BT_POS_MAGIC	0x53505442	/* "BTPS" */
+#define BT_POS_VERSION	1
+
+struct pos_reader {
+	const unsigned char *p;
+	size_t left;
+};
+
 struct stream_saved_pos {
 	/*
 	 * Use file_stream pointer to check if the trace collection we
 	 * restore to match the one we saved from, for each stream.
+	 * Deserialized positions are resolved to file_stream pointers
+	 * of the iterator they are created for.
 	 */
 	struct ctf_file_stream *file_stream;
 	size_t cur_index;	/* current index in packet index */
@@ -109,6 +131,171 @@ void bt_iter_free_pos(struct bt_iter_pos *iter_pos)
 	g_free(iter_pos);
 }
 
+/*
+ * Position the stream on a recorded event and read it, as
+ * BT_SEEK_RESTORE does.
+ */
+static int restore_packet_event(struct ctf_file_stream *cfs, uint64_t index,
+		const struct bt_packet_event *event)
+{
+	struct ctf_stream_pos *stream_pos = &cfs->pos;
+	struct ctf_stream_definition *stream = &cfs->parent;
+
+	stream_pos->packet_seek(&stream_pos->parent, index, SEEK_SET);
+	stream->real_timestamp = event->real_timestamp;
+	stream->cycles_timestamp = event->cycles_timestamp;
+	stream_pos->offset = event->offset;
+	stream_pos->last_offset = LAST_OFFSET_POISON;
+	return stream_read_event(cfs);
+}
+
+/*
+ * Find the last checkpoint of packet index before timestamp. Returns
+ * its number (from 1), or -1 if none.
+ */
+static long find_checkpoint(struct ctf_file_stream *cfs, uint64_t index,
+		uint64_t timestamp, struct packet_checkpoint *checkpoint)
+{
+	GArray *checkpoints;
+	size_t low, high;
+
+	checkpoints = ctf_packet_index_checkpoints(cfs->pos.packet_index, index);
+	if (!checkpoints)
+		return -1;
+	low = 0;
+	high = checkpoints->len;
+	while (low < high) {
+		size_t mid = low + ((high - low) >> 1);
+		uint64_t ts;
+
+		ts = ctf_get_real_timestamp(&cfs->parent,
+			g_array_index(checkpoints, struct packet_checkpoint,
+				mid).cycles_timestamp);
+		if (ts < timestamp)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (!low)
+		return -1;
+	*checkpoint = g_array_index(checkpoints, struct packet_checkpoint,
+			low - 1);
+	return low;
+}
+
+/*
+ * Position the stream on checkpoint nr of packet index and read its
+ * event. The events read from there keep adding checkpoints.
+ */
+static int restore_checkpoint(struct ctf_file_stream *cfs, uint64_t index,
+		long nr, const struct packet_checkpoint *checkpoint)
+{
+	struct ctf_stream_pos *stream_pos = &cfs->pos;
+	struct ctf_stream_definition *stream = &cfs->parent;
+
+	stream_pos->packet_seek(&stream_pos->parent, index, SEEK_SET);
+	stream->cycles_timestamp = checkpoint->cycles_timestamp;
+	stream->real_timestamp = ctf_get_real_timestamp(stream,
+			checkpoint->cycles_timestamp);
+	stream_pos->offset = checkpoint->offset;
+	stream_pos->last_offset = LAST_OFFSET_POISON;
+	stream_pos->packet_events = nr * PACKET_CHECKPOINT_INTERVAL;
+	stream_pos->checkpoint_next = checkpoint->offset;
+	return stream_read_event(cfs);
+}
+
+/*
+ * Read the event of packet index from which to decode up to timestamp:
+ * the last checkpoint before it, or the first event of the packet.
+ */
+static int start_packet_seek(struct ctf_file_stream *cfs, uint64_t index,
+		uint64_t timestamp)
+{
+	struct ctf_stream_pos *stream_pos = &cfs->pos;
+	struct packet_checkpoint checkpoint;
+	long nr;
+
+	nr = find_checkpoint(cfs, index, timestamp, &checkpoint);
+	if (nr >= 0)
+		return restore_checkpoint(cfs, index, nr, &checkpoint);
+	stream_pos->packet_seek(&stream_pos->parent, index, SEEK_SET);
+	return stream_read_event(cfs);
+}
+
+/*
+ * Seek within packet index to the first event at or after timestamp,
+ * using and extending the events recorded for this packet.
+ */
+static int seek_packet_cached(struct bt_packet_cache *cache,
+		struct ctf_file_stream *cfs, uint64_t index, uint64_t timestamp)
+{
+	struct ctf_stream_pos *stream_pos = &cfs->pos;
+	struct bt_packet_cache_entry *entry;
+	struct bt_packet_event *events;
+	struct packet_checkpoint checkpoint;
+	size_t low, high, len;
+	int ret, record, skip;
+	long nr;
+
+	entry = bt_packet_cache_get(cache, cfs, index);
+	events = (struct bt_packet_event *) entry->events->data;
+	len = entry->events->len;
+	low = 0;
+	high = len;
+	while (low < high) {
+		size_t mid = low + ((high - low) >> 1);
+
+		if (events[mid].real_timestamp < timestamp)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < len)
+		return restore_packet_event(cfs, index, &events[low]);
+
+	record = !entry->complete;
+	skip = 0;
+	nr = find_checkpoint(cfs, index, timestamp, &checkpoint);
+	if (nr >= 0 && (!len || checkpoint.offset > events[len - 1].offset)) {
+		/*
+		 * The checkpoint is past the recorded events, which must
+		 * stay a prefix of the packet.
+		 */
+		ret = restore_checkpoint(cfs, index, nr, &checkpoint);
+		record = 0;
+	} else if (len) {
+		/* Resume after the last recorded event, read again. */
+		ret = restore_packet_event(cfs, index, &events[len - 1]);
+		skip = 1;
+	} else {
+		stream_pos->packet_seek(&stream_pos->parent, index, SEEK_SET);
+		ret = stream_read_event(cfs);
+	}
+	while (ret == 0) {
+		if (record && stream_pos->cur_index != index) {
+			/* Left the packet: all its events are recorded. */
+			entry->complete = 1;
+			record = 0;
+		}
+		if (record && !skip) {
+			struct bt_packet_event event;
+
+			event.offset = stream_pos->last_offset;
+			event.cycles_timestamp = cfs->parent.cycles_timestamp;
+			event.real_timestamp = cfs->parent.real_timestamp;
+			if (bt_packet_cache_append(cache, entry, &event))
+				record = 0;
+		}
+		skip = 0;
+		if (cfs->parent.real_timestamp >= timestamp)
+			break;
+		ret = stream_read_event(cfs);
+	}
+	if (ret == EOF && record)
+		entry->complete = 1;
+	return ret;
+}
+
 /*
  * seek_file_stream_by_timestamp
  *
@@ -117,40 +304,69 @@ void bt_iter_free_pos(struct bt_iter_pos *iter_pos)
  * are looking for (either the exact timestamp or the event just after the
  * timestamp).
  *
+ * The first packet ending at or after the timestamp is found with a
+ * binary search on the timestamp_end column of the packet index.
+ * Decoding starts from the last checkpoint of that packet before the
+ * timestamp, if any. With a packet cache, the events recorded for that
+ * packet are used first.
+ *
+ * A packet index still being built in the background is only waited
+ * for until it covers the timestamp.
+ *
  * Return 0 if the seek succeded, EOF if we didn't find any packet
  * containing the timestamp, or a positive integer for error.
- *
- * TODO: this should be turned into a binary search! It is currently
- * doing a linear search in the packets. This is a O(n) operation on a
- * very frequent code path.
  */
 static int seek_file_stream_by_timestamp(struct ctf_file_stream *cfs,
-		uint64_t timestamp)
+		uint64_t timestamp, struct bt_packet_cache *cache)
 {
 	struct ctf_stream_pos *stream_pos;
-	struct packet_index *index;
-	int i, ret;
+	struct ctf_packet_index *index;
+	size_t low, high, len;
+	int ret;
 
 	stream_pos = &cfs->pos;
-	for (i = 0; i < stream_pos->packet_real_index->len; i++) {
-		index = &g_array_index(stream_pos->packet_real_index,
-				struct packet_index, i);
-		if (index->timestamp_end < timestamp)
-			continue;
+	index = stream_pos->packet_index;
+	while (index->extend) {
+		len = ctf_packet_index_len(index);
+		if (len && ctf_get_real_timestamp(&cfs->parent,
+				ctf_packet_index_timestamp_end(index, len - 1))
+					>= timestamp)
+			break;
+		ctf_packet_index_extend(index, len ? len << 1 : 1);
+		if (ctf_packet_index_len(index) == len)
+			break;
+	}
+	low = 0;
+	high = ctf_packet_index_len(stream_pos->packet_index);
+	while (low < high) {
+		size_t mid = low + ((high - low) >> 1);
+		uint64_t end;
+
+		end = ctf_get_real_timestamp(&cfs->parent,
+			ctf_packet_index_timestamp_end(stream_pos->packet_index,
+				mid));
+		if (end < timestamp)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == ctf_packet_index_len(stream_pos->packet_index)) {
+		/*
+		 * Cannot find the timestamp within the stream packets,
+		 * return EOF.
+		 */
+		return EOF;
+	}
 
-		stream_pos->packet_seek(&stream_pos->parent, i, SEEK_SET);
-		do {
-			ret = stream_read_event(cfs);
-		} while (cfs->parent.real_timestamp < timestamp && ret == 0);
+	if (cache)
+		return seek_packet_cached(cache, cfs, low, timestamp);
 
-		/* Can return either EOF, 0, or error (> 0). */
-		return ret;
-	}
-	/*
-	 * Cannot find the timestamp within the stream packets, return
-	 * EOF.
-	 */
-	return EOF;
+	ret = start_packet_seek(cfs, low, timestamp);
+	while (ret == 0 && cfs->parent.real_timestamp < timestamp)
+		ret = stream_read_event(cfs);
+
+	/* Can return either EOF, 0, or error (> 0). */
+	return ret;
 }
 
 /*
@@ -163,7 +379,8 @@ static int seek_file_stream_by_timestamp(struct ctf_file_stream *cfs,
  * On other errors, return positive value.
  */
 static int seek_ctf_trace_by_timestamp(struct ctf_trace *tin,
-		uint64_t timestamp, struct ptr_heap *stream_heap)
+		uint64_t timestamp, struct ptr_heap *stream_heap,
+		struct bt_packet_cache *cache)
 {
 	int i, j, ret;
 	int found = 0;
@@ -185,7 +402,8 @@ static int seek_ctf_trace_by_timestamp(struct ctf_trace *tin,
 				continue;
 			cfs = container_of(stream, struct ctf_file_stream,
 					parent);
-			ret = seek_file_stream_by_timestamp(cfs, timestamp);
+			ret = seek_file_stream_by_timestamp(cfs, timestamp,
+					cache);
 			if (ret == 0) {
 				/* Add to heap */
 				ret = bt_heap_insert(stream_heap, cfs);
@@ -226,7 +444,8 @@ static int find_max_timestamp_ctf_file_stream(struct ctf_file_stream *cfs,
 	 * either find at least one event, or we reach the first packet
 	 * (some packets can be empty).
 	 */
-	for (i = stream_pos->packet_real_index->len - 1; i >= 0; i--) {
+	ctf_packet_index_complete(stream_pos->packet_index);
+	for (i = ctf_packet_index_len(stream_pos->packet_index) - 1; i >= 0; i--) {
 		stream_pos->packet_seek(&stream_pos->parent, i, SEEK_SET);
 		count = 0;
 		/* read each event until we reach the end of the stream */
@@ -346,13 +565,57 @@ static int seek_last_ctf_trace_collection(struct trace_collection *tc,
 	if (!found) {
 		ret = EOF;
 	} else {
-		ret = seek_file_stream_by_timestamp(*cfsp, max_timestamp);
+		ret = seek_file_stream_by_timestamp(*cfsp, max_timestamp,
+				NULL);
 		assert(ret == 0);
 	}
 end:
 	return ret;
 }
 
+/*
+ * Position a file stream on its saved event, unless it is in current,
+ * the set of streams in the heap, and already on that event.
+ */
+static int restore_stream_saved_pos(struct stream_saved_pos *saved_pos,
+		GHashTable *current)
+{
+	struct ctf_stream_pos *stream_pos = &saved_pos->file_stream->pos;
+	struct ctf_stream_definition *stream = &saved_pos->file_stream->parent;
+
+	if (g_hash_table_lookup(current, saved_pos->file_stream)
+			&& stream_pos->cur_index == saved_pos->cur_index
+			&& stream_pos->last_offset == saved_pos->offset
+			&& stream->cycles_timestamp
+				== saved_pos->current_cycles_timestamp)
+		return 0;
+
+	stream_pos->packet_seek(&stream_pos->parent,
+			saved_pos->cur_index, SEEK_SET);
+
+	/*
+	 * the timestamp needs to be restored after
+	 * packet_seek, because this function resets
+	 * the timestamp to the beginning of the packet
+	 */
+	stream->real_timestamp = saved_pos->current_real_timestamp;
+	stream->cycles_timestamp = saved_pos->current_cycles_timestamp;
+	stream_pos->offset = saved_pos->offset;
+	stream_pos->last_offset = LAST_OFFSET_POISON;
+
+	stream->prev_real_timestamp = 0;
+	stream->prev_real_timestamp_end = 0;
+	stream->prev_cycles_timestamp = 0;
+	stream->prev_cycles_timestamp_end = 0;
+
+	printf_debug("restored to cur_index = %" PRId64 " and "
+		"offset = %" PRId64 ", timestamp = %" PRIu64 "\n",
+		stream_pos->cur_index,
+		stream_pos->offset, stream->real_timestamp);
+
+	return stream_read_event(saved_pos->file_stream);
+}
+
 int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 {
 	struct trace_collection *tc;
@@ -361,63 +624,52 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 	if (!iter || !iter_pos)
 		return -EINVAL;
 
+	if (iter->wait_stream)
+		iter->wait_stream(iter, NULL);
+	iter->bypass_stream = NULL;
+
 	switch (iter_pos->type) {
 	case BT_SEEK_RESTORE:
-		if (!iter_pos->u.restore)
+	{
+		GHashTable *current;
+
+		if (!iter_pos->u.restore || iter_pos->u.restore->tc != iter->ctx->tc)
 			return -EINVAL;
 
+		/* Streams currently in the heap, positioned on an event. */
+		current = g_hash_table_new(g_direct_hash, g_direct_equal);
+		for (i = 0; i < iter->stream_heap->len; i++)
+			g_hash_table_insert(current, iter->stream_heap->ptrs[i],
+					iter->stream_heap->ptrs[i]);
+
 		bt_heap_free(iter->stream_heap);
 		ret = bt_heap_init(iter->stream_heap, 0, stream_compare);
-		if (ret < 0)
+		if (ret < 0) {
+			g_hash_table_destroy(current);
 			goto error_heap_init;
+		}
 
 		for (i = 0; i < iter_pos->u.restore->stream_saved_pos->len;
 				i++) {
 			struct stream_saved_pos *saved_pos;
-			struct ctf_stream_pos *stream_pos;
-			struct ctf_stream_definition *stream;
 
 			saved_pos = &g_array_index(
 					iter_pos->u.restore->stream_saved_pos,
 					struct stream_saved_pos, i);
-			stream = &saved_pos->file_stream->parent;
-			stream_pos = &saved_pos->file_stream->pos;
-
-			stream_pos->packet_seek(&stream_pos->parent,
-					saved_pos->cur_index, SEEK_SET);
-
-			/*
-			 * the timestamp needs to be restored after
-			 * packet_seek, because this function resets
-			 * the timestamp to the beginning of the packet
-			 */
-			stream->real_timestamp = saved_pos->current_real_timestamp;
-			stream->cycles_timestamp = saved_pos->current_cycles_timestamp;
-			stream_pos->offset = saved_pos->offset;
-			stream_pos->last_offset = LAST_OFFSET_POISON;
-
-			stream->prev_real_timestamp = 0;
-			stream->prev_real_timestamp_end = 0;
-			stream->prev_cycles_timestamp = 0;
-			stream->prev_cycles_timestamp_end = 0;
-
-			printf_debug("restored to cur_index = %" PRId64 " and "
-				"offset = %" PRId64 ", timestamp = %" PRIu64 "\n",
-				stream_pos->cur_index,
-				stream_pos->offset, stream->real_timestamp);
-
-			ret = stream_read_event(saved_pos->file_stream);
-			if (ret != 0) {
-				goto error;
-			}
-
+			ret = restore_stream_saved_pos(saved_pos, current);
+			if (ret)
+				break;
 			/* Add to heap */
 			ret = bt_heap_insert(iter->stream_heap,
 					saved_pos->file_stream);
 			if (ret)
-				goto error;
+				break;
 		}
+		g_hash_table_destroy(current);
+		if (ret)
+			goto error;
 		return 0;
+	}
 	case BT_SEEK_TIME:
 		tc = iter->ctx->tc;
 
@@ -438,7 +690,7 @@ int bt_iter_set_pos(struct bt_iter *iter, const struct bt_iter_pos *iter_pos)
 
 			ret = seek_ctf_trace_by_timestamp(tin,
 					iter_pos->u.seek_time,
-					iter->stream_heap);
+					iter->stream_heap, iter->packet_cache);
 			/*
 			 * Positive errors are failure. Negative value
 			 * is EOF (for which we continue with other
@@ -546,9 +798,7 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 {
 	struct bt_iter_pos *pos;
 	struct trace_collection *tc;
-	struct ctf_file_stream *file_stream = NULL, *removed;
-	struct ptr_heap iter_heap_copy;
-	int ret;
+	size_t i;
 
 	if (!iter)
 		return NULL;
@@ -563,15 +813,13 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 	if (!pos->u.restore->stream_saved_pos)
 		goto error;
 
-	ret = bt_heap_copy(&iter_heap_copy, iter->stream_heap);
-	if (ret < 0)
-		goto error_heap;
-
-	/* iterate over each stream in the heap */
-	file_stream = bt_heap_maximum(&iter_heap_copy);
-	while (file_stream != NULL) {
+	/* Restoring rebuilds the heap, the order of streams is not kept. */
+	for (i = 0; i < iter->stream_heap->len; i++) {
+		struct ctf_file_stream *file_stream;
 		struct stream_saved_pos saved_pos;
 
+		file_stream = iter->stream_heap->ptrs[i];
+
 		assert(file_stream->pos.last_offset != LAST_OFFSET_POISON);
 		saved_pos.offset = file_stream->pos.last_offset;
 		saved_pos.file_stream = file_stream;
@@ -590,19 +838,11 @@ struct bt_iter_pos *bt_iter_get_pos(struct bt_iter *iter)
 				file_stream->parent.stream_id,
 				saved_pos.cur_index, saved_pos.offset,
 				saved_pos.current_real_timestamp);
-
-		/* remove the stream from the heap copy */
-		removed = bt_heap_remove(&iter_heap_copy);
-		assert(removed == file_stream);
-
-		file_stream = bt_heap_maximum(&iter_heap_copy);
 	}
-	bt_heap_free(&iter_heap_copy);
 	return pos;
 
-error_heap:
-	g_array_free(pos->u.restore->stream_saved_pos, TRUE);
 error:
+	g_free(pos->u.restore);
 	g_free(pos);
 	return NULL;
 }
@@ -621,6 +861,295 @@ struct bt_iter_pos *bt_iter_create_time_pos(struct bt_iter *iter,
 	return pos;
 }
 
+static void put_u32(GByteArray *buf, uint32_t v)
+{
+	unsigned char b[4];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		b[i] = v >> (8 * i);
+	g_byte_array_append(buf, b, sizeof(b));
+}
+
+static void put_u64(GByteArray *buf, uint64_t v)
+{
+	unsigned char b[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		b[i] = v >> (8 * i);
+	g_byte_array_append(buf, b, sizeof(b));
+}
+
+static int get_bytes(struct pos_reader *r, void *dest, size_t len)
+{
+	if (r->left < len)
+		return -EINVAL;
+	memcpy(dest, r->p, len);
+	r->p += len;
+	r->left -= len;
+	return 0;
+}
+
+static int get_u32(struct pos_reader *r, uint32_t *v)
+{
+	unsigned char b[4];
+	int i;
+
+	if (get_bytes(r, b, sizeof(b)))
+		return -EINVAL;
+	*v = 0;
+	for (i = 0; i < 4; i++)
+		*v |= (uint32_t) b[i] << (8 * i);
+	return 0;
+}
+
+static int get_u64(struct pos_reader *r, uint64_t *v)
+{
+	unsigned char b[8];
+	int i;
+
+	if (get_bytes(r, b, sizeof(b)))
+		return -EINVAL;
+	*v = 0;
+	for (i = 0; i < 8; i++)
+		*v |= (uint64_t) b[i] << (8 * i);
+	return 0;
+}
+
+/*
+ * Number of file_stream within the file streams of its stream class.
+ * Identifies streams of memory-mapped traces, which have no path.
+ */
+static uint32_t file_stream_nr(struct ctf_file_stream *file_stream)
+{
+	GPtrArray *streams = file_stream->parent.stream_class->streams;
+	uint32_t i;
+
+	for (i = 0; i < streams->len; i++) {
+		if (g_ptr_array_index(streams, i) == file_stream)
+			break;
+	}
+	return i;
+}
+
+static void serialize_stream_saved_pos(GByteArray *buf,
+		const struct stream_saved_pos *saved_pos)
+{
+	struct ctf_file_stream *file_stream = saved_pos->file_stream;
+	struct ctf_stream_declaration *stream_class;
+	size_t path_len;
+
+	stream_class = file_stream->parent.stream_class;
+	path_len = strlen(file_stream->parent.path);
+	g_byte_array_append(buf, stream_class->trace->uuid,
+			BABELTRACE_UUID_LEN);
+	put_u64(buf, stream_class->stream_id);
+	put_u32(buf, file_stream_nr(file_stream));
+	put_u32(buf, path_len);
+	g_byte_array_append(buf, (const guint8 *) file_stream->parent.path,
+			path_len);
+	put_u64(buf, saved_pos->cur_index);
+	put_u64(buf, saved_pos->offset);
+	put_u64(buf, saved_pos->current_real_timestamp);
+	put_u64(buf, saved_pos->current_cycles_timestamp);
+}
+
+void *bt_iter_serialize_pos(const struct bt_iter_pos *pos, size_t *len)
+{
+	GByteArray *buf;
+	void *data;
+	size_t i;
+
+	if (!pos || !len)
+		return NULL;
+	if (pos->type == BT_SEEK_RESTORE && !pos->u.restore)
+		return NULL;
+
+	buf = g_byte_array_new();
+	put_u32(buf, BT_POS_MAGIC);
+	put_u32(buf, BT_POS_VERSION);
+	put_u32(buf, pos->type);
+	switch (pos->type) {
+	case BT_SEEK_TIME:
+		put_u64(buf, pos->u.seek_time);
+		break;
+	case BT_SEEK_RESTORE:
+	{
+		GArray *saved = pos->u.restore->stream_saved_pos;
+
+		put_u32(buf, saved->len);
+		for (i = 0; i < saved->len; i++)
+			serialize_stream_saved_pos(buf,
+				&g_array_index(saved, struct stream_saved_pos, i));
+		break;
+	}
+	default:
+		break;
+	}
+
+	data = malloc(buf->len);
+	if (data) {
+		memcpy(data, buf->data, buf->len);
+		*len = buf->len;
+	}
+	g_byte_array_free(buf, TRUE);
+	return data;
+}
+
+/*
+ * Find the file stream of the trace collection matching a serialized
+ * stream: same trace UUID and stream class, then same path, or same
+ * file number for streams without path.
+ */
+static struct ctf_file_stream *find_file_stream(struct trace_collection *tc,
+		const unsigned char *uuid, uint64_t stream_id,
+		uint32_t filenr, const char *path)
+{
+	int i;
+
+	for (i = 0; i < tc->array->len; i++) {
+		struct bt_trace_descriptor *td_read;
+		struct ctf_stream_declaration *stream_class;
+		struct ctf_trace *tin;
+		uint32_t j;
+
+		td_read = g_ptr_array_index(tc->array, i);
+		if (!td_read)
+			continue;
+		tin = container_of(td_read, struct ctf_trace, parent);
+		if (memcmp(tin->uuid, uuid, BABELTRACE_UUID_LEN))
+			continue;
+		if (stream_id >= tin->streams->len)
+			continue;
+		stream_class = g_ptr_array_index(tin->streams, stream_id);
+		if (!stream_class)
+			continue;
+		if (!path[0]) {
+			if (filenr < stream_class->streams->len)
+				return g_ptr_array_index(stream_class->streams,
+						filenr);
+			continue;
+		}
+		for (j = 0; j < stream_class->streams->len; j++) {
+			struct ctf_file_stream *file_stream;
+
+			file_stream = g_ptr_array_index(stream_class->streams, j);
+			if (file_stream && !strcmp(file_stream->parent.path, path))
+				return file_stream;
+		}
+	}
+	return NULL;
+}
+
+static int deserialize_stream_saved_pos(struct pos_reader *r,
+		struct trace_collection *tc, struct stream_saved_pos *saved_pos)
+{
+	unsigned char uuid[BABELTRACE_UUID_LEN];
+	char path[PATH_MAX];
+	uint64_t stream_id, cur_index, offset;
+	uint32_t filenr, path_len;
+	struct ctf_file_stream *file_stream;
+	struct packet_index entry;
+
+	if (get_bytes(r, uuid, sizeof(uuid))
+			|| get_u64(r, &stream_id)
+			|| get_u32(r, &filenr)
+			|| get_u32(r, &path_len)
+			|| path_len >= sizeof(path)
+			|| get_bytes(r, path, path_len)
+			|| get_u64(r, &cur_index)
+			|| get_u64(r, &offset)
+			|| get_u64(r, &saved_pos->current_real_timestamp)
+			|| get_u64(r, &saved_pos->current_cycles_timestamp))
+		return -EINVAL;
+	path[path_len] = '\0';
+
+	file_stream = find_file_stream(tc, uuid, stream_id, filenr, path);
+	if (!file_stream) {
+		fprintf(stderr, "[error] Stream \"%s\" of saved position not "
+			"found in trace collection.\n", path);
+		return -ENOENT;
+	}
+	ctf_packet_index_extend(file_stream->pos.packet_index, cur_index + 1);
+	if (cur_index >= ctf_packet_index_len(file_stream->pos.packet_index)) {
+		fprintf(stderr, "[error] Packet %" PRIu64 " of saved position "
+			"out of range for stream \"%s\".\n", cur_index, path);
+		return -EINVAL;
+	}
+	/* The event must start within the packet content. */
+	ctf_packet_index_get(file_stream->pos.packet_index, cur_index, &entry);
+	if ((int64_t) offset < entry.data_offset
+			|| offset >= entry.content_size) {
+		fprintf(stderr, "[error] Offset %" PRIu64 " of saved position "
+			"out of packet %" PRIu64 " of stream \"%s\".\n",
+			offset, cur_index, path);
+		return -EINVAL;
+	}
+	saved_pos->file_stream = file_stream;
+	saved_pos->cur_index = cur_index;
+	saved_pos->offset = offset;
+	return 0;
+}
+
+struct bt_iter_pos *bt_iter_deserialize_pos(struct bt_iter *iter,
+		const void *data, size_t len)
+{
+	struct pos_reader r = { .p = data, .left = len };
+	struct bt_iter_pos *pos;
+	uint32_t magic, version, type, nr_streams, i;
+
+	if (!iter || !data)
+		return NULL;
+	if (get_u32(&r, &magic) || magic != BT_POS_MAGIC
+			|| get_u32(&r, &version) || version != BT_POS_VERSION
+			|| get_u32(&r, &type)) {
+		fprintf(stderr, "[error] Invalid saved position.\n");
+		return NULL;
+	}
+
+	pos = g_new0(struct bt_iter_pos, 1);
+	pos->type = type;
+	switch (type) {
+	case BT_SEEK_TIME:
+		if (get_u64(&r, &pos->u.seek_time))
+			goto error;
+		break;
+	case BT_SEEK_RESTORE:
+		if (get_u32(&r, &nr_streams))
+			goto error;
+		pos->u.restore = g_new0(struct bt_saved_pos, 1);
+		pos->u.restore->tc = iter->ctx->tc;
+		pos->u.restore->stream_saved_pos = g_array_sized_new(FALSE,
+				TRUE, sizeof(struct stream_saved_pos),
+				MIN(nr_streams, r.left));
+		for (i = 0; i < nr_streams; i++) {
+			struct stream_saved_pos saved_pos;
+
+			if (deserialize_stream_saved_pos(&r, iter->ctx->tc,
+					&saved_pos))
+				goto error;
+			g_array_append_val(pos->u.restore->stream_saved_pos,
+					saved_pos);
+		}
+		break;
+	case BT_SEEK_CUR:
+	case BT_SEEK_BEGIN:
+	case BT_SEEK_LAST:
+		break;
+	default:
+		goto error;
+	}
+	if (r.left)
+		goto error;
+	return pos;
+
+error:
+	fprintf(stderr, "[error] Invalid saved position.\n");
+	bt_iter_free_pos(pos);
+	return NULL;
+}
+
 /*
  * babeltrace_filestream_seek: seek a filestream to given position.
  *
@@ -674,6 +1203,9 @@ int bt_iter_init(struct bt_iter *iter,
 
 	iter->stream_heap = g_new(struct ptr_heap, 1);
 	iter->end_pos = end_pos;
+	iter->bypass_stream = NULL;
+	iter->packet_cache = NULL;
+	iter->wait_stream = NULL;
 	bt_context_get(ctx);
 	iter->ctx = ctx;
 
@@ -745,6 +1277,64 @@ error_ctx:
 	return ret;
 }
 
+int bt_iter_resume_streams(struct bt_iter *iter)
+{
+	struct bt_context *ctx = iter->ctx;
+	int i, stream_id;
+	int ret;
+
+	iter->bypass_stream = NULL;
+	for (i = 0; i < ctx->tc->array->len; i++) {
+		struct ctf_trace *tin;
+		struct bt_trace_descriptor *td_read;
+
+		td_read = g_ptr_array_index(ctx->tc->array, i);
+		if (!td_read)
+			continue;
+		tin = container_of(td_read, struct ctf_trace, parent);
+
+		for (stream_id = 0; stream_id < tin->streams->len;
+				stream_id++) {
+			struct ctf_stream_declaration *stream;
+			int filenr;
+
+			stream = g_ptr_array_index(tin->streams, stream_id);
+			if (!stream)
+				continue;
+			for (filenr = 0; filenr < stream->streams->len;
+					filenr++) {
+				struct ctf_file_stream *file_stream;
+				struct ctf_stream_pos *pos;
+
+				file_stream = g_ptr_array_index(stream->streams,
+						filenr);
+				if (!file_stream)
+					continue;
+				pos = &file_stream->pos;
+				/* Streams still in the heap are not at EOF. */
+				if (pos->offset != EOF || !pos->packet_index)
+					continue;
+				ctf_packet_index_extend(pos->packet_index,
+						pos->cur_index + 1);
+				if (pos->cur_index >= ctf_packet_index_len(pos->packet_index))
+					continue;
+				pos->packet_seek(&pos->parent, pos->cur_index,
+						SEEK_SET);
+				ret = stream_read_event(file_stream);
+				if (ret == EOF)
+					continue;
+				else if (ret)
+					return ret;
+				ret = bt_heap_insert(iter->stream_heap,
+						file_stream);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+	return 0;
+}
+
 struct bt_iter *bt_iter_create(struct bt_context *ctx,
 		const struct bt_iter_pos *begin_pos,
 		const struct bt_iter_pos *end_pos)
@@ -771,10 +1361,22 @@ void bt_iter_fini(struct bt_iter *iter)
 		bt_heap_free(iter->stream_heap);
 		g_free(iter->stream_heap);
 	}
+	bt_packet_cache_destroy(iter->packet_cache);
 	iter->ctx->current_iterator = NULL;
 	bt_context_put(iter->ctx);
 }
 
+int bt_iter_set_packet_cache_size(struct bt_iter *iter, size_t max_size)
+{
+	if (!iter)
+		return -EINVAL;
+	bt_packet_cache_destroy(iter->packet_cache);
+	iter->packet_cache = NULL;
+	if (max_size)
+		iter->packet_cache = bt_packet_cache_create(max_size);
+	return 0;
+}
+
 void bt_iter_destroy(struct bt_iter *iter)
 {
 	assert(iter);
@@ -782,6 +1384,26 @@ void bt_iter_destroy(struct bt_iter *iter)
 	g_free(iter);
 }
 
+/*
+ * Remember the smallest timestamp among the streams below the top of
+ * the heap: the children of the root.
+ */
+static
+void update_bypass(struct bt_iter *iter)
+{
+	struct ptr_heap *heap = iter->stream_heap;
+	uint64_t next = -1ULL;
+	size_t i;
+
+	for (i = 1; i < 3 && i < heap->len; i++) {
+		struct ctf_file_stream *cfs = heap->ptrs[i];
+
+		next = MIN(next, cfs->parent.real_timestamp);
+	}
+	iter->bypass_stream = bt_heap_maximum(heap);
+	iter->bypass_timestamp = next;
+}
+
 int bt_iter_next(struct bt_iter *iter)
 {
 	struct ctf_file_stream *file_stream, *removed;
@@ -797,18 +1419,31 @@ int bt_iter_next(struct bt_iter *iter)
 		goto end;
 	}
 
+	if (iter->wait_stream)
+		iter->wait_stream(iter, file_stream);
 	ret = stream_read_event(file_stream);
 	if (ret == EOF) {
 		removed = bt_heap_remove(iter->stream_heap);
 		assert(removed == file_stream);
+		iter->bypass_stream = NULL;
 		ret = 0;
 		goto end;
 	} else if (ret) {
 		goto end;
 	}
+	/*
+	 * The other streams did not move: while the top stream stays
+	 * strictly before all of them, it remains the top of the heap.
+	 * Ties go through stream_compare. Streams which do not overlap
+	 * in time are thus read without heap operations.
+	 */
+	if (file_stream == iter->bypass_stream
+			&& file_stream->parent.real_timestamp < iter->bypass_timestamp)
+		goto end;
 	/* Reinsert the file stream into the heap, and rebalance. */
 	removed = bt_heap_replace_max(iter->stream_heap, file_stream);
 	assert(removed == file_stream);
+	update_bypass(iter);
 
 end:
 	return ret;
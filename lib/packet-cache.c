@@ -0,0 +1,138 @@
+/*
+ * packet-cache.c
+ *
+ * Babeltrace Library
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/packet-cache-internal.h>
+#include <errno.h>
+
+#define ENTRY_SIZE(entry)	(sizeof(*(entry)) \
+		+ (entry)->events->len * sizeof(struct bt_packet_event))
+
+static
+guint packet_key_hash(gconstpointer key)
+{
+	const struct bt_packet_key *k = key;
+
+	return g_direct_hash(k->cfs) ^ g_int64_hash(&k->index);
+}
+
+static
+gboolean packet_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct bt_packet_key *ka = a, *kb = b;
+
+	return ka->cfs == kb->cfs && ka->index == kb->index;
+}
+
+static
+void entry_free(gpointer data)
+{
+	struct bt_packet_cache_entry *entry = data;
+
+	g_array_free(entry->events, TRUE);
+	g_free(entry);
+}
+
+struct bt_packet_cache *bt_packet_cache_create(size_t max_size)
+{
+	struct bt_packet_cache *cache;
+
+	cache = g_new0(struct bt_packet_cache, 1);
+	cache->entries = g_hash_table_new_full(packet_key_hash,
+			packet_key_equal, NULL, entry_free);
+	BT_INIT_LIST_HEAD(&cache->lru);
+	cache->max_size = max_size;
+	return cache;
+}
+
+void bt_packet_cache_destroy(struct bt_packet_cache *cache)
+{
+	if (!cache)
+		return;
+	g_hash_table_destroy(cache->entries);
+	g_free(cache);
+}
+
+static
+void evict(struct bt_packet_cache *cache, struct bt_packet_cache_entry *entry)
+{
+	bt_list_del(&entry->node);
+	cache->size -= ENTRY_SIZE(entry);
+	g_hash_table_remove(cache->entries, &entry->key);
+}
+
+/* Evict least recently used entries, except keep, to fit len more bytes. */
+static
+int make_room(struct bt_packet_cache *cache,
+		struct bt_packet_cache_entry *keep, size_t len)
+{
+	while (cache->size + len > cache->max_size) {
+		struct bt_packet_cache_entry *victim;
+
+		victim = bt_list_entry(cache->lru.prev,
+				struct bt_packet_cache_entry, node);
+		if (victim == keep)
+			return -ENOSPC;
+		evict(cache, victim);
+	}
+	return 0;
+}
+
+struct bt_packet_cache_entry *bt_packet_cache_get(struct bt_packet_cache *cache,
+		struct ctf_file_stream *cfs, uint64_t index)
+{
+	struct bt_packet_cache_entry *entry;
+	struct bt_packet_key key = { cfs, index };
+
+	entry = g_hash_table_lookup(cache->entries, &key);
+	if (entry) {
+		bt_list_move(&entry->node, &cache->lru);
+		return entry;
+	}
+	entry = g_new0(struct bt_packet_cache_entry, 1);
+	entry->key = key;
+	entry->events = g_array_new(FALSE, FALSE,
+			sizeof(struct bt_packet_event));
+	bt_list_add(&entry->node, &cache->lru);
+	g_hash_table_insert(cache->entries, &entry->key, entry);
+	cache->size += ENTRY_SIZE(entry);
+	/* May evict entries, never the new one. */
+	make_room(cache, entry, 0);
+	return entry;
+}
+
+int bt_packet_cache_append(struct bt_packet_cache *cache,
+		struct bt_packet_cache_entry *entry,
+		const struct bt_packet_event *event)
+{
+	int ret;
+
+	ret = make_room(cache, entry, sizeof(*event));
+	if (ret)
+		return ret;
+	g_array_append_val(entry->events, *event);
+	cache->size += sizeof(*event);
+	return 0;
+}
@@ -108,6 +108,13 @@ uint64_t bt_trace_handle_get_timestamp_end(struct bt_context *ctx,
 		ret = -1ULL;
 		goto end;
 	}
+	if (!handle->timestamp_end_valid) {
+		handle->real_timestamp_end = handle->format->timestamp_end(
+				handle->td, handle, BT_CLOCK_REAL);
+		handle->cycles_timestamp_end = handle->format->timestamp_end(
+				handle->td, handle, BT_CLOCK_CYCLES);
+		handle->timestamp_end_valid = 1;
+	}
 	if (type == BT_CLOCK_REAL) {
 		ret = handle->real_timestamp_end;
 	} else if (type == BT_CLOCK_CYCLES) {
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Text log ingestion benchmark.
+#
+# Generates a text log with timestamps in both formats supported by
+# babeltrace-log and reports the rate at which it is converted to CTF.
+#
+# Usage: bench-log.sh [NR_LINES] [NR_RUNS] [PACKET_SIZE]
+
+TESTDIR=$(dirname $0)
+DIR=$(readlink -f ${TESTDIR})
+BABELTRACE_LOG_BIN=${BABELTRACE_LOG_BIN:-${DIR}/../converter/babeltrace-log}
+
+NR_LINES=${1:-2000000}
+NR_RUNS=${2:-3}
+PACKET_SIZE=${3:+-s $3}
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf ${WORK_DIR}" EXIT
+
+awk -v nr=${NR_LINES} 'BEGIN {
+	for (i = 0; i < nr; i++) {
+		if (i % 2)
+			printf("[%d.%06d] event %d: some log message payload\n",
+				1000 + i / 1000000, i % 1000000, i);
+		else
+			printf("[2013-05-06 07:%02d:%02d.%03d] event %d: some log message payload\n",
+				(i / 60000) % 60, (i / 1000) % 60, i % 1000, i);
+	}
+}' > ${WORK_DIR}/log
+echo "Log: ${NR_LINES} lines, $(stat -c %s ${WORK_DIR}/log) bytes"
+
+best=
+for i in $(seq ${NR_RUNS}); do
+	rm -rf ${WORK_DIR}/trace
+	start=$(date +%s.%N)
+	${BABELTRACE_LOG_BIN} -t ${PACKET_SIZE} ${WORK_DIR}/trace < ${WORK_DIR}/log
+	if [ $? -ne 0 ]; then
+		echo "babeltrace-log failed to convert the log"
+		exit 1
+	fi
+	t=$(echo "$(date +%s.%N) - ${start}" | bc)
+	if [ -z "${best}" ] || [ $(echo "${t} < ${best}" | bc) -eq 1 ]; then
+		best=${t}
+	fi
+done
+echo "Trace: $(stat -c %s ${WORK_DIR}/trace/datastream) bytes"
+echo "Convert: ${best} s, $(echo "${NR_LINES} / ${best}" | bc) lines/s"
+
+exit 0
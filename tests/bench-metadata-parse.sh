@@ -0,0 +1,98 @@
+#!/bin/bash
+#
+# Metadata parsing benchmark.
+#
+# Generates a trace holding only a large text-only TSDL metadata file
+# (one event declaration per tracepoint, as large UST applications
+# produce) and times babeltrace parsing it.
+#
+# Usage: bench-metadata-parse.sh [NR_EVENTS] [NR_RUNS]
+
+TESTDIR=$(dirname $0)
+DIR=$(readlink -f ${TESTDIR})
+BABELTRACE_BIN=${DIR}/../converter/babeltrace
+
+NR_EVENTS=${1:-100000}
+NR_RUNS=${2:-3}
+
+TRACE_DIR=$(mktemp -d)
+trap "rm -rf ${TRACE_DIR}" EXIT
+
+function generate_metadata ()
+{
+	cat <<EOF
+/* CTF 1.8 */
+typealias integer { size = 8; align = 8; signed = false; } := uint8_t;
+typealias integer { size = 16; align = 8; signed = false; } := uint16_t;
+typealias integer { size = 32; align = 8; signed = false; } := uint32_t;
+typealias integer { size = 64; align = 8; signed = false; } := uint64_t;
+typealias integer { size = 64; align = 8; signed = true; } := int64_t;
+
+trace {
+	major = 1;
+	minor = 8;
+	uuid = "2a6422d0-6cee-11e0-8c08-cb07d7b3a564";
+	byte_order = le;
+	packet.header := struct {
+		uint32_t magic;
+		uint8_t  uuid[16];
+		uint32_t stream_id;
+	};
+};
+
+clock {
+	name = monotonic;
+	freq = 1000000000;
+};
+
+typealias integer { size = 64; align = 8; signed = false; map = clock.monotonic.value; } := uint64_clock_monotonic_t;
+
+stream {
+	id = 0;
+	event.header := struct {
+		uint32_t id;
+		uint64_clock_monotonic_t timestamp;
+	};
+	packet.context := struct {
+		uint64_clock_monotonic_t timestamp_begin;
+		uint64_clock_monotonic_t timestamp_end;
+		uint64_t content_size;
+		uint64_t packet_size;
+		uint64_t events_discarded;
+	};
+};
+
+EOF
+	awk -v nr=${NR_EVENTS} 'BEGIN {
+		for (i = 0; i < nr; i++) {
+			printf("event {\n");
+			printf("\tname = \"provider:tracepoint_%d\";\n", i);
+			printf("\tid = %d;\n", i);
+			printf("\tstream_id = 0;\n");
+			printf("\tloglevel = %d;\n", i % 15);
+			printf("\tfields := struct {\n");
+			printf("\t\tint64_t _value;\n");
+			printf("\t\tuint64_t _address;\n");
+			printf("\t\tenum : uint8_t { OFF = 0, ON = 1, UNKNOWN = 2 } _state;\n");
+			printf("\t\tstring _name;\n");
+			printf("\t\tuint16_t _len;\n");
+			printf("\t\tuint8_t _payload[_len];\n");
+			printf("\t};\n");
+			printf("};\n\n");
+		}
+	}'
+}
+
+generate_metadata > ${TRACE_DIR}/metadata
+echo "Metadata: ${NR_EVENTS} events, $(stat -c %s ${TRACE_DIR}/metadata) bytes"
+
+for i in $(seq ${NR_RUNS}); do
+	/usr/bin/time -f "Run ${i}: %e s, %M KiB max RSS" \
+		${BABELTRACE_BIN} -o ctf-metadata ${TRACE_DIR} > /dev/null
+	if [ $? -ne 0 ]; then
+		echo "babeltrace failed to parse generated metadata"
+		exit 1
+	fi
+done
+
+exit 0
@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Packet checksum verification benchmark.
+#
+# Generates a trace with babeltrace-log, which checksums its packets,
+# and compares the time babeltrace takes to read it with and without
+# --verify.
+#
+# Usage: bench-verify.sh [NR_LINES] [NR_RUNS]
+
+TESTDIR=$(dirname $0)
+DIR=$(readlink -f ${TESTDIR})
+BABELTRACE_BIN=${DIR}/../converter/babeltrace
+BABELTRACE_LOG_BIN=${DIR}/../converter/babeltrace-log
+
+NR_LINES=${1:-2000000}
+NR_RUNS=${2:-3}
+
+TRACE_DIR=$(mktemp -d)
+trap "rm -rf ${TRACE_DIR}" EXIT
+
+awk -v nr=${NR_LINES} 'BEGIN {
+	for (i = 0; i < nr; i++)
+		printf("[%d.%06d] event %d: some log message payload\n",
+			1000 + i / 1000000, i % 1000000, i);
+}' | ${BABELTRACE_LOG_BIN} -t ${TRACE_DIR}/trace
+if [ $? -ne 0 ]; then
+	echo "babeltrace-log failed to generate the trace"
+	exit 1
+fi
+echo "Trace: ${NR_LINES} events, $(stat -c %s ${TRACE_DIR}/trace/datastream) bytes"
+
+# Best of NR_RUNS, in seconds
+function best_time ()
+{
+	local best=
+
+	for i in $(seq ${NR_RUNS}); do
+		local start=$(date +%s.%N)
+		${BABELTRACE_BIN} -o dummy $* ${TRACE_DIR}/trace > /dev/null
+		if [ $? -ne 0 ]; then
+			echo "babeltrace failed to read the trace" >&2
+			exit 1
+		fi
+		local t=$(echo "$(date +%s.%N) - ${start}" | bc)
+		if [ -z "${best}" ] || [ $(echo "${t} < ${best}" | bc) -eq 1 ]; then
+			best=${t}
+		fi
+	done
+	echo ${best}
+}
+
+plain=$(best_time) || exit 1
+verify=$(best_time --verify) || exit 1
+echo "Read: ${plain} s, with --verify: ${verify} s"
+echo "Overhead: $(echo "scale=2; 100 * (${verify} - ${plain}) / ${plain}" | bc) %"
+
+exit 0
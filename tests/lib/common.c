@@ -22,6 +22,15 @@
 
 #include <babeltrace/context.h>
 #include <babeltrace/iterator.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#define TEMP_TRACE_NAME	"trace"
+#define NFTW_MAX_FDS	16
 
 struct bt_context *create_context_with_path(const char *path)
 {
@@ -40,3 +49,45 @@ struct bt_context *create_context_with_path(const char *path)
 	}
 	return ctx;
 }
+
+char *create_temp_trace_path(const char *test_name)
+{
+	char *path;
+	size_t dir_len;
+
+	if (asprintf(&path, "/tmp/%s-XXXXXX/" TEMP_TRACE_NAME, test_name) < 0)
+		return NULL;
+	/* mkdtemp() wants the template at the end of the string. */
+	dir_len = strlen(path) - strlen("/" TEMP_TRACE_NAME);
+	path[dir_len] = '\0';
+	if (!mkdtemp(path)) {
+		free(path);
+		return NULL;
+	}
+	path[dir_len] = '/';
+	return path;
+}
+
+static
+int remove_entry(const char *path, const struct stat *sb, int type,
+		struct FTW *ftwbuf)
+{
+	return remove(path);
+}
+
+int remove_temp_trace(const char *trace_path)
+{
+	char *dir, *slash;
+	int ret;
+
+	dir = strdup(trace_path);
+	if (!dir)
+		return -1;
+	slash = strrchr(dir, '/');
+	if (slash)
+		*slash = '\0';
+	/* Children first, without following symbolic links. */
+	ret = nftw(dir, remove_entry, NFTW_MAX_FDS, FTW_DEPTH | FTW_PHYS);
+	free(dir);
+	return ret;
+}
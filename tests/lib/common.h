@@ -25,4 +25,17 @@ struct bt_context;
 
 struct bt_context *create_context_with_path(const char *path);
 
+/*
+ * Create a temporary directory named after the test, for a trace the
+ * test writes. Returns the path of the trace inside it, to be freed
+ * by the caller, or NULL on error.
+ */
+char *create_temp_trace_path(const char *test_name);
+
+/*
+ * Remove the temporary directory holding trace_path, as returned by
+ * create_temp_trace_path(), with its content. Returns 0 on success.
+ */
+int remove_temp_trace(const char *trace_path);
+
 #endif /* _TESTS_COMMON_H */
@@ -7,3 +7,35 @@
 
 # run bitfield tests
 ./test-bitfield
+
+# run packet index tests
+./test-packet-index
+
+# run CRC32C tests
+./test-crc32c
+
+# run CTF writer API round-trip tests
+./test-ctf-writer
+
+# run shared metadata AST tests, with two traces of different metadata
+./test-metadata-cache ../ctf-traces/succeed/wk-heartbeat-u/ ../ctf-traces/succeed/lttng-modules-2.0-pre5/
+
+# run histogram tests, against a full read of the trace
+./test-histogram ../ctf-traces/succeed/wk-heartbeat-u/
+./test-histogram ../ctf-traces/succeed/lttng-modules-2.0-pre5/
+
+# run iterator filter tests, on a copy of the trace with discarded events
+./test-iter-filters ../ctf-traces/succeed/lttng-modules-2.0-pre5/
+
+# run callback dependency graph tests
+./test-callbacks ../ctf-traces/succeed/lttng-modules-2.0-pre5/
+
+# run iterator merge tests, on a trace written with interleaved and
+# non-overlapping streams
+./test-iter-merge
+
+# run packet checkpoint tests, seeking inside a large packet
+./test-checkpoints
+
+# run background index tests, opening a trace of many packets
+./test-lazy-index
@@ -0,0 +1,331 @@
+/*
+ * test-callbacks.c
+ *
+ * BabelTrace - callback dependency graph test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/callbacks.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <glib.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	8
+#define NR_CHAINS	4
+#define NR_THREADS	3
+
+/* Names of the callbacks called for the last event, in call order */
+static char call_log[64];
+
+/* Events seen by an independent callback */
+struct chain_state {
+	uint64_t events;
+	uint64_t last_timestamp;
+	int in_order;
+	unsigned long work;		/* loop iterations per event */
+};
+
+static
+enum bt_cb_ret log_call(struct bt_ctf_event *event, void *private_data)
+{
+	size_t len = strlen(call_log);
+
+	if (len < sizeof(call_log) - 1)
+		call_log[len] = *(const char *) private_data;
+	return BT_CB_OK;
+}
+
+static
+enum bt_cb_ret log_stop(struct bt_ctf_event *event, void *private_data)
+{
+	log_call(event, private_data);
+	return BT_CB_OK_STOP;
+}
+
+/*
+ * Register callback name, for event, or all events if NULL, with
+ * comma-separated dependencies and results, or NULL for none.
+ */
+static
+int add_callback(struct bt_ctf_iter *iter, const char *event,
+		const char *name, const char *depends, const char *provides)
+{
+	struct bt_dependencies *deps = NULL, *prov = NULL;
+
+	if (depends)
+		deps = bt_dependencies_create(depends, NULL);
+	if (provides)
+		prov = bt_dependencies_create(provides, NULL);
+	return bt_ctf_iter_add_callback(iter,
+			event ? g_quark_from_string(event) : 0,
+			(void *) name, 0, log_call, deps, NULL, prov);
+}
+
+static
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static
+enum bt_cb_ret count_event(struct bt_ctf_event *event, void *private_data)
+{
+	struct chain_state *state = private_data;
+	uint64_t timestamp = bt_ctf_get_timestamp(event);
+	volatile unsigned long i;
+
+	for (i = 0; i < state->work; i++)
+		;
+	if (timestamp < state->last_timestamp)
+		state->in_order = 0;
+	state->last_timestamp = timestamp;
+	state->events++;
+	return BT_CB_OK;
+}
+
+/*
+ * Read the trace with NR_CHAINS independent callbacks doing work loop
+ * iterations per event, on nr_threads workers. Returns the events read
+ * per second, and sets *all_ok if each callback saw the nr_events events
+ * in order.
+ */
+static
+double run_chains(struct bt_context *ctx, int nr_threads,
+		unsigned long work, uint64_t nr_events, int *all_ok)
+{
+	struct chain_state states[NR_CHAINS];
+	struct bt_ctf_iter *iter;
+	double begin, elapsed;
+	int i, ret = 0;
+
+	memset(states, 0, sizeof(states));
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		return 0.0;
+	for (i = 0; i < NR_CHAINS; i++) {
+		states[i].in_order = 1;
+		states[i].work = work;
+		ret |= bt_ctf_iter_add_callback(iter, 0, &states[i], 0,
+				count_event, NULL, NULL, NULL);
+	}
+	ret |= bt_ctf_iter_set_callback_threads(iter, nr_threads);
+	begin = now();
+	while (!ret && bt_ctf_iter_read_event(iter)) {
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	elapsed = now() - begin;
+	bt_ctf_iter_destroy(iter);
+
+	*all_ok = !ret;
+	for (i = 0; i < NR_CHAINS; i++) {
+		if (states[i].events != nr_events || !states[i].in_order)
+			*all_ok = 0;
+	}
+	return nr_events / elapsed;
+}
+
+/* Number of events of the trace */
+static
+uint64_t count_events(struct bt_context *ctx)
+{
+	struct bt_ctf_iter *iter;
+	uint64_t nr_events = 0;
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		return 0;
+	while (bt_ctf_iter_read_event(iter)) {
+		nr_events++;
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+	return nr_events;
+}
+
+/* Read the first event, returning its name. */
+static
+const char *read_first_event(struct bt_ctf_iter *iter)
+{
+	struct bt_ctf_event *event;
+
+	call_log[0] = '\0';
+	event = bt_ctf_iter_read_event(iter);
+	return event ? bt_ctf_event_name(event) : NULL;
+}
+
+/* Name of an event declared by the trace, other than name. */
+static
+const char *other_event(struct bt_context *ctx, const char *name)
+{
+	struct bt_ctf_event_decl * const *list;
+	unsigned int count, i;
+
+	if (bt_ctf_get_event_decl_list(0, ctx, &list, &count))
+		return NULL;
+	for (i = 0; i < count; i++) {
+		const char *other = bt_ctf_get_decl_event_name(list[i]);
+
+		if (other && strcmp(other, name))
+			return other;
+	}
+	return NULL;
+}
+
+/*
+ * Independent callbacks on workers see each event in order. The event
+ * rates tell whether callbacks of this cost pay for the handoff of
+ * the events to the workers.
+ */
+static
+void test_threads(struct bt_context *ctx, unsigned long work)
+{
+	uint64_t nr_events = count_events(ctx);
+	double serial, parallel;
+	int serial_ok, parallel_ok;
+
+	serial = run_chains(ctx, 0, work, nr_events, &serial_ok);
+	parallel = run_chains(ctx, NR_THREADS, work, nr_events, &parallel_ok);
+	ok(serial_ok, "Serial callbacks see the %" PRIu64 " events in order",
+		nr_events);
+	ok(parallel_ok, "Callbacks on %d workers see the events in order",
+		NR_THREADS);
+	diag("%d callbacks of %lu iterations: %.0f events/s serially, "
+		"%.0f events/s with %d workers", NR_CHAINS, work,
+		serial, parallel, NR_THREADS);
+}
+
+static
+void run_test(const char *path, unsigned long work)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	const char *first, *other;
+	int ret;
+
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+
+	/*
+	 * Dependencies first, then registration order: D depends on
+	 * nothing, C on B, and B on A, registered in reverse order.
+	 */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	ret = add_callback(iter, NULL, "D", NULL, NULL);
+	ret |= add_callback(iter, NULL, "C", "x", NULL);
+	ret |= add_callback(iter, NULL, "B", "y", "x");
+	ret |= add_callback(iter, NULL, "A", NULL, "y");
+	first = read_first_event(iter);
+	if (ret || !first)
+		plan_skip_all("Cannot read trace");
+	ok(!strcmp(call_log, "DABC"), "Callbacks ordered by dependencies (%s)",
+		call_log);
+	bt_ctf_iter_destroy(iter);
+
+	/*
+	 * P provides a result nobody consumes. Q, for all events,
+	 * provides a result only consumed by R, for another event: Q is
+	 * still called for the events without callbacks of their own.
+	 */
+	other = other_event(ctx, first);
+	if (!other)
+		plan_skip_all("Trace declares a single event");
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	ret = add_callback(iter, NULL, "T", NULL, NULL);
+	ret |= add_callback(iter, NULL, "P", NULL, "unused");
+	ret |= add_callback(iter, NULL, "Q", NULL, "z");
+	ret |= add_callback(iter, other, "R", "z", NULL);
+	if (ret || !read_first_event(iter))
+		plan_skip_all("Cannot read trace");
+	ok(!strchr(call_log, 'P'), "Unconsumed provider pruned (%s)", call_log);
+	ok(!strcmp(call_log, "TQ"),
+		"Provider consumed for another event kept (%s)", call_log);
+	bt_ctf_iter_destroy(iter);
+
+	/*
+	 * X and Y depend on each other: the cycle is broken at the
+	 * earliest registered of them, X, then T, registered first, runs
+	 * once its dependency is met.
+	 */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	ret = add_callback(iter, NULL, "T", "a", NULL);
+	ret |= add_callback(iter, NULL, "X", "b", "a");
+	ret |= add_callback(iter, NULL, "Y", "a", "b");
+	if (ret || !read_first_event(iter))
+		plan_skip_all("Cannot read trace");
+	ok(!strcmp(call_log, "XTY"), "Cycle broken in registration order (%s)",
+		call_log);
+	bt_ctf_iter_destroy(iter);
+
+	/* Events with callbacks of their own get those of all events too. */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	ret = add_callback(iter, first, "E", "z", NULL);
+	ret |= add_callback(iter, NULL, "Q", NULL, "z");
+	if (ret || !read_first_event(iter))
+		plan_skip_all("Cannot read trace");
+	ok(!strcmp(call_log, "QE"), "Event callbacks merged with those of "
+		"all events (%s)", call_log);
+	bt_ctf_iter_destroy(iter);
+
+	/*
+	 * S and T are independent chains, run in order by a single
+	 * worker: the stop returned by S ends T too. Destroying the
+	 * iterator waits for the worker.
+	 */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	ret = bt_ctf_iter_add_callback(iter, 0, "S", 0, log_stop,
+			NULL, NULL, NULL);
+	ret |= add_callback(iter, NULL, "T", NULL, NULL);
+	ret |= bt_ctf_iter_set_callback_threads(iter, 1);
+	if (ret || !read_first_event(iter))
+		plan_skip_all("Cannot read trace");
+	bt_ctf_iter_destroy(iter);
+	ok(!strcmp(call_log, "S"), "Stop on a worker ends the other chains (%s)",
+		call_log);
+
+	test_threads(ctx, work);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NR_TESTS);
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need a trace path");
+
+	/* The work per callback and event can be given as benchmark. */
+	run_test(argv[1], argc > 2 ? strtoul(argv[2], NULL, 0) : 1000);
+
+	return exit_status();
+}
@@ -0,0 +1,254 @@
+/*
+ * test-checkpoints.c
+ *
+ * BabelTrace - packet checkpoint test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Writes a trace holding a single packet of several times
+ * PACKET_CHECKPOINT_INTERVAL events, checks the checkpoints recorded
+ * while reading it, and seeks inside the packet from them.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/writer.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <babeltrace/compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	7
+
+#define NR_EVENTS	(5 * PACKET_CHECKPOINT_INTERVAL + 100)
+/* Holds all the events */
+#define PACKET_SIZE	(1 << 20)
+
+#define NR_SEEKS	6
+
+static
+uint64_t event_timestamp(uint64_t seq)
+{
+	return 1000 + seq * 10;
+}
+
+static
+int write_trace(const char *path)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_writer_stream_class *stream_class;
+	struct bt_ctf_writer_event_class *sample;
+	struct bt_ctf_writer_stream *stream;
+	union bt_ctf_writer_value value;
+	uint64_t seq, timestamp;
+	int ret;
+
+	writer = bt_ctf_writer_create(path);
+	if (!writer)
+		return -1;
+	ret = bt_ctf_writer_set_packet_size(writer, PACKET_SIZE);
+	stream_class = bt_ctf_writer_add_stream_class(writer);
+	sample = bt_ctf_writer_add_event_class(stream_class, "sample");
+	ret |= bt_ctf_writer_event_class_add_field(sample, "seq", BT_CTF_WRITER_UINT64);
+	stream = bt_ctf_writer_create_stream(stream_class);
+	if (ret || !stream)
+		goto end;
+	for (seq = 0; seq < NR_EVENTS; seq++) {
+		timestamp = event_timestamp(seq);
+		value.u = seq;
+		if (bt_ctf_writer_append_events(stream, sample, &timestamp,
+				&value, 1) != 1) {
+			ret = -1;
+			goto end;
+		}
+	}
+end:
+	if (bt_ctf_writer_close(writer))
+		ret = -1;
+	return ret;
+}
+
+static
+uint64_t get_seq(struct bt_ctf_event *event)
+{
+	const struct bt_definition *scope;
+
+	scope = bt_ctf_get_top_level_scope(event, BT_EVENT_FIELDS);
+	return bt_ctf_get_uint64(bt_ctf_get_field(event, scope, "seq"));
+}
+
+/*
+ * Read the events up to the end of the trace, checking that they
+ * follow first. Returns the number of events read, or -1 if one is out
+ * of order.
+ */
+static
+int64_t read_events(struct bt_ctf_iter *iter, uint64_t first)
+{
+	struct bt_ctf_event *event;
+	uint64_t nr = 0;
+
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		if (get_seq(event) != first + nr
+				|| bt_ctf_get_timestamp(event)
+					!= event_timestamp(first + nr))
+			return -1;
+		nr++;
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			return -1;
+	}
+	return nr;
+}
+
+/* Seek to timestamp and check the events read from there. */
+static
+int seek_and_read(struct bt_ctf_iter *iter, uint64_t timestamp,
+		uint64_t first)
+{
+	struct bt_iter_pos *pos;
+	int64_t nr;
+	int ret;
+
+	pos = bt_iter_create_time_pos(bt_ctf_get_iter(iter), timestamp);
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), pos);
+	bt_iter_free_pos(pos);
+	if (ret)
+		return 0;
+	nr = read_events(iter, first);
+	if (nr != NR_EVENTS - first) {
+		diag("Seek to %" PRIu64 ": %" PRId64 " events read from event %"
+			PRIu64, timestamp, nr, first);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Whether the checkpoints of the packet are on events
+ * PACKET_CHECKPOINT_INTERVAL, 2 * PACKET_CHECKPOINT_INTERVAL, ...
+ */
+static
+int check_checkpoints(struct ctf_packet_index *index)
+{
+	GArray *checkpoints = ctf_packet_index_checkpoints(index, 0);
+	size_t i;
+
+	if (!checkpoints || checkpoints->len
+			!= (NR_EVENTS - 1) / PACKET_CHECKPOINT_INTERVAL) {
+		diag("%u checkpoints", checkpoints ? checkpoints->len : 0);
+		return 0;
+	}
+	for (i = 0; i < checkpoints->len; i++) {
+		struct packet_checkpoint *checkpoint;
+
+		checkpoint = &g_array_index(checkpoints,
+				struct packet_checkpoint, i);
+		if (checkpoint->cycles_timestamp != event_timestamp((i + 1)
+				* PACKET_CHECKPOINT_INTERVAL)) {
+			diag("Checkpoint %zu at %" PRIu64, i + 1,
+				checkpoint->cycles_timestamp);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static
+void run_test(const char *path)
+{
+	/*
+	 * Before the first checkpoint, on a checkpoint, right after one,
+	 * between two, after the last one, and the last event.
+	 */
+	const uint64_t seek_seqs[NR_SEEKS] = {
+		10,
+		PACKET_CHECKPOINT_INTERVAL,
+		2 * PACKET_CHECKPOINT_INTERVAL + 1,
+		3 * PACKET_CHECKPOINT_INTERVAL - PACKET_CHECKPOINT_INTERVAL / 2,
+		5 * PACKET_CHECKPOINT_INTERVAL + 50,
+		NR_EVENTS - 1,
+	};
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	struct ctf_packet_index *index;
+	int i, same;
+
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		plan_skip_all("Cannot create valid iterator");
+	event = bt_ctf_iter_read_event(iter);
+	if (!event)
+		plan_skip_all("Cannot read trace");
+	index = container_of(event->parent->stream, struct ctf_file_stream,
+			parent)->pos.packet_index;
+	ok(ctf_packet_index_len(index) == 1, "Events written in a single packet");
+
+	/* A time seek before any checkpoint decodes from the packet start. */
+	same = seek_and_read(iter, event_timestamp(seek_seqs[3]), seek_seqs[3]);
+	ok(same, "Time seek inside the packet without checkpoints");
+	ok(check_checkpoints(index), "Checkpoints recorded from event %d",
+		PACKET_CHECKPOINT_INTERVAL);
+
+	ok(seek_and_read(iter, 0, 0), "Full read from the beginning");
+	ok(check_checkpoints(index), "Checkpoints unchanged by a full read");
+
+	same = 1;
+	for (i = 0; i < NR_SEEKS; i++) {
+		/* On the event, and right before it. */
+		same &= seek_and_read(iter, event_timestamp(seek_seqs[i]),
+				seek_seqs[i]);
+		same &= seek_and_read(iter, event_timestamp(seek_seqs[i]) - 5,
+				seek_seqs[i]);
+	}
+	ok(same, "%d time seeks from the checkpoints", 2 * NR_SEEKS);
+	ok(check_checkpoints(index), "Checkpoints unchanged by time seeks");
+
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	char *trace_path;
+
+	plan_tests(NR_TESTS);
+
+	trace_path = create_temp_trace_path("test-checkpoints");
+	if (!trace_path)
+		plan_skip_all("Cannot create temporary directory");
+	if (write_trace(trace_path))
+		plan_skip_all("Cannot write trace");
+
+	run_test(trace_path);
+
+	if (remove_temp_trace(trace_path))
+		diag("Unable to remove %s", trace_path);
+	free(trace_path);
+	return exit_status();
+}
@@ -0,0 +1,72 @@
+/*
+ * test-crc32c.c
+ *
+ * BabelTrace - CRC32C test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/ctf/crc32c.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tap.h"
+
+#define BUF_LEN		4096
+#define NR_TESTS	5
+
+static
+void run_test(void)
+{
+	unsigned char buf[BUF_LEN + 8];
+	size_t align, len;
+	int same = 1;
+	uint32_t crc;
+
+	ok(ctf_crc32c(0, "123456789", 9) == 0xE3069283,
+		"CRC32C check value");
+	ok(ctf_crc32c_sw(0, "123456789", 9) == 0xE3069283,
+		"Table-driven CRC32C check value");
+	memset(buf, 0, 32);
+	ok(ctf_crc32c(0, buf, 32) == 0x8A9136AA,
+		"CRC32C of 32 zero bytes");
+
+	srand(0);
+	for (len = 0; len < sizeof(buf); len++)
+		buf[len] = rand();
+	/* Every length and alignment around the 8-byte loop bounds. */
+	for (align = 0; align < 8; align++) {
+		for (len = 0; len <= BUF_LEN; len += (len < 64) ? 1 : 61) {
+			if (ctf_crc32c(0, buf + align, len)
+					!= ctf_crc32c_sw(0, buf + align, len))
+				same = 0;
+		}
+	}
+	ok(same, "Accelerated and table-driven CRC32C match");
+
+	crc = ctf_crc32c(0, buf, 1000);
+	crc = ctf_crc32c(crc, buf + 1000, BUF_LEN - 1000);
+	ok(crc == ctf_crc32c(0, buf, BUF_LEN),
+		"CRC32C computed in two chunks matches");
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NR_TESTS);
+
+	run_test();
+	return exit_status();
+}
@@ -0,0 +1,231 @@
+/*
+ * test-ctf-writer.c
+ *
+ * BabelTrace - CTF writer API round-trip test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Writes a trace through the CTF writer API, reads it back through the
+ * CTF iterator and reports the write and read rates. The number of
+ * events can be given as argument to use it as a benchmark.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/writer.h>
+#include <babeltrace/types.h>
+#include <babeltrace/compiler.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	7
+#define BATCH_LEN	1024
+#define NR_SAMPLE_FIELDS	4
+
+static const char *notes[] = { "begin", "checkpoint", "end" };
+
+static
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Write nr_events "sample" events, in batches, followed by a "note"
+ * event after each batch.
+ */
+static
+int write_trace(const char *path, uint64_t nr_events)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_writer_stream_class *stream_class;
+	struct bt_ctf_writer_event_class *sample, *note;
+	struct bt_ctf_writer_stream *stream;
+	union bt_ctf_writer_value values[BATCH_LEN * NR_SAMPLE_FIELDS];
+	uint64_t timestamps[BATCH_LEN];
+	uint64_t done = 0;
+	int ret;
+
+	writer = bt_ctf_writer_create(path);
+	if (!writer)
+		return -1;
+	stream_class = bt_ctf_writer_add_stream_class(writer);
+	sample = bt_ctf_writer_add_event_class(stream_class, "sample");
+	note = bt_ctf_writer_add_event_class(stream_class, "note");
+	ret = bt_ctf_writer_event_class_add_field(sample, "seq", BT_CTF_WRITER_UINT64);
+	ret |= bt_ctf_writer_event_class_add_field(sample, "delta", BT_CTF_WRITER_INT16);
+	ret |= bt_ctf_writer_event_class_add_field(sample, "value", BT_CTF_WRITER_DOUBLE);
+	ret |= bt_ctf_writer_event_class_add_field(sample, "ratio", BT_CTF_WRITER_FLOAT);
+	ret |= bt_ctf_writer_event_class_add_field(note, "msg", BT_CTF_WRITER_STRING);
+	stream = bt_ctf_writer_create_stream(stream_class);
+	if (ret || !stream)
+		goto end;
+	while (done < nr_events) {
+		uint64_t i, nr = nr_events - done;
+
+		if (nr > BATCH_LEN)
+			nr = BATCH_LEN;
+		for (i = 0; i < nr; i++) {
+			uint64_t seq = done + i;
+
+			timestamps[i] = 1000 + seq * 10;
+			values[i * NR_SAMPLE_FIELDS].u = seq;
+			values[i * NR_SAMPLE_FIELDS + 1].s = -(int64_t) (seq % 1000);
+			values[i * NR_SAMPLE_FIELDS + 2].d = seq * 0.5;
+			/* Exact in single precision up to 2^22 events */
+			values[i * NR_SAMPLE_FIELDS + 3].d = seq * 0.25;
+		}
+		if (bt_ctf_writer_append_events(stream, sample, timestamps,
+				values, nr) != nr) {
+			ret = -1;
+			goto end;
+		}
+		done += nr;
+		values[0].str = notes[(done / BATCH_LEN) % 3];
+		if (bt_ctf_writer_append_events(stream, note,
+				&timestamps[nr - 1], values, 1) != 1) {
+			ret = -1;
+			goto end;
+		}
+	}
+end:
+	if (bt_ctf_writer_close(writer))
+		ret = -1;
+	return ret;
+}
+
+/* Value of a floating point field, or NaN if it is not one. */
+static
+double get_float(const struct bt_definition *field)
+{
+	if (!field || bt_ctf_field_type(bt_ctf_get_decl_from_def(field))
+			!= CTF_TYPE_FLOAT)
+		return 0.0 / 0.0;
+	return container_of(field, const struct definition_float, p)->value;
+}
+
+/*
+ * Read the trace back, checking the sample sequence numbers and
+ * counting the note events, and the samples whose floating point
+ * fields differ from what was written.
+ */
+static
+int read_trace(const char *path, uint64_t *nr_samples, uint64_t *nr_notes,
+		uint64_t *nr_bad_floats)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	int in_order = 1;
+
+	*nr_samples = *nr_notes = *nr_bad_floats = 0;
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		return -1;
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		bt_context_put(ctx);
+		return -1;
+	}
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		const struct bt_definition *scope;
+
+		scope = bt_ctf_get_top_level_scope(event, BT_EVENT_FIELDS);
+		if (!strcmp(bt_ctf_event_name(event), "sample")) {
+			uint64_t seq;
+
+			seq = bt_ctf_get_uint64(bt_ctf_get_field(event, scope, "seq"));
+			if (seq != *nr_samples
+					|| bt_ctf_get_int64(bt_ctf_get_field(event,
+						scope, "delta")) != -(int64_t) (seq % 1000)
+					|| bt_ctf_get_cycles(event) != 1000 + seq * 10)
+				in_order = 0;
+			if (get_float(bt_ctf_get_field(event, scope, "value"))
+					!= seq * 0.5
+					|| get_float(bt_ctf_get_field(event,
+						scope, "ratio")) != seq * 0.25)
+				(*nr_bad_floats)++;
+			(*nr_samples)++;
+		} else {
+			const char *msg;
+
+			msg = bt_ctf_get_string(bt_ctf_get_field(event, scope, "msg"));
+			if (!msg || strcmp(msg, notes[(*nr_samples / BATCH_LEN) % 3]))
+				in_order = 0;
+			(*nr_notes)++;
+		}
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+	return in_order ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	char *trace_path;
+	uint64_t nr_events = 100000, nr_samples, nr_notes, nr_bad_floats;
+	double begin, write_time, read_time;
+	int ret;
+
+	if (argc > 1)
+		nr_events = strtoull(argv[1], NULL, 0);
+	plan_tests(NR_TESTS);
+
+	trace_path = create_temp_trace_path("test-ctf-writer");
+	if (!trace_path)
+		return exit_status();
+
+	begin = now();
+	ret = write_trace(trace_path, nr_events);
+	write_time = now() - begin;
+	ok(ret == 0, "Write %" PRIu64 " events", nr_events);
+
+	begin = now();
+	ret = read_trace(trace_path, &nr_samples, &nr_notes, &nr_bad_floats);
+	read_time = now() - begin;
+	ok(ret >= 0, "Read the trace back");
+	ok(nr_samples == nr_events, "All sample events read (%" PRIu64 ")",
+		nr_samples);
+	ok(nr_notes == (nr_events + BATCH_LEN - 1) / BATCH_LEN,
+		"All note events read (%" PRIu64 ")", nr_notes);
+	ok(ret == 0, "Events read in order with their fields");
+	ok(nr_bad_floats == 0, "Float and double fields read back (%" PRIu64
+		" mismatches)", nr_bad_floats);
+
+	ok(!bt_ctf_writer_create(trace_path), "Existing trace directory refused");
+
+	diag("Write: %.0f events/s, read: %.0f events/s",
+		nr_events / write_time, nr_events / read_time);
+
+	if (remove_temp_trace(trace_path))
+		diag("Unable to remove %s", trace_path);
+	free(trace_path);
+	return exit_status();
+}
@@ -0,0 +1,295 @@
+/*
+ * test-histogram.c
+ *
+ * BabelTrace - event rate histogram test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/ctf/histogram.h>
+#include <babeltrace/compiler.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	8
+
+/* Streams in histogram order, with their events counted by packet. */
+struct test_stream {
+	struct ctf_file_stream *cfs;
+	GArray *packet_events;		/* uint64_t, by packet */
+	uint64_t events;
+};
+
+static
+int near(double value, double expected)
+{
+	return fabs(value - expected) <= 1e-6 * MAX(1.0, fabs(expected));
+}
+
+/* Same order as the streams of the histogram. */
+static
+GPtrArray *list_streams(struct bt_context *ctx)
+{
+	GPtrArray *streams = g_ptr_array_new();
+	int i, j, k;
+
+	for (i = 0; i < ctx->tc->array->len; i++) {
+		struct ctf_trace *trace = container_of(
+				g_ptr_array_index(ctx->tc->array, i),
+				struct ctf_trace, parent);
+
+		for (j = 0; j < trace->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(trace->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct test_stream *ts;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream)
+					continue;
+				ts = g_new0(struct test_stream, 1);
+				ts->cfs = container_of(stream,
+						struct ctf_file_stream, parent);
+				ts->packet_events = g_array_new(FALSE, TRUE,
+						sizeof(uint64_t));
+				g_array_set_size(ts->packet_events,
+					ctf_packet_index_len(ts->cfs->pos.packet_index));
+				g_ptr_array_add(streams, ts);
+			}
+		}
+	}
+	return streams;
+}
+
+static
+void free_streams(GPtrArray *streams)
+{
+	unsigned int i;
+
+	for (i = 0; i < streams->len; i++) {
+		struct test_stream *ts = g_ptr_array_index(streams, i);
+
+		g_array_free(ts->packet_events, TRUE);
+		g_free(ts);
+	}
+	g_ptr_array_free(streams, TRUE);
+}
+
+/*
+ * Read all the events, counting them by stream and packet, and by
+ * event class name in classes. Returns the number of events.
+ */
+static
+uint64_t read_events(struct bt_context *ctx, GPtrArray *streams,
+		GHashTable *classes)
+{
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	uint64_t nr_events = 0;
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		return 0;
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		struct ctf_stream_definition *stream = event->parent->stream;
+		const char *name = bt_ctf_event_name(event);
+		unsigned int i;
+
+		for (i = 0; i < streams->len; i++) {
+			struct test_stream *ts = g_ptr_array_index(streams, i);
+
+			if (&ts->cfs->parent != stream)
+				continue;
+			g_array_index(ts->packet_events, uint64_t,
+				ts->cfs->pos.cur_index)++;
+			ts->events++;
+			break;
+		}
+		g_hash_table_insert(classes, (gpointer) name,
+			GUINT_TO_POINTER(GPOINTER_TO_UINT(
+				g_hash_table_lookup(classes, name)) + 1));
+		nr_events++;
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+	bt_ctf_iter_destroy(iter);
+	return nr_events;
+}
+
+/* Bucket of a real timestamp, clamped to the histogram span. */
+static
+size_t bucket_of(struct bt_ctf_histogram *h, uint64_t ts)
+{
+	uint64_t begin = bt_ctf_histogram_get_begin(h);
+	uint64_t len = bt_ctf_histogram_get_bucket_len(h);
+	size_t nr = bt_ctf_histogram_get_nr_buckets(h);
+
+	if (ts < begin)
+		return 0;
+	return MIN((ts - begin) / len, nr - 1);
+}
+
+/*
+ * The events of a packet are spread over the buckets it overlaps: a
+ * bucket holds at least the events of the packets within it, and at
+ * most those of the packets overlapping it.
+ */
+static
+int check_buckets(struct bt_ctf_histogram *h, struct test_stream *ts, int s)
+{
+	struct ctf_packet_index *index = ts->cfs->pos.packet_index;
+	size_t nr_buckets = bt_ctf_histogram_get_nr_buckets(h);
+	size_t k, i, len = ctf_packet_index_len(index);
+	int ret = 1;
+
+	for (k = 0; k < nr_buckets; k++) {
+		double events = bt_ctf_histogram_get_events(h, s, k);
+		uint64_t min = 0, max = 0;
+
+		for (i = 0; i < len; i++) {
+			uint64_t n = g_array_index(ts->packet_events, uint64_t, i);
+			size_t first, last;
+
+			first = bucket_of(h, ctf_get_real_timestamp(&ts->cfs->parent,
+				ctf_packet_index_timestamp_begin(index, i)));
+			last = bucket_of(h, ctf_get_real_timestamp(&ts->cfs->parent,
+				ctf_packet_index_timestamp_end(index, i)));
+			if (first == k && last == k)
+				min += n;
+			if (first <= k && k <= last)
+				max += n;
+		}
+		if (events < min - 1e-6 || events > max + 1e-6) {
+			diag("Stream %d bucket %zu: %g events, expected %" PRIu64
+				" to %" PRIu64, s, k, events, min, max);
+			ret = 0;
+		}
+	}
+	return ret;
+}
+
+static
+void run_test(const char *path)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_histogram *h;
+	GPtrArray *streams;
+	GHashTable *classes;
+	uint64_t nr_events, nr_nonempty = 0;
+	double total = 0.0;
+	int streams_ok = 1, buckets_ok = 1, classes_ok = 1;
+	unsigned int i;
+	size_t k;
+
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+
+	/* Decode all the packets: the counts are exact. */
+	h = bt_ctf_histogram_create(ctx, 0, 1.0);
+	ok(h != NULL, "Create a histogram decoding all the packets");
+	if (!h)
+		return;
+	streams = list_streams(ctx);
+	classes = g_hash_table_new(g_str_hash, g_str_equal);
+	nr_events = read_events(ctx, streams, classes);
+	ok(nr_events > 0, "Read %" PRIu64 " events", nr_events);
+	ok1(bt_ctf_histogram_get_nr_streams(h) == streams->len);
+
+	for (i = 0; i < streams->len; i++) {
+		struct test_stream *ts = g_ptr_array_index(streams, i);
+		double events = 0.0;
+
+		for (k = 0; k < ts->packet_events->len; k++)
+			if (g_array_index(ts->packet_events, uint64_t, k))
+				nr_nonempty++;
+		for (k = 0; k < bt_ctf_histogram_get_nr_buckets(h); k++)
+			events += bt_ctf_histogram_get_events(h, i, k);
+		if (!near(events, ts->events)) {
+			diag("Stream %u: %g events, expected %" PRIu64,
+				i, events, ts->events);
+			streams_ok = 0;
+		}
+		if (!check_buckets(h, ts, i))
+			buckets_ok = 0;
+	}
+	ok(nr_nonempty == bt_ctf_histogram_get_nr_sampled(h),
+		"All %" PRIu64 " packets holding events decoded", nr_nonempty);
+	ok(streams_ok, "Events of each stream match a full read");
+	ok(buckets_ok, "Bucket counts match the events of their packets");
+
+	for (i = 0; i < bt_ctf_histogram_get_nr_event_classes(h); i++) {
+		const char *name = bt_ctf_histogram_get_event_class_name(h, i);
+		double events = bt_ctf_histogram_get_event_class_events(h, i);
+		uint64_t expected = GPOINTER_TO_UINT(
+				g_hash_table_lookup(classes, name));
+
+		if (!near(events, expected)) {
+			diag("Event class %s: %g events, expected %" PRIu64,
+				name, events, expected);
+			classes_ok = 0;
+		}
+	}
+	ok(classes_ok && bt_ctf_histogram_get_nr_event_classes(h)
+			== g_hash_table_size(classes),
+		"Events of each class match a full read");
+	bt_ctf_histogram_destroy(h);
+	free_streams(streams);
+	g_hash_table_destroy(classes);
+	bt_context_put(ctx);
+
+	/* A bucket spanning the whole trace holds all the events. */
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+	h = bt_ctf_histogram_create(ctx, -1ULL >> 1, 1.0);
+	if (h && bt_ctf_histogram_get_nr_buckets(h) == 1)
+		total = bt_ctf_histogram_get_events(h,
+				BT_CTF_HISTOGRAM_ALL_STREAMS, 0);
+	ok(near(total, nr_events), "Single bucket holds all %g events", total);
+	bt_ctf_histogram_destroy(h);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NR_TESTS);
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need a trace path");
+
+	run_test(argv[1]);
+
+	return exit_status();
+}
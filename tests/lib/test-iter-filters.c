@@ -0,0 +1,459 @@
+/*
+ * test-iter-filters.c
+ *
+ * BabelTrace - iterator filters test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/endian.h>
+#include <babeltrace/compiler.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	7
+
+/*
+ * Packet context of the lttng-modules-2.0-pre5 trace, in bytes from
+ * the start of a packet: little endian, byte aligned, after the 24
+ * bytes of the packet header.
+ */
+#define EVENTS_DISCARDED_OFFSET	40
+#define PACKET_SIZE_OFFSET	48
+
+/* Events discarded by the tracer before the end of each packet */
+#define DISCARDED_PER_PACKET	5
+
+/* CPU of the events read by the field filter test */
+#define FILTER_CPU_ID		1
+
+/* Events read from a stream */
+struct stream_count {
+	uint64_t events;
+	size_t last_packet;		/* of the last event read */
+	uint64_t lost;			/* stream events_discarded, added up */
+};
+
+/*
+ * Set the events_discarded counter of packet k of each stream file of
+ * the trace copied at path to k * DISCARDED_PER_PACKET.
+ */
+static
+int add_discarded_events(const char *path)
+{
+	DIR *dir;
+	struct dirent *entry;
+	int ret = 0;
+
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while (!ret && (entry = readdir(dir))) {
+		char file[PATH_MAX];
+		struct stat st;
+		off_t offset = 0;
+		uint32_t k = 0;
+		int fd;
+
+		if (strncmp(entry->d_name, "channel", strlen("channel")))
+			continue;
+		snprintf(file, PATH_MAX, "%s/%s", path, entry->d_name);
+		fd = open(file, O_RDWR);
+		if (fd < 0 || fstat(fd, &st)) {
+			ret = -1;
+			break;
+		}
+		while (offset < st.st_size) {
+			uint32_t packet_size, discarded;
+
+			if (pread(fd, &packet_size, sizeof(packet_size),
+					offset + PACKET_SIZE_OFFSET)
+					!= sizeof(packet_size)) {
+				ret = -1;
+				break;
+			}
+			packet_size = GUINT32_FROM_LE(packet_size) / CHAR_BIT;
+			discarded = GUINT32_TO_LE(k++ * DISCARDED_PER_PACKET);
+			if (!packet_size || pwrite(fd, &discarded,
+					sizeof(discarded),
+					offset + EVENTS_DISCARDED_OFFSET)
+					!= sizeof(discarded)) {
+				ret = -1;
+				break;
+			}
+			offset += packet_size;
+		}
+		close(fd);
+	}
+	closedir(dir);
+	return ret;
+}
+
+static
+struct stream_count *get_count(GHashTable *counts,
+		struct ctf_stream_definition *stream)
+{
+	struct stream_count *count = g_hash_table_lookup(counts, stream);
+
+	if (!count) {
+		count = g_new0(struct stream_count, 1);
+		g_hash_table_insert(counts, stream, count);
+	}
+	return count;
+}
+
+/*
+ * Read the events, only those named name if not NULL, counting them by
+ * stream in counts and by name in names. Returns the number of events
+ * lost, from the iterator.
+ */
+static
+uint64_t read_events(struct bt_context *ctx, const char *name,
+		GHashTable *counts, GHashTable *names)
+{
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	uint64_t lost = 0;
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		return 0;
+	if (name && bt_ctf_iter_add_event_filter(iter, name))
+		goto end;
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		struct ctf_stream_definition *stream = event->parent->stream;
+		const char *event_name = bt_ctf_event_name(event);
+		struct stream_count *count = get_count(counts, stream);
+
+		count->events++;
+		count->last_packet = container_of(stream,
+				struct ctf_file_stream, parent)->pos.cur_index;
+		/* Consumed as an output format does */
+		count->lost += stream->events_discarded;
+		stream->events_discarded = 0;
+		lost += bt_ctf_get_lost_events_count(iter);
+		if (names)
+			g_hash_table_insert(names, (gpointer) event_name,
+				GUINT_TO_POINTER(GPOINTER_TO_UINT(
+					g_hash_table_lookup(names,
+						event_name)) + 1));
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+end:
+	bt_ctf_iter_destroy(iter);
+	return lost;
+}
+
+/* Least frequent event name, likely missing from many packets */
+static
+const char *find_rarest(GHashTable *names)
+{
+	GHashTableIter it;
+	gpointer key, value;
+	const char *rarest;
+	unsigned int min = 0;
+
+	g_hash_table_iter_init(&it, names);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		if (!rarest || GPOINTER_TO_UINT(value) < min) {
+			rarest = key;
+			min = GPOINTER_TO_UINT(value);
+		}
+	}
+	return rarest;
+}
+
+static
+uint64_t discarded(struct ctf_stream_definition *stream, size_t packet)
+{
+	struct packet_index index;
+
+	ctf_packet_index_get(container_of(stream, struct ctf_file_stream,
+			parent)->pos.packet_index, packet, &index);
+	return index.events_discarded;
+}
+
+/*
+ * The iterator counts the events lost up to the packet of the last
+ * event read. The stream counter is set when leaving a packet: the
+ * events discarded by the packets skipped before the last one read
+ * add up.
+ */
+static
+void check_counts(GHashTable *counts, GHashTable *all, uint64_t lost, int *events_ok, int *lost_ok, int *stream_lost_ok)
+{
+	GHashTableIter it;
+	gpointer key, value;
+	uint64_t expected_lost = 0;
+
+	*stream_lost_ok = 1;
+	g_hash_table_iter_init(&it, counts);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		struct ctf_stream_definition *stream = key;
+		struct stream_count *count = value;
+		uint64_t expected;
+
+		expected_lost += discarded(stream, count->last_packet);
+		expected = count->last_packet ?
+			discarded(stream, count->last_packet - 1) : 0;
+		if (count->lost != expected) {
+			diag("Stream %s: %" PRIu64 " events discarded, expected %"
+				PRIu64, stream->path, count->lost, expected);
+			*stream_lost_ok = 0;
+		}
+	}
+	*events_ok = g_hash_table_size(counts) > 0;
+	g_hash_table_iter_init(&it, counts);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		struct stream_count *count = value;
+		struct stream_count *full = g_hash_table_lookup(all, key);
+
+		if (!full || full->events < count->events)
+			*events_ok = 0;
+	}
+	*lost_ok = lost == expected_lost;
+	if (!*lost_ok)
+		diag("%" PRIu64 " events lost, expected %" PRIu64,
+			lost, expected_lost);
+}
+
+static
+void test_event_filter(const char *path)
+{
+	struct bt_context *ctx;
+	GHashTable *all, *counts, *names;
+	const char *rarest;
+	uint64_t lost, nr_events = 0;
+	int events_ok, lost_ok, stream_lost_ok;
+	GHashTableIter it;
+	gpointer value;
+
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+	all = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	counts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	names = g_hash_table_new(g_str_hash, g_str_equal);
+
+	/* Read everything first: the index learns the events of each packet. */
+	read_events(ctx, NULL, all, names);
+	rarest = find_rarest(names);
+	if (!rarest)
+		plan_skip_all("No events in trace");
+
+	lost = read_events(ctx, rarest, counts, NULL);
+	g_hash_table_iter_init(&it, counts);
+	while (g_hash_table_iter_next(&it, NULL, &value))
+		nr_events += ((struct stream_count *) value)->events;
+	check_counts(counts, all, lost, &events_ok, &lost_ok,
+		&stream_lost_ok);
+	ok(nr_events == GPOINTER_TO_UINT(g_hash_table_lookup(names, rarest))
+			&& events_ok,
+		"Event filter reads the %" PRIu64 " %s events", nr_events, rarest);
+	ok(lost_ok, "Lost event count of the iterator with an event filter");
+	ok(stream_lost_ok, "Events discarded by skipped packets add up");
+
+	g_hash_table_destroy(names);
+	g_hash_table_destroy(counts);
+	g_hash_table_destroy(all);
+	bt_context_put(ctx);
+}
+
+/* An event, to compare the events read by two iterators */
+struct event_key {
+	uint64_t timestamp;
+	const char *name;		/* quark string */
+};
+
+static
+int64_t event_cpu_id(struct bt_ctf_event *event)
+{
+	const struct bt_definition *field;
+
+	field = bt_ctf_get_field(event, bt_ctf_get_top_level_scope(event,
+			BT_STREAM_PACKET_CONTEXT), "cpu_id");
+	return field ? (int64_t) bt_ctf_get_uint64(field) : -1;
+}
+
+/*
+ * Read the events of ctx, those of FILTER_CPU_ID only, with a field
+ * filter if filter is set, and through the events otherwise.
+ */
+static
+GArray *read_cpu_events(struct bt_context *ctx, int filter)
+{
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	GArray *events = g_array_new(FALSE, TRUE, sizeof(struct event_key));
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		return events;
+	if (filter && bt_ctf_iter_add_field_filter(iter, "cpu_id",
+			FILTER_CPU_ID, FILTER_CPU_ID))
+		goto end;
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		if (event_cpu_id(event) == FILTER_CPU_ID) {
+			struct event_key key;
+
+			key.timestamp = bt_ctf_get_timestamp(event);
+			key.name = bt_ctf_event_name(event);
+			g_array_append_val(events, key);
+		}
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0)
+			break;
+	}
+end:
+	bt_ctf_iter_destroy(iter);
+	return events;
+}
+
+/*
+ * Only the packets decoded entirely get their event ids in the index.
+ * The first packet of each stream is read by the iterator creation,
+ * before the filter is added, and sets the stream packet context. The
+ * other packets are skipped from their packet context cpu_id, without
+ * being mapped.
+ */
+static
+void check_skipped(struct bt_context *ctx, int *skipped_ok, int *read_ok)
+{
+	int i, j, k;
+
+	*skipped_ok = *read_ok = 1;
+	for (i = 0; i < ctx->tc->array->len; i++) {
+		struct ctf_trace *trace = container_of(
+				g_ptr_array_index(ctx->tc->array, i),
+				struct ctf_trace, parent);
+
+		for (j = 0; j < trace->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(trace->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_stream_definition *stream;
+				struct ctf_packet_index *index;
+				struct definition_integer *cpu_id;
+				size_t n;
+
+				stream = g_ptr_array_index(stream_class->streams, k);
+				if (!stream || !stream->stream_packet_context)
+					continue;
+				cpu_id = bt_lookup_integer(
+					&stream->stream_packet_context->p,
+					"cpu_id", FALSE);
+				if (!cpu_id)
+					continue;
+				index = container_of(stream, struct ctf_file_stream,
+						parent)->pos.packet_index;
+				for (n = 1; n < ctf_packet_index_len(index); n++) {
+					int decoded = ctf_packet_index_event_ids(index, n)
+						!= PACKET_EVENT_IDS_UNKNOWN;
+
+					if (cpu_id->value._unsigned == FILTER_CPU_ID
+							&& !decoded) {
+						diag("Packet %zu of %s not read",
+							n, stream->path);
+						*read_ok = 0;
+					} else if (cpu_id->value._unsigned
+							!= FILTER_CPU_ID && decoded) {
+						diag("Packet %zu of %s not skipped",
+							n, stream->path);
+						*skipped_ok = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+static
+void test_field_filter(const char *path)
+{
+	struct bt_context *ctx, *ctx_filter;
+	GArray *expected, *events;
+	int skipped_ok, read_ok;
+
+	ctx = create_context_with_path(path);
+	ctx_filter = create_context_with_path(path);
+	if (!ctx || !ctx_filter)
+		plan_skip_all("Cannot create valid context");
+
+	expected = read_cpu_events(ctx, 0);
+	events = read_cpu_events(ctx_filter, 1);
+	ok(expected->len > 0 && events->len == expected->len
+			&& !memcmp(events->data, expected->data,
+				events->len * sizeof(struct event_key)),
+		"Field filter reads the %u events of CPU %d, in order",
+		events->len, FILTER_CPU_ID);
+	check_skipped(ctx_filter, &skipped_ok, &read_ok);
+	ok(skipped_ok, "Packets of the other CPUs skipped");
+	ok(read_ok, "Packets of CPU %d read", FILTER_CPU_ID);
+
+	g_array_free(events, TRUE);
+	g_array_free(expected, TRUE);
+	bt_context_put(ctx_filter);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	char *trace_path, *cmd;
+
+	plan_tests(NR_TESTS);
+
+	if (argc < 2)
+		plan_skip_all("Invalid arguments: need the lttng-modules-2.0-pre5 trace");
+	trace_path = create_temp_trace_path("test-iter-filters");
+	if (!trace_path)
+		plan_skip_all("Cannot create temporary directory");
+	if (asprintf(&cmd, "cp -r %s %s", argv[1], trace_path) < 0
+			|| system(cmd))
+		plan_skip_all("Cannot copy trace");
+	free(cmd);
+
+	ok(!add_discarded_events(trace_path),
+		"Add discarded events to the packets of the trace");
+	test_event_filter(trace_path);
+	test_field_filter(trace_path);
+
+	if (remove_temp_trace(trace_path))
+		diag("Unable to remove %s", trace_path);
+	free(trace_path);
+	return exit_status();
+}
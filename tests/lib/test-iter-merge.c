@@ -0,0 +1,350 @@
+/*
+ * test-iter-merge.c
+ *
+ * BabelTrace - iterator merge bypass test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Writes a trace whose streams interleave, tie, and run alone in time,
+ * then checks that bt_iter_next(), which skips heap rebalancing while
+ * the top stream stays ahead of the others, returns the events in the
+ * same order as a read rebalancing the heap after every event, also
+ * after bt_iter_set_pos().
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/iterator-internal.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events.h>
+#include <babeltrace/ctf/writer.h>
+#include <babeltrace/compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	6
+
+/* Events of each interleaved stream */
+#define NR_STEPS	20000
+/* Period of the interleaved streams, in ns */
+#define STEP		1000
+/* A burst of the burst stream runs alone every BURST_PERIOD steps. */
+#define BURST_PERIOD	100
+#define BURST_LEN	300
+/* Events of the streams before and after all others */
+#define NR_EARLY	900
+#define NR_LATE		5000
+
+#define NR_SAVED_POS	4
+#define NR_SEEK_TIMES	5
+
+enum stream_id {
+	STREAM_A,	/* interleaved with B */
+	STREAM_B,
+	STREAM_TIES,	/* same timestamps as A */
+	STREAM_BURSTS,	/* runs of events between A and B */
+	STREAM_EARLY,	/* before all other streams */
+	STREAM_LATE,	/* after all other streams */
+	NR_STREAMS,
+};
+
+struct event_key {
+	uint64_t timestamp;
+	uint64_t stream;
+	uint64_t seq;
+};
+
+struct event_list {
+	struct event_key *keys;
+	size_t len;
+};
+
+static
+uint64_t event_timestamp(enum stream_id id, uint64_t seq)
+{
+	switch (id) {
+	case STREAM_A:
+	case STREAM_TIES:
+		return STEP + seq * STEP;
+	case STREAM_B:
+		return STEP + seq * STEP + STEP / 2;
+	case STREAM_BURSTS:
+		return STEP + (seq / BURST_LEN) * BURST_PERIOD * STEP
+			+ 1 + seq % BURST_LEN;
+	case STREAM_EARLY:
+		return 1 + seq;
+	case STREAM_LATE:
+	default:
+		return STEP + (NR_STEPS + 1) * STEP + seq;
+	}
+}
+
+static
+uint64_t stream_len(enum stream_id id)
+{
+	switch (id) {
+	case STREAM_BURSTS:
+		return NR_STEPS / BURST_PERIOD * BURST_LEN;
+	case STREAM_EARLY:
+		return NR_EARLY;
+	case STREAM_LATE:
+		return NR_LATE;
+	default:
+		return NR_STEPS;
+	}
+}
+
+/* Write each stream in its own file, in page sized packets. */
+static
+int write_trace(const char *path)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_writer_stream_class *stream_class;
+	struct bt_ctf_writer_event_class *sample;
+	struct bt_ctf_writer_stream *streams[NR_STREAMS];
+	union bt_ctf_writer_value values[2];
+	int id, ret;
+
+	writer = bt_ctf_writer_create(path);
+	if (!writer)
+		return -1;
+	ret = bt_ctf_writer_set_packet_size(writer, getpagesize());
+	stream_class = bt_ctf_writer_add_stream_class(writer);
+	sample = bt_ctf_writer_add_event_class(stream_class, "sample");
+	ret |= bt_ctf_writer_event_class_add_field(sample, "stream", BT_CTF_WRITER_UINT8);
+	ret |= bt_ctf_writer_event_class_add_field(sample, "seq", BT_CTF_WRITER_UINT64);
+	for (id = 0; id < NR_STREAMS; id++) {
+		streams[id] = bt_ctf_writer_create_stream(stream_class);
+		if (!streams[id])
+			ret = -1;
+	}
+	if (ret)
+		goto end;
+	for (id = 0; id < NR_STREAMS; id++) {
+		uint64_t seq, timestamp;
+
+		for (seq = 0; seq < stream_len(id); seq++) {
+			timestamp = event_timestamp(id, seq);
+			values[0].u = id;
+			values[1].u = seq;
+			if (bt_ctf_writer_append_events(streams[id], sample,
+					&timestamp, values, 1) != 1) {
+				ret = -1;
+				goto end;
+			}
+		}
+	}
+end:
+	if (bt_ctf_writer_close(writer))
+		ret = -1;
+	return ret;
+}
+
+static
+void get_key(struct bt_ctf_event *event, struct event_key *key)
+{
+	const struct bt_definition *scope;
+
+	scope = bt_ctf_get_top_level_scope(event, BT_EVENT_FIELDS);
+	key->timestamp = bt_ctf_get_timestamp(event);
+	key->stream = bt_ctf_get_uint64(bt_ctf_get_field(event, scope, "stream"));
+	key->seq = bt_ctf_get_uint64(bt_ctf_get_field(event, scope, "seq"));
+}
+
+/*
+ * Read the events up to the end of the trace. With heap_only, the
+ * bypass is forgotten before each event, so that the heap is
+ * rebalanced after every event. The positions before the events listed
+ * in save_at are saved in saved.
+ */
+static
+int read_events(struct bt_ctf_iter *iter, struct event_list *list,
+		int heap_only, const size_t *save_at,
+		struct bt_iter_pos **saved, int nr_saved)
+{
+	struct bt_iter *bt_iter = bt_ctf_get_iter(iter);
+	struct bt_ctf_event *event;
+	size_t max_len = 0;
+	int i;
+
+	list->keys = NULL;
+	list->len = 0;
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		for (i = 0; i < nr_saved; i++) {
+			if (save_at[i] == list->len)
+				saved[i] = bt_iter_get_pos(bt_iter);
+		}
+		if (list->len == max_len) {
+			max_len = max_len ? 2 * max_len : 4096;
+			list->keys = realloc(list->keys,
+					max_len * sizeof(*list->keys));
+			if (!list->keys)
+				return -1;
+		}
+		get_key(event, &list->keys[list->len++]);
+		if (heap_only)
+			bt_iter->bypass_stream = NULL;
+		if (bt_iter_next(bt_iter) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* Whether the events read from pos are the ones of ref from first. */
+static
+int same_events_from(struct bt_ctf_iter *iter, struct bt_iter_pos *pos,
+		const struct event_list *ref, size_t first)
+{
+	struct event_list list;
+	int same;
+
+	if (!pos || bt_iter_set_pos(bt_ctf_get_iter(iter), pos))
+		return 0;
+	if (read_events(iter, &list, 0, NULL, NULL, 0)) {
+		free(list.keys);
+		return 0;
+	}
+	same = list.len == ref->len - first
+		&& (!list.len || !memcmp(list.keys, &ref->keys[first],
+			list.len * sizeof(*list.keys)));
+	if (!same)
+		diag("%zu events read from position of event %zu, expected %zu",
+			list.len, first, ref->len - first);
+	free(list.keys);
+	return same;
+}
+
+/* Index of the first event of ref at or after timestamp. */
+static
+size_t first_event_at(const struct event_list *ref, uint64_t timestamp)
+{
+	size_t i;
+
+	for (i = 0; i < ref->len; i++) {
+		if (ref->keys[i].timestamp >= timestamp)
+			break;
+	}
+	return i;
+}
+
+static
+void run_test(const char *path)
+{
+	/* Inside a burst, across interleaved and tied streams, late. */
+	const uint64_t seek_times[NR_SEEK_TIMES] = {
+		1 + NR_EARLY / 2,
+		STEP + BURST_PERIOD * STEP + 100,
+		STEP + 7 * STEP + STEP / 2,
+		STEP + 7 * STEP,
+		STEP + (NR_STEPS + 1) * STEP + NR_LATE / 3,
+	};
+	struct bt_iter_pos *saved[NR_SAVED_POS] = { NULL };
+	size_t save_at[NR_SAVED_POS];
+	struct event_list ref, list;
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	uint64_t nr_events = 0;
+	size_t i;
+	int id, same = 1;
+
+	for (id = 0; id < NR_STREAMS; id++)
+		nr_events += stream_len(id);
+	/* In the early stream, a burst, interleaved streams, late stream */
+	save_at[0] = NR_EARLY / 3;
+	save_at[1] = NR_EARLY + 2 + BURST_LEN / 2;
+	save_at[2] = nr_events / 2 + 1;
+	save_at[3] = nr_events - NR_LATE / 2;
+
+	ctx = create_context_with_path(path);
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter)
+		plan_skip_all("Cannot create valid iterator");
+
+	ok(!read_events(iter, &ref, 1, NULL, NULL, 0)
+		&& ref.len == nr_events,
+		"Heap read of %" PRIu64 " events (%zu)", nr_events, ref.len);
+	for (i = 1; i < ref.len; i++) {
+		if (ref.keys[i].timestamp < ref.keys[i - 1].timestamp)
+			break;
+	}
+	ok(ref.len && i == ref.len, "Heap read in timestamp order");
+
+	if (bt_iter_set_pos(bt_ctf_get_iter(iter), bt_iter_create_time_pos(
+			bt_ctf_get_iter(iter), 0)))
+		plan_skip_all("Cannot seek to the beginning of the trace");
+	ok(!read_events(iter, &list, 0, save_at, saved, NR_SAVED_POS)
+		&& list.len == ref.len
+		&& !memcmp(list.keys, ref.keys, ref.len * sizeof(*ref.keys)),
+		"Read with bypass in heap order");
+	free(list.keys);
+
+	for (i = 0; i < NR_SAVED_POS; i++)
+		same &= same_events_from(iter, saved[i], &ref, save_at[i]);
+	ok(same, "Reads from %d restored positions in heap order",
+		NR_SAVED_POS);
+
+	same = 1;
+	for (i = 0; i < NR_SEEK_TIMES; i++) {
+		struct bt_iter_pos *pos;
+
+		pos = bt_iter_create_time_pos(bt_ctf_get_iter(iter),
+				seek_times[i]);
+		same &= same_events_from(iter, pos, &ref,
+				first_event_at(&ref, seek_times[i]));
+		bt_iter_free_pos(pos);
+	}
+	ok(same, "Reads from %d time positions in heap order",
+		NR_SEEK_TIMES);
+
+	/* Seeking back restarts the bypass from the rebuilt heap. */
+	same = same_events_from(iter, saved[1], &ref, save_at[1])
+		&& same_events_from(iter, saved[0], &ref, save_at[0]);
+	ok(same, "Reads after seeking backwards in heap order");
+
+	for (i = 0; i < NR_SAVED_POS; i++)
+		bt_iter_free_pos(saved[i]);
+	free(ref.keys);
+	bt_ctf_iter_destroy(iter);
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	char *trace_path;
+
+	plan_tests(NR_TESTS);
+
+	trace_path = create_temp_trace_path("test-iter-merge");
+	if (!trace_path)
+		plan_skip_all("Cannot create temporary directory");
+	if (write_trace(trace_path))
+		plan_skip_all("Cannot write trace");
+
+	run_test(trace_path);
+
+	if (remove_temp_trace(trace_path))
+		diag("Unable to remove %s", trace_path);
+	free(trace_path);
+	return exit_status();
+}
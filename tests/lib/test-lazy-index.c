@@ -0,0 +1,180 @@
+/*
+ * test-lazy-index.c
+ *
+ * BabelTrace - background packet index test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Writes a trace of several streams of many packets, opens it with
+ * bt_ctf_set_lazy_index(), and checks that opening the trace does not
+ * wait for the background index, which the end timestamp of the trace
+ * then completes.
+ */
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/trace-handle.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/writer.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf/packet-index.h>
+#include <babeltrace/compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "tap.h"
+
+#define NR_TESTS	5
+
+#define NR_STREAMS	3
+/* Events of each stream, in page sized packets */
+#define NR_EVENTS	20000
+
+static
+uint64_t event_timestamp(int stream, uint64_t seq)
+{
+	return 1000 + seq * NR_STREAMS + stream;
+}
+
+static
+int write_trace(const char *path)
+{
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_writer_stream_class *stream_class;
+	struct bt_ctf_writer_event_class *sample;
+	struct bt_ctf_writer_stream *streams[NR_STREAMS];
+	union bt_ctf_writer_value value;
+	int id, ret;
+
+	writer = bt_ctf_writer_create(path);
+	if (!writer)
+		return -1;
+	ret = bt_ctf_writer_set_packet_size(writer, getpagesize());
+	stream_class = bt_ctf_writer_add_stream_class(writer);
+	sample = bt_ctf_writer_add_event_class(stream_class, "sample");
+	ret |= bt_ctf_writer_event_class_add_field(sample, "seq", BT_CTF_WRITER_UINT64);
+	for (id = 0; id < NR_STREAMS; id++) {
+		streams[id] = bt_ctf_writer_create_stream(stream_class);
+		if (!streams[id])
+			ret = -1;
+	}
+	if (ret)
+		goto end;
+	for (id = 0; id < NR_STREAMS; id++) {
+		uint64_t seq, timestamp;
+
+		for (seq = 0; seq < NR_EVENTS; seq++) {
+			timestamp = event_timestamp(id, seq);
+			value.u = seq;
+			if (bt_ctf_writer_append_events(streams[id], sample,
+					&timestamp, &value, 1) != 1) {
+				ret = -1;
+				goto end;
+			}
+		}
+	}
+end:
+	if (bt_ctf_writer_close(writer))
+		ret = -1;
+	return ret;
+}
+
+/* Number of stream packet indexes still built in the background. */
+static
+int count_lazy_indexes(struct bt_context *ctx)
+{
+	struct trace_collection *tc = ctx->tc;
+	int i, j, k, nr_lazy = 0;
+
+	for (i = 0; i < tc->array->len; i++) {
+		struct ctf_trace *trace;
+
+		trace = container_of(g_ptr_array_index(tc->array, i),
+				struct ctf_trace, parent);
+		for (j = 0; j < trace->streams->len; j++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(trace->streams, j);
+			if (!stream_class)
+				continue;
+			for (k = 0; k < stream_class->streams->len; k++) {
+				struct ctf_file_stream *cfs;
+
+				cfs = container_of(g_ptr_array_index(
+						stream_class->streams, k),
+						struct ctf_file_stream, parent);
+				if (cfs->pos.packet_index->extend)
+					nr_lazy++;
+			}
+		}
+	}
+	return nr_lazy;
+}
+
+static
+void run_test(const char *path)
+{
+	struct bt_context *ctx;
+	int handle_id;
+
+	bt_ctf_set_lazy_index(1);
+	ctx = bt_context_create();
+	if (!ctx)
+		plan_skip_all("Cannot create valid context");
+	handle_id = bt_context_add_trace(ctx, path, "ctf", NULL, NULL, NULL);
+	ok(handle_id >= 0, "Trace opened with a background index");
+	if (handle_id < 0)
+		plan_skip_all("Cannot open trace");
+
+	ok(count_lazy_indexes(ctx) == NR_STREAMS,
+		"Opening the trace leaves the %d stream indexes to the "
+		"background thread", NR_STREAMS);
+	ok(bt_trace_handle_get_timestamp_begin(ctx, handle_id,
+			BT_CLOCK_CYCLES) == event_timestamp(0, 0),
+		"Begin timestamp from the first packets");
+	ok(bt_trace_handle_get_timestamp_end(ctx, handle_id,
+			BT_CLOCK_CYCLES)
+			== event_timestamp(NR_STREAMS - 1, NR_EVENTS - 1),
+		"End timestamp from the last packets");
+	ok(count_lazy_indexes(ctx) == 0,
+		"End timestamp completes the stream indexes");
+
+	bt_context_put(ctx);
+	bt_ctf_set_lazy_index(0);
+}
+
+int main(int argc, char **argv)
+{
+	char *trace_path;
+
+	plan_tests(NR_TESTS);
+
+	trace_path = create_temp_trace_path("test-lazy-index");
+	if (!trace_path)
+		plan_skip_all("Cannot create temporary directory");
+	if (write_trace(trace_path))
+		plan_skip_all("Cannot write trace");
+
+	run_test(trace_path);
+
+	if (remove_temp_trace(trace_path))
+		diag("Unable to remove %s", trace_path);
+	free(trace_path);
+	return exit_status();
+}
@@ -0,0 +1,129 @@
+/*
+ * test-metadata-cache.c
+ *
+ * BabelTrace - shared metadata AST test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/context.h>
+#include <babeltrace/context-internal.h>
+#include <babeltrace/trace-handle-internal.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/compiler.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "tap.h"
+
+#define NR_TESTS	10
+
+static
+struct ctf_trace *get_trace(struct bt_context *ctx, int handle_id)
+{
+	struct bt_trace_handle *handle;
+
+	handle = g_hash_table_lookup(ctx->trace_handles,
+			(gpointer) (unsigned long) handle_id);
+	if (!handle)
+		return NULL;
+	return container_of(handle->td, struct ctf_trace, parent);
+}
+
+static
+struct ctf_trace *add_trace(struct bt_context *ctx, const char *path,
+		int *handle_id)
+{
+	*handle_id = bt_context_add_trace(ctx, path, "ctf", NULL, NULL, NULL);
+	if (*handle_id < 0)
+		return NULL;
+	return get_trace(ctx, *handle_id);
+}
+
+static
+void run_test(const char *path, const char *other_path)
+{
+	struct bt_context *ctx, *ctx2;
+	struct ctf_trace *td1, *td2, *td3, *other;
+	struct ctf_metadata_ast *ast;
+	int id1, id2, id3, id_other;
+
+	ctx = bt_context_create();
+	ctx2 = bt_context_create();
+	if (!ctx || !ctx2)
+		plan_skip_all("Cannot create valid contexts");
+
+	/* The same metadata opened twice in a context is parsed once. */
+	td1 = add_trace(ctx, path, &id1);
+	td2 = add_trace(ctx, path, &id2);
+	if (!td1 || !td2)
+		plan_skip_all("Cannot open trace");
+	ast = td1->metadata_ast;
+	ok(ast && td2->metadata_ast == ast,
+		"Traces with identical metadata share their AST");
+	ok(ast->refcount == 2, "AST held by 2 traces (%u)", ast->refcount);
+
+	/* Traces with other metadata get their own AST. */
+	other = add_trace(ctx, other_path, &id_other);
+	if (!other)
+		plan_skip_all("Cannot open trace");
+	ok(other->metadata_ast && other->metadata_ast != ast,
+		"Traces with other metadata do not share the AST");
+	ok(ast->refcount == 2, "AST still held by 2 traces (%u)",
+		ast->refcount);
+
+	/* Traces are opened before being added to a context. */
+	td3 = add_trace(ctx2, path, &id3);
+	if (!td3)
+		plan_skip_all("Cannot open trace");
+	ok(td3->metadata_ast == ast, "AST shared with another context");
+	ok(ast->refcount == 3, "AST held by 3 traces (%u)", ast->refcount);
+
+	/* Closing traces releases their reference. */
+	ok1(!bt_context_remove_trace(ctx, id2));
+	ok(ast->refcount == 2, "AST held by 2 traces after close (%u)",
+		ast->refcount);
+	ok(!bt_context_remove_trace(ctx2, id3) && ast->refcount == 1,
+		"AST held by 1 trace after close in other context (%u)",
+		ast->refcount);
+	bt_context_remove_trace(ctx, id_other);
+	bt_context_remove_trace(ctx, id1);
+	bt_context_put(ctx2);
+	bt_context_put(ctx);
+
+	/* The last close freed the AST: opening again parses it anew. */
+	ctx = bt_context_create();
+	td1 = add_trace(ctx, path, &id1);
+	if (!td1)
+		plan_skip_all("Cannot open trace");
+	ok(td1->metadata_ast && td1->metadata_ast->refcount == 1,
+		"AST parsed again once released");
+	bt_context_put(ctx);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NR_TESTS);
+
+	if (argc < 3)
+		plan_skip_all("Invalid arguments: need two traces with "
+			"different metadata");
+
+	run_test(argv[1], argv[2]);
+
+	return exit_status();
+}
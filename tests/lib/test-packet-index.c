@@ -0,0 +1,125 @@
+/*
+ * test-packet-index.c
+ *
+ * BabelTrace - compact packet index test program
+ *
+ * Copyright 2013 EfficiOS Inc. and Linux Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include <babeltrace/ctf/packet-index.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tap.h"
+
+#define NR_PACKETS	1000
+#define NR_TESTS	5
+
+static
+void make_entry(struct packet_index *entry, size_t i, off_t offset)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->offset = offset;
+	/* Mostly constant packet size, with a few outliers. */
+	entry->packet_size = (i % 97) ? 4096 * CHAR_BIT : 65536 * CHAR_BIT;
+	entry->content_size = entry->packet_size - (i % 13) * CHAR_BIT;
+	entry->data_offset = (i % 211) ? 256 : 320;
+	entry->timestamp_begin = 1000000ULL * i;
+	entry->timestamp_end = 1000000ULL * i + 999999;
+	/* 32-bit counter wrapping around. */
+	entry->events_discarded = (uint32_t) (0xFFFFFF00U + 3 * i);
+	entry->events_discarded_len = 32;
+}
+
+static
+int entry_equal(const struct packet_index *a, const struct packet_index *b)
+{
+	return a->offset == b->offset
+		&& a->data_offset == b->data_offset
+		&& a->packet_size == b->packet_size
+		&& a->content_size == b->content_size
+		&& a->timestamp_begin == b->timestamp_begin
+		&& a->timestamp_end == b->timestamp_end
+		&& a->events_discarded == b->events_discarded
+		&& a->events_discarded_len == b->events_discarded_len;
+}
+
+static
+void run_test(void)
+{
+	struct ctf_packet_index *index;
+	struct packet_index entry, expect;
+	off_t offset = 0;
+	size_t i;
+	int seq_ok = 1, rand_ok = 1, ts_ok = 1;
+
+	index = ctf_packet_index_create();
+	for (i = 0; i < NR_PACKETS; i++) {
+		make_entry(&entry, i, offset);
+		ctf_packet_index_append(index, &entry);
+		offset += entry.packet_size / CHAR_BIT;
+	}
+	ok1(ctf_packet_index_len(index) == NR_PACKETS);
+
+	/* Sequential read-back, as done by packet_seek SEEK_CUR. */
+	offset = 0;
+	for (i = 0; i < NR_PACKETS; i++) {
+		make_entry(&expect, i, offset);
+		ctf_packet_index_get(index, i, &entry);
+		if (!entry_equal(&entry, &expect))
+			seq_ok = 0;
+		if (ctf_packet_index_timestamp_end(index, i)
+				!= expect.timestamp_end)
+			ts_ok = 0;
+		offset += expect.packet_size / CHAR_BIT;
+	}
+	ok(seq_ok, "Sequential decoding matches appended entries");
+	ok(ts_ok, "Timestamp column matches appended entries");
+
+	/* Backward read-back, which goes through the block checkpoints. */
+	for (i = NR_PACKETS; i-- > 0; ) {
+		size_t j;
+
+		offset = 0;
+		for (j = 0; j < i; j++) {
+			make_entry(&expect, j, offset);
+			offset += expect.packet_size / CHAR_BIT;
+		}
+		make_entry(&expect, i, offset);
+		ctf_packet_index_get(index, i, &entry);
+		if (!entry_equal(&entry, &expect))
+			rand_ok = 0;
+	}
+	ok(rand_ok, "Random access decoding matches appended entries");
+
+	ok(ctf_packet_index_mem_size(index)
+			< NR_PACKETS * sizeof(struct packet_index) / 2,
+		"Index is at least twice smaller than an array of entries "
+		"(%zu bytes)", ctf_packet_index_mem_size(index));
+
+	ctf_packet_index_destroy(index);
+}
+
+int main(int argc, char **argv)
+{
+	plan_tests(NR_TESTS);
+
+	run_test();
+	return exit_status();
+}
@@ -26,13 +26,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <limits.h>
 
 #include "common.h"
 #include "tap.h"
 
-#define NR_TESTS	29
+#define NR_TESTS	40
 
 void run_seek_begin(char *path, uint64_t expected_begin)
 {
@@ -186,6 +187,63 @@ void run_seek_time_at_last(char *path, uint64_t expected_last)
 	bt_context_put(ctx);
 }
 
+void run_seek_time_cached(char *path, uint64_t expected_begin,
+		uint64_t expected_last)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	struct bt_iter_pos newpos;
+	int ret, i;
+
+	/* Open the trace */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		plan_skip_all("Cannot create valid context");
+	}
+
+	/* Create iterator with null last and end */
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		plan_skip_all("Cannot create valid iterator");
+	}
+
+	ret = bt_iter_set_packet_cache_size(bt_ctf_get_iter(iter), 1 << 20);
+
+	ok(ret == 0, "Set packet cache size retval %d", ret);
+
+	/* The second seek to last is served by the packet cache */
+	newpos.type = BT_SEEK_TIME;
+	for (i = 0; i < 2; i++) {
+		newpos.u.seek_time = expected_last;
+		ret = bt_iter_set_pos(bt_ctf_get_iter(iter), &newpos);
+		event = bt_ctf_iter_read_event(iter);
+
+		ok(ret == 0 && event && bt_ctf_get_timestamp(event) == expected_last,
+			"Cached seek time at last, pass %d", i);
+	}
+
+	newpos.u.seek_time = expected_begin;
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), &newpos);
+	event = bt_ctf_iter_read_event(iter);
+
+	ok(ret == 0 && event && bt_ctf_get_timestamp(event) == expected_begin,
+		"Cached seek time at begin");
+
+	/* Try to read next event after last */
+	newpos.u.seek_time = expected_last;
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), &newpos);
+
+	ok(ret == 0, "Cached seek time at last again retval %d", ret);
+
+	ret = bt_iter_next(bt_ctf_get_iter(iter));
+	event = bt_ctf_iter_read_event(iter);
+
+	ok(ret == 0 && event == 0, "Event after last should be invalid");
+
+	bt_context_put(ctx);
+}
+
 void run_seek_cycles(char *path,
 		uint64_t expected_begin,
 		uint64_t expected_last)
@@ -267,6 +325,99 @@ void run_seek_cycles(char *path,
 	bt_context_put(ctx);
 }
 
+/*
+ * Offset of the event offset of the first stream in a serialized
+ * restore position: after the header, stream count, trace UUID, stream
+ * class id, file number, path and packet number. Integers are little
+ * endian and the UUID takes 16 bytes.
+ */
+static
+size_t first_event_offset(const unsigned char *data)
+{
+	size_t p = 4 * 4 + 16 + 8 + 4;
+	uint32_t path_len;
+
+	path_len = data[p] | data[p + 1] << 8 | data[p + 2] << 16
+		| (uint32_t) data[p + 3] << 24;
+	return p + 4 + path_len + 8;
+}
+
+void run_seek_restore_serialized(char *path)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter;
+	struct bt_ctf_event *event;
+	struct bt_iter_pos *pos;
+	void *data;
+	size_t len;
+	int ret;
+	uint64_t timestamp;
+
+	/* Save the position of the second event */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		plan_skip_all("Cannot create valid context");
+	}
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		plan_skip_all("Cannot create valid iterator");
+	}
+
+	ret = bt_iter_next(bt_ctf_get_iter(iter));
+	event = bt_ctf_iter_read_event(iter);
+
+	ok(ret == 0 && event, "Event valid after first");
+
+	timestamp = bt_ctf_get_timestamp(event);
+	pos = bt_iter_get_pos(bt_ctf_get_iter(iter));
+	data = bt_iter_serialize_pos(pos, &len);
+
+	ok(data, "Serialize position");
+
+	bt_iter_free_pos(pos);
+	bt_context_put(ctx);
+
+	/* Restore it in another context */
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		plan_skip_all("Cannot create valid context");
+	}
+
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		plan_skip_all("Cannot create valid iterator");
+	}
+
+	pos = bt_iter_deserialize_pos(bt_ctf_get_iter(iter), data, len);
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), pos);
+	event = bt_ctf_iter_read_event(iter);
+
+	ok(pos && ret == 0 && event && bt_ctf_get_timestamp(event) == timestamp,
+		"Restore deserialized position");
+
+	/* Streams already on their saved event are kept */
+	ret = bt_iter_set_pos(bt_ctf_get_iter(iter), pos);
+	event = bt_ctf_iter_read_event(iter);
+
+	ok(ret == 0 && event && bt_ctf_get_timestamp(event) == timestamp,
+		"Restore deserialized position again");
+	bt_iter_free_pos(pos);
+
+	/* Event offsets outside of their packet are refused */
+	memset((char *) data + first_event_offset(data), 0xFF, 8);
+	pos = bt_iter_deserialize_pos(bt_ctf_get_iter(iter), data, len);
+	ret = !pos;
+	bt_iter_free_pos(pos);
+	memset((char *) data + first_event_offset(data), 0, 8);
+	pos = bt_iter_deserialize_pos(bt_ctf_get_iter(iter), data, len);
+	ok(ret && !pos, "Deserialized position outside of its packet refused");
+
+	bt_iter_free_pos(pos);
+	free(data);
+	bt_context_put(ctx);
+}
+
 int main(int argc, char **argv)
 {
 	char *path;
@@ -297,6 +448,8 @@ int main(int argc, char **argv)
 	run_seek_time_at_last(path, expected_last);
 	run_seek_last(path, expected_last);
 	run_seek_cycles(path, expected_begin, expected_last);
+	run_seek_time_cached(path, expected_begin, expected_last);
+	run_seek_restore_serialized(path);
 
 	return exit_status();
 }
@@ -3,6 +3,8 @@
 TESTDIR=$(dirname $0)
 DIR=$(readlink -f ${TESTDIR})
 BABELTRACE_BIN=${DIR}/../converter/babeltrace
+BABELTRACE_COMPRESS_BIN=${DIR}/../converter/babeltrace-compress
+BABELTRACE_LOG_BIN=${DIR}/../converter/babeltrace-log
 CTF_TRACES=${DIR}/ctf-traces
 
 function test_check_success ()
@@ -44,9 +46,174 @@ function print_test_result ()
 	echo -e " "${1}" - "${3}
 }
 
+function test_ctf_same_output ()
+{
+	local tracePath=${1}
+
+	shift
+	diff -q <(${BABELTRACE_BIN} ${tracePath} 2>&1) \
+		<(${BABELTRACE_BIN} $* ${tracePath} 2>&1) > /dev/null
+}
+
+# With --lazy-index, reading trace ${1} and seeking to the ${2} to ${3}
+# range print the same events as with the index built upfront.
+function test_ctf_lazy_index ()
+{
+	test_ctf_same_output ${1} --lazy-index &&
+	diff -q <(${BABELTRACE_BIN} --begin ${2} --end ${3} ${1} 2>&1) \
+		<(${BABELTRACE_BIN} --lazy-index --begin ${2} --end ${3} ${1} 2>&1) \
+		> /dev/null
+}
+
+# Only the events of CPU 1, as printed from the packet context.
+function test_ctf_where ()
+{
+	diff -q <(${BABELTRACE_BIN} --where cpu_id=1 ${1} 2>/dev/null) \
+		<(${BABELTRACE_BIN} ${1} 2>/dev/null | grep -F '{ cpu_id = 1 }') \
+		> /dev/null
+}
+
+function test_ctf_roundtrip ()
+{
+	local outDir=$(mktemp -d)
+
+	${BABELTRACE_BIN} -o ctf -w ${outDir}/trace ${1} > /dev/null 2>&1 &&
+	diff -q <(${BABELTRACE_BIN} ${1} 2>&1) \
+		<(${BABELTRACE_BIN} ${outDir}/trace 2>&1) > /dev/null
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+# Trim a trace to the ${2} to ${3} range, which must be within the trace
+# so that the packets crossing the range bounds are re-encoded, and
+# compare with reading that range of the trace.
+function test_ctf_trim ()
+{
+	local outDir=$(mktemp -d)
+
+	${BABELTRACE_BIN} -o ctf -w ${outDir}/trace --begin ${2} --end ${3} ${1} > /dev/null 2>&1 &&
+	diff -q <(${BABELTRACE_BIN} --begin ${2} --end ${3} ${1} 2>&1) \
+		<(${BABELTRACE_BIN} ${outDir}/trace 2>&1) > /dev/null &&
+	# The range is not empty, nor the whole trace.
+	[ -n "$(${BABELTRACE_BIN} ${outDir}/trace 2>/dev/null | head -1)" ] &&
+	! diff -q <(${BABELTRACE_BIN} ${1} 2>&1) \
+		<(${BABELTRACE_BIN} ${outDir}/trace 2>&1) > /dev/null
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+function test_ctf_compress ()
+{
+	local outDir=$(mktemp -d)
+
+	cp -r ${1} ${outDir}/trace &&
+	${BABELTRACE_COMPRESS_BIN} ${outDir}/trace > /dev/null 2>&1 &&
+	diff -q <(${BABELTRACE_BIN} ${1} 2>&1) \
+		<(${BABELTRACE_BIN} ${outDir}/trace 2>&1) > /dev/null
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+function test_ctf_verify ()
+{
+	local outDir=$(mktemp -d)
+
+	seq 1 10000 | ${BABELTRACE_LOG_BIN} ${outDir}/trace > /dev/null 2>&1 &&
+	run_babeltrace --verify ${outDir}/trace &&
+	# Corrupt the first event of the packet, after its checksum.
+	printf '\377' | dd of=${outDir}/trace/datastream bs=1 seek=100 \
+		conv=notrunc > /dev/null 2>&1 &&
+	! run_babeltrace --verify ${outDir}/trace
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+# Lines 1 to 10000 are events of 48894 bytes: 38894 digits and the
+# null bytes ending the strings.
+function test_ctf_stats ()
+{
+	local outDir=$(mktemp -d)
+
+	seq 1 10000 | ${BABELTRACE_LOG_BIN} ${outDir}/trace > /dev/null 2>&1 &&
+	${BABELTRACE_BIN} -o stats ${outDir}/trace > ${outDir}/stats 2>&1 &&
+	grep -q '^string  *10000  *0  *48894 ' ${outDir}/stats &&
+	grep -q '^datastream (0)  *10000  *0  *48894 ' ${outDir}/stats &&
+	grep -q '^Total  *10000  *0  *48894 ' ${outDir}/stats &&
+	# No CPU section without cpu_id in the packet context.
+	! grep -q '^CPUs:' ${outDir}/stats
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+# Write log lines with timestamps in both formats, and check the event
+# timestamps. Dates are in UTC; the conversion of the date and minute
+# is kept for the next lines of the same minute.
+function test_log_timestamps ()
+{
+	local outDir=$(mktemp -d)
+
+	printf '%s\n' \
+		'[1351532897.000123] seconds' \
+		'[2012-10-29 17:48:17.250] date' \
+		'[2012-10-29 17:48:18.007] same minute' \
+		'[2012-10-29 17:49:00.000] next minute' |
+	${BABELTRACE_LOG_BIN} -t ${outDir}/trace > /dev/null 2>&1 &&
+	printf '%s\n' \
+		'1351532897.000123000 seconds' \
+		'1351532897.250000000 date' \
+		'1351532898.007000000 same minute' \
+		'1351532940.000000000 next minute' > ${outDir}/expected &&
+	${BABELTRACE_BIN} --clock-seconds ${outDir}/trace 2>&1 |
+		sed -n 's/^\[\([0-9.]*\)\].*str = "\(.*\)".*$/\1 \2/p' |
+		diff -q ${outDir}/expected - > /dev/null
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
+function test_ctf_follow ()
+{
+	local outDir=$(mktemp -d)
+	local size pid
+
+	seq 1 10000 | ${BABELTRACE_LOG_BIN} ${outDir}/trace > /dev/null 2>&1 &&
+	mkdir ${outDir}/follow &&
+	cp ${outDir}/trace/metadata ${outDir}/follow/ &&
+	touch ${outDir}/follow/datastream || { rm -rf ${outDir}; return 1; }
+	size=$(stat -c %s ${outDir}/trace/datastream)
+
+	# Start from an empty stream file, then append the packets in two
+	# steps, the first one ending within a packet.
+	${BABELTRACE_BIN} --follow ${outDir}/follow > ${outDir}/out 2>&1 &
+	pid=$!
+	sleep 1
+	head -c $((size / 2 + 100)) ${outDir}/trace/datastream \
+		>> ${outDir}/follow/datastream
+	sleep 1
+	tail -c +$((size / 2 + 101)) ${outDir}/trace/datastream \
+		>> ${outDir}/follow/datastream
+	sleep 1
+	kill ${pid}
+	wait ${pid}
+	diff -q <(${BABELTRACE_BIN} ${outDir}/trace 2>&1) ${outDir}/out \
+		> /dev/null
+	local ret=$?
+	rm -rf ${outDir}
+	return ${ret}
+}
+
 successTraces=(${CTF_TRACES}/succeed/*)
 failTraces=(${CTF_TRACES}/fail/*)
-testCount=$((2 + ${#successTraces[@]} + ${#failTraces[@]}))
+roundtripTraces=(${CTF_TRACES}/succeed/lttng-modules-2.0-pre5 ${CTF_TRACES}/succeed/wk-heartbeat-u)
+# Trim range within each roundtrip trace, in seconds since the epoch.
+trimBegin=(61334.5 1351532897.588)
+trimEnd=(61335.5 1351532897.590)
+testCount=$((7 + ${#successTraces[@]} + ${#failTraces[@]} + 6 * ${#roundtripTraces[@]}))
 
 currentTestIndex=1
 echo -e 1..${testCount}
@@ -61,6 +228,21 @@ run_babeltrace --bogusarg
 test_check_fail
 print_test_result $((currentTestIndex++)) $? "Running babeltrace with a bogus argument"
 
+test_ctf_verify
+print_test_result $((currentTestIndex++)) $? "Verifying packet checksums of a babeltrace-log trace"
+
+test_ctf_stats
+print_test_result $((currentTestIndex++)) $? "Printing statistics of a babeltrace-log trace"
+
+test_log_timestamps
+print_test_result $((currentTestIndex++)) $? "Reading babeltrace-log timestamps in both formats"
+
+test_ctf_follow
+print_test_result $((currentTestIndex++)) $? "Following packets appended to a babeltrace-log trace"
+
+test_ctf_where ${CTF_TRACES}/succeed/lttng-modules-2.0-pre5
+print_test_result $((currentTestIndex++)) $? "Reading the events of one CPU with --where"
+
 for tracePath in ${successTraces[@]}; do
 	run_babeltrace ${tracePath}
 	test_check_success
@@ -73,4 +255,20 @@ for tracePath in ${failTraces[@]}; do
 	print_test_result $((currentTestIndex++)) $? "Running babeltrace with trace ${tracePath}"
 done
 
+for i in ${!roundtripTraces[@]}; do
+	tracePath=${roundtripTraces[$i]}
+	test_ctf_roundtrip ${tracePath}
+	print_test_result $((currentTestIndex++)) $? "Writing trace ${tracePath} to CTF and reading it back"
+	test_ctf_trim ${tracePath} ${trimBegin[$i]} ${trimEnd[$i]}
+	print_test_result $((currentTestIndex++)) $? "Trimming trace ${tracePath} to CTF and reading it back"
+	test_ctf_compress ${tracePath}
+	print_test_result $((currentTestIndex++)) $? "Compressing trace ${tracePath} and reading it back"
+	test_ctf_same_output ${tracePath} --max-mappings 2 --max-open-files 2
+	print_test_result $((currentTestIndex++)) $? "Reading trace ${tracePath} with 2 packet mappings and open files"
+	test_ctf_same_output ${tracePath} --io-uring 8
+	print_test_result $((currentTestIndex++)) $? "Reading trace ${tracePath} through io_uring"
+	test_ctf_lazy_index ${tracePath} ${trimBegin[$i]} ${trimEnd[$i]}
+	print_test_result $((currentTestIndex++)) $? "Reading and seeking trace ${tracePath} with --lazy-index"
+done
+
 exit 0